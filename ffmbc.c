@@ -81,6 +81,10 @@
 #endif
 #include <time.h>
 
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #include "cmdutils.h"
 
 #include "libavutil/avassert.h"
@@ -181,6 +185,7 @@ static int loop_output = AVFMT_NOOUTPUTLOOP;
 static int qp_hist = 0;
 #if CONFIG_AVFILTER
 static char *vfilters = NULL;
+static int filter_threads = 1;
 #endif
 
 static int intra_only = 0;
@@ -228,6 +233,7 @@ static char *vstats_filename;
 static FILE *vstats_file;
 static int opt_programid = 0;
 static int copy_initial_nonkeyframes = 0;
+static int use_pipeline = 0;
 
 static int rate_emu = 0;
 
@@ -267,6 +273,9 @@ static unsigned int allocated_audio_out_size, allocated_audio_buf_size, input_tm
 
 static short *samples;
 
+static int bit_buffer_size= 1024*256;
+static uint8_t *bit_buffer= NULL;
+
 static AVBitStreamFilterContext *video_bitstream_filters=NULL;
 static AVBitStreamFilterContext *audio_bitstream_filters=NULL;
 static AVBitStreamFilterContext *subtitle_bitstream_filters=NULL;
@@ -276,12 +285,14 @@ static AVBitStreamFilterContext *subtitle_bitstream_filters=NULL;
 struct AVInputStream;
 
 typedef struct {
-    uint8_t *buf;
-    unsigned buf_size;
-    unsigned last_sample_pos; /* last valid sample pos in buf */
-    unsigned buf_index[MAX_AUDIO_CHANNEL_MAPS];
+    uint8_t *buf; /* one ring of ring_size samples per output channel */
+    uint8_t *out; /* interleaved samples being output */
+    unsigned ring_size; /* power of 2 */
+    unsigned read; /* samples output so far */
+    unsigned write[MAX_AUDIO_CHANNEL_MAPS]; /* samples added so far, per channel */
     uint8_t sample_size; /* size of one sample */
     uint8_t out_channels;
+    AVAudioInterleave *interleave;
 } AudioMergeContext;
 
 typedef struct AVOutputStream {
@@ -308,6 +319,7 @@ typedef struct AVOutputStream {
     int resample_width;
     int resample_pix_fmt;
     int sws_flags;
+    int sws_threads;
 
     const char *target;
 
@@ -345,6 +357,20 @@ typedef struct AVOutputStream {
     AVFilterBufferRef *prev_picref;
     char *avfilter;
     AVFilterGraph *graph;
+    int filter_shared;       /* graph and input filter owned by another stream */
+#endif
+
+    /* pipelined transcoding, see init_pipeline() */
+    struct EncodeJob *jobs;  /* encoder input queue, NULL when encoding in the main thread */
+    int job_in;              /* next job to be queued by the main thread */
+    int job_out;             /* next job to be encoded by the encoder thread */
+    uint8_t *enc_buffer;     /* output buffer of the encoder thread */
+    AVFrame coded_frame;     /* last coded_frame of the encoder thread, for print_report() */
+    int64_t mux_pts;         /* st->pts.val as of the last packet written by the muxing thread */
+#if HAVE_PTHREADS
+    pthread_t encode_thread;
+    pthread_mutex_t codec_mutex; /* guards st->codec against the muxing thread */
+    int has_codec_mutex;
 #endif
 } AVOutputStream;
 
@@ -391,19 +417,18 @@ static struct termios oldtty;
 
 #if CONFIG_AVFILTER
 
-static int configure_filters(AVInputStream *ist, AVOutputStream *ost)
+/**
+ * Create the buffer source fed with the decoded pictures of ist, followed
+ * by the auto-inserted rotate filter when the stream asks for one.
+ */
+static int configure_input_filters(AVInputStream *ist, AVFilterGraph *graph,
+                                   AVFilterContext **src, AVFilterContext **last)
 {
-    AVFilterContext *last_filter;
-    /** filter graph containing all filters including input & output */
-    AVCodecContext *codec = ost->st->codec;
-    FFSinkContext ffsink_ctx = { .pix_fmt = codec->pix_fmt };
     AVRational sample_aspect_ratio;
     AVMetadataTag *t;
     char args[255];
     int ret;
 
-    ost->graph = avfilter_graph_alloc();
-
     if (ist->st->sample_aspect_ratio.num)
         sample_aspect_ratio = ist->st->sample_aspect_ratio;
     else if (ist->st->codec->sample_aspect_ratio.num)
@@ -415,15 +440,11 @@ static int configure_filters(AVInputStream *ist, AVOutputStream *ost)
              ist->st->codec->height, ist->st->codec->pix_fmt, 1, AV_TIME_BASE,
              sample_aspect_ratio.num, sample_aspect_ratio.den);
 
-    ret = avfilter_graph_create_filter(&ost->input_video_filter, avfilter_get_by_name("buffer"),
-                                       "src", args, NULL, ost->graph);
-    if (ret < 0)
-        return ret;
-    ret = avfilter_graph_create_filter(&ost->output_video_filter, &ffsink,
-                                       "out", NULL, &ffsink_ctx, ost->graph);
+    ret = avfilter_graph_create_filter(src, avfilter_get_by_name("buffer"),
+                                       "src", args, NULL, graph);
     if (ret < 0)
         return ret;
-    last_filter = ost->input_video_filter;
+    *last = *src;
 
     if (t = av_metadata_get(ist->st->metadata, "rotate", NULL, 0)) {
         AVFilterContext *filter;
@@ -434,39 +455,64 @@ static int configure_filters(AVInputStream *ist, AVOutputStream *ost)
             return ret;
         if ((ret = avfilter_init_filter(filter, args, NULL)) < 0)
             return ret;
-        if ((ret = avfilter_link(last_filter, 0, filter, 0)) < 0)
+        if ((ret = avfilter_link(*last, 0, filter, 0)) < 0)
             return ret;
-        last_filter = filter;
-        avfilter_graph_add_filter(ost->graph, last_filter);
+        *last = filter;
+        avfilter_graph_add_filter(graph, *last);
     }
+    return 0;
+}
 
-    snprintf(args, sizeof(args), "flags=0x%X", ost->sws_flags);
-    ost->graph->scale_sws_opts = av_strdup(args);
+/**
+ * Connect pad src_pad of src to the input of dst through the filters
+ * described by chain, or directly if chain is empty.
+ */
+static int insert_filter_chain(AVFilterGraph *graph, const char *chain,
+                               AVFilterContext *src, int src_pad,
+                               AVFilterContext *dst)
+{
+    AVFilterInOut *outputs, *inputs;
 
-    if (ost->avfilter) {
-        AVFilterInOut *outputs = av_malloc(sizeof(AVFilterInOut));
-        AVFilterInOut *inputs  = av_malloc(sizeof(AVFilterInOut));
+    if (!chain || !*chain)
+        return avfilter_link(src, src_pad, dst, 0);
 
-        outputs->name    = av_strdup("in");
-        outputs->filter_ctx = last_filter;
-        outputs->pad_idx = 0;
-        outputs->next    = NULL;
+    outputs = av_mallocz(sizeof(AVFilterInOut));
+    inputs  = av_mallocz(sizeof(AVFilterInOut));
+    if (!outputs || !inputs) {
+        av_free(outputs);
+        av_free(inputs);
+        return AVERROR(ENOMEM);
+    }
 
-        inputs->name    = av_strdup("out");
-        inputs->filter_ctx = ost->output_video_filter;
-        inputs->pad_idx = 0;
-        inputs->next    = NULL;
+    outputs->name    = av_strdup("in");
+    outputs->filter_ctx = src;
+    outputs->pad_idx = src_pad;
+    outputs->next    = NULL;
 
-        if ((ret = avfilter_graph_parse(ost->graph, ost->avfilter, inputs, outputs, NULL)) < 0)
-            return ret;
-        av_freep(&ost->avfilter);
-    } else {
-        if ((ret = avfilter_link(last_filter, 0, ost->output_video_filter, 0)) < 0)
-            return ret;
-    }
+    inputs->name    = av_strdup("out");
+    inputs->filter_ctx = dst;
+    inputs->pad_idx = 0;
+    inputs->next    = NULL;
 
-    if ((ret = avfilter_graph_config(ost->graph)) < 0)
-        return ret;
+    return avfilter_graph_parse(graph, chain, inputs, outputs, NULL);
+}
+
+static int create_output_filter(AVOutputStream *ost, AVFilterGraph *graph, int index)
+{
+    FFSinkContext ffsink_ctx = { .pix_fmt = ost->st->codec->pix_fmt };
+    char name[16];
+
+    if (index < 0)
+        snprintf(name, sizeof(name), "out");
+    else
+        snprintf(name, sizeof(name), "out%d", index);
+    return avfilter_graph_create_filter(&ost->output_video_filter, &ffsink,
+                                        name, NULL, &ffsink_ctx, graph);
+}
+
+static void set_filtered_frame_size(AVOutputStream *ost)
+{
+    AVCodecContext *codec = ost->st->codec;
 
     codec->width  = ost->output_video_filter->inputs[0]->w;
     codec->height = ost->output_video_filter->inputs[0]->h;
@@ -474,7 +520,176 @@ static int configure_filters(AVInputStream *ist, AVOutputStream *ost)
         frame_aspect_ratio.num ? // overriden by the -aspect cli option
         av_mul_q(frame_aspect_ratio, (AVRational){codec->height, codec->width}) :
         ost->output_video_filter->inputs[0]->sample_aspect_ratio;
+}
 
+static int configure_filters(AVInputStream *ist, AVOutputStream *ost)
+{
+    AVFilterContext *last_filter;
+    char args[255];
+    int ret;
+
+    /* filter graph containing all filters including input & output */
+    ost->graph = avfilter_graph_alloc();
+    ost->graph->thread_count = filter_threads;
+
+    if ((ret = configure_input_filters(ist, ost->graph, &ost->input_video_filter,
+                                       &last_filter)) < 0)
+        return ret;
+    if ((ret = create_output_filter(ost, ost->graph, -1)) < 0)
+        return ret;
+
+    snprintf(args, sizeof(args), "flags=0x%X:threads=%d", ost->sws_flags, ost->sws_threads);
+    ost->graph->scale_sws_opts = av_strdup(args);
+
+    if ((ret = insert_filter_chain(ost->graph, ost->avfilter, last_filter, 0,
+                                   ost->output_video_filter)) < 0)
+        return ret;
+    av_freep(&ost->avfilter);
+
+    if ((ret = avfilter_graph_config(ost->graph)) < 0)
+        return ret;
+
+    set_filtered_frame_size(ost);
+    return 0;
+}
+
+/**
+ * Return the number of filters in the first len bytes of chain, or -1 if
+ * chain is not a plain comma separated list of filters.
+ */
+static int filter_chain_length(const char *chain, int len)
+{
+    int i, n = len > 0;
+
+    for (i = 0; i < len; i++) {
+        if (strchr("[];'\\", chain[i]))
+            return -1;
+        n += chain[i] == ',';
+    }
+    return n;
+}
+
+static int can_share_filters(AVOutputStream *ost, AVOutputStream *first)
+{
+    const char *chain = ost->avfilter ? ost->avfilter : "";
+
+    return ost->st->codec->codec_type == AVMEDIA_TYPE_VIDEO &&
+        !ost->st->stream_copy && ost->nb_source_indexes == 1 &&
+        ost->source_index[0] == first->source_index[0] &&
+        ost->sws_flags == first->sws_flags &&
+        ost->sws_threads == first->sws_threads &&
+        !(ost->target && !strncmp(ost->target, "imx", 3)) &&
+        filter_chain_length(chain, strlen(chain)) >= 0;
+}
+
+/**
+ * Return the length of the longest run of filters all the chains of
+ * group start with.
+ */
+static int common_filter_prefix(AVOutputStream **group, int nb_group)
+{
+    const char *a = group[0]->avfilter ? group[0]->avfilter : "";
+    int i, len = strlen(a);
+
+    for (i = 1; i < nb_group; i++) {
+        const char *b = group[i]->avfilter ? group[i]->avfilter : "";
+        int n = 0;
+
+        while (n < len && a[n] == b[n])
+            n++;
+        /* only cut between two filters */
+        while (n > 0 && (a[n] && a[n] != ',' || b[n] && b[n] != ','))
+            n--;
+        len = n;
+    }
+    return len;
+}
+
+/**
+ * Decode once, filter for several outputs: when more video outputs are
+ * encoded from the same input stream, build a single graph for all of
+ * them. The filters their -vf chains start with are run only once, and
+ * a split filter hands out references to the pictures they output to
+ * the remaining filters of each output.
+ *
+ * The graph is owned by the first output, the other ones only pull
+ * pictures from their own sink.
+ */
+static int configure_shared_filters(AVInputStream *ist, AVOutputStream **ost_table,
+                                    int nb_ostreams, int first)
+{
+    AVOutputStream *ost = ost_table[first], *group[MAX_STREAMS];
+    AVFilterContext *last_filter, *split;
+    AVFilterGraph *graph;
+    int i, prefix, nb_group = 1, ret;
+    char args[255];
+
+    if (!can_share_filters(ost, ost))
+        return configure_filters(ist, ost);
+
+    group[0] = ost;
+    for (i = first + 1; i < nb_ostreams && nb_group < MAX_STREAMS; i++)
+        if (!ost_table[i]->input_video_filter && can_share_filters(ost_table[i], ost))
+            group[nb_group++] = ost_table[i];
+
+    if (nb_group < 2)
+        return configure_filters(ist, ost);
+
+    prefix = common_filter_prefix(group, nb_group);
+    if (verbose > 1)
+        fprintf(stderr, "Sharing %d filter(s) of input stream #%d.%d between %d outputs\n",
+                filter_chain_length(ost->avfilter, prefix),
+                ist->file_index, ist->index, nb_group);
+
+    graph = ost->graph = avfilter_graph_alloc();
+    if (!graph)
+        return AVERROR(ENOMEM);
+    graph->thread_count = filter_threads;
+
+    if ((ret = configure_input_filters(ist, graph, &ost->input_video_filter,
+                                       &last_filter)) < 0)
+        return ret;
+
+    snprintf(args, sizeof(args), "flags=0x%X:threads=%d", ost->sws_flags, ost->sws_threads);
+    graph->scale_sws_opts = av_strdup(args);
+
+    snprintf(args, sizeof(args), "%d", nb_group);
+    if ((ret = avfilter_graph_create_filter(&split, avfilter_get_by_name("split"),
+                                            "split", args, NULL, graph)) < 0)
+        return ret;
+    if (prefix) {
+        char *chain = av_malloc(prefix + 1);
+        if (!chain)
+            return AVERROR(ENOMEM);
+        av_strlcpy(chain, ost->avfilter, prefix + 1);
+        ret = insert_filter_chain(graph, chain, last_filter, 0, split);
+        av_free(chain);
+    } else
+        ret = avfilter_link(last_filter, 0, split, 0);
+    if (ret < 0)
+        return ret;
+
+    for (i = 0; i < nb_group; i++) {
+        const char *chain = group[i]->avfilter ? group[i]->avfilter + prefix : NULL;
+
+        if (chain && *chain == ',')
+            chain++;
+        if ((ret = create_output_filter(group[i], graph, i)) < 0)
+            return ret;
+        if ((ret = insert_filter_chain(graph, chain, split, i,
+                                       group[i]->output_video_filter)) < 0)
+            return ret;
+        group[i]->input_video_filter = ost->input_video_filter;
+        group[i]->filter_shared      = i > 0;
+    }
+    for (i = 0; i < nb_group; i++)
+        av_freep(&group[i]->avfilter);
+
+    if ((ret = avfilter_graph_config(graph)) < 0)
+        return ret;
+
+    for (i = 0; i < nb_group; i++)
+        set_filtered_frame_size(group[i]);
     return 0;
 }
 #endif /* CONFIG_AVFILTER */
@@ -558,15 +773,24 @@ static int decode_interrupt_cb(void)
     return q_pressed || (q_pressed = read_key() == 'q');
 }
 
+static void stop_pipeline(int flush);
+
 static int ffmpeg_exit(int ret)
 {
     int i;
 
+    stop_pipeline(0);
+
     /* close files */
     for(i=0;i<nb_output_files;i++) {
         AVFormatContext *s = output_files[i];
-        if (!(s->oformat->flags & AVFMT_NOFILE) && s->pb)
-            url_fclose(s->pb);
+        /* pending writes of a write-behind output fail here at the latest */
+        if (!(s->oformat->flags & AVFMT_NOFILE) && s->pb &&
+            url_fclose(s->pb) < 0) {
+            fprintf(stderr, "Error while closing output file '%s'\n", s->filename);
+            if (!ret)
+                ret = 1;
+        }
         avformat_free_context(s);
         av_free(output_streams_for_file[i]);
     }
@@ -715,7 +939,8 @@ get_sync_ipts(const AVOutputStream *ost)
     return (double)(ist->pts - start_time)/AV_TIME_BASE;
 }
 
-static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx, AVBitStreamFilterContext *bsfc){
+/* bitstream filter and mux one packet, return a negative value on error */
+static int mux_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx, AVBitStreamFilterContext *bsfc){
     int ret;
 
     while(bsfc){
@@ -733,7 +958,7 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx
                     avctx->codec ? avctx->codec->name : "copy");
             print_error("", a);
             if (exit_on_error)
-                ffmpeg_exit(1);
+                return a;
         }
         *pkt= new_pkt;
 
@@ -741,27 +966,524 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx
     }
 
     ret= av_interleaved_write_frame(s, pkt);
-    if(ret < 0){
+    if(ret < 0)
         print_error("av_interleaved_write_frame()", ret);
+    return ret;
+}
+
+/* Pipelined transcoding (-pipeline): the video streams are encoded by one
+   thread per output stream and each output file is written by its own
+   thread. Demuxing, decoding, filtering and audio encoding stay in the main
+   thread: the demuxer and its parsers update the codec context the decoder
+   uses, so they cannot run apart. Decoders parallelize themselves with
+   -threads. The muxing threads write packets in the order the main thread
+   produced them, pending encoder output included, so the output files do
+   not depend on thread scheduling. A muxer reads the codec context of the
+   stream it writes, so the encoder of a stream and the muxing of its
+   packets are serialized by the codec_mutex of the stream. */
+
+#define ENCODE_QUEUE_SIZE 8   /* pictures queued per encoder thread */
+#define MUX_QUEUE_SIZE    256 /* packets and encoder jobs queued per output file */
+
+enum { JOB_FREE, JOB_QUEUED, JOB_DONE };
+
+typedef struct EncodeJob {
+    int state;
+    int flush;               /* drain the encoder instead of encoding frame */
+    AVFrame frame;
+    AVPicture picture;       /* copy of the picture data */
+    int picture_allocated;
+    AVPacketList *pkts;      /* packets output by the encoder for this job */
+} EncodeJob;
+
+typedef struct MuxEntry {
+    AVOutputStream *ost;
+    AVPacket pkt;
+    EncodeJob *job;          /* if set, write the packets of job instead of pkt */
+} MuxEntry;
+
+typedef struct OutputThread {
+#if HAVE_PTHREADS
+    pthread_t thread;
+#endif
+    int running;
+    MuxEntry queue[MUX_QUEUE_SIZE];
+    int head, count;
+    int64_t size;            /* output position after the last packet written */
+} OutputThread;
+
+static OutputThread output_threads[MAX_FILES];
+static int pipeline_running;
+
+#if HAVE_PTHREADS
+static pthread_mutex_t pipeline_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  pipeline_cond  = PTHREAD_COND_INITIALIZER;
+static int pipeline_abort;
+static int pipeline_error;
+
+/* encode the frame of job, or drain the encoder, into job->pkts */
+static int encode_job(AVOutputStream *ost, EncodeJob *job, int *size)
+{
+    AVCodecContext *enc = ost->st->codec;
+    AVPacketList **next = &job->pkts;
+    int ret;
+
+    pthread_mutex_lock(&ost->codec_mutex);
+    do {
+        AVPacketList *pktl;
+
+        ret = avcodec_encode_video(enc, ost->enc_buffer, bit_buffer_size,
+                                   job->flush ? NULL : &job->frame);
+        if (ret < 0) {
+            fprintf(stderr, "Video encoding failed\n");
+            break;
+        }
+        if (!ret)
+            break;
+
+        pktl = av_mallocz(sizeof(*pktl));
+        if (!pktl || av_new_packet(&pktl->pkt, ret) < 0) {
+            av_free(pktl);
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        memcpy(pktl->pkt.data, ost->enc_buffer, ret);
+        pktl->pkt.stream_index = ost->index;
+        if (enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
+            pktl->pkt.pts = av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
+        if (enc->coded_frame && enc->coded_frame->key_frame)
+            pktl->pkt.flags |= AV_PKT_FLAG_KEY;
+        *next = pktl;
+        next = &pktl->next;
+        *size += ret;
+
+        if (ost->logfile && enc->stats_out) {
+            fprintf(ost->logfile, "%s", enc->stats_out);
+        }
+    } while (job->flush);
+    pthread_mutex_unlock(&ost->codec_mutex);
+
+    return FFMIN(ret, 0);
+}
+
+static void *encode_thread(void *arg)
+{
+    AVOutputStream *ost = arg;
+    AVCodecContext *enc = ost->st->codec;
+
+    pthread_mutex_lock(&pipeline_mutex);
+    for (;;) {
+        EncodeJob *job = &ost->jobs[ost->job_out];
+        int ret, size = 0;
+
+        while (!pipeline_abort && job->state != JOB_QUEUED)
+            pthread_cond_wait(&pipeline_cond, &pipeline_mutex);
+        if (pipeline_abort)
+            break;
+        pthread_mutex_unlock(&pipeline_mutex);
+
+        ret = encode_job(ost, job, &size);
+
+        pthread_mutex_lock(&pipeline_mutex);
+        if (ret < 0)
+            pipeline_error = ret;
+        if (enc->coded_frame)
+            ost->coded_frame = *enc->coded_frame;
+        video_size += size;
+        job->state = JOB_DONE;
+        ost->job_out = (ost->job_out + 1) % ENCODE_QUEUE_SIZE;
+        pthread_cond_broadcast(&pipeline_cond);
+    }
+    pthread_mutex_unlock(&pipeline_mutex);
+
+    return NULL;
+}
+
+static void *mux_thread(void *arg)
+{
+    OutputThread *ot = arg;
+    AVFormatContext *s = output_files[ot - output_threads];
+
+    pthread_mutex_lock(&pipeline_mutex);
+    for (;;) {
+        MuxEntry *e = &ot->queue[ot->head];
+        AVCodecContext *avctx;
+        int ret = 0;
+
+        while (!pipeline_abort &&
+               (!ot->count || (e->job && e->job->state != JOB_DONE)))
+            pthread_cond_wait(&pipeline_cond, &pipeline_mutex);
+        if (pipeline_abort)
+            break;
+        pthread_mutex_unlock(&pipeline_mutex);
+
+        avctx = e->ost->st->codec;
+        pthread_mutex_lock(&e->ost->codec_mutex);
+        if (e->job) {
+            AVPacketList *pktl, *next;
+            for (pktl = e->job->pkts; pktl; pktl = next) {
+                next = pktl->next;
+                if (ret >= 0)
+                    ret = mux_frame(s, &pktl->pkt, avctx, e->ost->bitstream_filters);
+                else
+                    av_free_packet(&pktl->pkt);
+                av_free(pktl);
+            }
+            e->job->pkts = NULL;
+        } else
+            ret = mux_frame(s, &e->pkt, avctx, e->ost->bitstream_filters);
+        pthread_mutex_unlock(&e->ost->codec_mutex);
+
+        pthread_mutex_lock(&pipeline_mutex);
+        if (ret < 0)
+            pipeline_error = ret;
+        if (e->job)
+            e->job->state = JOB_FREE;
+        e->ost->mux_pts = e->ost->st->pts.val;
+        if (s->pb)
+            ot->size = url_ftell(s->pb);
+        ot->head = (ot->head + 1) % MUX_QUEUE_SIZE;
+        ot->count--;
+        pthread_cond_broadcast(&pipeline_cond);
+    }
+    pthread_mutex_unlock(&pipeline_mutex);
+
+    return NULL;
+}
+
+static void queue_mux_entry(AVOutputStream *ost, AVPacket *pkt, EncodeJob *job)
+{
+    OutputThread *ot = &output_threads[ost->file_index];
+    MuxEntry *e;
+    int error;
+
+    pthread_mutex_lock(&pipeline_mutex);
+    while (!pipeline_error && ot->count == MUX_QUEUE_SIZE)
+        pthread_cond_wait(&pipeline_cond, &pipeline_mutex);
+    if (!(error = pipeline_error)) {
+        e = &ot->queue[(ot->head + ot->count) % MUX_QUEUE_SIZE];
+        e->ost = ost;
+        e->job = job;
+        if (pkt) {
+            e->pkt = *pkt;
+            pkt->destruct = NULL; /* the queue owns the data now */
+        }
+        ot->count++;
+        pthread_cond_broadcast(&pipeline_cond);
+    }
+    pthread_mutex_unlock(&pipeline_mutex);
+
+    if (error)
         ffmpeg_exit(1);
+}
+
+/* hand frame to the encoder thread of ost, frame = NULL flushes the encoder */
+static void queue_encode_job(AVOutputStream *ost, const AVFrame *frame)
+{
+    AVCodecContext *enc = ost->st->codec;
+    EncodeJob *job = &ost->jobs[ost->job_in];
+    int error;
+
+    pthread_mutex_lock(&pipeline_mutex);
+    while (!pipeline_error && job->state != JOB_FREE)
+        pthread_cond_wait(&pipeline_cond, &pipeline_mutex);
+    error = pipeline_error;
+    pthread_mutex_unlock(&pipeline_mutex);
+    if (error)
+        ffmpeg_exit(1);
+
+    job->flush = !frame;
+    if (frame) {
+        if (!job->picture_allocated) {
+            if (avpicture_alloc(&job->picture, enc->pix_fmt, enc->width, enc->height) < 0) {
+                fprintf(stderr, "Could not allocate encoder picture\n");
+                ffmpeg_exit(1);
+            }
+            job->picture_allocated = 1;
+        }
+        av_picture_copy(&job->picture, (const AVPicture *)frame,
+                        enc->pix_fmt, enc->width, enc->height);
+
+        /* only pass what the encoder uses, the other fields may point to
+           decoder buffers that do not outlive this call */
+        avcodec_get_frame_defaults(&job->frame);
+        memcpy(job->frame.data,     job->picture.data,     sizeof(job->frame.data));
+        memcpy(job->frame.linesize, job->picture.linesize, sizeof(job->frame.linesize));
+        job->frame.key_frame        = frame->key_frame;
+        job->frame.pict_type        = frame->pict_type;
+        job->frame.pts              = frame->pts;
+        job->frame.quality          = frame->quality;
+        job->frame.repeat_pict      = frame->repeat_pict;
+        job->frame.interlaced_frame = frame->interlaced_frame;
+        job->frame.top_field_first  = frame->top_field_first;
+        job->frame.reordered_opaque = frame->reordered_opaque;
+    }
+
+    pthread_mutex_lock(&pipeline_mutex);
+    job->state = JOB_QUEUED;
+    pthread_cond_broadcast(&pipeline_cond);
+    pthread_mutex_unlock(&pipeline_mutex);
+    ost->job_in = (ost->job_in + 1) % ENCODE_QUEUE_SIZE;
+
+    queue_mux_entry(ost, NULL, job);
+}
+
+/**
+ * Stop all pipeline threads.
+ * @param flush write out everything queued before stopping
+ */
+static void stop_pipeline(int flush)
+{
+    int i, j;
+
+    if (!pipeline_running)
+        return;
+
+    pthread_mutex_lock(&pipeline_mutex);
+    for (i = 0; flush && i < nb_output_files; i++)
+        while (!pipeline_error && output_threads[i].count)
+            pthread_cond_wait(&pipeline_cond, &pipeline_mutex);
+    pipeline_abort = 1;
+    pthread_cond_broadcast(&pipeline_cond);
+    pthread_mutex_unlock(&pipeline_mutex);
+
+    for (i = 0; i < nb_output_files; i++) {
+        OutputThread *ot = &output_threads[i];
+        if (ot->running)
+            pthread_join(ot->thread, NULL);
+        for (; ot->count; ot->count--) {
+            MuxEntry *e = &ot->queue[ot->head];
+            if (!e->job)
+                av_free_packet(&e->pkt);
+            ot->head = (ot->head + 1) % MUX_QUEUE_SIZE;
+        }
+        ot->running = 0;
+    }
+
+    for (i = 0; i < nb_output_files; i++) {
+        for (j = 0; j < nb_output_streams_for_file[i]; j++) {
+            AVOutputStream *ost = output_streams_for_file[i][j];
+            int k;
+            if (!ost)
+                continue;
+            if (ost->jobs) {
+                pthread_join(ost->encode_thread, NULL);
+                for (k = 0; k < ENCODE_QUEUE_SIZE; k++) {
+                    EncodeJob *job = &ost->jobs[k];
+                    while (job->pkts) {
+                        AVPacketList *pktl = job->pkts;
+                        job->pkts = pktl->next;
+                        av_free_packet(&pktl->pkt);
+                        av_free(pktl);
+                    }
+                    if (job->picture_allocated)
+                        avpicture_free(&job->picture);
+                }
+                av_freep(&ost->jobs);
+                av_freep(&ost->enc_buffer);
+            }
+            if (ost->has_codec_mutex) {
+                pthread_mutex_destroy(&ost->codec_mutex);
+                ost->has_codec_mutex = 0;
+            }
+        }
     }
+
+    pipeline_running = 0;
+    pipeline_abort = 0;
 }
 
-static int audiomerge_init(AudioMergeContext *a, uint8_t out_channels, uint8_t sample_size)
+static int init_pipeline(void)
+{
+    int i, j;
+
+    pipeline_running = 1;
+
+    for (i = 0; i < nb_output_files; i++) {
+        AVFormatContext *os = output_files[i];
+        OutputThread *ot = &output_threads[i];
+
+        /* raw pictures are muxed by reference, they must be written
+           before the frame is reused */
+        if (os->oformat->flags & AVFMT_RAWPICTURE)
+            continue;
+        ot->size = os->pb ? url_ftell(os->pb) : 0;
+        if (pthread_create(&ot->thread, NULL, mux_thread, ot))
+            goto fail;
+        ot->running = 1;
+
+        for (j = 0; j < nb_output_streams_for_file[i]; j++) {
+            AVOutputStream *ost = output_streams_for_file[i][j];
+
+            if (pthread_mutex_init(&ost->codec_mutex, NULL))
+                goto fail;
+            ost->has_codec_mutex = 1;
+            ost->mux_pts = ost->st->pts.val;
+            /* -vstats needs the coded frame of each picture when it is written */
+            if (!ost->encoding_needed || vstats_filename ||
+                ost->st->codec->codec_type != AVMEDIA_TYPE_VIDEO)
+                continue;
+            ost->jobs       = av_mallocz(ENCODE_QUEUE_SIZE * sizeof(*ost->jobs));
+            ost->enc_buffer = av_malloc(bit_buffer_size);
+            if (!ost->jobs || !ost->enc_buffer)
+                goto fail;
+            if (pthread_create(&ost->encode_thread, NULL, encode_thread, ost)) {
+                av_freep(&ost->jobs);
+                goto fail;
+            }
+        }
+    }
+
+    return 0;
+ fail:
+    fprintf(stderr, "Could not start the transcoding pipeline\n");
+    stop_pipeline(0);
+    return AVERROR(ENOMEM);
+}
+#else
+static void queue_mux_entry(AVOutputStream *ost, AVPacket *pkt, EncodeJob *job) {}
+static void queue_encode_job(AVOutputStream *ost, const AVFrame *frame) {}
+static void stop_pipeline(int flush) {}
+
+static int init_pipeline(void)
+{
+    fprintf(stderr, "Pipelined transcoding is not supported in this build, ignoring -pipeline\n");
+    return 0;
+}
+#endif /* HAVE_PTHREADS */
+
+static void pipeline_lock(void)
+{
+#if HAVE_PTHREADS
+    if (pipeline_running)
+        pthread_mutex_lock(&pipeline_mutex);
+#endif
+}
+
+static void pipeline_unlock(void)
 {
+#if HAVE_PTHREADS
+    if (pipeline_running)
+        pthread_mutex_unlock(&pipeline_mutex);
+#endif
+}
+
+/* keep the muxing thread off the codec context of ost while the main thread uses it */
+static void codec_lock(AVOutputStream *ost)
+{
+#if HAVE_PTHREADS
+    if (ost->has_codec_mutex)
+        pthread_mutex_lock(&ost->codec_mutex);
+#endif
+}
+
+static void codec_unlock(AVOutputStream *ost)
+{
+#if HAVE_PTHREADS
+    if (ost->has_codec_mutex)
+        pthread_mutex_unlock(&ost->codec_mutex);
+#endif
+}
+
+/**
+ * Wait for the muxing threads to write everything queued, so that the
+ * muxing state seen by the main thread is the same as without threads.
+ * The caller holds the pipeline lock.
+ */
+static void pipeline_sync(void)
+{
+#if HAVE_PTHREADS
     int i;
 
+    for (i = 0; pipeline_running && i < nb_output_files; i++)
+        while (!pipeline_error && output_threads[i].count)
+            pthread_cond_wait(&pipeline_cond, &pipeline_mutex);
+#endif
+}
+
+/* current muxing position of ost, the caller holds the pipeline lock */
+static int64_t output_pts(const AVOutputStream *ost)
+{
+    return output_threads[ost->file_index].running ? ost->mux_pts :
+                                                     ost->st->pts.val;
+}
+
+static void write_frame(AVFormatContext *s, AVPacket *pkt, AVOutputStream *ost)
+{
+    if (output_threads[ost->file_index].running) {
+        if (av_dup_packet(pkt) < 0) {
+            fprintf(stderr, "Could not queue packet for muxing\n");
+            ffmpeg_exit(1);
+        }
+        queue_mux_entry(ost, pkt, NULL);
+        return;
+    }
+
+    if (mux_frame(s, pkt, ost->st->codec, ost->bitstream_filters) < 0)
+        ffmpeg_exit(1);
+}
+
+static int audiomerge_alloc(AudioMergeContext *a, unsigned ring_size)
+{
+    unsigned size = ring_size*a->sample_size*a->out_channels;
+
+    if ((uint64_t)ring_size*a->sample_size*a->out_channels > INT_MAX)
+        return -1;
+    a->buf = av_malloc(size);
+    a->out = av_malloc(size);
+    if (!a->buf || !a->out) {
+        av_freep(&a->buf);
+        av_freep(&a->out);
+        return -1;
+    }
+    a->ring_size = ring_size;
+    return 0;
+}
+
+static int audiomerge_init(AudioMergeContext *a, uint8_t out_channels, uint8_t sample_size)
+{
     a->out_channels = out_channels;
     a->sample_size = sample_size;
+    if (!(a->interleave = av_audio_interleave_alloc(sample_size)))
+        return -1;
+
+    return audiomerge_alloc(a, 1 << 16); // more than 1 sec at 48khz
+}
+
+/* only needed if one input gets ahead of the others by more than the ring */
+static int audiomerge_grow(AudioMergeContext *a, unsigned needed)
+{
+    uint8_t *buf = a->buf, *out = a->out;
+    unsigned old_size = a->ring_size, ring_size = a->ring_size;
+    int i;
 
-    a->buf_size = out_channels*sample_size*48000; // 1 sec at 48khz
-    a->buf = av_malloc(a->buf_size);
-    if (!a->buf)
+    while (ring_size < needed) {
+        if (ring_size >= 1U << 30)
+            return -1;
+        ring_size <<= 1;
+    }
+    if (audiomerge_alloc(a, ring_size) < 0) {
+        a->buf = buf;
+        a->out = out;
         return -1;
+    }
 
-    for (i = 0; i < out_channels; i++)
-        a->buf_index[i] = i*sample_size;
+    /* move the pending samples to the start of the new rings and restart
+       the counters at 0, only their differences matter */
+    for (i = 0; i < a->out_channels; i++) {
+        const uint8_t *plane = buf + i*old_size*a->sample_size;
+        uint8_t *dst = a->buf + i*ring_size*a->sample_size;
+        unsigned start = a->read & (old_size - 1);
+        unsigned n = a->write[i] - a->read, n1 = FFMIN(n, old_size - start);
 
+        memcpy(dst, plane + start*a->sample_size, n1*a->sample_size);
+        memcpy(dst + n1*a->sample_size, plane, (n - n1)*a->sample_size);
+        a->write[i] = n;
+    }
+    a->read = 0;
+
+    av_free(buf);
+    av_free(out);
     return 0;
 }
 
@@ -769,47 +1491,55 @@ static int audiomerge_add_channel(AudioMergeContext *a, uint8_t *input,
                                   unsigned in_channel, unsigned out_channel,
                                   unsigned in_channels, unsigned samples)
 {
+    unsigned pending, start, n1;
+    uint8_t *plane;
+
     if (out_channel >= a->out_channels)
         return -1;
 
-    //fprintf(stderr, "in channel %d out channel %d samples %d\n", in_channel, out_channel, samples);
-
-    if (a->buf_index[out_channel] +
-        (int64_t)samples*a->sample_size*a->out_channels >= a->buf_size) {
-        uint8_t *buf;
-        if (a->buf_size + (int64_t)samples*a->sample_size*a->out_channels >= UINT_MAX)
-            goto error;
-        a->buf_size += (int64_t)samples*a->sample_size*a->out_channels;
-        buf = av_realloc(a->buf, a->buf_size);
-        if (!buf) {
-        error:
-            fprintf(stderr, "error reallocating audiomerge buffer\n");
-            return -1;
-        }
-        a->buf = buf;
+    pending = a->write[out_channel] - a->read;
+    if (pending + (uint64_t)samples > a->ring_size &&
+        audiomerge_grow(a, pending + samples) < 0) {
+        fprintf(stderr, "error reallocating audiomerge buffer\n");
+        return -1;
     }
 
-    input += a->sample_size*in_channel;
-    while (samples--) {
-        memcpy(a->buf + a->buf_index[out_channel], input, a->sample_size);
-        a->buf_index[out_channel] += a->sample_size*a->out_channels;
-        input += a->sample_size*in_channels;
-    }
+    plane = a->buf + out_channel*a->ring_size*a->sample_size;
+    start = a->write[out_channel] & (a->ring_size - 1);
+    n1 = FFMIN(samples, a->ring_size - start);
 
-    a->last_sample_pos = FFMAX(a->buf_index[out_channel], a->last_sample_pos);
+    input += a->sample_size*in_channel;
+    av_audio_deinterleave(a->interleave, plane + start*a->sample_size, input, n1, in_channels);
+    av_audio_deinterleave(a->interleave, plane, input + n1*a->sample_size*in_channels,
+                          samples - n1, in_channels);
+    a->write[out_channel] += samples;
 
     return 0;
 }
 
-
-static unsigned audiomerge_complete_size(AudioMergeContext *a)
+/**
+ * Interleave the samples received on all the channels into a->out.
+ * @return size in bytes of the interleaved samples
+ */
+static unsigned audiomerge_output(AudioMergeContext *a)
 {
-    int i, min = INT_MAX;
-    int align = a->out_channels*a->sample_size;
+    unsigned plane_size = a->ring_size*a->sample_size;
+    unsigned i, n = UINT_MAX, start, n1;
 
     for (i = 0; i < a->out_channels; i++)
-        min = FFMIN(a->buf_index[i], min);
-    return (min / align) * align;
+        n = FFMIN(a->write[i] - a->read, n);
+    if (!n)
+        return 0;
+
+    start = a->read & (a->ring_size - 1);
+    n1 = FFMIN(n, a->ring_size - start);
+    av_audio_interleave(a->interleave, a->out, a->buf + start*a->sample_size, plane_size,
+                        n1, a->out_channels);
+    av_audio_interleave(a->interleave, a->out + n1*a->sample_size*a->out_channels, a->buf,
+                        plane_size, n - n1, a->out_channels);
+    a->read += n;
+
+    return n*a->sample_size*a->out_channels;
 }
 
 static unsigned audiomerge_get_buffered_samples(const AVOutputStream *ost, const AVInputStream *ist)
@@ -822,29 +1552,14 @@ static unsigned audiomerge_get_buffered_samples(const AVOutputStream *ost, const
     for (i = 0; i < ost->nb_audio_channel_maps; i++) {
         if (ost->audio_channel_maps[i]->file_index == ist->file_index &&
             ost->audio_channel_maps[i]->stream_index == ist->index) {
-            return ost->audiomerge.buf_index[ost->audio_channel_maps[i]->out_channel_index] /
-                (ost->audiomerge.sample_size*ost->audiomerge.out_channels);
+            return ost->audiomerge.write[ost->audio_channel_maps[i]->out_channel_index] -
+                   ost->audiomerge.read;
         }
     }
     fprintf(stderr, "error, could not find corresponding channel mapping\n");
     return 0;
 }
 
-static void audiomerge_drain_complete_size(AudioMergeContext *a)
-{
-    int i;
-    unsigned complete_size = audiomerge_complete_size(a);
-
-    if (!complete_size)
-        return;
-
-    memmove(a->buf, a->buf + complete_size,
-            a->last_sample_pos - complete_size);
-    a->last_sample_pos -= complete_size;
-    for (i = 0; i < a->out_channels; i++)
-        a->buf_index[i] -= complete_size;
-}
-
 #define MAX_AUDIO_PACKET_SIZE (128 * 1024)
 
 static void do_audio_out(AVFormatContext *s,
@@ -923,7 +1638,8 @@ need_realloc:
             ost->audio_resample = 0;
         } else {
             ost->audio_resample = 1;
-            if (dec->sample_fmt != AV_SAMPLE_FMT_S16 && enc->sample_fmt != AV_SAMPLE_FMT_S16)
+            if (dec->sample_fmt != AV_SAMPLE_FMT_S16 && enc->sample_fmt != AV_SAMPLE_FMT_S16 &&
+                enc->channels != in_channels)
                 fprintf(stderr, "Warning, using s16 intermediate sample format for resampling\n");
             ost->resample = av_audio_resample_init(enc->channels,    in_channels,
                                                    enc->sample_rate, dec->sample_rate,
@@ -1025,8 +1741,8 @@ need_realloc:
                 }
             }
         }
-        buftmp = ost->audiomerge.buf;
-        size_out = audiomerge_complete_size(&ost->audiomerge);
+        buftmp = ost->audiomerge.out;
+        size_out = audiomerge_output(&ost->audiomerge);
         if (!size_out)
             return; // no complete frame
     } else {
@@ -1077,8 +1793,12 @@ need_realloc:
 
             //FIXME pass ost->sync_opts as AVFrame.pts in avcodec_encode_audio()
 
+            codec_lock(ost);
             ret = avcodec_encode_audio(enc, audio_out, audio_out_size,
                                        (short *)audio_buf);
+            if(ret >= 0 && enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
+                pkt.pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
+            codec_unlock(ost);
             if (ret < 0) {
                 fprintf(stderr, "Audio encoding failed\n");
                 ffmpeg_exit(1);
@@ -1087,10 +1807,8 @@ need_realloc:
             pkt.stream_index= ost->index;
             pkt.data= audio_out;
             pkt.size= ret;
-            if(enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
-                pkt.pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
             pkt.flags |= AV_PKT_FLAG_KEY;
-            write_frame(s, &pkt, enc, ost->bitstream_filters);
+            write_frame(s, &pkt, ost);
 
             ost->sync_opts += enc->frame_size;
         }
@@ -1112,8 +1830,12 @@ need_realloc:
         }
 
         //FIXME pass ost->sync_opts as AVFrame.pts in avcodec_encode_audio()
+        codec_lock(ost);
         ret = avcodec_encode_audio(enc, audio_out, size_out,
                                    (short *)buftmp);
+        if(ret >= 0 && enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
+            pkt.pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
+        codec_unlock(ost);
         if (ret < 0) {
             fprintf(stderr, "Audio encoding failed\n");
             ffmpeg_exit(1);
@@ -1122,15 +1844,10 @@ need_realloc:
         pkt.stream_index= ost->index;
         pkt.data= audio_out;
         pkt.size= ret;
-        if(enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
-            pkt.pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
         pkt.flags |= AV_PKT_FLAG_KEY;
-        write_frame(s, &pkt, enc, ost->bitstream_filters);
+        write_frame(s, &pkt, ost);
     }
 
-    if (ost->nb_audio_channel_maps > 0)
-        audiomerge_drain_complete_size(&ost->audiomerge);
-
     ist->is_start = 0;
 }
 
@@ -1176,8 +1893,10 @@ static void do_subtitle_out(AVFormatContext *s,
         sub->pts              += av_rescale_q(sub->start_display_time, (AVRational){1, 1000}, AV_TIME_BASE_Q);
         sub->end_display_time -= sub->start_display_time;
         sub->start_display_time = 0;
+        codec_lock(ost);
         subtitle_out_size = avcodec_encode_subtitle(enc, subtitle_out,
                                                     subtitle_out_max_size, sub);
+        codec_unlock(ost);
         if (subtitle_out_size < 0) {
             fprintf(stderr, "Subtitle encoding failed\n");
             ffmpeg_exit(1);
@@ -1196,13 +1915,10 @@ static void do_subtitle_out(AVFormatContext *s,
             else
                 pkt.pts += 90 * sub->end_display_time;
         }
-        write_frame(s, &pkt, ost->st->codec, ost->bitstream_filters);
+        write_frame(s, &pkt, ost);
     }
 }
 
-static int bit_buffer_size= 1024*256;
-static uint8_t *bit_buffer= NULL;
-
 static void encode_frame(AVFormatContext *s,
                          AVOutputStream *ost, AVInputStream *ist, int nb_frames,
                          AVFrame *frame, int *frame_size)
@@ -1225,8 +1941,10 @@ static void encode_frame(AVFormatContext *s,
             pkt.pts = av_rescale_q(ost->sync_opts, enc->time_base, ost->st->time_base);
             pkt.flags |= AV_PKT_FLAG_KEY;
 
-            write_frame(s, &pkt, ost->st->codec, ost->bitstream_filters);
+            write_frame(s, &pkt, ost);
+            pipeline_lock();
             video_size += avpicture_get_size(enc->pix_fmt, enc->width, enc->height);
+            pipeline_unlock();
         } else {
             /* handles sameq here. This is not correct because it may
                not be a global option */
@@ -1239,9 +1957,25 @@ static void encode_frame(AVFormatContext *s,
                 frame->pict_type = FF_I_TYPE;
                 ost->forced_kf_index++;
             }
+            if (ost->jobs) {
+                queue_encode_job(ost, frame);
+                goto next;
+            }
+            codec_lock(ost);
             ret = avcodec_encode_video(enc,
                                        bit_buffer, bit_buffer_size,
                                        frame);
+            if (ret > 0) {
+                if (enc->coded_frame->pts != AV_NOPTS_VALUE)
+                    pkt.pts = av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
+
+                if (enc->coded_frame->key_frame)
+                    pkt.flags |= AV_PKT_FLAG_KEY;
+                if (ost->logfile && enc->stats_out) {
+                    fprintf(ost->logfile, "%s", enc->stats_out);
+                }
+            }
+            codec_unlock(ost);
             if (ret < 0) {
                 fprintf(stderr, "Video encoding failed\n");
                 ffmpeg_exit(1);
@@ -1250,19 +1984,14 @@ static void encode_frame(AVFormatContext *s,
             if (ret > 0) {
                 pkt.data = bit_buffer;
                 pkt.size = ret;
-                if (enc->coded_frame->pts != AV_NOPTS_VALUE)
-                    pkt.pts = av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
-
-                if (enc->coded_frame->key_frame)
-                    pkt.flags |= AV_PKT_FLAG_KEY;
-                write_frame(s, &pkt, ost->st->codec, ost->bitstream_filters);
+                write_frame(s, &pkt, ost);
                 *frame_size = ret;
+                pipeline_lock();
                 video_size += ret;
-                if (ost->logfile && enc->stats_out) {
-                    fprintf(ost->logfile, "%s", enc->stats_out);
-                }
+                pipeline_unlock();
             }
         }
+    next:
         ost->sync_opts++;
         ost->frame_number++;
     }
@@ -1475,20 +2204,29 @@ static void print_report(AVFormatContext **output_files,
 
     oc = output_files[0];
 
-    total_size = url_fsize(oc->pb);
-    if(total_size<0) // FIXME improve url_fsize() so it works with non seekable output too
-        total_size= url_ftell(oc->pb);
+    /* the encoder and muxing threads publish their state under the lock */
+    pipeline_lock();
+
+    if (output_threads[0].running) {
+        total_size = output_threads[0].size;
+    } else {
+        total_size = url_fsize(oc->pb);
+        if(total_size<0) // FIXME improve url_fsize() so it works with non seekable output too
+            total_size= url_ftell(oc->pb);
+    }
     if(total_size<0)
         total_size = 0;
 
     buf[0] = '\0';
     vid = 0;
     for(i=0;i<nb_ostreams;i++) {
+        AVFrame *coded_frame;
         ost = ost_table[i];
         enc = ost->st->codec;
-        if (vid && enc->coded_frame && enc->codec_type == AVMEDIA_TYPE_VIDEO) {
+        coded_frame = ost->jobs ? &ost->coded_frame : enc->coded_frame;
+        if (vid && coded_frame && enc->codec_type == AVMEDIA_TYPE_VIDEO) {
             snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "q=%2.1f ",
-                     enc->coded_frame->quality/(float)FF_QP2LAMBDA);
+                     coded_frame->quality/(float)FF_QP2LAMBDA);
         }
         if (!vid && enc->codec_type == AVMEDIA_TYPE_VIDEO) {
             float t = (av_gettime()-timer_start) / 1000000.0;
@@ -1496,15 +2234,15 @@ static void print_report(AVFormatContext **output_files,
             frame_number = ost->frame_number;
             snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "frame=%5d fps=%3d ",
                      frame_number, (t>1)?(int)(frame_number/t+0.5) : 0);
-            if (enc->coded_frame) {
+            if (coded_frame) {
                 snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "q=%2.1f ",
-                         enc->coded_frame->quality/(float)FF_QP2LAMBDA);
+                         coded_frame->quality/(float)FF_QP2LAMBDA);
             }
             if(is_last_report)
                 snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "L");
             if(qp_hist){
                 int j;
-                int qp= lrintf(enc->coded_frame->quality/(float)FF_QP2LAMBDA);
+                int qp= lrintf(coded_frame->quality/(float)FF_QP2LAMBDA);
                 if(qp>=0 && qp<FF_ARRAY_ELEMS(qp_histogram))
                     qp_histogram[qp]++;
                 for(j=0; j<32; j++)
@@ -1521,7 +2259,7 @@ static void print_report(AVFormatContext **output_files,
                         error= enc->error[j];
                         scale= enc->width*enc->height*255.0*255.0*frame_number;
                     }else{
-                        error= enc->coded_frame->error[j];
+                        error= coded_frame->error[j];
                         scale= enc->width*enc->height*255.0*255.0;
                     }
                     if(j) scale/=4;
@@ -1535,7 +2273,7 @@ static void print_report(AVFormatContext **output_files,
             vst = ost;
         }
         /* compute min output value */
-        pts = FFMIN(pts, av_rescale_q(ost->st->pts.val,
+        pts = FFMIN(pts, av_rescale_q(output_pts(ost),
                                       ost->st->time_base, AV_TIME_BASE_Q));
     }
 
@@ -1592,6 +2330,8 @@ static void print_report(AVFormatContext **output_files,
                 extra_size/1024.0,
                 total_size ? 100.0*(total_size - raw)/raw : 0);
     }
+
+    pipeline_unlock();
 }
 
 /* pkt = NULL means EOF (needed to flush decoder buffers) */
@@ -1792,7 +2532,8 @@ static int output_packet(AVInputStream *ist, int ist_index,
                     continue;
 
 #if CONFIG_AVFILTER
-                if (ist->st->codec->codec_type == AVMEDIA_TYPE_VIDEO && ost->input_video_filter) {
+                if (ist->st->codec->codec_type == AVMEDIA_TYPE_VIDEO && ost->input_video_filter &&
+                    !ost->filter_shared) {
                     // add it to be filtered
                     av_vsrc_buffer_add_frame(ost->input_video_filter, &picture, ist->pts);
                 }
@@ -1851,7 +2592,9 @@ static int output_packet(AVInputStream *ist, int ist_index,
                         if(ost->st->codec->codec_type == AVMEDIA_TYPE_AUDIO)
                             audio_size += data_size;
                         else if (ost->st->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
+                            pipeline_lock();
                             video_size += data_size;
+                            pipeline_unlock();
                             ost->sync_opts++;
                         }
 
@@ -1895,7 +2638,7 @@ static int output_packet(AVInputStream *ist, int ist_index,
                             opkt.size = data_size;
                         }
 
-                        write_frame(os, &opkt, ost->st->codec, ost->bitstream_filters);
+                        write_frame(os, &opkt, ost);
                         ost->st->codec->frame_number++;
                         ost->frame_number++;
                         av_free_packet(&opkt);
@@ -1954,6 +2697,12 @@ static int output_packet(AVInputStream *ist, int ist_index,
                 if(ost->st->codec->codec_type == AVMEDIA_TYPE_VIDEO && (os->oformat->flags & AVFMT_RAWPICTURE))
                     continue;
 
+                if (ost->jobs) {
+                    /* the encoder thread drains the encoder */
+                    queue_encode_job(ost, NULL);
+                    continue;
+                }
+
                 if (ost->encoding_needed) {
                     for(;;) {
                         AVPacket pkt;
@@ -1961,6 +2710,7 @@ static int output_packet(AVInputStream *ist, int ist_index,
                         av_init_packet(&pkt);
                         pkt.stream_index= ost->index;
 
+                        codec_lock(ost);
                         switch(ost->st->codec->codec_type) {
                         case AVMEDIA_TYPE_AUDIO:
                             fifo_bytes = av_fifo_size(ost->fifo);
@@ -1975,8 +2725,10 @@ static int output_packet(AVInputStream *ist, int ist_index,
                                     enc->frame_size = fifo_bytes / (osize * enc->channels);
                                 } else { /* pad */
                                     int frame_bytes = enc->frame_size*osize*enc->channels;
-                                    if (allocated_audio_buf_size < frame_bytes)
+                                    if (allocated_audio_buf_size < frame_bytes) {
+                                        codec_unlock(ost);
                                         ffmpeg_exit(1);
+                                    }
                                     memset(audio_buf+fifo_bytes, 0, frame_bytes - fifo_bytes);
                                 }
 
@@ -1990,6 +2742,7 @@ static int output_packet(AVInputStream *ist, int ist_index,
                             }
                             if (ret < 0) {
                                 fprintf(stderr, "Audio encoding failed\n");
+                                codec_unlock(ost);
                                 ffmpeg_exit(1);
                             }
                             audio_size += ret;
@@ -1999,9 +2752,12 @@ static int output_packet(AVInputStream *ist, int ist_index,
                             ret = avcodec_encode_video(enc, bit_buffer, bit_buffer_size, NULL);
                             if (ret < 0) {
                                 fprintf(stderr, "Video encoding failed\n");
+                                codec_unlock(ost);
                                 ffmpeg_exit(1);
                             }
+                            pipeline_lock();
                             video_size += ret;
+                            pipeline_unlock();
                             if(enc->coded_frame && enc->coded_frame->key_frame)
                                 pkt.flags |= AV_PKT_FLAG_KEY;
                             if (ost->logfile && enc->stats_out) {
@@ -2012,13 +2768,14 @@ static int output_packet(AVInputStream *ist, int ist_index,
                             ret=-1;
                         }
 
+                        if(ret > 0 && enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
+                            pkt.pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
+                        codec_unlock(ost);
                         if(ret<=0)
                             break;
                         pkt.data= bit_buffer;
                         pkt.size= ret;
-                        if(enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
-                            pkt.pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
-                        write_frame(os, &pkt, ost->st->codec, ost->bitstream_filters);
+                        write_frame(os, &pkt, ost);
                     }
                 }
             }
@@ -2201,12 +2958,12 @@ static void validate_target(AVOutputStream *ost)
             if (norm == PAL) {
                 if (ost->st->codec->width != 720 || ost->st->codec->height != 576)
                     snprintf(scale_args, sizeof(scale_args),
-                             "720:576:flags=0x%X", ost->sws_flags);
+                             "720:576:flags=0x%X:threads=%d", ost->sws_flags, ost->sws_threads);
                 args = "720:608:0:32:black:1";
             } else {
                 if (ost->st->codec->width != 720 || ost->st->codec->height != 486)
                     snprintf(scale_args, sizeof(scale_args),
-                             "720:486:flags=0x%X", ost->sws_flags);
+                             "720:486:flags=0x%X:threads=%d", ost->sws_flags, ost->sws_threads);
                 args = "720:512:0:26:black:1";
             }
 
@@ -2266,6 +3023,7 @@ static int transcode(AVFormatContext **output_files,
                      AVStreamMap *stream_maps, int nb_stream_maps)
 {
     int ret = 0, i, j, k, n, nb_istreams = 0, nb_ostreams = 0;
+    int64_t expected_duration;
     AVFormatContext *is, *os;
     AVCodecContext *codec, *icodec;
     AVOutputStream *ost, **ost_table = NULL;
@@ -2617,8 +3375,11 @@ static int transcode(AVFormatContext **output_files,
 
                 if (ost->audiomerge.out_channels > 0) {
                     codec->channels = ost->audiomerge.out_channels; // update channels to merged channels
-                    audiomerge_init(&ost->audiomerge, ost->audiomerge.out_channels,
-                                    av_get_bits_per_sample_fmt(icodec->sample_fmt)/8);
+                    if (audiomerge_init(&ost->audiomerge, ost->audiomerge.out_channels,
+                                        av_get_bits_per_sample_fmt(icodec->sample_fmt)/8) < 0) {
+                        fprintf(stderr, "Could not allocate the audio merge buffers\n");
+                        ffmpeg_exit(1);
+                    }
                 }
                 break;
             case AVMEDIA_TYPE_VIDEO:
@@ -2664,7 +3425,8 @@ static int transcode(AVFormatContext **output_files,
                 ist->decoding_needed = 1;
 
 #if CONFIG_AVFILTER
-                if (configure_filters(ist, ost)) {
+                if (!ost->input_video_filter &&
+                    configure_shared_filters(ist, ost_table, nb_ostreams, i)) {
                     fprintf(stderr, "Error opening filters!\n");
                     exit(1);
                 }
@@ -2867,9 +3629,23 @@ static int transcode(AVFormatContext **output_files,
         copy_chapters(infile, outfile);
     }
 
+    /* expected output duration, used by muxers to preallocate their index */
+    if (recording_time != INT64_MAX) {
+        expected_duration = recording_time;
+    } else {
+        expected_duration = 0;
+        for (i = 0; i < nb_input_files; i++) {
+            is = input_files[i];
+            if (is->duration > 0)
+                expected_duration = FFMAX(expected_duration, is->duration - start_time);
+        }
+    }
+
     /* open files and write file headers */
     for(i=0;i<nb_output_files;i++) {
         os = output_files[i];
+        if (!os->duration && expected_duration > 0)
+            os->duration = expected_duration;
         if (av_write_header(os) < 0) {
             fprintf(stderr, "Could not write header for output file #%d\n", i);
             ret = AVERROR(EINVAL);
@@ -2921,6 +3697,9 @@ static int transcode(AVFormatContext **output_files,
     }
     term_init();
 
+    if (use_pipeline && (ret = init_pipeline()) < 0)
+        goto fail;
+
     timer_start = av_gettime();
 
     for(; received_sigterm == 0;) {
@@ -2943,9 +3722,19 @@ static int transcode(AVFormatContext **output_files,
                 break;
         }
 
+#if HAVE_PTHREADS
+        if (pipeline_error)
+            ffmpeg_exit(1);
+#endif
+
         /* select the stream that we must read now by looking at the
            smallest output pts */
         file_index = -1;
+        pipeline_lock();
+        /* the choice between several inputs and the size limit depend on
+           what has been muxed so far, keep them deterministic */
+        if (nb_input_files > 1 || limit_filesize)
+            pipeline_sync();
         for(i=0;i<nb_ostreams;i++) {
             double ipts, opts;
             ost = ost_table[i];
@@ -2954,7 +3743,7 @@ static int transcode(AVFormatContext **output_files,
             ist = ist_table[ost->source_index[j]];
             if(ist->is_past_recording_time || no_packet[ist->file_index])
                 continue;
-            opts = ost->st->pts.val * av_q2d(ost->st->time_base);
+            opts = output_pts(ost) * av_q2d(ost->st->time_base);
             ipts = (double)ist->pts;
             if (!file_table[ist->file_index].eof_reached){
                 if(ipts < ipts_min) {
@@ -2973,9 +3762,10 @@ static int transcode(AVFormatContext **output_files,
             }
             }
         }
+    out:
+        pipeline_unlock();
         /* if none, if is finished */
         if (file_index < 0) {
-        out:
             if(no_packet_count){
                 no_packet_count=0;
                 memset(no_packet, 0, sizeof(no_packet));
@@ -2986,8 +3776,15 @@ static int transcode(AVFormatContext **output_files,
         }
 
         /* finish if limit size exhausted */
-        if (limit_filesize != 0 && limit_filesize <= url_ftell(output_files[0]->pb))
-            break;
+        if (limit_filesize != 0) {
+            int64_t size;
+            pipeline_lock();
+            size = output_threads[0].running ? output_threads[0].size :
+                                               url_ftell(output_files[0]->pb);
+            pipeline_unlock();
+            if (limit_filesize <= size)
+                break;
+        }
 
         /* read a frame from it and output it in the fifo */
         is = input_files[file_index];
@@ -3059,8 +3856,11 @@ static int transcode(AVFormatContext **output_files,
 
         //fprintf(stderr,"read #%d.%d size=%d\n", ist->file_index, ist->index, pkt.size);
         if (output_packet(ist, ist_index, ost_table, nb_ostreams, &pkt) < 0) {
-            if (exit_on_error)
+            if (exit_on_error) {
+                /* the encoding threads update the statistics */
+                stop_pipeline(0);
                 print_report(output_files, ost_table, nb_ostreams, 1, duration);
+            }
             if (verbose >= 0)
                 fprintf(stderr, "Error while decoding stream #%d.%d\n",
                         ist->file_index, ist->index);
@@ -3091,6 +3891,13 @@ static int transcode(AVFormatContext **output_files,
         }
     }
 
+    /* let the encoder and muxing threads finish */
+    stop_pipeline(1);
+#if HAVE_PTHREADS
+    if (pipeline_error)
+        ffmpeg_exit(1);
+#endif
+
     term_exit();
 
     /* write the trailer if needed and close file */
@@ -3159,6 +3966,8 @@ static int transcode(AVFormatContext **output_files,
                     av_free(ost->prev_frame.data[0]);
                 av_free(ost->forced_kf_pts);
                 av_free(ost->audiomerge.buf);
+                av_free(ost->audiomerge.out);
+                av_audio_interleave_free(ost->audiomerge.interleave);
                 if (ost->video_resample)
                     sws_freeContext(ost->img_resample_ctx);
                 if (ost->resample)
@@ -3939,6 +4748,7 @@ static void new_video_stream(AVFormatContext *oc, int file_idx)
 
         set_context_opts(sws_opts, AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_ENCODING_PARAM, NULL);
         ost->sws_flags = av_get_int(sws_opts, "sws_flags", NULL);
+        ost->sws_threads = av_get_int(sws_opts, "sws_threads", NULL);
     }
 
     avcodec_get_context_defaults3(st->codec, ost->codec);
@@ -4851,6 +5661,7 @@ static const OptionDef options[] = {
     { "programid", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&opt_programid}, "desired program number", "" },
     { "xerror", OPT_BOOL, {(void*)&exit_on_error}, "exit on error", "error" },
     { "copyinkf", OPT_BOOL | OPT_EXPERT, {(void*)&copy_initial_nonkeyframes}, "copy initial non-keyframes" },
+    { "pipeline", OPT_BOOL | OPT_EXPERT, {(void*)&use_pipeline}, "encode video and mux in separate threads" },
 
     /* video options */
     { "b", OPT_FUNC2 | HAS_ARG | OPT_VIDEO, {(void*)opt_bitrate}, "set bitrate (in bits/s)", "bitrate" },
@@ -4885,6 +5696,7 @@ static const OptionDef options[] = {
     { "vstats_file", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_vstats_file}, "dump video coding statistics to file", "file" },
 #if CONFIG_AVFILTER
     { "vf", HAS_ARG, {(void*)&opt_vf}, "add video filter", "filter list" },
+    { "filter_threads", HAS_ARG | OPT_INT | OPT_EXPERT | OPT_VIDEO, {(void*)&filter_threads}, "number of threads the video filters can use (experimental)", "count" },
 #endif
     { "intra_matrix", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_intra_matrix}, "specify intra matrix coeffs", "matrix" },
     { "inter_matrix", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_inter_matrix}, "specify inter matrix coeffs", "matrix" },
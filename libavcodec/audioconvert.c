@@ -30,6 +30,7 @@
 #include "libavutil/samplefmt.h"
 #include "avcodec.h"
 #include "audioconvert.h"
+#include "interleavedsp.h"
 
 #if FF_API_OLD_SAMPLE_FMT
 const char *avcodec_get_sample_fmt_name(int sample_fmt)
@@ -105,6 +106,41 @@ void av_audio_convert_free(AVAudioConvert *ctx)
     av_free(ctx);
 }
 
+struct AVAudioInterleave {
+    InterleaveDSPContext dsp;
+    int log2_size;
+};
+
+AVAudioInterleave *av_audio_interleave_alloc(int sample_size)
+{
+    AVAudioInterleave *ctx;
+    if (sample_size != 1 && sample_size != 2 && sample_size != 4 && sample_size != 8)
+        return NULL;
+    ctx = av_malloc(sizeof(AVAudioInterleave));
+    if (!ctx)
+        return NULL;
+    ff_interleavedsp_init(&ctx->dsp);
+    ctx->log2_size = av_log2(sample_size);
+    return ctx;
+}
+
+void av_audio_interleave_free(AVAudioInterleave *ctx)
+{
+    av_free(ctx);
+}
+
+void av_audio_interleave(AVAudioInterleave *ctx, uint8_t *dst, const uint8_t *src,
+                         int plane_size, int len, int channels)
+{
+    ctx->dsp.interleave[ctx->log2_size](dst, src, plane_size, len, channels);
+}
+
+void av_audio_deinterleave(AVAudioInterleave *ctx, uint8_t *dst, const uint8_t *src,
+                           int len, int channels)
+{
+    ctx->dsp.deinterleave[ctx->log2_size](dst, src, len, channels);
+}
+
 int av_audio_convert(AVAudioConvert *ctx,
                            void * const out[6], const int out_stride[6],
                      const void * const  in[6], const int  in_stride[6], int len)
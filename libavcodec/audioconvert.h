@@ -116,4 +116,36 @@ int av_audio_convert(AVAudioConvert *ctx,
                            void * const out[6], const int out_stride[6],
                      const void * const  in[6], const int  in_stride[6], int len);
 
+struct AVAudioInterleave;
+typedef struct AVAudioInterleave AVAudioInterleave;
+
+/**
+ * Create a context to interleave and deinterleave audio channels
+ * @param sample_size size of one sample in bytes, 1, 2, 4 or 8
+ * @return NULL on error
+ */
+AVAudioInterleave *av_audio_interleave_alloc(int sample_size);
+
+/**
+ * Free audio interleaving context
+ */
+void av_audio_interleave_free(AVAudioInterleave *ctx);
+
+/**
+ * Interleave planar channels, the planes being plane_size bytes apart:
+ * sample i of channel c is copied from src + c * plane_size + i * size
+ * to dst + (i * channels + c) * size. No alignment constraint.
+ * @param len number of samples per channel
+ */
+void av_audio_interleave(AVAudioInterleave *ctx, uint8_t *dst, const uint8_t *src,
+                         int plane_size, int len, int channels);
+
+/**
+ * Copy one channel of interleaved samples to a plane:
+ * sample i is copied from src + i * channels * size to dst + i * size.
+ * @param len number of samples
+ */
+void av_audio_deinterleave(AVAudioInterleave *ctx, uint8_t *dst, const uint8_t *src,
+                           int len, int channels);
+
 #endif /* AVCODEC_AUDIOCONVERT_H */
@@ -728,6 +728,8 @@ typedef struct RcOverride{
 #define CODEC_CAP_NEG_LINESIZES    0x0800
 /**
  * Codec supports frame-level multithreading.
+ * Encoders with this capability code each frame independently of the others,
+ * or only when intra-only if they also have CODEC_CAP_DELAY.
  */
 #define CODEC_CAP_FRAME_THREADS    0x1000
 
@@ -2870,6 +2872,14 @@ typedef struct AVCodecContext {
      * Which multithreading methods to use.
      * Use of FF_THREAD_FRAME will increase decoding delay by one frame per thread,
      * so clients which cannot provide future frames should not use it.
+     * Likewise, encoders using it return packets one frame per thread late,
+     * and must be flushed with NULL pictures at the end even if they do not
+     * have CODEC_CAP_DELAY, so encoders only use it when FF_THREAD_SLICE is
+     * not set.
+     * FF_THREAD_GOP makes long-GOP encoders code one closed GOP per thread,
+     * it delays packets by thread_count - 1 GOPs and requires gop_size > 1,
+     * CODEC_FLAG_CLOSED_GOP, CODEC_FLAG2_STRICT_GOP and no rc_buffer_size.
+     * It is not used unless requested.
      *
      * - encoding: Set by user, otherwise the default is used.
      * - decoding: Set by user, otherwise the default is used.
@@ -2877,6 +2887,7 @@ typedef struct AVCodecContext {
     int thread_type;
 #define FF_THREAD_FRAME   1 //< Decode more than one frame at once
 #define FF_THREAD_SLICE   2 //< Decode more than one part of a single frame at once
+#define FF_THREAD_GOP     4 //< Encode more than one GOP at once
 
     /**
      * Which multithreading methods are in use by the codec.
@@ -2994,6 +3005,13 @@ typedef struct AVCodec {
      * must call ff_thread_finish_setup().
      *
      * dst and src will (rarely) point to the same context, in which case memcpy should be skipped.
+     *
+     * For encoders, called in output order when the frame encoded by dst is
+     * returned, src being the context the previous frame was returned from,
+     * to carry state such as rate control from frame to frame.
+     * With GOP threading, called once per GOP when its first packet is
+     * returned, and also before dst starts a GOP, src being the context the
+     * last GOP was returned from.
      */
     int (*update_thread_context)(AVCodecContext *dst, const AVCodecContext *src);
     /** @} */
@@ -407,7 +407,7 @@ int ff_dnxhd_get_cid_table(int cid)
     return -1;
 }
 
-int ff_dnxhd_find_cid(AVCodecContext *avctx)
+int ff_dnxhd_find_cid(AVCodecContext *avctx, int bit_depth)
 {
     int i, j;
     int mbs = avctx->bit_rate/1000000;
@@ -417,8 +417,8 @@ int ff_dnxhd_find_cid(AVCodecContext *avctx)
         const CIDEntry *cid = &ff_dnxhd_cid_table[i];
         if (cid->width == avctx->width && cid->height == avctx->height &&
             cid->interlaced == !!(avctx->flags & CODEC_FLAG_INTERLACED_DCT) &&
-            cid->bit_depth == 8) { // until 10 bit is supported
-            for (j = 0; j < sizeof(cid->bit_rates); j++) {
+            cid->bit_depth == bit_depth) {
+            for (j = 0; j < FF_ARRAY_ELEMS(cid->bit_rates); j++) {
                 if (cid->bit_rates[j] == mbs)
                     return cid->cid;
             }
@@ -25,9 +25,12 @@
 #define RC_VARIANCE 1 // use variance or ssd for fast rc
 
 #include "libavutil/opt.h"
+#include "libavutil/timer.h"
 #include "avcodec.h"
 #include "dsputil.h"
 #include "mpegvideo.h"
+#include "faandct.h"
+#include "simple_idct.h"
 #include "dnxhdenc.h"
 
 #define VE AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_ENCODING_PARAM
@@ -35,14 +38,16 @@
 static const AVOption options[]={
     {"qmax", "max video quantizer scale", offsetof(DNXHDEncContext, qmax), FF_OPT_TYPE_INT, 0, 0, 1024, VE},
     {"nitris_compat", "encode with Avid Nitris compatibility", offsetof(DNXHDEncContext, nitris_compat), FF_OPT_TYPE_INT, 0, 0, 1, VE},
+    {"rd_window", "with mbd rd, only search qscales this far from the ones of the previous frame, 0 to search all", offsetof(DNXHDEncContext, rd_window), FF_OPT_TYPE_INT, 3, 0, 1024, VE},
+    {"rd_bench", "with mbd rd, report the speed and quality of the search against the exhaustive one", offsetof(DNXHDEncContext, rd_bench), FF_OPT_TYPE_INT, 0, 0, 1, VE},
     {NULL}
 };
 
 static const AVClass class = { "dnxhd", av_default_item_name, options, LIBAVUTIL_VERSION_INT };
 
-static int dct_quantize_c(DNXHDEncContext *s,
-                          DCTELEM *block, int n,
-                          int qp, int *overflow)
+static int quantize_c(DNXHDEncContext *s,
+                      DCTELEM *block, int n,
+                      int qp, int *overflow)
 {
     int i, j, level, last_non_zero, q, start_i;
     const int *qmat;
@@ -51,9 +56,7 @@ static int dct_quantize_c(DNXHDEncContext *s,
     int max=0;
     unsigned int threshold1, threshold2;
 
-    s->dsp.fdct(block);
-
-    q = 1 << 3;
+    q = s->cid_table->bit_depth == 10 ? 1 << 2 : 1 << 3;
     /* note: block[0] is assumed to be positive */
     block[0] = (block[0] + (q >> 1)) / q;
     start_i = 1;
@@ -99,6 +102,83 @@ static int dct_quantize_c(DNXHDEncContext *s,
     return last_non_zero;
 }
 
+static int dct_quantize_c(DNXHDEncContext *s,
+                          DCTELEM *block, int n,
+                          int qp, int *overflow)
+{
+    s->dsp.fdct(block);
+    return quantize_c(s, block, n, qp, overflow);
+}
+
+static void dnxhd_unquantize_c(DNXHDEncContext *ctx, DCTELEM *block, int n, int qscale, int last_index)
+{
+    const uint8_t *weight_matrix;
+    int level;
+    int i;
+    int level_shift = ctx->cid_table->bit_depth == 10 ? 4 : 6;
+    int level_bias  = 1 << (level_shift - 1);
+
+    weight_matrix = (n&2) ? ctx->cid_table->chroma_weight : ctx->cid_table->luma_weight;
+
+    for (i = 1; i <= last_index; i++) {
+        int j = ctx->intra_scantable.permutated[i];
+        level = block[j];
+        if (level) {
+            if (level < 0) {
+                level = (1-2*level) * qscale * weight_matrix[i];
+                if (weight_matrix[i] != level_bias)
+                    level += level_bias;
+                level >>= level_shift;
+                level = -level;
+            } else {
+                level = (2*level+1) * qscale * weight_matrix[i];
+                if (weight_matrix[i] != level_bias)
+                    level += level_bias;
+                level >>= level_shift;
+            }
+            block[j] = level;
+        }
+    }
+}
+
+static int dnxhd_ssd_block(DCTELEM *qblock, DCTELEM *block)
+{
+    int score = 0;
+    int i;
+    for (i = 0; i < 64; i++)
+        score += (block[i]-qblock[i])*(block[i]-qblock[i]);
+    return score;
+}
+
+static int dnxhd_calc_ac_bits(DNXHDEncContext *ctx, DCTELEM *block, int last_index)
+{
+    int last_non_zero = 0;
+    int bits = 0;
+    int i, j, level;
+    for (i = 1; i <= last_index; i++) {
+        j = ctx->intra_scantable.permutated[i];
+        level = block[j];
+        if (level) {
+            int run_level = i - last_non_zero - 1;
+            bits += ctx->vlc_bits[(level<<1)|!!run_level]+ctx->run_bits[run_level];
+            last_non_zero = i;
+        }
+    }
+    return bits;
+}
+
+/**
+ * cycle counter of the rd_bench timings, 0 where there is none
+ */
+static av_always_inline int64_t dnxhd_read_time(void)
+{
+#ifdef AV_READ_TIME
+    return AV_READ_TIME();
+#else
+    return 0;
+#endif
+}
+
 #define LAMBDA_FRAC_BITS 10
 
 static av_always_inline void dnxhd_get_pixels_8x4(DCTELEM *restrict block, const uint8_t *pixels, int line_size)
@@ -118,6 +198,34 @@ static av_always_inline void dnxhd_get_pixels_8x4(DCTELEM *restrict block, const
     memcpy(block+24, block-32, sizeof(*block)*8);
 }
 
+static void dnxhd_10bit_get_pixels_8x8(DCTELEM *restrict block, const uint8_t *pixels, int line_size)
+{
+    int i, j;
+    for (i = 0; i < 8; i++) {
+        const uint16_t *src = (const uint16_t *)pixels;
+        for (j = 0; j < 8; j++)
+            block[j] = src[j];
+        pixels += line_size;
+        block += 8;
+    }
+}
+
+static void dnxhd_10bit_get_pixels_8x4_sym(DCTELEM *restrict block, const uint8_t *pixels, int line_size)
+{
+    int i, j;
+    for (i = 0; i < 4; i++) {
+        const uint16_t *src = (const uint16_t *)pixels;
+        for (j = 0; j < 8; j++)
+            block[j] = src[j];
+        pixels += line_size;
+        block += 8;
+    }
+    memcpy(block   , block- 8, sizeof(*block)*8);
+    memcpy(block+ 8, block-16, sizeof(*block)*8);
+    memcpy(block+16, block-24, sizeof(*block)*8);
+    memcpy(block+24, block-32, sizeof(*block)*8);
+}
+
 static int dnxhd_init_vlc(DNXHDEncContext *ctx)
 {
     int i, j, level, run;
@@ -177,6 +285,8 @@ static int dnxhd_init_qmat(DNXHDEncContext *ctx, int lbias, int cbias)
 {
     // init first elem to 1 to avoid div by 0 in convert_matrix
     uint16_t weight_matrix[64] = {1,}; // convert_matrix needs uint16_t*
+    // 10 bit dequantization shifts 2 bits less and ff_faandct_10 is scaled by 1/2
+    int numerator = ctx->cid_table->bit_depth == 10 ? 2 : 4;
     int i;
 
     if (!ctx->qmax)
@@ -192,13 +302,13 @@ static int dnxhd_init_qmat(DNXHDEncContext *ctx, int lbias, int cbias)
         weight_matrix[j] = ctx->cid_table->luma_weight[i];
     }
     ff_convert_matrix(&ctx->dsp, ctx->qmatrix_l, ctx->qmatrix_l16, NULL,
-                      weight_matrix, ctx->intra_quant_bias, 1, ctx->qmax, 1, 4);
+                      weight_matrix, ctx->intra_quant_bias, 1, ctx->qmax, 1, numerator);
     for (i = 1; i < 64; i++) {
         int j = ctx->dsp.idct_permutation[ff_zigzag_direct[i]];
         weight_matrix[j] = ctx->cid_table->chroma_weight[i];
     }
     ff_convert_matrix(&ctx->dsp, ctx->qmatrix_c, ctx->qmatrix_c16, NULL,
-                      weight_matrix, ctx->intra_quant_bias, 1, ctx->qmax, 1, 4);
+                      weight_matrix, ctx->intra_quant_bias, 1, ctx->qmax, 1, numerator);
     return 0;
  fail:
     return -1;
@@ -221,7 +331,7 @@ static int dnxhd_init_rc(DNXHDEncContext *ctx)
 static int dnxhd_encode_init(AVCodecContext *avctx)
 {
     DNXHDEncContext *ctx = avctx->priv_data;
-    int i, index;
+    int i, index, bit_depth;
 
     if (!((avctx->width == 1920 && avctx->height == 1080) ||
           avctx->width == 1280 && avctx->height == 720)) {
@@ -232,9 +342,24 @@ static int dnxhd_encode_init(AVCodecContext *avctx)
         av_log(avctx, AV_LOG_ERROR, "1280x720 interlaced is not supported\n");
         return -1;
     }
-    ctx->cid = ff_dnxhd_find_cid(avctx);
-    if (!ctx->cid || avctx->pix_fmt != PIX_FMT_YUV422P)
+    switch (avctx->pix_fmt) {
+    case PIX_FMT_YUV422P:
+        bit_depth = 8;
+        break;
+    case PIX_FMT_YUV422P10:
+        bit_depth = 10;
+        break;
+    default:
+        av_log(avctx, AV_LOG_ERROR, "pixel format is incompatible with DNxHD\n");
+        return -1;
+    }
+
+    ctx->cid = ff_dnxhd_find_cid(avctx, bit_depth);
+    if (!ctx->cid) {
+        av_log(avctx, AV_LOG_ERROR, "video parameters incompatible with DNxHD, "
+               "no cid for %d bits at this bitrate\n", bit_depth);
         return -1;
+    }
     av_log(avctx, AV_LOG_DEBUG, "cid %d\n", ctx->cid);
 
     index = ff_dnxhd_get_cid_table(ctx->cid);
@@ -244,15 +369,33 @@ static int dnxhd_encode_init(AVCodecContext *avctx)
 
     ctx->get_pixels_8x4_sym = dnxhd_get_pixels_8x4;
 
+    avctx->bits_per_raw_sample = bit_depth;
     dsputil_init(&ctx->dsp, avctx);
 
+    if (bit_depth == 10) {
+        /* 16 bits samples and 32 bits intermediate values for the transforms */
+        ctx->dsp.get_pixels = dnxhd_10bit_get_pixels_8x8;
+        ctx->get_pixels_8x4_sym = dnxhd_10bit_get_pixels_8x4_sym;
+        ctx->dsp.fdct = ff_faandct_10;
+        ctx->dsp.idct = ff_simple_idct_10;
+        ctx->dsp.idct_permutation_type = FF_NO_IDCT_PERM;
+        for (i = 0; i < 64; i++)
+            ctx->dsp.idct_permutation[i] = i;
+    }
+
     ff_init_scantable(ctx->dsp.idct_permutation, &ctx->intra_scantable, ff_zigzag_direct);
 
+    ctx->unquantize   = dnxhd_unquantize_c;
+    ctx->ssd_block    = dnxhd_ssd_block;
+    ctx->calc_ac_bits = dnxhd_calc_ac_bits;
+
 #if HAVE_MMX
     ff_dnxhd_init_mmx(ctx);
 #endif
-    if (!ctx->dct_quantize)
+    if (!ctx->dct_quantize) {
         ctx->dct_quantize = dct_quantize_c;
+        ctx->quantize     = quantize_c;
+    }
 
     ctx->mb_height = (avctx->height + 15) / 16;
     ctx->mb_width  = (avctx->width  + 15) / 16;
@@ -286,6 +429,18 @@ static int dnxhd_encode_init(AVCodecContext *avctx)
     FF_ALLOCZ_OR_GOTO(ctx->avctx, ctx->mb_bits,    ctx->mb_num   *sizeof(uint16_t), fail);
     FF_ALLOCZ_OR_GOTO(ctx->avctx, ctx->mb_qscale,  ctx->mb_num   *sizeof(uint8_t) , fail);
 
+    if (avctx->mb_decision == FF_MB_DECISION_RD) {
+        FF_ALLOCZ_OR_GOTO(ctx->avctx, ctx->mb_qlo,     ctx->mb_num    *sizeof(uint8_t) , fail);
+        FF_ALLOCZ_OR_GOTO(ctx->avctx, ctx->mb_qhi,     ctx->mb_num    *sizeof(uint8_t) , fail);
+        FF_ALLOCZ_OR_GOTO(ctx->avctx, ctx->mb_dc_bits, ctx->mb_num    *sizeof(uint16_t), fail);
+        FF_ALLOCZ_OR_GOTO(ctx->avctx, ctx->rd_qscale,  ctx->mb_num * 2*sizeof(uint8_t) , fail);
+        FF_ALLOCZ_OR_GOTO(ctx->avctx, ctx->row_bits,   ctx->mb_height *sizeof(int)     , fail);
+        if (ctx->rd_bench) {
+            FF_ALLOCZ_OR_GOTO(ctx->avctx, ctx->bench_qscale, ctx->mb_num*sizeof(uint8_t) , fail);
+            FF_ALLOCZ_OR_GOTO(ctx->avctx, ctx->bench_bits,   ctx->mb_num*sizeof(uint16_t), fail);
+        }
+    }
+
     ctx->frame.key_frame = 1;
     ctx->frame.pict_type = FF_I_TYPE;
     ctx->avctx->coded_frame = &ctx->frame;
@@ -321,7 +476,7 @@ static int dnxhd_write_header(AVCodecContext *avctx, uint8_t *buf)
     AV_WB16(buf + 0x1a, avctx->width);  // SPL
     AV_WB16(buf + 0x1d, avctx->height>>ctx->interlaced); // NAL
 
-    buf[0x21] = 0x38; // FIXME 8 bit per comp
+    buf[0x21] = ctx->cid_table->bit_depth == 10 ? 0x58 : 0x38;
     buf[0x22] = 0x88 + (ctx->interlaced<<2);
     AV_WB32(buf + 0x28, ctx->cid); // CID
     buf[0x2c] = ctx->interlaced ? 0 : 0x80;
@@ -373,77 +528,32 @@ static av_always_inline void dnxhd_encode_block(DNXHDEncContext *ctx, DCTELEM *b
     put_bits(&ctx->pb, ctx->vlc_bits[0], ctx->vlc_codes[0]); // EOB
 }
 
-static av_always_inline void dnxhd_unquantize_c(DNXHDEncContext *ctx, DCTELEM *block, int n, int qscale, int last_index)
+static av_always_inline int dnxhd_calc_dc_bits(DNXHDEncContext *ctx, int diff)
 {
-    const uint8_t *weight_matrix;
-    int level;
-    int i;
-
-    weight_matrix = (n&2) ? ctx->cid_table->chroma_weight : ctx->cid_table->luma_weight;
-
-    for (i = 1; i <= last_index; i++) {
-        int j = ctx->intra_scantable.permutated[i];
-        level = block[j];
-        if (level) {
-            if (level < 0) {
-                level = (1-2*level) * qscale * weight_matrix[i];
-                if (weight_matrix[i] != 32)
-                    level += 32;
-                level >>= 6;
-                level = -level;
-            } else {
-                level = (2*level+1) * qscale * weight_matrix[i];
-                if (weight_matrix[i] != 32)
-                    level += 32;
-                level >>= 6;
-            }
-            block[j] = level;
-        }
-    }
-}
-
-static av_always_inline int dnxhd_ssd_block(DCTELEM *qblock, DCTELEM *block)
-{
-    int score = 0;
-    int i;
-    for (i = 0; i < 64; i++)
-        score += (block[i]-qblock[i])*(block[i]-qblock[i]);
-    return score;
-}
-
-static av_always_inline int dnxhd_calc_ac_bits(DNXHDEncContext *ctx, DCTELEM *block, int last_index)
-{
-    int last_non_zero = 0;
-    int bits = 0;
-    int i, j, level;
-    for (i = 1; i <= last_index; i++) {
-        j = ctx->intra_scantable.permutated[i];
-        level = block[j];
-        if (level) {
-            int run_level = i - last_non_zero - 1;
-            bits += ctx->vlc_bits[(level<<1)|!!run_level]+ctx->run_bits[run_level];
-            last_non_zero = i;
-        }
-    }
-    return bits;
+    int nbits;
+    if (diff < 0) nbits = av_log2_16bit(-2*diff);
+    else          nbits = av_log2_16bit( 2*diff);
+    return ctx->cid_table->dc_bits[nbits] + nbits;
 }
 
 static av_always_inline void dnxhd_get_blocks(DNXHDEncContext *ctx, int mb_x, int mb_y)
 {
-    const uint8_t *ptr_y = ctx->thread[0]->src[0] + ((mb_y << 4) * ctx->linesize)   + (mb_x << 4);
-    const uint8_t *ptr_u = ctx->thread[0]->src[1] + ((mb_y << 4) * ctx->uvlinesize) + (mb_x << 3);
-    const uint8_t *ptr_v = ctx->thread[0]->src[2] + ((mb_y << 4) * ctx->uvlinesize) + (mb_x << 3);
+    int shift = ctx->cid_table->bit_depth == 10; // 2 bytes per sample
+    const uint8_t *ptr_y = ctx->thread[0]->src[0] + ((mb_y << 4) * ctx->linesize)   + (mb_x << (4 + shift));
+    const uint8_t *ptr_u = ctx->thread[0]->src[1] + ((mb_y << 4) * ctx->uvlinesize) + (mb_x << (3 + shift));
+    const uint8_t *ptr_v = ctx->thread[0]->src[2] + ((mb_y << 4) * ctx->uvlinesize) + (mb_x << (3 + shift));
+    const int y_offset8 = 8 << shift;
     DSPContext *dsp = &ctx->dsp;
 
-    dsp->get_pixels(ctx->blocks[0], ptr_y    , ctx->linesize);
-    dsp->get_pixels(ctx->blocks[1], ptr_y + 8, ctx->linesize);
+    dsp->get_pixels(ctx->blocks[0], ptr_y            , ctx->linesize);
+    dsp->get_pixels(ctx->blocks[1], ptr_y + y_offset8, ctx->linesize);
     dsp->get_pixels(ctx->blocks[2], ptr_u    , ctx->uvlinesize);
     dsp->get_pixels(ctx->blocks[3], ptr_v    , ctx->uvlinesize);
 
     if (mb_y+1 == ctx->mb_height && ctx->avctx->height == 1080) {
         if (ctx->interlaced) {
-            ctx->get_pixels_8x4_sym(ctx->blocks[4], ptr_y + ctx->dct_y_offset    , ctx->linesize);
-            ctx->get_pixels_8x4_sym(ctx->blocks[5], ptr_y + ctx->dct_y_offset + 8, ctx->linesize);
+            ctx->get_pixels_8x4_sym(ctx->blocks[4], ptr_y + ctx->dct_y_offset            , ctx->linesize);
+            ctx->get_pixels_8x4_sym(ctx->blocks[5], ptr_y + ctx->dct_y_offset + y_offset8, ctx->linesize);
             ctx->get_pixels_8x4_sym(ctx->blocks[6], ptr_u + ctx->dct_uv_offset   , ctx->uvlinesize);
             ctx->get_pixels_8x4_sym(ctx->blocks[7], ptr_v + ctx->dct_uv_offset   , ctx->uvlinesize);
         } else {
@@ -451,8 +561,8 @@ static av_always_inline void dnxhd_get_blocks(DNXHDEncContext *ctx, int mb_x, in
             dsp->clear_block(ctx->blocks[6]); dsp->clear_block(ctx->blocks[7]);
         }
     } else {
-        dsp->get_pixels(ctx->blocks[4], ptr_y + ctx->dct_y_offset    , ctx->linesize);
-        dsp->get_pixels(ctx->blocks[5], ptr_y + ctx->dct_y_offset + 8, ctx->linesize);
+        dsp->get_pixels(ctx->blocks[4], ptr_y + ctx->dct_y_offset            , ctx->linesize);
+        dsp->get_pixels(ctx->blocks[5], ptr_y + ctx->dct_y_offset + y_offset8, ctx->linesize);
         dsp->get_pixels(ctx->blocks[6], ptr_u + ctx->dct_uv_offset   , ctx->uvlinesize);
         dsp->get_pixels(ctx->blocks[7], ptr_v + ctx->dct_uv_offset   , ctx->uvlinesize);
     }
@@ -481,7 +591,7 @@ static int dnxhd_calc_bits_thread(AVCodecContext *avctx, void *arg, int jobnr, i
 
     ctx->last_dc[0] =
     ctx->last_dc[1] =
-    ctx->last_dc[2] = 1024;
+    ctx->last_dc[2] = 1 << (ctx->cid_table->bit_depth + 2);
 
     for (mb_x = 0; mb_x < ctx->mb_width; mb_x++) {
         unsigned mb = mb_y * ctx->mb_width + mb_x;
@@ -494,32 +604,185 @@ static int dnxhd_calc_bits_thread(AVCodecContext *avctx, void *arg, int jobnr, i
 
         for (i = 0; i < 8; i++) {
             DCTELEM *src_block = ctx->blocks[i];
-            int overflow, nbits, diff, last_index;
+            int overflow, last_index;
             int n = dnxhd_switch_matrix(ctx, i);
 
             memcpy(block, src_block, 64*sizeof(*block));
             last_index = ctx->dct_quantize(ctx, block, i, qscale, &overflow);
-            ac_bits += dnxhd_calc_ac_bits(ctx, block, last_index);
-
-            diff = block[0] - ctx->last_dc[n];
-            if (diff < 0) nbits = av_log2_16bit(-2*diff);
-            else          nbits = av_log2_16bit( 2*diff);
-            dc_bits += ctx->cid_table->dc_bits[nbits] + nbits;
-
+            ac_bits += ctx->calc_ac_bits(ctx, block, last_index);
+            dc_bits += dnxhd_calc_dc_bits(ctx, block[0] - ctx->last_dc[n]);
             ctx->last_dc[n] = block[0];
 
             if (avctx->mb_decision == FF_MB_DECISION_RD || !RC_VARIANCE) {
-                dnxhd_unquantize_c(ctx, block, i, qscale, last_index);
+                ctx->unquantize(ctx, block, i, qscale, last_index);
                 ctx->dsp.idct(block);
-                ssd += dnxhd_ssd_block(block, src_block);
+                ssd += ctx->ssd_block(block, src_block);
             }
         }
-        ctx->mb_rc[qscale][mb].ssd = ssd;
+        // keep distortion on the 8 bit scale so lambda stays meaningful
+        ctx->mb_rc[qscale][mb].ssd = ssd >> (2 * (ctx->cid_table->bit_depth - 8));
         ctx->mb_rc[qscale][mb].bits = ac_bits+dc_bits+12+8*ctx->vlc_bits[0];
     }
     return 0;
 }
 
+static void dnxhd_load_mb(DNXHDEncContext *ctx, int mb_x, int mb_y)
+{
+    int i;
+
+    dnxhd_get_blocks(ctx, mb_x, mb_y);
+    for (i = 0; i < 8; i++) {
+        memcpy(ctx->dct_blocks[i], ctx->blocks[i], 64*sizeof(DCTELEM));
+        ctx->dsp.fdct(ctx->dct_blocks[i]);
+    }
+}
+
+/**
+ * Fill mb_rc for qscales qlo to qhi of an MB loaded by dnxhd_load_mb().
+ * The DC coefficients do not depend on the qscale: their bits are counted
+ * once, with the MB coded at qlo, when update_dc is set.
+ */
+static void dnxhd_calc_rd_mb(DNXHDEncContext *ctx, int mb, int qlo, int qhi, int update_dc)
+{
+    LOCAL_ALIGNED_16(DCTELEM, block, [64]);
+    int q, i;
+
+    for (q = qlo; q <= qhi; q++) {
+        int ssd     = 0;
+        int ac_bits = 0;
+        int dc_bits = 0;
+
+        for (i = 0; i < 8; i++) {
+            int overflow, last_index;
+            int n = dnxhd_switch_matrix(ctx, i);
+
+            memcpy(block, ctx->dct_blocks[i], 64*sizeof(*block));
+            last_index = ctx->quantize(ctx, block, i, q, &overflow);
+            ac_bits += ctx->calc_ac_bits(ctx, block, last_index);
+            if (update_dc) {
+                dc_bits += dnxhd_calc_dc_bits(ctx, block[0] - ctx->last_dc[n]);
+                ctx->last_dc[n] = block[0];
+            }
+            ctx->unquantize(ctx, block, i, q, last_index);
+            ctx->dsp.idct(block);
+            ssd += ctx->ssd_block(block, ctx->blocks[i]);
+        }
+        if (update_dc) {
+            ctx->mb_dc_bits[mb] = dc_bits;
+            update_dc = 0;
+        }
+        ctx->mb_rc[q][mb].ssd  = ssd >> (2 * (ctx->cid_table->bit_depth - 8));
+        ctx->mb_rc[q][mb].bits = ac_bits+ctx->mb_dc_bits[mb]+12+8*ctx->vlc_bits[0];
+    }
+}
+
+static int dnxhd_calc_rd_thread(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    DNXHDEncContext *ctx = avctx->priv_data;
+    const uint8_t *pred = ctx->rd_qscale + ctx->cur_field * ctx->mb_num;
+    int window = ctx->rd_range;
+    int mb_y = jobnr, mb_x;
+    ctx = ctx->thread[threadnr];
+
+    ctx->last_dc[0] =
+    ctx->last_dc[1] =
+    ctx->last_dc[2] = 1 << (ctx->cid_table->bit_depth + 2);
+
+    for (mb_x = 0; mb_x < ctx->mb_width; mb_x++) {
+        unsigned mb = mb_y * ctx->mb_width + mb_x;
+        int qlo = 1, qhi = ctx->qmax;
+
+        if (window) {
+            qlo = FFMAX(pred[mb] - window, 1);
+            qhi = FFMIN(pred[mb] + window, ctx->qmax);
+        }
+        dnxhd_load_mb(ctx, mb_x, mb_y);
+        dnxhd_calc_rd_mb(ctx, mb, qlo, qhi, 1);
+        ctx->mb_qlo[mb] = qlo;
+        ctx->mb_qhi[mb] = qhi;
+    }
+    return 0;
+}
+
+static av_always_inline int dnxhd_rd_best_qscale(DNXHDEncContext *ctx, int mb, unsigned lambda)
+{
+    unsigned min = UINT_MAX;
+    int qscale = ctx->mb_qlo[mb];
+    int q;
+
+    for (q = ctx->mb_qlo[mb]; q <= ctx->mb_qhi[mb]; q++) {
+        unsigned score = ctx->mb_rc[q][mb].bits*lambda+(ctx->mb_rc[q][mb].ssd<<LAMBDA_FRAC_BITS);
+        if (score < min) {
+            min = score;
+            qscale = q;
+        }
+    }
+    return qscale;
+}
+
+/**
+ * Choose the qscales of an MB row for the lambda pointed to by arg.
+ * @return bits of the row, padded
+ */
+static int dnxhd_rd_row_thread(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    DNXHDEncContext *ctx = avctx->priv_data;
+    unsigned lambda = *(int *)arg;
+    int mb_y = jobnr, mb_x;
+    int bits = 0;
+
+    for (mb_x = 0; mb_x < ctx->mb_width; mb_x++) {
+        unsigned mb = mb_y * ctx->mb_width + mb_x;
+        int qscale = dnxhd_rd_best_qscale(ctx, mb, lambda);
+        bits += ctx->mb_rc[qscale][mb].bits;
+        ctx->mb_qscale[mb] = qscale;
+        ctx->mb_bits[mb] = ctx->mb_rc[qscale][mb].bits;
+    }
+    return (bits+31)&~31; // padding
+}
+
+/**
+ * Widen the searched qscales of the MBs of a row whose best qscale for the
+ * lambda pointed to by arg is at an edge of them, until it is inside them
+ * or at the limits.
+ * @return number of MBs widened
+ */
+static int dnxhd_rd_widen_thread(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    DNXHDEncContext *ctx = avctx->priv_data;
+    unsigned lambda = *(int *)arg;
+    int window = FFMAX(ctx->rd_range, 1);
+    int mb_y = jobnr, mb_x;
+    int widened = 0;
+    ctx = ctx->thread[threadnr];
+
+    for (mb_x = 0; mb_x < ctx->mb_width; mb_x++) {
+        unsigned mb = mb_y * ctx->mb_width + mb_x;
+        int loaded = 0;
+
+        for (;;) {
+            int qscale = dnxhd_rd_best_qscale(ctx, mb, lambda);
+            int qlo = ctx->mb_qlo[mb], qhi = ctx->mb_qhi[mb];
+
+            if (qscale == qlo && qlo > 1) {
+                qlo = FFMAX(qlo - window, 1);
+                qhi = ctx->mb_qlo[mb] - 1;
+                ctx->mb_qlo[mb] = qlo;
+            } else if (qscale == qhi && qhi < ctx->qmax) {
+                qlo = qhi + 1;
+                qhi = FFMIN(qhi + window, ctx->qmax);
+                ctx->mb_qhi[mb] = qhi;
+            } else
+                break;
+            if (!loaded++)
+                dnxhd_load_mb(ctx, mb_x, mb_y);
+            dnxhd_calc_rd_mb(ctx, mb, qlo, qhi, 0);
+        }
+        widened += !!loaded;
+    }
+    return widened;
+}
+
 static int dnxhd_encode_thread(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
 {
     DNXHDEncContext *ctx = avctx->priv_data;
@@ -529,7 +792,7 @@ static int dnxhd_encode_thread(AVCodecContext *avctx, void *arg, int jobnr, int
 
     ctx->last_dc[0] =
     ctx->last_dc[1] =
-    ctx->last_dc[2] = 1024;
+    ctx->last_dc[2] = 1 << (ctx->cid_table->bit_depth + 2);
     for (mb_x = 0; mb_x < ctx->mb_width; mb_x++) {
         unsigned mb = mb_y * ctx->mb_width + mb_x;
         int qscale = ctx->mb_qscale[mb];
@@ -580,28 +843,43 @@ static int dnxhd_mb_var_thread(AVCodecContext *avctx, void *arg, int jobnr, int
     int mb_y = jobnr, mb_x;
     ctx = ctx->thread[threadnr];
     for (mb_x = 0; mb_x < ctx->mb_width; mb_x++) {
-        unsigned mb  = mb_y * ctx->mb_width + mb_x;
-        uint8_t *pix = ctx->thread[0]->src[0] + ((mb_y<<4) * ctx->linesize) + (mb_x<<4);
-        int sum      = ctx->dsp.pix_sum(pix, ctx->linesize);
-        int varc     = (ctx->dsp.pix_norm1(pix, ctx->linesize) - (((unsigned)(sum*sum))>>8)+128)>>8;
+        unsigned mb = mb_y * ctx->mb_width + mb_x;
+        int varc;
+        if (ctx->cid_table->bit_depth == 10) {
+            const uint8_t *pix = ctx->thread[0]->src[0] + ((mb_y<<4) * ctx->linesize) + (mb_x<<5);
+            int64_t sum = 0, sqr = 0;
+            int i, j;
+            for (i = 0; i < 16; i++) {
+                const uint16_t *line = (const uint16_t *)(pix + i * ctx->linesize);
+                for (j = 0; j < 16; j++) {
+                    sum += line[j];
+                    sqr += line[j] * line[j];
+                }
+            }
+            // scaled down to the 8 bit variance range
+            varc = ((sqr - ((sum * sum) >> 8) + 128) >> 8) >> 4;
+        } else {
+            uint8_t *pix = ctx->thread[0]->src[0] + ((mb_y<<4) * ctx->linesize) + (mb_x<<4);
+            int sum      = ctx->dsp.pix_sum(pix, ctx->linesize);
+            varc         = (ctx->dsp.pix_norm1(pix, ctx->linesize) - (((unsigned)(sum*sum))>>8)+128)>>8;
+        }
         ctx->mb_cmp[mb].value = varc;
         ctx->mb_cmp[mb].mb = mb;
     }
     return 0;
 }
 
-static int dnxhd_encode_rdo(AVCodecContext *avctx, DNXHDEncContext *ctx)
+/**
+ * Find the lowest lambda for which the qscales of the MBs fit in the frame.
+ * @param lambda_p initial lambda, set to the last one tried
+ */
+static int dnxhd_find_lambda(AVCodecContext *avctx, DNXHDEncContext *ctx, int *lambda_p)
 {
-    int lambda, up_step, down_step;
+    int lambda = *lambda_p, up_step, down_step;
     int last_lower = INT_MAX, last_higher = 0;
-    int x, y, q;
+    int ret = 0, y;
 
-    for (q = 1; q <= ctx->qmax; q++) {
-        ctx->qscale = q;
-        avctx->execute2(avctx, dnxhd_calc_bits_thread, NULL, NULL, ctx->mb_height);
-    }
     up_step = down_step = 2<<LAMBDA_FRAC_BITS;
-    lambda = ctx->lambda;
 
     for (;;) {
         int bits = 0;
@@ -610,31 +888,14 @@ static int dnxhd_encode_rdo(AVCodecContext *avctx, DNXHDEncContext *ctx)
             lambda++;
             end = 1; // need to set final qscales/bits
         }
-        for (y = 0; y < ctx->mb_height; y++) {
-            for (x = 0; x < ctx->mb_width; x++) {
-                unsigned min = UINT_MAX;
-                int qscale = 1;
-                int mb = y*ctx->mb_width+x;
-                for (q = 1; q <= ctx->qmax; q++) {
-                    unsigned score = ctx->mb_rc[q][mb].bits*lambda+(ctx->mb_rc[q][mb].ssd<<LAMBDA_FRAC_BITS);
-                    if (score < min) {
-                        min = score;
-                        qscale = q;
-                    }
-                }
-                bits += ctx->mb_rc[qscale][mb].bits;
-                ctx->mb_qscale[mb] = qscale;
-                ctx->mb_bits[mb] = ctx->mb_rc[qscale][mb].bits;
-            }
-            bits = (bits+31)&~31; // padding
-            if (bits > ctx->frame_bits)
-                break;
-        }
+        avctx->execute2(avctx, dnxhd_rd_row_thread, &lambda, ctx->row_bits, ctx->mb_height);
+        for (y = 0; y < ctx->mb_height; y++)
+            bits += ctx->row_bits[y];
         //av_dlog(ctx->avctx, "lambda %d, up %u, down %u, bits %d, frame %d\n",
         //        lambda, last_higher, last_lower, bits, ctx->frame_bits);
         if (end) {
             if (bits > ctx->frame_bits)
-                return -1;
+                ret = -1;
             break;
         }
         if (bits < ctx->frame_bits) {
@@ -652,16 +913,106 @@ static int dnxhd_encode_rdo(AVCodecContext *avctx, DNXHDEncContext *ctx)
             last_higher = FFMAX(lambda, last_higher);
             if (last_lower != INT_MAX)
                 lambda = (lambda+last_lower)>>1;
-            else if ((int64_t)lambda + up_step > INT_MAX)
-                return -1;
-            else
+            else if ((int64_t)lambda + up_step > INT_MAX) {
+                ret = -1;
+                break;
+            } else
                 lambda += up_step;
             up_step = FFMIN((int64_t)up_step*5, INT_MAX);
             down_step = 1<<LAMBDA_FRAC_BITS;
         }
     }
+    *lambda_p = lambda;
+    return ret;
+}
+
+/**
+ * Search the qscales of the MBs minimizing the distortion at the frame size.
+ * The search starts from the lambda of the previous coding unit. When window
+ * is set, the qscales of each MB are first searched around the one of the
+ * previous coding unit of the same field. The searched qscales of the MBs
+ * are kept during each lambda search, so that the bits decrease with the
+ * lambda, and then widened where the best one is at their edge, until no
+ * MB needs it. If the frame does not fit, all qscales are searched.
+ */
+static int dnxhd_rd_search(AVCodecContext *avctx, DNXHDEncContext *ctx, int window)
+{
+    int lambda = ctx->lambda;
+    int ret, y;
+
+    ctx->rd_range = ctx->rd_history[ctx->cur_field] ? window : 0;
+    avctx->execute2(avctx, dnxhd_calc_rd_thread, NULL, NULL, ctx->mb_height);
+
+    for (;;) {
+        int widened = 0;
+        ret = dnxhd_find_lambda(avctx, ctx, &lambda);
+        if (!ctx->rd_range)
+            break;
+        if (ret < 0) {
+            // the qscales needed are too far, search them all
+            ctx->rd_range = 0;
+            avctx->execute2(avctx, dnxhd_calc_rd_thread, NULL, NULL, ctx->mb_height);
+            lambda = ctx->lambda;
+            continue;
+        }
+        avctx->execute2(avctx, dnxhd_rd_widen_thread, &lambda, ctx->row_bits, ctx->mb_height);
+        for (y = 0; y < ctx->mb_height; y++)
+            widened += ctx->row_bits[y];
+        if (!widened)
+            break;
+    }
+    if (ret < 0)
+        return ret;
     //av_dlog(ctx->avctx, "out lambda %d\n", lambda);
     ctx->lambda = lambda;
+    memcpy(ctx->rd_qscale + ctx->cur_field * ctx->mb_num, ctx->mb_qscale, ctx->mb_num);
+    ctx->rd_history[ctx->cur_field] = 1;
+    return 0;
+}
+
+static int64_t dnxhd_rd_ssd(DNXHDEncContext *ctx)
+{
+    int64_t ssd = 0;
+    int mb;
+    for (mb = 0; mb < ctx->mb_num; mb++)
+        ssd += ctx->mb_rc[ctx->mb_qscale[mb]][mb].ssd;
+    return ssd;
+}
+
+static int dnxhd_encode_rdo(AVCodecContext *avctx, DNXHDEncContext *ctx)
+{
+    unsigned lambda = ctx->lambda;
+    int64_t t0, t1, t2;
+    int ret;
+
+    if (!ctx->rd_bench)
+        return dnxhd_rd_search(avctx, ctx, ctx->rd_window);
+
+    /* the exhaustive search runs after the incremental one,
+     * whose results are kept for encoding and for the next frames */
+    t0 = dnxhd_read_time();
+    if ((ret = dnxhd_rd_search(avctx, ctx, ctx->rd_window)) < 0)
+        return ret;
+    t1 = dnxhd_read_time();
+    ctx->bench_ssd[0] += dnxhd_rd_ssd(ctx);
+    memcpy(ctx->bench_qscale, ctx->mb_qscale, ctx->mb_num*sizeof(*ctx->mb_qscale));
+    memcpy(ctx->bench_bits,   ctx->mb_bits,   ctx->mb_num*sizeof(*ctx->mb_bits));
+    FFSWAP(unsigned, lambda, ctx->lambda);
+
+    ret = dnxhd_rd_search(avctx, ctx, 0);
+    t2 = dnxhd_read_time();
+    if (ret < 0)
+        av_log(avctx, AV_LOG_WARNING, "exhaustive rd search failed\n");
+    else
+        ctx->bench_ssd[1] += dnxhd_rd_ssd(ctx);
+
+    ctx->lambda = lambda;
+    memcpy(ctx->mb_qscale, ctx->bench_qscale, ctx->mb_num*sizeof(*ctx->mb_qscale));
+    memcpy(ctx->mb_bits,   ctx->bench_bits,   ctx->mb_num*sizeof(*ctx->mb_bits));
+    memcpy(ctx->rd_qscale + ctx->cur_field * ctx->mb_num, ctx->mb_qscale, ctx->mb_num);
+    ctx->bench_time[0] += t1 - t0;
+    ctx->bench_time[1] += t2 - t1;
+    ctx->bench_units++;
     return 0;
 }
 
@@ -841,6 +1192,7 @@ static int dnxhd_encode_picture(AVCodecContext *avctx, unsigned char *buf, int b
     DNXHDEncContext *ctx = avctx->priv_data;
     int first_field = 1;
     int offset, i, ret;
+    int64_t start = ctx->rd_bench ? dnxhd_read_time() : 0;
 
     if (buf_size < ctx->cid_table->frame_size) {
         av_log(avctx, AV_LOG_ERROR, "output buffer is too small to compress picture\n");
@@ -894,6 +1246,9 @@ static int dnxhd_encode_picture(AVCodecContext *avctx, unsigned char *buf, int b
 
     ctx->frame.quality = ctx->qscale*FF_QP2LAMBDA;
 
+    if (ctx->rd_bench)
+        ctx->bench_time[2] += dnxhd_read_time() - start;
+
     return ctx->cid_table->frame_size;
 }
 
@@ -903,6 +1258,20 @@ static int dnxhd_encode_end(AVCodecContext *avctx)
     int max_level = 1<<(ctx->cid_table->bit_depth+2);
     int i;
 
+    if (ctx->bench_units) {
+        /* 512 samples per MB on the 8 bit scale */
+        double samples = ctx->bench_units * ctx->mb_num * 512.0;
+        double frames  = FFMAX(ctx->bench_units >> ctx->interlaced, 1);
+        av_log(avctx, AV_LOG_INFO, "rd search over %d coding units: "
+               "window %d: %.2f Mcycles/frame, PSNR %.3f dB, "
+               "exhaustive: %.2f Mcycles/frame, PSNR %.3f dB\n",
+               ctx->bench_units, ctx->rd_window,
+               (ctx->bench_time[2] - ctx->bench_time[1]) / (frames * 1000000),
+               10 * log10(255 * 255 * samples / FFMAX(ctx->bench_ssd[0], 1)),
+               (ctx->bench_time[2] - ctx->bench_time[0]) / (frames * 1000000),
+               10 * log10(255 * 255 * samples / FFMAX(ctx->bench_ssd[1], 1)));
+    }
+
     av_free(ctx->vlc_codes-max_level*2);
     av_free(ctx->vlc_bits -max_level*2);
     av_freep(&ctx->run_codes);
@@ -912,6 +1281,13 @@ static int dnxhd_encode_end(AVCodecContext *avctx)
     av_freep(&ctx->mb_qscale);
     av_freep(&ctx->mb_rc);
     av_freep(&ctx->mb_cmp);
+    av_freep(&ctx->mb_qlo);
+    av_freep(&ctx->mb_qhi);
+    av_freep(&ctx->mb_dc_bits);
+    av_freep(&ctx->rd_qscale);
+    av_freep(&ctx->row_bits);
+    av_freep(&ctx->bench_qscale);
+    av_freep(&ctx->bench_bits);
     av_freep(&ctx->slice_size);
     av_freep(&ctx->slice_offs);
 
@@ -919,6 +1295,7 @@ static int dnxhd_encode_end(AVCodecContext *avctx)
     av_freep(&ctx->qmatrix_l);
     av_freep(&ctx->qmatrix_c16);
     av_freep(&ctx->qmatrix_l16);
+    av_freep(&ctx->scan_mask);
 
     for (i = 1; i < avctx->thread_count; i++)
         av_freep(&ctx->thread[i]);
@@ -934,7 +1311,8 @@ AVCodec ff_dnxhd_encoder = {
     dnxhd_encode_init,
     dnxhd_encode_picture,
     dnxhd_encode_end,
-    .pix_fmts = (const enum PixelFormat[]){PIX_FMT_YUV422P, PIX_FMT_NONE},
+    .pix_fmts = (const enum PixelFormat[]){PIX_FMT_YUV422P, PIX_FMT_YUV422P10, PIX_FMT_NONE},
+    .capabilities = CODEC_CAP_FRAME_THREADS,
     .long_name = NULL_IF_CONFIG_SMALL("VC3/DNxHD"),
     .priv_class = &class,
 };
@@ -67,12 +67,17 @@ typedef struct DNXHDEncContext {
     unsigned min_padding;
 
     DECLARE_ALIGNED(16, DCTELEM, blocks)[8][64];
+    DECLARE_ALIGNED(16, DCTELEM, dct_blocks)[8][64]; ///< transformed blocks, quantized once per candidate qscale
 
     int      (*qmatrix_c)     [64];
     int      (*qmatrix_l)     [64];
     uint16_t (*qmatrix_l16)[2][64];
     uint16_t (*qmatrix_c16)[2][64];
 
+    DECLARE_ALIGNED(16, uint16_t, unquant_weight)[2][64]; ///< luma and chroma weights in coefficient order
+    DECLARE_ALIGNED(16, int32_t,  unquant_bias)  [2][64]; ///< rounding added to the dequantized coefficients
+    uint64_t (*scan_mask)[256]; ///< scan order bits of each byte of a coefficient order bit mask
+
     int (*q_intra_matrix)[64];
     uint16_t (*q_intra_matrix16)[2][64];
     int max_qcoeff; ///< maximum encodable coefficient
@@ -102,9 +107,33 @@ typedef struct DNXHDEncContext {
     RCCMPEntry *mb_cmp;
     RCEntry   (*mb_rc)[8160];
 
+    /** Rate distortion search */
+    int rd_window;           ///< qscales searched around the previous ones, 0 for all
+    int rd_range;            ///< window of the current search, 0 when exhaustive
+    uint8_t  *mb_qlo;        ///< lowest qscale of mb_rc computed for each MB
+    uint8_t  *mb_qhi;        ///< highest qscale of mb_rc computed for each MB
+    uint16_t *mb_dc_bits;
+    uint8_t  *rd_qscale;     ///< qscales chosen for the previous coding unit of each field
+    int rd_history[2];       ///< set when rd_qscale holds the qscales of a field
+    int *row_bits;
+
+    int rd_bench;            ///< compare the search with the exhaustive one
+    int bench_units;
+    int64_t bench_time[3];   ///< cycles of the incremental search, exhaustive search, whole encoding
+    int64_t bench_ssd[2];
+    uint8_t  *bench_qscale;
+    uint16_t *bench_bits;
+
     void (*get_pixels_8x4_sym)(DCTELEM */*align 16*/, const uint8_t *, int);
     int (*dct_quantize)(struct DNXHDEncContext *ctx, DCTELEM *block/*align 16*/,
                         int n, int qscale, int *overflow);
+    /** same as dct_quantize on a block already transformed by dsp.fdct */
+    int (*quantize)(struct DNXHDEncContext *ctx, DCTELEM *block/*align 16*/,
+                    int n, int qscale, int *overflow);
+    void (*unquantize)(struct DNXHDEncContext *ctx, DCTELEM *block/*align 16*/,
+                       int n, int qscale, int last_index);
+    int (*ssd_block)(DCTELEM *qblock/*align 16*/, DCTELEM *block/*align 16*/);
+    int (*calc_ac_bits)(struct DNXHDEncContext *ctx, DCTELEM *block/*align 16*/, int last_index);
     void (*denoise_dct)(struct DNXHDEncContext *ctx, DCTELEM *block);
 } DNXHDEncContext;
 
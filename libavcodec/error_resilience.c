@@ -32,6 +32,7 @@
 #include "mpegvideo.h"
 #include "h264.h"
 #include "rectangle.h"
+#include "thread.h"
 
 /*
  * H264 redefines mb_intra so it is not mistakely used (its uninitialized in h264)
@@ -642,6 +643,13 @@ static int is_intra_more_likely(MpegEncContext *s){
     if(CONFIG_MPEG_XVMC_DECODER && s->avctx->xvmc_acceleration && s->pict_type == FF_I_TYPE)
         return 1;
 
+    /* the sad check below reads the previous frame, which may still be decoded by another thread */
+    if(s->pict_type==FF_I_TYPE && HAVE_PTHREADS && (s->avctx->active_thread_type&FF_THREAD_FRAME)){
+        ff_thread_await_progress((AVFrame*)s->last_picture_ptr, INT_MAX, 0);
+        if(s->last_picture_ptr->field_picture)
+            ff_thread_await_progress((AVFrame*)s->last_picture_ptr, INT_MAX, 1);
+    }
+
     skip_amount= FFMAX(undamaged_count/50, 1); //check only upto 50 MBs
     is_intra_likely=0;
 
@@ -122,19 +122,14 @@ static av_always_inline void row_fdct(FLOAT temp[64], DCTELEM * data)
     }
 }
 
-void ff_faandct(DCTELEM * data)
+static av_always_inline void column_fdct(DCTELEM * data, FLOAT temp[64], const FLOAT scale)
 {
     FLOAT tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
     FLOAT tmp10, tmp11, tmp12, tmp13;
     FLOAT z2, z4, z11, z13;
     FLOAT av_unused z5;
-    FLOAT temp[64];
     int i;
 
-    emms_c();
-
-    row_fdct(temp, data);
-
     for (i=0; i<8; i++) {
         tmp0= temp[8*0 + i] + temp[8*7 + i];
         tmp7= temp[8*0 + i] - temp[8*7 + i];
@@ -150,13 +145,13 @@ void ff_faandct(DCTELEM * data)
         tmp11= tmp1 + tmp2;
         tmp12= tmp1 - tmp2;
 
-        data[8*0 + i]= lrintf(SCALE(8*0 + i) * (tmp10 + tmp11));
-        data[8*4 + i]= lrintf(SCALE(8*4 + i) * (tmp10 - tmp11));
+        data[8*0 + i]= lrintf(scale * SCALE(8*0 + i) * (tmp10 + tmp11));
+        data[8*4 + i]= lrintf(scale * SCALE(8*4 + i) * (tmp10 - tmp11));
 
         tmp12 += tmp13;
         tmp12 *= A1;
-        data[8*2 + i]= lrintf(SCALE(8*2 + i) * (tmp13 + tmp12));
-        data[8*6 + i]= lrintf(SCALE(8*6 + i) * (tmp13 - tmp12));
+        data[8*2 + i]= lrintf(scale * SCALE(8*2 + i) * (tmp13 + tmp12));
+        data[8*6 + i]= lrintf(scale * SCALE(8*6 + i) * (tmp13 - tmp12));
 
         tmp4 += tmp5;
         tmp5 += tmp6;
@@ -175,13 +170,37 @@ void ff_faandct(DCTELEM * data)
         z11= tmp7 + tmp5;
         z13= tmp7 - tmp5;
 
-        data[8*5 + i]= lrintf(SCALE(8*5 + i) * (z13 + z2));
-        data[8*3 + i]= lrintf(SCALE(8*3 + i) * (z13 - z2));
-        data[8*1 + i]= lrintf(SCALE(8*1 + i) * (z11 + z4));
-        data[8*7 + i]= lrintf(SCALE(8*7 + i) * (z11 - z4));
+        data[8*5 + i]= lrintf(scale * SCALE(8*5 + i) * (z13 + z2));
+        data[8*3 + i]= lrintf(scale * SCALE(8*3 + i) * (z13 - z2));
+        data[8*1 + i]= lrintf(scale * SCALE(8*1 + i) * (z11 + z4));
+        data[8*7 + i]= lrintf(scale * SCALE(8*7 + i) * (z11 - z4));
     }
 }
 
+void ff_faandct(DCTELEM * data)
+{
+    FLOAT temp[64];
+
+    emms_c();
+
+    row_fdct(temp, data);
+    column_fdct(data, temp, 1.0);
+}
+
+/**
+ * Same as ff_faandct() but output is scaled down by 2, so that
+ * the coefficients of 10 bit samples fit in a DCTELEM.
+ */
+void ff_faandct_10(DCTELEM * data)
+{
+    FLOAT temp[64];
+
+    emms_c();
+
+    row_fdct(temp, data);
+    column_fdct(data, temp, 0.5);
+}
+
 void ff_faandct248(DCTELEM * data)
 {
     FLOAT tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
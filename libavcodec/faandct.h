@@ -35,5 +35,6 @@
 
 void ff_faandct(DCTELEM * data);
 void ff_faandct248(DCTELEM * data);
+void ff_faandct_10(DCTELEM * data);
 
 #endif /* AVCODEC_FAANDCT_H */
@@ -505,6 +505,8 @@ typedef struct H264Context{
     Picture default_ref_list[2][32]; ///< base reference list for all slices of a coded picture
     Picture *delayed_pic[MAX_DELAYED_PIC_COUNT+2]; //FIXME size?
     int outputed_poc;
+    int next_outputed_poc;          ///< outputed_poc once the current picture has been output
+    Picture *next_output_pic;       ///< picture to return once the current one is decoded
 
     /**
      * memory management control operations buffer.
@@ -31,6 +31,7 @@
 #include "mpegvideo.h"
 #include "h264.h"
 #include "rectangle.h"
+#include "thread.h"
 
 //#undef NDEBUG
 #include <assert.h>
@@ -140,6 +141,32 @@ void ff_h264_direct_ref_list_init(H264Context * const h){
     }
 }
 
+/**
+ * Wait until the co-located macroblock row of the first list 1 reference
+ * has been decoded by its frame thread.
+ */
+static void await_reference_mb_row(H264Context * const h, Picture *ref, int mb_y)
+{
+    int ref_field_picture = ref->field_picture;
+    int ref_height = 16*h->s.mb_height >> ref_field_picture;
+    int line;
+
+    if(!HAVE_PTHREADS || !(h->s.avctx->active_thread_type&FF_THREAD_FRAME))
+        return;
+
+    //FIXME the mb data is available before the pixels are deblocked
+    line = FFMIN(16*mb_y >> ref_field_picture, ref_height-1);
+
+    if(!ref_field_picture){
+        ff_thread_await_progress((AVFrame*)ref, line, 0);
+    }else{
+        if(ref->reference & PICT_TOP_FIELD)
+            ff_thread_await_progress((AVFrame*)ref, line, 0);
+        if(ref->reference & PICT_BOTTOM_FIELD)
+            ff_thread_await_progress((AVFrame*)ref, line, 1);
+    }
+}
+
 static void pred_spatial_direct_motion(H264Context * const h, int *mb_type){
     MpegEncContext * const s = &h->s;
     int b8_stride = 2;
@@ -157,6 +184,8 @@ static void pred_spatial_direct_motion(H264Context * const h, int *mb_type){
 
     assert(h->ref_list[1][0].reference&3);
 
+    await_reference_mb_row(h, &h->ref_list[1][0], s->mb_y + !!IS_INTERLACED(*mb_type));
+
 #define MB_TYPE_16x16_OR_INTRA (MB_TYPE_16x16|MB_TYPE_INTRA4x4|MB_TYPE_INTRA16x16|MB_TYPE_INTRA_PCM)
 
 
@@ -394,6 +423,8 @@ static void pred_temp_direct_motion(H264Context * const h, int *mb_type){
 
     assert(h->ref_list[1][0].reference&3);
 
+    await_reference_mb_row(h, &h->ref_list[1][0], s->mb_y + !!IS_INTERLACED(*mb_type));
+
     if(IS_INTERLACED(h->ref_list[1][0].mb_type[mb_xy])){ // AFL/AFR/FR/FL -> AFL/FL
         if(!IS_INTERLACED(*mb_type)){                    //     AFR/FR    -> AFL/FL
             mb_xy= s->mb_x + ((s->mb_y&~1) + h->col_parity)*s->mb_stride;
@@ -0,0 +1,75 @@
+/*
+ * Audio channel interleaving
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+#include "config.h"
+#include "libavutil/attributes.h"
+#include "libavutil/intreadwrite.h"
+#include "interleavedsp.h"
+
+#define INTERLEAVE_DSP(bits)                                                  \
+void ff_interleave_##bits##_c(uint8_t *dst, const uint8_t *src,              \
+                              int plane_size, int len, int channels)          \
+{                                                                             \
+    int i, c;                                                                 \
+                                                                              \
+    for (c = 0; c < channels; c++) {                                          \
+        const uint8_t *s = src + c * plane_size;                              \
+        uint8_t *d = dst + c * (bits / 8);                                    \
+        for (i = 0; i < len; i++)                                             \
+            AV_WN##bits(d + i * channels * (bits / 8), AV_RN##bits(s + i * (bits / 8))); \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+static void deinterleave_##bits##_c(uint8_t *dst, const uint8_t *src,        \
+                                    int len, int channels)                    \
+{                                                                             \
+    int i;                                                                    \
+                                                                              \
+    if (channels == 1) {                                                      \
+        memcpy(dst, src, len * (bits / 8));                                   \
+        return;                                                               \
+    }                                                                         \
+    for (i = 0; i < len; i++)                                                 \
+        AV_WN##bits(dst + i * (bits / 8), AV_RN##bits(src + i * channels * (bits / 8))); \
+}
+
+#define AV_RN8 AV_RB8
+#define AV_WN8 AV_WB8
+
+INTERLEAVE_DSP(8)
+INTERLEAVE_DSP(16)
+INTERLEAVE_DSP(32)
+INTERLEAVE_DSP(64)
+
+av_cold void ff_interleavedsp_init(InterleaveDSPContext *c)
+{
+    c->interleave[0]   = ff_interleave_8_c;
+    c->interleave[1]   = ff_interleave_16_c;
+    c->interleave[2]   = ff_interleave_32_c;
+    c->interleave[3]   = ff_interleave_64_c;
+    c->deinterleave[0] = deinterleave_8_c;
+    c->deinterleave[1] = deinterleave_16_c;
+    c->deinterleave[2] = deinterleave_32_c;
+    c->deinterleave[3] = deinterleave_64_c;
+
+    if (HAVE_MMX)
+        ff_interleavedsp_init_x86(c);
+}
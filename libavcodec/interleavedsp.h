@@ -0,0 +1,56 @@
+/*
+ * Audio channel interleaving
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_INTERLEAVEDSP_H
+#define AVCODEC_INTERLEAVEDSP_H
+
+#include <stdint.h>
+
+typedef struct InterleaveDSPContext {
+    /**
+     * Interleave planar channels, the planes being plane_size bytes apart:
+     * sample i of channel c is copied from src + c * plane_size + i * size
+     * to dst + (i * channels + c) * size.
+     * Indexed by the log2 of the sample size, 1 to 8 bytes.
+     * No alignment constraint.
+     */
+    void (*interleave[4])(uint8_t *dst, const uint8_t *src, int plane_size,
+                          int len, int channels);
+    /**
+     * Copy one channel of interleaved samples to a plane:
+     * sample i is copied from src + i * channels * size to dst + i * size.
+     * Indexed by the log2 of the sample size, 1 to 8 bytes.
+     */
+    void (*deinterleave[4])(uint8_t *dst, const uint8_t *src, int len, int channels);
+} InterleaveDSPContext;
+
+void ff_interleave_8_c (uint8_t *dst, const uint8_t *src, int plane_size,
+                        int len, int channels);
+void ff_interleave_16_c(uint8_t *dst, const uint8_t *src, int plane_size,
+                        int len, int channels);
+void ff_interleave_32_c(uint8_t *dst, const uint8_t *src, int plane_size,
+                        int len, int channels);
+void ff_interleave_64_c(uint8_t *dst, const uint8_t *src, int plane_size,
+                        int len, int channels);
+
+void ff_interleavedsp_init    (InterleaveDSPContext *c);
+void ff_interleavedsp_init_x86(InterleaveDSPContext *c);
+
+#endif /* AVCODEC_INTERLEAVEDSP_H */
@@ -996,9 +996,10 @@ AVCodec ff_mpeg1video_encoder = {
     MPV_encode_end,
     .supported_framerates= ff_frame_rate_tab+1,
     .pix_fmts= (const enum PixelFormat[]){PIX_FMT_YUV420P, PIX_FMT_NONE},
-    .capabilities= CODEC_CAP_DELAY,
+    .capabilities= CODEC_CAP_DELAY | CODEC_CAP_FRAME_THREADS,
     .long_name= NULL_IF_CONFIG_SMALL("MPEG-1 video"),
     .priv_class = &class,
+    .update_thread_context = ONLY_IF_THREADS_ENABLED(ff_mpv_encode_update_thread_context),
 };
 
 AVCodec ff_mpeg2video_encoder = {
@@ -1011,7 +1012,8 @@ AVCodec ff_mpeg2video_encoder = {
     MPV_encode_end,
     .supported_framerates= ff_frame_rate_tab+1,
     .pix_fmts= (const enum PixelFormat[]){PIX_FMT_YUV420P, PIX_FMT_YUV422P, PIX_FMT_NONE},
-    .capabilities= CODEC_CAP_DELAY,
+    .capabilities= CODEC_CAP_DELAY | CODEC_CAP_FRAME_THREADS,
     .long_name= NULL_IF_CONFIG_SMALL("MPEG-2 video"),
     .priv_class = &class,
+    .update_thread_context = ONLY_IF_THREADS_ENABLED(ff_mpv_encode_update_thread_context),
 };
@@ -1244,6 +1244,24 @@ int MPV_encode_picture(AVCodecContext *avctx,
         init_put_bits(&s->thread_context[i]->pb, start, end - start);
     }
 
+    if (avctx->active_thread_type & FF_THREAD_GOP) {
+        /* each GOP is sent from its first frame to the end of the flush,
+         * the GOPs before it are encoded by the other threads */
+        if (!pic_arg) {
+            s->gop_open = 0;
+        } else if (!s->gop_open) {
+            s->gop_open = 1;
+            s->input_picture_number =
+            s->coded_picture_number = avctx->frame_number;
+            ff_rate_control_thread_sync(s);
+        }
+    } else if (avctx->active_thread_type & FF_THREAD_FRAME) {
+        /* the frames in between are encoded by the other threads */
+        s->input_picture_number =
+        s->coded_picture_number = avctx->frame_number;
+        ff_rate_control_thread_sync(s);
+    }
+
     s->picture_in_gop_number++;
 
     if(load_input_picture(s, pic_arg) < 0)
@@ -1378,6 +1396,12 @@ vbv_retry:
     return s->frame_bits/8;
 }
 
+int ff_mpv_encode_update_thread_context(AVCodecContext *dst, const AVCodecContext *src)
+{
+    ff_rate_control_update_thread_context(dst->priv_data, src->priv_data);
+    return 0;
+}
+
 static inline void dct_single_coeff_elimination(MpegEncContext *s, int n, int threshold)
 {
     static const char tab[64]=
@@ -104,6 +104,19 @@ typedef struct PerThreadContext {
     uint8_t progress_used[MAX_BUFFERS];
 
     AVFrame *requested_frame;       ///< AVFrame the codec passed to get_buffer()
+
+    /**
+     * GOP threading: input frames and output packets of the GOP.
+     * Packets are stored one after the other in gop_buf.
+     */
+    AVFrame  *gop_frames;
+    AVFrame  *gop_coded;            ///< coded_frame of each packet.
+    int      *gop_sizes;            ///< Size of each packet, one per frame.
+    uint8_t  *gop_buf;
+    unsigned  gop_buf_size;
+    int       nb_gop_frames;        ///< Number of frames of the GOP received so far.
+    int       gop_output;           ///< Next packet to return.
+    int       gop_offset;           ///< Offset of the next packet in gop_buf.
 } PerThreadContext;
 
 /**
@@ -112,6 +125,7 @@ typedef struct PerThreadContext {
 typedef struct FrameThreadContext {
     PerThreadContext *threads;     ///< The contexts for each thread.
     PerThreadContext *prev_thread; ///< The last thread submit_packet() was called on.
+    PerThreadContext *prev_output; ///< The last thread an encoded frame was returned from.
 
     pthread_mutex_t buffer_mutex;  ///< Mutex used to protect get/release_buffer().
 
@@ -272,6 +286,53 @@ static int thread_init(AVCodecContext *avctx)
     return 0;
 }
 
+/**
+ * Encode the GOP received by the thread and flush the encoder, keeping the
+ * packets in the thread. One packet is stored per input frame, empty ones
+ * standing for the frames the encoder did not output.
+ */
+static int encode_gop(PerThreadContext *p)
+{
+    AVCodecContext *avctx = p->avctx;
+    AVCodec *codec = avctx->codec;
+    uint8_t *buf;
+    int i, size, nb_packets = 0, offset = 0;
+
+    for (i = 0; ; i++) {
+        AVFrame *pict = i < p->nb_gop_frames ? &p->gop_frames[i] : NULL;
+
+        size = codec->encode(avctx, p->avpkt.data, p->avpkt.size, pict);
+        emms_c();
+        if (size < 0)
+            return size;
+        if (!size) {
+            if (!pict) break;
+            continue;
+        }
+        if (nb_packets >= p->nb_gop_frames) {
+            av_log(avctx, AV_LOG_ERROR, "more packets than frames in a GOP\n");
+            return -1;
+        }
+
+        buf = av_fast_realloc(p->gop_buf, &p->gop_buf_size, offset + size);
+        if (!buf)
+            return AVERROR(ENOMEM);
+        p->gop_buf = buf;
+        memcpy(p->gop_buf + offset, p->avpkt.data, size);
+        offset += size;
+
+        p->gop_sizes[nb_packets] = size;
+        p->gop_coded[nb_packets] = *avctx->coded_frame;
+        memset(p->gop_coded[nb_packets].data, 0, sizeof(p->gop_coded[nb_packets].data));
+        nb_packets++;
+    }
+
+    for (; nb_packets < p->nb_gop_frames; nb_packets++)
+        p->gop_sizes[nb_packets] = 0;
+
+    return 0;
+}
+
 /**
  * Codec worker thread.
  *
@@ -296,14 +357,24 @@ static attribute_align_arg void *frame_worker_thread(void *arg)
 
         if (fctx->die) break;
 
-        if (!codec->update_thread_context) ff_thread_finish_setup(avctx);
+        if (codec->encode) {
+            pthread_mutex_lock(&p->mutex);
+            if (avctx->active_thread_type & FF_THREAD_GOP) {
+                p->result = encode_gop(p);
+            } else {
+                p->result = codec->encode(avctx, p->avpkt.data, p->avpkt.size, &p->frame);
+                emms_c();
+            }
+        } else {
+            if (!codec->update_thread_context) ff_thread_finish_setup(avctx);
 
-        pthread_mutex_lock(&p->mutex);
-        avcodec_get_frame_defaults(&p->frame);
-        p->got_frame = 0;
-        p->result = codec->decode(avctx, &p->frame, &p->got_frame, &p->avpkt);
+            pthread_mutex_lock(&p->mutex);
+            avcodec_get_frame_defaults(&p->frame);
+            p->got_frame = 0;
+            p->result = codec->decode(avctx, &p->frame, &p->got_frame, &p->avpkt);
 
-        if (p->state == STATE_SETTING_UP) ff_thread_finish_setup(avctx);
+            if (p->state == STATE_SETTING_UP) ff_thread_finish_setup(avctx);
+        }
 
         p->state = STATE_INPUT_READY;
 
@@ -561,6 +632,281 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
     return p->result;
 }
 
+/**
+ * Copy the user's picture pict to frame, allocating it on first use.
+ * The caller may reuse its picture as soon as we return.
+ */
+static int copy_frame(AVCodecContext *avctx, AVFrame *frame, const AVFrame *pict)
+{
+    if (!frame->data[0] &&
+        avpicture_alloc((AVPicture*)frame, avctx->pix_fmt, avctx->width, avctx->height) < 0)
+        return AVERROR(ENOMEM);
+
+    av_picture_copy((AVPicture*)frame, (const AVPicture*)pict,
+                    avctx->pix_fmt, avctx->width, avctx->height);
+    frame->pts              = pict->pts;
+    frame->key_frame        = pict->key_frame;
+    frame->pict_type        = pict->pict_type;
+    frame->quality          = pict->quality;
+    frame->repeat_pict      = pict->repeat_pict;
+    frame->interlaced_frame = pict->interlaced_frame;
+    frame->top_field_first  = pict->top_field_first;
+    frame->reordered_opaque = pict->reordered_opaque;
+    frame->opaque           = pict->opaque;
+
+    return 0;
+}
+
+static int submit_frame(PerThreadContext *p, const AVFrame *pict, int buf_size)
+{
+    AVCodecContext *avctx = p->avctx;
+    int err;
+
+    pthread_mutex_lock(&p->mutex);
+
+    av_fast_malloc(&p->avpkt.data, &p->allocated_buf_size, buf_size);
+    if (!p->avpkt.data) {
+        pthread_mutex_unlock(&p->mutex);
+        return AVERROR(ENOMEM);
+    }
+    p->avpkt.size = buf_size;
+
+    err = copy_frame(avctx, &p->frame, pict);
+    if (err) {
+        pthread_mutex_unlock(&p->mutex);
+        return err;
+    }
+
+    p->got_frame = 1;
+    p->state = STATE_SETTING_UP;
+    pthread_cond_signal(&p->input_cond);
+    pthread_mutex_unlock(&p->mutex);
+
+    return 0;
+}
+
+/**
+ * Start encoding the GOP collected by p, from the state after the last
+ * GOP returned, such as rate control.
+ */
+static int submit_gop(PerThreadContext *p)
+{
+    FrameThreadContext *fctx = p->parent;
+    AVCodec *codec = p->avctx->codec;
+
+    if (fctx->prev_output && fctx->prev_output != p && codec->update_thread_context) {
+        int err = codec->update_thread_context(p->avctx, fctx->prev_output->avctx);
+        if (err) return err;
+    }
+
+    pthread_mutex_lock(&p->mutex);
+    p->gop_output = 0;
+    p->gop_offset = 0;
+    p->got_frame  = 1;
+    p->state = STATE_SETTING_UP;
+    pthread_cond_signal(&p->input_cond);
+    pthread_mutex_unlock(&p->mutex);
+
+    return 0;
+}
+
+/**
+ * ff_thread_encode_video() with GOP threading.
+ * Frames are collected GOP by GOP, and each GOP is encoded by the next
+ * thread once complete. Packets are returned one per frame, thread_count - 1
+ * GOPs late, while flushing only the non empty ones are returned.
+ */
+static int encode_video_gop(AVCodecContext *avctx, uint8_t *buf, int buf_size,
+                            const AVFrame *pict)
+{
+    FrameThreadContext *fctx = avctx->thread_opaque;
+    AVCodec *codec = avctx->codec;
+    PerThreadContext *p = &fctx->threads[fctx->next_decoding];
+    int size, err;
+
+    /*
+     * Add the picture to the GOP being collected, and start encoding the GOP
+     * when it is complete or at the end of the stream.
+     */
+
+    if (pict) {
+        AVFrame *frame;
+
+        if (!p->nb_gop_frames) {
+            update_context_from_user(p->avctx, avctx);
+
+            av_fast_malloc(&p->avpkt.data, &p->allocated_buf_size, buf_size);
+            if (!p->avpkt.data)
+                return AVERROR(ENOMEM);
+            p->avpkt.size = buf_size;
+        }
+
+        frame = &p->gop_frames[p->nb_gop_frames];
+        err = copy_frame(p->avctx, frame, pict);
+        if (err) return err;
+        if (frame->pts == AV_NOPTS_VALUE)
+            frame->pts = avctx->frame_number;
+        /* a closed GOP starts with an intra frame */
+        if (!p->nb_gop_frames)
+            frame->pict_type = FF_I_TYPE;
+
+        if (++p->nb_gop_frames == avctx->gop_size) {
+            err = submit_gop(p);
+            if (err) return err;
+            if (++fctx->next_decoding >= avctx->thread_count) fctx->next_decoding = 0;
+        }
+
+        if (avctx->frame_number < (avctx->thread_count - 1) * avctx->gop_size)
+            return 0;
+    } else if (p->nb_gop_frames && !p->got_frame) {
+        err = submit_gop(p);
+        if (err) return err;
+        if (++fctx->next_decoding >= avctx->thread_count) fctx->next_decoding = 0;
+    }
+
+    /*
+     * Return the next packet of the oldest GOP.
+     */
+
+    do {
+        p = &fctx->threads[fctx->next_finished];
+        if (!p->got_frame)
+            return 0;
+
+        if (p->state != STATE_INPUT_READY) {
+            pthread_mutex_lock(&p->progress_mutex);
+            while (p->state != STATE_INPUT_READY)
+                pthread_cond_wait(&p->output_cond, &p->progress_mutex);
+            pthread_mutex_unlock(&p->progress_mutex);
+        }
+        if (p->result < 0)
+            return p->result;
+
+        /*
+         * Carry the rate control state from the previous GOP once
+         * the first packet of this one is returned.
+         */
+
+        if (!p->gop_output) {
+            if (codec->update_thread_context) {
+                err = codec->update_thread_context(p->avctx, fctx->prev_output ?
+                                                   fctx->prev_output->avctx : p->avctx);
+                if (err) return err;
+            }
+            fctx->prev_output = p;
+        }
+
+        size = p->gop_sizes[p->gop_output];
+        if (size > buf_size) {
+            av_log(avctx, AV_LOG_ERROR, "encoded frame too large for the output buffer\n");
+            return -1;
+        }
+        if (size > 0) {
+            memcpy(buf, p->gop_buf + p->gop_offset, size);
+            avctx->coded_frame = &p->gop_coded[p->gop_output];
+            avctx->frame_bits  = size * 8;
+            if (avctx->flags & CODEC_FLAG_PSNR) {
+                int i;
+                for (i = 0; i < 4; i++)
+                    avctx->error[i] += avctx->coded_frame->error[i];
+            }
+        }
+        p->gop_offset += size;
+
+        if (++p->gop_output == p->nb_gop_frames) {
+            p->nb_gop_frames = 0;
+            p->got_frame = 0;
+            if (++fctx->next_finished >= avctx->thread_count) fctx->next_finished = 0;
+        }
+    } while (!pict && !size);
+
+    return size;
+}
+
+int ff_thread_encode_video(AVCodecContext *avctx, uint8_t *buf, int buf_size,
+                           const AVFrame *pict)
+{
+    FrameThreadContext *fctx = avctx->thread_opaque;
+    AVCodec *codec = avctx->codec;
+    PerThreadContext *p;
+    int err, i;
+
+    if (avctx->active_thread_type & FF_THREAD_GOP)
+        return encode_video_gop(avctx, buf, buf_size, pict);
+
+    /*
+     * Submit the picture to the next encoding thread.
+     */
+
+    if (pict) {
+        p = &fctx->threads[fctx->next_decoding];
+        update_context_from_user(p->avctx, avctx);
+        err = submit_frame(p, pict, buf_size);
+        if (err) return err;
+
+        fctx->next_decoding++;
+
+        /*
+         * If we're still receiving the initial frames, don't return a packet.
+         */
+
+        if (fctx->delaying) {
+            if (fctx->next_decoding >= (avctx->thread_count-1)) fctx->delaying = 0;
+
+            return 0;
+        }
+
+        if (fctx->next_decoding >= avctx->thread_count) fctx->next_decoding = 0;
+    }
+
+    /*
+     * Return the packet of the oldest frame, in the order the frames
+     * were submitted. At the end of the stream, there is nothing left
+     * to return once all threads are idle.
+     */
+
+    p = &fctx->threads[fctx->next_finished];
+    if (!p->got_frame)
+        return 0;
+
+    if (p->state != STATE_INPUT_READY) {
+        pthread_mutex_lock(&p->progress_mutex);
+        while (p->state != STATE_INPUT_READY)
+            pthread_cond_wait(&p->output_cond, &p->progress_mutex);
+        pthread_mutex_unlock(&p->progress_mutex);
+    }
+
+    p->got_frame = 0;
+    if (++fctx->next_finished >= avctx->thread_count) fctx->next_finished = 0;
+
+    /*
+     * Let the codec carry the state which has to follow the frames
+     * in order, such as rate control, from the previous frame's thread.
+     */
+
+    if (codec->update_thread_context) {
+        err = codec->update_thread_context(p->avctx, fctx->prev_output ?
+                                           fctx->prev_output->avctx : p->avctx);
+        if (err) return err;
+    }
+    fctx->prev_output = p;
+
+    update_context_from_thread(avctx, p->avctx, 1);
+
+    if (p->result > buf_size) {
+        av_log(avctx, AV_LOG_ERROR, "encoded frame too large for the output buffer\n");
+        return -1;
+    }
+    if (p->result > 0)
+        memcpy(buf, p->avpkt.data, p->result);
+
+    if ((avctx->flags & CODEC_FLAG_PSNR) && avctx->coded_frame)
+        for (i = 0; i < 4; i++)
+            avctx->error[i] += avctx->coded_frame->error[i];
+
+    return p->result;
+}
+
 void ff_thread_report_progress(AVFrame *f, int n, int field)
 {
     PerThreadContext *p;
@@ -647,7 +993,7 @@ static void frame_thread_free(AVCodecContext *avctx, int thread_count)
 
         pthread_join(p->thread, NULL);
 
-        if (codec->close)
+        if (codec->close && p->avctx->priv_data)
             codec->close(p->avctx);
 
         avctx->codec = NULL;
@@ -659,6 +1005,17 @@ static void frame_thread_free(AVCodecContext *avctx, int thread_count)
         PerThreadContext *p = &fctx->threads[i];
 
         avcodec_default_free_buffers(p->avctx);
+        if (codec->encode)
+            avpicture_free((AVPicture*)&p->frame);
+        if (p->gop_frames) {
+            int j;
+            for (j = 0; j < avctx->gop_size; j++)
+                avpicture_free((AVPicture*)&p->gop_frames[j]);
+        }
+        av_freep(&p->gop_frames);
+        av_freep(&p->gop_coded);
+        av_freep(&p->gop_sizes);
+        av_freep(&p->gop_buf);
 
         pthread_mutex_destroy(&p->mutex);
         pthread_mutex_destroy(&p->progress_mutex);
@@ -667,8 +1024,10 @@ static void frame_thread_free(AVCodecContext *avctx, int thread_count)
         pthread_cond_destroy(&p->output_cond);
         av_freep(&p->avpkt.data);
 
-        if (i)
+        if (i || codec->encode)
             av_freep(&p->avctx->priv_data);
+        if (codec->encode)
+            av_freep(&p->avctx->extradata);
 
         av_freep(&p->avctx);
     }
@@ -709,7 +1068,49 @@ static int frame_thread_init(AVCodecContext *avctx)
         copy->thread_opaque = p;
         copy->pkt = &p->avpkt;
 
-        if (!i) {
+        if (codec->encode) {
+            /*
+             * Encoder threads have no shared state, each one is initialized
+             * from the user's settings and encodes its frames by itself.
+             */
+            copy->thread_count   = 1;
+            copy->extradata      = NULL;
+            copy->extradata_size = 0;
+            copy->priv_data      = NULL;
+
+            if (avctx->active_thread_type & FF_THREAD_GOP) {
+                p->gop_frames = av_mallocz(avctx->gop_size * sizeof(*p->gop_frames));
+                p->gop_coded  = av_mallocz(avctx->gop_size * sizeof(*p->gop_coded));
+                p->gop_sizes  = av_mallocz(avctx->gop_size * sizeof(*p->gop_sizes));
+                if (!p->gop_frames || !p->gop_coded || !p->gop_sizes) {
+                    err = AVERROR(ENOMEM);
+                    goto error;
+                }
+            }
+
+            /* global headers must be identical in every thread */
+            if (avctx->extradata_size) {
+                copy->extradata = av_mallocz(avctx->extradata_size + FF_INPUT_BUFFER_PADDING_SIZE);
+                if (!copy->extradata) {
+                    err = AVERROR(ENOMEM);
+                    goto error;
+                }
+                memcpy(copy->extradata, avctx->extradata, avctx->extradata_size);
+                copy->extradata_size = avctx->extradata_size;
+            }
+
+            copy->priv_data = av_malloc(codec->priv_data_size);
+            if (!copy->priv_data) {
+                err = AVERROR(ENOMEM);
+                goto error;
+            }
+            memcpy(copy->priv_data, avctx->priv_data, codec->priv_data_size);
+
+            err = codec->init(copy);
+
+            if (!i)
+                update_context_from_thread(avctx, copy, 1);
+        } else if (!i) {
             src = copy;
 
             if (codec->init)
@@ -778,7 +1179,8 @@ int ff_thread_get_buffer(AVCodecContext *avctx, AVFrame *f)
 
     f->owner = avctx;
 
-    if (!(avctx->active_thread_type&FF_THREAD_FRAME)) {
+    /* encoding threads do not share pictures */
+    if (!(avctx->active_thread_type&FF_THREAD_FRAME) || avctx->codec->encode) {
         f->thread_opaque = NULL;
         return avctx->get_buffer(avctx, f);
     }
@@ -832,7 +1234,7 @@ void ff_thread_release_buffer(AVCodecContext *avctx, AVFrame *f)
 {
     PerThreadContext *p = avctx->thread_opaque;
 
-    if (!(avctx->active_thread_type&FF_THREAD_FRAME)) {
+    if (!(avctx->active_thread_type&FF_THREAD_FRAME) || avctx->codec->encode) {
         avctx->release_buffer(avctx, f);
         return;
     }
@@ -850,12 +1252,26 @@ void ff_thread_release_buffer(AVCodecContext *avctx, AVFrame *f)
     memset(f->data, 0, sizeof(f->data));
 }
 
+int ff_thread_get_index(AVCodecContext *avctx)
+{
+    PerThreadContext *p = avctx->thread_opaque;
+
+    if (!(avctx->active_thread_type&FF_THREAD_FRAME)) return 0;
+
+    return p - p->parent->threads;
+}
+
 /**
  * Set the threading algorithms used.
  *
  * Threading requires more than one thread.
  * Frame threading requires entire frames to be passed to the codec,
  * and introduces extra decoding delay, so is incompatible with low_delay.
+ * Encoders can only be frame threaded when every frame is coded by itself:
+ * codecs with a delay must be intra-only, and two-pass rate control needs
+ * the statistics of the frames in order.
+ * GOP threading needs GOPs which can be coded by themselves and no VBV
+ * buffer, and is only used when requested.
  *
  * @param avctx The context.
  */
@@ -865,8 +1281,32 @@ static void validate_thread_parameters(AVCodecContext *avctx)
                                 && !(avctx->flags & CODEC_FLAG_TRUNCATED)
                                 && !(avctx->flags & CODEC_FLAG_LOW_DELAY)
                                 && !(avctx->flags2 & CODEC_FLAG2_CHUNKS);
+    int gop_threading_supported = avctx->codec->encode
+                                && (avctx->codec->capabilities & CODEC_CAP_FRAME_THREADS)
+                                && (avctx->codec->capabilities & CODEC_CAP_DELAY)
+                                && avctx->gop_size > 1
+                                && (avctx->flags & CODEC_FLAG_CLOSED_GOP)
+                                && (avctx->flags2 & CODEC_FLAG2_STRICT_GOP)
+                                && !(avctx->flags & (CODEC_FLAG_PASS1|CODEC_FLAG_PASS2));
+    /* Frame threading delays the packets of encoders without CODEC_CAP_DELAY,
+     * so it must be requested explicitly rather than through the default
+     * thread_type. */
+    if (avctx->codec->encode)
+        frame_threading_supported = (avctx->codec->capabilities & CODEC_CAP_FRAME_THREADS)
+                                && !(avctx->thread_type & FF_THREAD_SLICE)
+                                && !(avctx->flags & (CODEC_FLAG_PASS1|CODEC_FLAG_PASS2))
+                                && (!(avctx->codec->capabilities & CODEC_CAP_DELAY) || avctx->gop_size <= 1);
+    /* the VBV fullness, vbv_delay and stuffing of a GOP depend on the exact
+     * size of the GOPs before it, which are still being encoded */
+    if (gop_threading_supported && avctx->rc_buffer_size) {
+        if (avctx->thread_count > 1 && (avctx->thread_type & FF_THREAD_GOP))
+            av_log(avctx, AV_LOG_WARNING, "GOP threading is not supported with a VBV buffer\n");
+        gop_threading_supported = 0;
+    }
     if (avctx->thread_count == 1) {
         avctx->active_thread_type = 0;
+    } else if (gop_threading_supported && (avctx->thread_type & FF_THREAD_GOP)) {
+        avctx->active_thread_type = FF_THREAD_FRAME|FF_THREAD_GOP;
     } else if (frame_threading_supported && (avctx->thread_type & FF_THREAD_FRAME)) {
         avctx->active_thread_type = FF_THREAD_FRAME;
     } else {
@@ -125,6 +125,8 @@ int ff_rate_control_init(MpegEncContext *s)
         rcc->last_qscale_for[i]=FF_QP2LAMBDA * 5;
     }
     rcc->buffer_index= s->avctx->rc_initial_buffer_occupancy;
+    rcc->returned_buffer_index= rcc->buffer_index;
+    rcc->gop_returned= 1;
 
     if(s->flags&CODEC_FLAG_PASS2){
         int i;
@@ -263,42 +265,114 @@ void ff_rate_control_uninit(MpegEncContext *s)
 #endif
 }
 
-int ff_vbv_update(MpegEncContext *s, int frame_size){
-    RateControlContext *rcc= &s->rc_context;
+/**
+ * Update the fullness *buffer_index of the VBV buffer for a frame of frame_size bits.
+ * @return the number of stuffing bits needed to avoid an overflow
+ */
+static int vbv_update(MpegEncContext *s, double *buffer_index, int frame_size){
     const double fps= 1/av_q2d(s->avctx->time_base);
     const int buffer_size= s->avctx->rc_buffer_size;
     const double min_rate= s->avctx->rc_min_rate/fps;
     const double max_rate= s->avctx->rc_max_rate/fps;
 
-//printf("%d %f %d %f %f\n", buffer_size, rcc->buffer_index, frame_size, min_rate, max_rate);
+//printf("%d %f %d %f %f\n", buffer_size, *buffer_index, frame_size, min_rate, max_rate);
     if(buffer_size){
         int left;
 
-        rcc->buffer_index-= frame_size;
-        if(rcc->buffer_index < 0){
+        *buffer_index-= frame_size;
+        if(*buffer_index < 0){
             av_log(s->avctx, AV_LOG_ERROR, "rc buffer underflow\n");
-            rcc->buffer_index= 0;
+            *buffer_index= 0;
         }
 
-        left= buffer_size - rcc->buffer_index - 1;
-        rcc->buffer_index += av_clip(left, min_rate, max_rate);
+        left= buffer_size - *buffer_index - 1;
+        *buffer_index += av_clip(left, min_rate, max_rate);
 
-        if(rcc->buffer_index > buffer_size){
-            int stuffing= rcc->buffer_index - buffer_size;
+        if(*buffer_index > buffer_size){
+            int stuffing= *buffer_index - buffer_size;
 
             if(stuffing < 32 && s->codec_id == CODEC_ID_MPEG4)
                 stuffing = 32;
-            rcc->buffer_index -= stuffing;
+            *buffer_index -= stuffing;
 
-            if(s->avctx->debug & FF_DEBUG_RC)
-                av_log(s->avctx, AV_LOG_DEBUG, "stuffing %d bytes\n", stuffing>>3);
-
-            return stuffing>>3;
+            return stuffing;
         }
     }
     return 0;
 }
 
+int ff_vbv_update(MpegEncContext *s, int frame_size){
+    int stuffing= vbv_update(s, &s->rc_context.buffer_index, frame_size);
+
+    if(stuffing && s->avctx->debug & FF_DEBUG_RC)
+        av_log(s->avctx, AV_LOG_DEBUG, "stuffing %d bytes\n", stuffing>>3);
+
+    return stuffing>>3;
+}
+
+/**
+ * With frame threading, start the next frame from the state after the
+ * frames returned to the user so far. The frames still being encoded by
+ * the other threads are assumed to hit their target size, which is exact
+ * for CBR streams stuffed to the buffer size such as IMX.
+ */
+void ff_rate_control_thread_sync(MpegEncContext *s){
+    RateControlContext *rcc= &s->rc_context;
+    int pending= s->avctx->frame_number - rcc->returned_frames;
+
+    s->total_bits= rcc->returned_bits + llrint(pending * s->bit_rate * av_q2d(s->avctx->time_base));
+    rcc->buffer_index= rcc->returned_buffer_index;
+
+    rcc->gop_start_bits        = s->total_bits;
+    rcc->gop_start_frame       = s->avctx->frame_number;
+    rcc->gop_returned          = 0;
+}
+
+/**
+ * Account for the frame just returned from dst, src being the context the
+ * previous frame was returned from, or dst itself for the first frame.
+ * With GOP threading, account for the whole GOP returned from dst instead,
+ * or when dst is about to start a GOP, take the state after the GOPs
+ * returned so far from src.
+ */
+void ff_rate_control_update_thread_context(MpegEncContext *dst, const MpegEncContext *src){
+    RateControlContext *rcc= &dst->rc_context;
+
+    if(dst->avctx->active_thread_type & FF_THREAD_GOP){
+        /* there is no VBV buffer to account, see validate_thread_parameters() */
+        rcc->returned_bits        = src->rc_context.returned_bits;
+        rcc->returned_frames      = src->rc_context.returned_frames;
+        if(!rcc->gop_returned){
+            rcc->returned_bits        += dst->total_bits - rcc->gop_start_bits;
+            rcc->returned_frames      += dst->input_picture_number - rcc->gop_start_frame;
+            rcc->gop_returned= 1;
+        }else{
+            /* start the GOP from the model of the last GOP returned,
+             * instead of the one dst left thread_count GOPs ago */
+            const RateControlContext *src_rcc= &src->rc_context;
+
+            memcpy(rcc->pred, src_rcc->pred, sizeof(rcc->pred));
+            rcc->short_term_qsum       = src_rcc->short_term_qsum;
+            rcc->short_term_qcount     = src_rcc->short_term_qcount;
+            rcc->pass1_rc_eq_output_sum= src_rcc->pass1_rc_eq_output_sum;
+            rcc->pass1_wanted_bits     = src_rcc->pass1_wanted_bits;
+            rcc->last_qscale           = src_rcc->last_qscale;
+            memcpy(rcc->last_qscale_for, src_rcc->last_qscale_for, sizeof(rcc->last_qscale_for));
+            memcpy(rcc->i_cplx_sum     , src_rcc->i_cplx_sum     , sizeof(rcc->i_cplx_sum));
+            memcpy(rcc->p_cplx_sum     , src_rcc->p_cplx_sum     , sizeof(rcc->p_cplx_sum));
+            memcpy(rcc->mv_bits_sum    , src_rcc->mv_bits_sum    , sizeof(rcc->mv_bits_sum));
+            memcpy(rcc->qscale_sum     , src_rcc->qscale_sum     , sizeof(rcc->qscale_sum));
+            memcpy(rcc->frame_count    , src_rcc->frame_count    , sizeof(rcc->frame_count));
+        }
+        return;
+    }
+
+    rcc->returned_bits        = src->rc_context.returned_bits + dst->frame_bits;
+    rcc->returned_frames      = src->rc_context.returned_frames + 1;
+    rcc->returned_buffer_index= src->rc_context.returned_buffer_index;
+    vbv_update(dst, &rcc->returned_buffer_index, dst->frame_bits);
+}
+
 /**
  * modifies the bitrate curve from pass1 for one frame
  */
@@ -81,6 +81,16 @@ typedef struct RateControlContext{
     int frame_count[5];
     int last_non_b_pict_type;
 
+    /* frame threading: state after the frames returned to the user so far */
+    int64_t returned_bits;        ///< total size of the frames returned
+    int returned_frames;          ///< number of frames returned
+    double returned_buffer_index; ///< buffer_index after the last frame returned
+
+    /* GOP threading: state at the start of the GOP being encoded */
+    int64_t gop_start_bits;       ///< total_bits before the GOP
+    int gop_start_frame;          ///< number of the first frame of the GOP
+    int gop_returned;             ///< set once the GOP is accounted in the returned state
+
     void *non_lavc_opaque;        ///< context for non lavc rc code (for example xvid)
     float dry_run_qscale;         ///< for xvid rc
     int last_picture_number;      ///< for xvid rc
@@ -95,6 +105,8 @@ float ff_rate_estimate_qscale(struct MpegEncContext *s, int dry_run);
 void ff_write_pass1_stats(struct MpegEncContext *s);
 void ff_rate_control_uninit(struct MpegEncContext *s);
 int ff_vbv_update(struct MpegEncContext *s, int frame_size);
+void ff_rate_control_thread_sync(struct MpegEncContext *s);
+void ff_rate_control_update_thread_context(struct MpegEncContext *dst, const struct MpegEncContext *src);
 void ff_get_2pass_fcode(struct MpegEncContext *s);
 
 int ff_xvid_rate_control_init(struct MpegEncContext *s);
@@ -26,6 +26,7 @@
 
 #include "avcodec.h"
 #include "audioconvert.h"
+#include "resample2.h"
 #include "libavutil/opt.h"
 #include "libavutil/samplefmt.h"
 
@@ -51,6 +52,9 @@ struct ReSampleContext {
     unsigned sample_size[2];         ///< size of one sample in sample_fmt
     short *buffer[2];                ///< buffers used for conversion to S16
     unsigned buffer_size[2];         ///< sizes of allocated buffers
+    /* all the channels resampled at once, without S16 conversion */
+    int interleaved;
+    enum AVSampleFormat filter_fmt;  ///< sample format of the interleaved resampler
 };
 
 /* n1: number of samples */
@@ -141,6 +145,67 @@ static void ac3_5p1_mux(short *output, short *input1, short *input2, int n)
     }
 }
 
+/**
+ * Initialize the resampling of all the channels at once, in float when
+ * either format is floating point, in 32 bits otherwise.
+ */
+static ReSampleContext *resample_init_interleaved(int channels,
+                                                  int output_rate, int input_rate,
+                                                  enum AVSampleFormat sample_fmt_out,
+                                                  enum AVSampleFormat sample_fmt_in,
+                                                  int filter_length, int log2_phase_count,
+                                                  int linear, double cutoff)
+{
+    ReSampleContext *s = av_mallocz(sizeof(ReSampleContext));
+    int i;
+
+    if (!s) {
+        av_log(NULL, AV_LOG_ERROR, "Can't allocate memory for resample context.\n");
+        return NULL;
+    }
+
+    s->interleaved     = 1;
+    s->ratio           = (float)output_rate / (float)input_rate;
+    s->input_channels  = channels;
+    s->output_channels = channels;
+    s->sample_fmt[0]   = sample_fmt_in;
+    s->sample_fmt[1]   = sample_fmt_out;
+
+    if (sample_fmt_in  == AV_SAMPLE_FMT_FLT || sample_fmt_in  == AV_SAMPLE_FMT_DBL ||
+        sample_fmt_out == AV_SAMPLE_FMT_FLT || sample_fmt_out == AV_SAMPLE_FMT_DBL)
+        s->filter_fmt = AV_SAMPLE_FMT_FLT;
+    else
+        s->filter_fmt = AV_SAMPLE_FMT_S32;
+
+    for (i = 0; i < 2; i++) {
+        s->sample_size[i] = av_get_bits_per_sample_fmt(s->sample_fmt[i])>>3;
+        if (s->sample_fmt[i] == s->filter_fmt)
+            continue;
+        s->convert_ctx[i] = i ? av_audio_convert_alloc(s->sample_fmt[1], 1, s->filter_fmt, 1, NULL, 0) :
+                                av_audio_convert_alloc(s->filter_fmt, 1, s->sample_fmt[0], 1, NULL, 0);
+        if (!s->convert_ctx[i]) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot convert %s sample format to %s sample format\n",
+                   av_get_sample_fmt_name(i ? s->filter_fmt : s->sample_fmt[0]),
+                   av_get_sample_fmt_name(i ? s->sample_fmt[1] : s->filter_fmt));
+            goto fail;
+        }
+    }
+
+    s->resample_context = ff_resample_init_interleaved(output_rate, input_rate,
+                                                       filter_length, log2_phase_count,
+                                                       linear, cutoff, s->filter_fmt);
+    if (!s->resample_context)
+        goto fail;
+    *(const AVClass**)s->resample_context = &audioresample_context_class;
+
+    return s;
+fail:
+    av_audio_convert_free(s->convert_ctx[0]);
+    av_audio_convert_free(s->convert_ctx[1]);
+    av_free(s);
+    return NULL;
+}
+
 ReSampleContext *av_audio_resample_init(int output_channels, int input_channels,
                                         int output_rate, int input_rate,
                                         enum AVSampleFormat sample_fmt_out,
@@ -150,6 +215,14 @@ ReSampleContext *av_audio_resample_init(int output_channels, int input_channels,
 {
     ReSampleContext *s;
 
+    if (input_channels == output_channels &&
+        (input_channels > 8 ||
+         (sample_fmt_in  != AV_SAMPLE_FMT_U8 && sample_fmt_in  != AV_SAMPLE_FMT_S16) ||
+         (sample_fmt_out != AV_SAMPLE_FMT_U8 && sample_fmt_out != AV_SAMPLE_FMT_S16)))
+        return resample_init_interleaved(output_channels, output_rate, input_rate,
+                                         sample_fmt_out, sample_fmt_in,
+                                         filter_length, log2_phase_count, linear, cutoff);
+
     if (input_channels > 8)
       {
         av_log(NULL, AV_LOG_ERROR, "Resampling with input channels greater than 8 unsupported.\n");
@@ -225,6 +298,84 @@ ReSampleContext *audio_resample_init(int output_channels, int input_channels,
 }
 #endif
 
+static int resample_interleaved(ReSampleContext *s, short *output, short *input, int nb_samples)
+{
+    int channels = s->input_channels;
+    int size     = av_get_bits_per_sample_fmt(s->filter_fmt)>>3;
+    int lenout   = 2*nb_samples * s->ratio + 16;
+    unsigned input_size = (s->temp_len + nb_samples) * channels * size;
+    uint8_t *in;
+    void *out = output;
+    int consumed, nb_samples1;
+
+    /* the samples not consumed by the last call are kept at the start */
+    if (s->buffer_size[0] < input_size) {
+        void *buf = av_realloc(s->buffer[0], input_size);
+        if (!buf) {
+            av_log(s->resample_context, AV_LOG_ERROR, "Could not allocate buffer\n");
+            return 0;
+        }
+        s->buffer[0]      = buf;
+        s->buffer_size[0] = input_size;
+    }
+    in = (uint8_t *)s->buffer[0];
+
+    if (s->convert_ctx[0]) {
+        int istride[1] = { s->sample_size[0] };
+        int ostride[1] = { size };
+        const void *ibuf[1] = { input };
+        void       *obuf[1] = { in + s->temp_len * channels * size };
+
+        if (av_audio_convert(s->convert_ctx[0], obuf, ostride,
+                             ibuf, istride, nb_samples*channels) < 0) {
+            av_log(s->resample_context, AV_LOG_ERROR, "Audio sample format conversion failed\n");
+            return 0;
+        }
+    } else {
+        memcpy(in + s->temp_len * channels * size, input, nb_samples * channels * size);
+    }
+
+    if (s->convert_ctx[1]) {
+        unsigned output_size = lenout * channels * size;
+        if (s->buffer_size[1] < output_size) {
+            av_free(s->buffer[1]);
+            s->buffer_size[1] = output_size;
+            s->buffer[1] = av_malloc(s->buffer_size[1]);
+            if (!s->buffer[1]) {
+                s->buffer_size[1] = 0;
+                av_log(s->resample_context, AV_LOG_ERROR, "Could not allocate buffer\n");
+                return 0;
+            }
+        }
+        out = s->buffer[1];
+    }
+
+    nb_samples += s->temp_len;
+    nb_samples1 = ff_resample_interleaved(s->resample_context, out, in, &consumed,
+                                          nb_samples, lenout, channels, 1);
+    if (nb_samples1 < 0) {
+        av_log(s->resample_context, AV_LOG_ERROR, "Could not allocate buffer\n");
+        return 0;
+    }
+    s->temp_len = nb_samples - consumed;
+    memmove(in, in + consumed * channels * size, s->temp_len * channels * size);
+
+    if (s->convert_ctx[1]) {
+        int istride[1] = { size };
+        int ostride[1] = { s->sample_size[1] };
+        const void *ibuf[1] = { out };
+        void       *obuf[1] = { output };
+
+        if (av_audio_convert(s->convert_ctx[1], obuf, ostride,
+                             ibuf, istride, nb_samples1*channels) < 0) {
+            av_log(s->resample_context, AV_LOG_ERROR, "Audio sample format convertion failed\n");
+            return 0;
+        }
+    }
+
+    return nb_samples1;
+}
+
 /* resample audio. 'nb_samples' is the number of input samples */
 /* XXX: optimize it ! */
 int audio_resample(ReSampleContext *s, short *output, short *input, int nb_samples)
@@ -236,6 +387,9 @@ int audio_resample(ReSampleContext *s, short *output, short *input, int nb_sampl
     short *output_bak = NULL;
     int lenout;
 
+    if (s->interleaved)
+        return resample_interleaved(s, output, input, nb_samples);
+
     if (s->input_channels == s->output_channels && s->ratio == 1.0 && 0) {
         /* nothing to do */
         memcpy(output, input, nb_samples * s->input_channels * sizeof(short));
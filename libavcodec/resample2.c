@@ -27,6 +27,9 @@
 
 #include "avcodec.h"
 #include "dsputil.h"
+#include "resample2.h"
+#include "resampledsp.h"
+#include "libavutil/mathematics.h"
 
 #ifndef CONFIG_RESAMPLE_HP
 #define FILTER_SHIFT 15
@@ -69,6 +72,14 @@ typedef struct AVResampleContext{
     int phase_shift;
     int phase_mask;
     int linear;
+
+    /* interleaved samples, see ff_resample_init_interleaved() */
+    int phase_count;
+    float  *filter_flt;  ///< filter bank for float samples
+    double *filter_dbl;  ///< filter bank for 32 bits samples
+    double *acc;         ///< filtered samples of each channel
+    unsigned acc_size;
+    ResampleDSPContext dsp;
 }AVResampleContext;
 
 /**
@@ -91,12 +102,13 @@ static double bessel(double x){
 
 /**
  * builds a polyphase filterbank.
+ * @param filter_dbl if not NULL, the filterbank is built in it, unscaled, instead of in filter
  * @param factor resampling factor
  * @param scale wanted sum of coefficients for each filter
  * @param type 0->cubic, 1->blackman nuttall windowed sinc, 2..16->kaiser windowed sinc beta=2..16
  * @return 0 on success, negative on error
  */
-static int build_filter(FELEM *filter, double factor, int tap_count, int phase_count, int scale, int type){
+static int build_filter(FELEM *filter, double *filter_dbl, double factor, int tap_count, int phase_count, int scale, int type){
     int ph, i;
     double x, y, w;
     double *tab = av_malloc(tap_count * sizeof(*tab));
@@ -138,6 +150,10 @@ static int build_filter(FELEM *filter, double factor, int tap_count, int phase_c
 
         /* normalize so that an uniform color remains the same */
         for(i=0;i<tap_count;i++) {
+            if (filter_dbl) {
+                filter_dbl[ph * tap_count + i] = tab[i] / norm;
+                continue;
+            }
 #ifdef CONFIG_RESAMPLE_AUDIOPHILE_KIDDY_MODE
             filter[ph * tap_count + i] = tab[i] / norm;
 #else
@@ -202,7 +218,7 @@ AVResampleContext *av_resample_init(int out_rate, int in_rate, int filter_size,
     c->filter_bank= av_mallocz(c->filter_length*(phase_count+1)*sizeof(FELEM));
     if (!c->filter_bank)
         goto error;
-    if (build_filter(c->filter_bank, factor, c->filter_length, phase_count, 1<<FILTER_SHIFT, WINDOW_TYPE))
+    if (build_filter(c->filter_bank, NULL, factor, c->filter_length, phase_count, 1<<FILTER_SHIFT, WINDOW_TYPE))
         goto error;
     memcpy(&c->filter_bank[c->filter_length*phase_count+1], c->filter_bank, (c->filter_length-1)*sizeof(FELEM));
     c->filter_bank[c->filter_length*phase_count]= c->filter_bank[c->filter_length - 1];
@@ -220,6 +236,9 @@ error:
 
 void av_resample_close(AVResampleContext *c){
     av_freep(&c->filter_bank);
+    av_freep(&c->filter_flt);
+    av_freep(&c->filter_dbl);
+    av_freep(&c->acc);
     av_freep(&c);
 }
 
@@ -318,3 +337,172 @@ av_log(NULL, AV_LOG_DEBUG, "%d %d %d\n", c->dst_incr, c->ideal_dst_incr, c->comp
 
     return dst_index;
 }
+
+AVResampleContext *ff_resample_init_interleaved(int out_rate, int in_rate, int filter_size, int phase_shift,
+                                                int linear, double cutoff, enum AVSampleFormat sample_fmt){
+    AVResampleContext *c;
+    double factor= FFMIN(out_rate * cutoff / in_rate, 1.0);
+    int phase_count= 1<<phase_shift;
+    int gcd= av_gcd(out_rate, in_rate);
+    double *bank;
+    int i;
+
+    if (sample_fmt != AV_SAMPLE_FMT_FLT && sample_fmt != AV_SAMPLE_FMT_S32)
+        return NULL;
+    if (!(c= av_mallocz(sizeof(AVResampleContext))))
+        return NULL;
+
+    /* a whole number of filters per output position within a period of
+     * the rates when there are few enough of them, such as 160 from 44.1
+     * to 48 kHz or 1001 from 48 to 48.048 kHz, so that all the phases are
+     * exact; the multiple keeps the fine phases needed by compensation
+     * when the period is short, e.g. a single position at equal rates */
+    if (out_rate / gcd <= phase_count)
+        phase_count= (phase_count + out_rate / gcd - 1) / (out_rate / gcd) * (out_rate / gcd);
+
+    c->phase_count= phase_count;
+    c->linear= linear;
+
+    c->filter_length= FFMAX((int)ceil(filter_size/factor), 1);
+    bank= c->filter_dbl= av_malloc(c->filter_length*(phase_count+1)*sizeof(*c->filter_dbl));
+    if (!bank)
+        goto error;
+    /* same window as the 32 bits filters of CONFIG_RESAMPLE_HP */
+    if (build_filter(NULL, bank, factor, c->filter_length, phase_count, 1, 12))
+        goto error;
+    memcpy(&bank[c->filter_length*phase_count+1], bank, (c->filter_length-1)*sizeof(*bank));
+    bank[c->filter_length*phase_count]= bank[c->filter_length - 1];
+
+    if (sample_fmt == AV_SAMPLE_FMT_FLT) {
+        c->filter_flt= av_malloc(c->filter_length*(phase_count+1)*sizeof(*c->filter_flt));
+        if (!c->filter_flt)
+            goto error;
+        for (i = 0; i < c->filter_length*(phase_count+1); i++)
+            c->filter_flt[i]= bank[i];
+        av_freep(&c->filter_dbl);
+    }
+
+    c->src_incr= out_rate;
+    c->ideal_dst_incr= c->dst_incr= in_rate * phase_count;
+    c->index= -phase_count*((c->filter_length-1)/2);
+
+    ff_resampledsp_init(&c->dsp);
+
+    return c;
+error:
+    av_resample_close(c);
+    return NULL;
+}
+
+/**
+ * Filter all the channels at a position of the input into val.
+ */
+static void filter_interleaved(AVResampleContext *c, double *val, const void *src,
+                               int sample_index, int phase, int channels){
+    int i;
+
+    if (c->filter_flt) {
+        float *tmp= (float *)(c->acc + 2*channels);
+        c->dsp.filter_flt(tmp, (const float *)src + sample_index*channels,
+                          c->filter_flt + c->filter_length*phase, c->filter_length, channels);
+        for (i = 0; i < channels; i++)
+            val[i]= tmp[i];
+    } else {
+        c->dsp.filter_s32(val, (const int32_t *)src + sample_index*channels,
+                          c->filter_dbl + c->filter_length*phase, c->filter_length, channels);
+    }
+}
+
+/**
+ * Same as filter_interleaved() at the start of the stream, where the
+ * samples before the first one are mirrored.
+ */
+static void filter_interleaved_mirrored(AVResampleContext *c, double *val, const void *src,
+                                        int sample_index, int phase, int src_size, int channels){
+    int i, ch;
+
+    for (ch = 0; ch < channels; ch++) {
+        double v= 0;
+        for (i = 0; i < c->filter_length; i++) {
+            int j= (FFABS(sample_index + i) % src_size) * channels + ch;
+            if (c->filter_flt) v += ((const float   *)src)[j] * c->filter_flt[c->filter_length*phase + i];
+            else               v += ((const int32_t *)src)[j] * c->filter_dbl[c->filter_length*phase + i];
+        }
+        val[ch]= v;
+    }
+}
+
+int ff_resample_interleaved(AVResampleContext *c, void *dst, const void *src, int *consumed,
+                            int src_size, int dst_size, int channels, int update_ctx){
+    int dst_index, ch;
+    int index= c->index;
+    int frac= c->frac;
+    int dst_incr_frac= c->dst_incr % c->src_incr;
+    int dst_incr=      c->dst_incr / c->src_incr;
+    int compensation_distance= c->compensation_distance;
+    const int phase_count= c->phase_count;
+    double *val, *v2;
+
+    /* filtered samples, those of the next phase, float samples */
+    av_fast_malloc(&c->acc, &c->acc_size, 3*channels*sizeof(*c->acc));
+    if (!c->acc)
+        return AVERROR(ENOMEM);
+    val= c->acc;
+    v2 = c->acc + channels;
+
+    for(dst_index=0; dst_index < dst_size; dst_index++){
+        int sample_index= index >= 0 ? index / phase_count : -((phase_count - 1 - index) / phase_count);
+        int phase= index - sample_index*phase_count;
+
+        if(sample_index < 0){
+            filter_interleaved_mirrored(c, val, src, sample_index, phase, src_size, channels);
+        }else if(sample_index + c->filter_length > src_size){
+            break;
+        }else{
+            filter_interleaved(c, val, src, sample_index, phase, channels);
+            if(c->linear){
+                filter_interleaved(c, v2, src, sample_index, phase + 1, channels);
+                for (ch = 0; ch < channels; ch++)
+                    val[ch] += (v2[ch]-val[ch])*frac / c->src_incr;
+            }
+        }
+
+        if (c->filter_flt) {
+            float *out= (float *)dst + dst_index*channels;
+            for (ch = 0; ch < channels; ch++)
+                out[ch]= val[ch];
+        } else {
+            int32_t *out= (int32_t *)dst + dst_index*channels;
+            for (ch = 0; ch < channels; ch++)
+                out[ch]= av_clipl_int32(llrint(val[ch]));
+        }
+
+        frac += dst_incr_frac;
+        index += dst_incr;
+        if(frac >= c->src_incr){
+            frac -= c->src_incr;
+            index++;
+        }
+
+        if(dst_index + 1 == compensation_distance){
+            compensation_distance= 0;
+            dst_incr_frac= c->ideal_dst_incr % c->src_incr;
+            dst_incr=      c->ideal_dst_incr / c->src_incr;
+        }
+    }
+    *consumed= FFMAX(index, 0) / phase_count;
+    if(index>=0) index %= phase_count;
+
+    if(compensation_distance){
+        compensation_distance -= dst_index;
+        assert(compensation_distance > 0);
+    }
+    if(update_ctx){
+        c->frac= frac;
+        c->index= index;
+        c->dst_incr= dst_incr_frac + c->src_incr*dst_incr;
+        c->compensation_distance= compensation_distance;
+    }
+
+    return dst_index;
+}
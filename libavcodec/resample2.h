@@ -0,0 +1,50 @@
+/*
+ * audio resampling
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_RESAMPLE2_H
+#define AVCODEC_RESAMPLE2_H
+
+#include "avcodec.h"
+#include "libavutil/samplefmt.h"
+
+/**
+ * Initialize a resampler of interleaved channels, the parameters being
+ * those of av_resample_init(). When the rates have a period of at most
+ * 1<<log2_phase_count output samples, the number of filters of the
+ * filterbank is the smallest multiple of that period which is not below
+ * 1<<log2_phase_count, so that every output position has an exact phase.
+ * The context is freed with
+ * av_resample_close() and can be compensated with av_resample_compensate().
+ * @param sample_fmt AV_SAMPLE_FMT_FLT or AV_SAMPLE_FMT_S32
+ */
+struct AVResampleContext *ff_resample_init_interleaved(int out_rate, int in_rate, int filter_length,
+                                                       int log2_phase_count, int linear, double cutoff,
+                                                       enum AVSampleFormat sample_fmt);
+
+/**
+ * Same as av_resample() on all the channels of interleaved samples.
+ * @param src_size number of input samples per channel
+ * @param dst_size maximum number of output samples per channel
+ * @return number of output samples per channel, negative on error
+ */
+int ff_resample_interleaved(struct AVResampleContext *c, void *dst, const void *src, int *consumed,
+                            int src_size, int dst_size, int channels, int update_ctx);
+
+#endif /* AVCODEC_RESAMPLE2_H */
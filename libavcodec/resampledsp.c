@@ -0,0 +1,60 @@
+/*
+ * Audio resampling filters
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+#include "libavutil/attributes.h"
+#include "resampledsp.h"
+
+static void resample_filter_flt_c(float *dst, const float *src, const float *filter,
+                                  int filter_length, int channels)
+{
+    int i, c;
+
+    for (c = 0; c < channels; c++)
+        dst[c] = 0;
+    for (i = 0; i < filter_length; i++) {
+        for (c = 0; c < channels; c++)
+            dst[c] += src[c] * filter[i];
+        src += channels;
+    }
+}
+
+static void resample_filter_s32_c(double *dst, const int32_t *src, const double *filter,
+                                  int filter_length, int channels)
+{
+    int i, c;
+
+    for (c = 0; c < channels; c++)
+        dst[c] = 0;
+    for (i = 0; i < filter_length; i++) {
+        for (c = 0; c < channels; c++)
+            dst[c] += src[c] * filter[i];
+        src += channels;
+    }
+}
+
+av_cold void ff_resampledsp_init(ResampleDSPContext *c)
+{
+    c->filter_flt = resample_filter_flt_c;
+    c->filter_s32 = resample_filter_s32_c;
+
+    if (HAVE_MMX)
+        ff_resampledsp_init_x86(c);
+}
@@ -0,0 +1,45 @@
+/*
+ * Audio resampling filters
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_RESAMPLEDSP_H
+#define AVCODEC_RESAMPLEDSP_H
+
+#include <stdint.h>
+
+typedef struct ResampleDSPContext {
+    /**
+     * Apply a FIR filter to all the channels of interleaved samples:
+     * dst[c] = sum of src[i * channels + c] * filter[i] for i < filter_length.
+     * The taps are summed in order for each channel.
+     * @param src first input sample, no alignment constraint
+     */
+    void (*filter_flt)(float *dst, const float *src, const float *filter,
+                       int filter_length, int channels);
+    /**
+     * Same as filter_flt() for 32 bits samples, summed as doubles.
+     */
+    void (*filter_s32)(double *dst, const int32_t *src, const double *filter,
+                       int filter_length, int channels);
+} ResampleDSPContext;
+
+void ff_resampledsp_init    (ResampleDSPContext *c);
+void ff_resampledsp_init_x86(ResampleDSPContext *c);
+
+#endif /* AVCODEC_RESAMPLEDSP_H */
@@ -398,6 +398,83 @@ void ff_simple_idct(DCTELEM *block)
         idctSparseCol(block + i);
 }
 
+/* 10 bit idct, intermediate values do not fit in 16 bits anymore */
+#define ROW_SHIFT_10 12
+#define COL_SHIFT_10 19
+
+static av_always_inline void idct1d_10(int *dst, const int *src, int stride, int shift)
+{
+    int a0, a1, a2, a3, b0, b1, b2, b3;
+
+    a0 = W4 * src[0] + (1 << (shift - 1));
+    a1 = a0;
+    a2 = a0;
+    a3 = a0;
+
+    a0 +=  W2 * src[2*stride];
+    a1 +=  W6 * src[2*stride];
+    a2 += -W6 * src[2*stride];
+    a3 += -W2 * src[2*stride];
+
+    b0 = W1 * src[1*stride] + W3 * src[3*stride];
+    b1 = W3 * src[1*stride] - W7 * src[3*stride];
+    b2 = W5 * src[1*stride] - W1 * src[3*stride];
+    b3 = W7 * src[1*stride] - W5 * src[3*stride];
+
+    a0 +=  W4 * src[4*stride] + W6 * src[6*stride];
+    a1 += -W4 * src[4*stride] - W2 * src[6*stride];
+    a2 += -W4 * src[4*stride] + W2 * src[6*stride];
+    a3 +=  W4 * src[4*stride] - W6 * src[6*stride];
+
+    b0 +=  W5 * src[5*stride] + W7 * src[7*stride];
+    b1 += -W1 * src[5*stride] - W5 * src[7*stride];
+    b2 +=  W7 * src[5*stride] + W3 * src[7*stride];
+    b3 +=  W3 * src[5*stride] - W1 * src[7*stride];
+
+    dst[0*stride] = (a0 + b0) >> shift;
+    dst[7*stride] = (a0 - b0) >> shift;
+    dst[1*stride] = (a1 + b1) >> shift;
+    dst[6*stride] = (a1 - b1) >> shift;
+    dst[2*stride] = (a2 + b2) >> shift;
+    dst[5*stride] = (a2 - b2) >> shift;
+    dst[3*stride] = (a3 + b3) >> shift;
+    dst[4*stride] = (a3 - b3) >> shift;
+}
+
+static void idct_10(int *tmp, const DCTELEM *block)
+{
+    int i;
+    for (i = 0; i < 64; i++)
+        tmp[i] = block[i];
+    for (i = 0; i < 8; i++)
+        idct1d_10(tmp + i*8, tmp + i*8, 1, ROW_SHIFT_10);
+    for (i = 0; i < 8; i++)
+        idct1d_10(tmp + i, tmp + i, 8, COL_SHIFT_10);
+}
+
+void ff_simple_idct_put_10(uint8_t *dest, int line_size, DCTELEM *block)
+{
+    int tmp[64];
+    int i, j;
+
+    idct_10(tmp, block);
+    for (i = 0; i < 8; i++) {
+        uint16_t *pixels = (uint16_t *)(dest + i*line_size);
+        for (j = 0; j < 8; j++)
+            pixels[j] = av_clip_uintp2(tmp[i*8 + j], 10);
+    }
+}
+
+void ff_simple_idct_10(DCTELEM *block)
+{
+    int tmp[64];
+    int i;
+
+    idct_10(tmp, block);
+    for (i = 0; i < 64; i++)
+        block[i] = tmp[i];
+}
+
 /* 2x4x8 idct */
 
 #define CN_SHIFT 12
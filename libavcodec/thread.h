@@ -48,6 +48,18 @@ void ff_thread_flush(AVCodecContext *avctx);
 int ff_thread_decode_frame(AVCodecContext *avctx, AVFrame *picture,
                            int *got_picture_ptr, AVPacket *avpkt);
 
+/**
+ * Submits a new frame to an encoding thread.
+ * Returns the packet of the oldest frame being encoded once all threads
+ * are busy, so the output is delayed by thread_count - 1 frames.
+ * With pict == NULL, returns the remaining packets one by one, 0 once
+ * there are none left.
+ *
+ * Parameters are the same as avcodec_encode_video().
+ */
+int ff_thread_encode_video(AVCodecContext *avctx, uint8_t *buf, int buf_size,
+                           const AVFrame *pict);
+
 /**
  * If the codec defines update_thread_context(), call this
  * when they are ready for the next thread to start decoding
@@ -108,6 +120,15 @@ int ff_thread_get_buffer(AVCodecContext *avctx, AVFrame *f);
  */
 void ff_thread_release_buffer(AVCodecContext *avctx, AVFrame *f);
 
+/**
+ * Returns the index of the decoding thread owning this context.
+ * Frame-multithreaded codecs can use it to partition resources shared
+ * between the thread contexts. 0 when frame threading is not active.
+ *
+ * @param avctx The current context.
+ */
+int ff_thread_get_index(AVCodecContext *avctx);
+
 int ff_thread_init(AVCodecContext *s, int thread_count);
 void ff_thread_free(AVCodecContext *s);
 
@@ -22,6 +22,7 @@
  */
 
 #include "avcodec.h"
+#include "v210dsp.h"
 #include "libavutil/bswap.h"
 
 static av_cold int decode_init(AVCodecContext *avctx)
@@ -35,18 +36,22 @@ static av_cold int decode_init(AVCodecContext *avctx)
 
     avctx->coded_frame         = avcodec_alloc_frame();
 
+    ff_v210dsp_init(avctx->priv_data, avctx);
+
     return 0;
 }
 
 static int decode_frame(AVCodecContext *avctx, void *data, int *data_size,
                         AVPacket *avpkt)
 {
+    V210DSPContext *dsp = avctx->priv_data;
     int h, w;
     AVFrame *pic = avctx->coded_frame;
     const uint8_t *psrc = avpkt->data;
     uint16_t *y, *u, *v;
     int aligned_width = ((avctx->width + 47) / 48) * 48;
     int stride = aligned_width * 8 / 3;
+    int dsp_width = V210_DSP_WIDTH(avctx->width);
 
     if (pic->data[0])
         avctx->release_buffer(avctx, pic);
@@ -75,9 +80,15 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size,
     } while (0)
 
     for (h = 0; h < avctx->height; h++) {
-        const uint32_t *src = (const uint32_t*)psrc;
+        const uint32_t *src = (const uint32_t*)(psrc + dsp_width / 6 * 16);
         uint32_t val;
-        for (w = 0; w < avctx->width - 5; w += 6) {
+
+        dsp->unpack_line(psrc, y, u, v, dsp_width);
+        y += dsp_width;
+        u += dsp_width >> 1;
+        v += dsp_width >> 1;
+
+        for (w = dsp_width; w < avctx->width - 5; w += 6) {
             READ_PIXELS(u, y, v);
             READ_PIXELS(y, u, y);
             READ_PIXELS(v, y, u);
@@ -88,14 +99,15 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size,
 
             val  = av_le2ne32(*src++);
             *y++ =  val & 0x3FF;
-        }
-        if (w < avctx->width - 3) {
-            *u++ = (val >> 10) & 0x3FF;
-            *y++ = (val >> 20) & 0x3FF;
 
-            val  = av_le2ne32(*src++);
-            *v++ =  val & 0x3FF;
-            *y++ = (val >> 10) & 0x3FF;
+            if (w < avctx->width - 3) {
+                *u++ = (val >> 10) & 0x3FF;
+                *y++ = (val >> 20) & 0x3FF;
+
+                val  = av_le2ne32(*src++);
+                *v++ =  val & 0x3FF;
+                *y++ = (val >> 10) & 0x3FF;
+            }
         }
 
         psrc += stride;
@@ -124,7 +136,7 @@ AVCodec ff_v210_decoder = {
     "v210",
     AVMEDIA_TYPE_VIDEO,
     CODEC_ID_V210,
-    0,
+    sizeof(V210DSPContext),
     decode_init,
     NULL,
     decode_close,
@@ -0,0 +1,173 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * v210 pack/unpack test, checks the optimized versions against C.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "config.h"
+#include "dsputil.h"
+#include "v210dsp.h"
+#include "libavutil/cpu.h"
+#include "libavutil/lfg.h"
+
+#undef exit
+#undef printf
+
+#define WIDTH 1920
+#define NB_ITS 2000
+
+/* room for the samples the optimized versions may touch past the line */
+#define PAD 16
+
+static uint8_t  packed[2][WIDTH / 6 * 16 + PAD];
+static uint16_t planes[2][3][WIDTH + PAD];
+
+static int64_t gettime(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static double speed_unpack(V210DSPContext *c)
+{
+    int64_t ti = gettime();
+    int it;
+
+    for (it = 0; it < NB_ITS; it++)
+        c->unpack_line(packed[0], planes[1][0], planes[1][1], planes[1][2], WIDTH);
+    emms_c();
+    ti = gettime() - ti;
+
+    return NB_ITS / (FFMAX(ti, 1) / 1000000.0);
+}
+
+static double speed_pack(V210DSPContext *c)
+{
+    int64_t ti = gettime();
+    int it;
+
+    for (it = 0; it < NB_ITS; it++)
+        c->pack_line(planes[0][0], planes[0][1], planes[0][2], packed[1], WIDTH);
+    emms_c();
+    ti = gettime() - ti;
+
+    return NB_ITS / (FFMAX(ti, 1) / 1000000.0);
+}
+
+static int check_unpack(const char *name, V210DSPContext *test, V210DSPContext *ref,
+                        AVLFG *prng)
+{
+    int i, it, p, width, errors = 0;
+
+    printf("testing unpack_line '%s'\n", name);
+
+    for (it = 0; it < 100; it++) {
+        width = (av_lfg_get(prng) % (WIDTH / 6) + 1) * 6;
+        for (i = 0; i < sizeof(packed[0]); i++)
+            packed[0][i] = av_lfg_get(prng);
+        memset(planes, 0, sizeof(planes));
+
+        ref ->unpack_line(packed[0], planes[0][0], planes[0][1], planes[0][2], width);
+        test->unpack_line(packed[0], planes[1][0], planes[1][1], planes[1][2], width);
+        emms_c();
+
+        for (p = 0; p < 3; p++) {
+            int len = p ? width / 2 : width;
+            if (memcmp(planes[0][p], planes[1][p], len * 2)) {
+                printf("error: plane %d differs for width %d\n", p, width);
+                errors++;
+            }
+        }
+    }
+
+    printf("  %0.0f lines/s, C %0.0f lines/s\n", speed_unpack(test), speed_unpack(ref));
+
+    return errors;
+}
+
+static int check_pack(const char *name, V210DSPContext *test, V210DSPContext *ref,
+                      AVLFG *prng)
+{
+    int i, it, p, width, errors = 0;
+
+    printf("testing pack_line '%s'\n", name);
+
+    for (it = 0; it < 100; it++) {
+        width = (av_lfg_get(prng) % (WIDTH / 6) + 1) * 6;
+        /* mostly 10-bit samples, with some out of range values to clip */
+        for (p = 0; p < 3; p++)
+            for (i = 0; i < WIDTH + PAD; i++)
+                planes[0][p][i] = it & 1 ? av_lfg_get(prng) : av_lfg_get(prng) & 0x3ff;
+        memset(packed, 0, sizeof(packed));
+
+        ref ->pack_line(planes[0][0], planes[0][1], planes[0][2], packed[0], width);
+        test->pack_line(planes[0][0], planes[0][1], planes[0][2], packed[1], width);
+        emms_c();
+
+        if (memcmp(packed[0], packed[1], sizeof(packed[0]))) {
+            printf("error: output differs for width %d\n", width);
+            errors++;
+        }
+    }
+
+    printf("  %0.0f lines/s, C %0.0f lines/s\n", speed_pack(test), speed_pack(ref));
+
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        int flags;
+    } cpus[] = {
+        { "ssse3", AV_CPU_FLAG_SSSE3 },
+    };
+    AVCodecContext *ctx;
+    V210DSPContext cctx, simdctx;
+    AVLFG prng;
+    int c, errors = 0;
+
+    printf("ffmpeg v210dsp test\n");
+
+    av_lfg_init(&prng, 1);
+
+    ctx = avcodec_alloc_context();
+    ctx->dsp_mask = 0xffff;
+    ff_v210dsp_init(&cctx, ctx);
+    for (c = 0; c < sizeof(cpus) / sizeof(cpus[0]); c++) {
+        if (!(av_get_cpu_flags() & cpus[c].flags))
+            continue;
+        ctx->dsp_mask = AV_CPU_FLAG_FORCE | cpus[c].flags;
+        ff_v210dsp_init(&simdctx, ctx);
+
+        errors += check_unpack(cpus[c].name, &simdctx, &cctx, &prng);
+        errors += check_pack  (cpus[c].name, &simdctx, &cctx, &prng);
+    }
+    av_free(ctx);
+
+    return !!errors;
+}
@@ -0,0 +1,79 @@
+/*
+ * V210 line packing and unpacking
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/intreadwrite.h"
+#include "v210dsp.h"
+
+static void v210_unpack_line_c(const uint8_t *src, uint16_t *y, uint16_t *u,
+                               uint16_t *v, int width)
+{
+    uint32_t val;
+    int w;
+
+#define READ_PIXELS(a, b, c)         \
+    do {                             \
+        val  = AV_RL32(src);         \
+        src += 4;                    \
+        *a++ =  val & 0x3FF;         \
+        *b++ = (val >> 10) & 0x3FF;  \
+        *c++ = (val >> 20) & 0x3FF;  \
+    } while (0)
+
+    for (w = 0; w < width; w += 6) {
+        READ_PIXELS(u, y, v);
+        READ_PIXELS(y, u, y);
+        READ_PIXELS(v, y, u);
+        READ_PIXELS(y, v, y);
+    }
+}
+
+static void v210_pack_line_c(const uint16_t *y, const uint16_t *u,
+                             const uint16_t *v, uint8_t *dst, int width)
+{
+    uint32_t val;
+    int w;
+
+#define CLIP(v) av_clip(v, 4, 1019)
+
+#define WRITE_PIXELS(a, b, c)           \
+    do {                                \
+        val =   CLIP(*a++);             \
+        val |= (CLIP(*b++) << 10) |     \
+               (CLIP(*c++) << 20);      \
+        AV_WL32(dst, val);              \
+        dst += 4;                       \
+    } while (0)
+
+    for (w = 0; w < width; w += 6) {
+        WRITE_PIXELS(u, y, v);
+        WRITE_PIXELS(y, u, y);
+        WRITE_PIXELS(v, y, u);
+        WRITE_PIXELS(y, v, y);
+    }
+}
+
+av_cold void ff_v210dsp_init(V210DSPContext *c, AVCodecContext *avctx)
+{
+    c->unpack_line = v210_unpack_line_c;
+    c->pack_line   = v210_pack_line_c;
+
+    if (HAVE_MMX)
+        ff_v210dsp_init_x86(c, avctx);
+}
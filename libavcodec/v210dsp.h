@@ -0,0 +1,56 @@
+/*
+ * V210 line packing and unpacking
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_V210DSP_H
+#define AVCODEC_V210DSP_H
+
+#include <stdint.h>
+#include "avcodec.h"
+
+typedef struct V210DSPContext {
+    /**
+     * Unpack width pixels of a v210 line into 10-bit planar samples.
+     * @param src   v210 words, no alignment constraint
+     * @param width number of luma samples, multiple of 6; up to 2 samples
+     *              past the end of each plane may be overwritten
+     */
+    void (*unpack_line)(const uint8_t *src, uint16_t *y, uint16_t *u,
+                        uint16_t *v, int width);
+    /**
+     * Pack width pixels of 10-bit planar samples into a v210 line,
+     * clipping them to 4..1019.
+     * @param width number of luma samples, multiple of 6; up to 2 samples
+     *              past the end of each plane may be read
+     */
+    void (*pack_line)(const uint16_t *y, const uint16_t *u,
+                      const uint16_t *v, uint8_t *dst, int width);
+} V210DSPContext;
+
+/**
+ * Number of luma samples of a line of the given width which the
+ * V210DSPContext functions can process without touching the samples
+ * after the end of the line.
+ */
+#define V210_DSP_WIDTH(width) ((width) >= 2 ? ((width) - 2) / 6 * 6 : 0)
+
+void ff_v210dsp_init    (V210DSPContext *c, AVCodecContext *avctx);
+void ff_v210dsp_init_x86(V210DSPContext *c, AVCodecContext *avctx);
+
+#endif /* AVCODEC_V210DSP_H */
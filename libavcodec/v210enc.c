@@ -22,6 +22,7 @@
  */
 
 #include "avcodec.h"
+#include "v210dsp.h"
 #include "libavcodec/bytestream.h"
 
 static av_cold int encode_init(AVCodecContext *avctx)
@@ -47,15 +48,19 @@ static av_cold int encode_init(AVCodecContext *avctx)
     avctx->bit_rate = stride * avctx->height * 8LL *
         avctx->time_base.den / avctx->time_base.num;
 
+    ff_v210dsp_init(avctx->priv_data, avctx);
+
     return 0;
 }
 
 static int encode_frame(AVCodecContext *avctx, unsigned char *buf,
                         int buf_size, void *data)
 {
+    V210DSPContext *dsp = avctx->priv_data;
     const AVFrame *pic = data;
     int aligned_width = ((avctx->width + 47) / 48) * 48;
     int stride = aligned_width * 8 / 3;
+    int dsp_width = V210_DSP_WIDTH(avctx->width);
     int h, w;
     const uint16_t *y = (const uint16_t*)pic->data[0];
     const uint16_t *u = (const uint16_t*)pic->data[1];
@@ -80,7 +85,14 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf,
 
     for (h = 0; h < avctx->height; h++) {
         uint32_t val;
-        for (w = 0; w < avctx->width - 5; w += 6) {
+
+        dsp->pack_line(y, u, v, p, dsp_width);
+        p += dsp_width / 6 * 16;
+        y += dsp_width;
+        u += dsp_width >> 1;
+        v += dsp_width >> 1;
+
+        for (w = dsp_width; w < avctx->width - 5; w += 6) {
             WRITE_PIXELS(u, y, v);
             WRITE_PIXELS(y, u, y);
             WRITE_PIXELS(v, y, u);
@@ -92,13 +104,14 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf,
             val = CLIP(*y++);
             if (w == avctx->width - 2)
                 bytestream_put_le32(&p, val);
-        }
-        if (w < avctx->width - 3) {
-            val |= (CLIP(*u++) << 10) | (CLIP(*y++) << 20);
-            bytestream_put_le32(&p, val);
 
-            val = CLIP(*v++) | (CLIP(*y++) << 10);
-            bytestream_put_le32(&p, val);
+            if (w < avctx->width - 3) {
+                val |= (CLIP(*u++) << 10) | (CLIP(*y++) << 20);
+                bytestream_put_le32(&p, val);
+
+                val = CLIP(*v++) | (CLIP(*y++) << 10);
+                bytestream_put_le32(&p, val);
+            }
         }
 
         pdst += stride;
@@ -123,7 +136,7 @@ AVCodec ff_v210_encoder = {
     "v210",
     AVMEDIA_TYPE_VIDEO,
     CODEC_ID_V210,
-    0,
+    sizeof(V210DSPContext),
     encode_init,
     encode_frame,
     encode_close,
@@ -52,6 +52,293 @@ static void get_pixels_8x4_sym_sse2(DCTELEM *block, const uint8_t *pixels, int l
     );
 }
 
+static int ssd_block_sse2(DCTELEM *qblock, DCTELEM *block)
+{
+    x86_reg i = -128;
+    int score;
+    __asm__ volatile(
+        "pxor      %%xmm4, %%xmm4       \n\t"
+        "1:                             \n\t"
+        "movdqa   (%2, %0), %%xmm0      \n\t"
+        "movdqa 16(%2, %0), %%xmm1      \n\t"
+        "psubw    (%3, %0), %%xmm0      \n\t"
+        "psubw  16(%3, %0), %%xmm1      \n\t"
+        "pmaddwd   %%xmm0, %%xmm0       \n\t"
+        "pmaddwd   %%xmm1, %%xmm1       \n\t"
+        "paddd     %%xmm0, %%xmm4       \n\t"
+        "paddd     %%xmm1, %%xmm4       \n\t"
+        "add       $32, %0              \n\t"
+        "js 1b                          \n\t"
+        "pshufd    $0x0E, %%xmm4, %%xmm0\n\t"
+        "paddd     %%xmm0, %%xmm4       \n\t"
+        "pshufd    $0x01, %%xmm4, %%xmm0\n\t"
+        "paddd     %%xmm0, %%xmm4       \n\t"
+        "movd      %%xmm4, %1           \n\t"
+        : "+r" (i), "=r" (score)
+        : "r" (block + 64), "r" (qblock + 64)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm4",) "memory"
+    );
+    return score;
+}
+
+/**
+ * Same as dnxhd_unquantize_c(), on all the coefficients of the block, the
+ * 32 bits products being built from 16x16 bits multiplications.
+ */
+static void unquantize_sse2(DNXHDEncContext *ctx, DCTELEM *block, int n, int qscale, int last_index)
+{
+    const int level_shift = ctx->cid_table->bit_depth == 10 ? 4 : 6;
+    const int c = (n & 2) >> 1;
+    int dc = block[0];
+    x86_reg i = -128;
+
+    __asm__ volatile(
+        "movd      %3, %%xmm7           \n\t"
+        "pshuflw   $0, %%xmm7, %%xmm7   \n\t"
+        "punpcklqdq %%xmm7, %%xmm7      \n\t" // qscale
+        "movd      %4, %%xmm6           \n\t" // level_shift
+        "pcmpeqw   %%xmm5, %%xmm5       \n\t"
+        "psrlw     $15, %%xmm5          \n\t" // 1
+        "1:                             \n\t"
+        "movdqa   (%1, %0), %%xmm0      \n\t"
+        "pxor      %%xmm3, %%xmm3       \n\t"
+        "pcmpgtw   %%xmm0, %%xmm3       \n\t" // sign
+        "pxor      %%xmm3, %%xmm0       \n\t"
+        "psubw     %%xmm3, %%xmm0       \n\t"
+        "paddw     %%xmm0, %%xmm0       \n\t"
+        "paddw     %%xmm5, %%xmm0       \n\t" // 2*|level|+1
+        "movdqa   (%2, %0), %%xmm1      \n\t"
+        "movdqa    %%xmm1, %%xmm2       \n\t"
+        "pmullw    %%xmm7, %%xmm1       \n\t" // low word of qscale*weight
+        "pmulhuw   %%xmm7, %%xmm2       \n\t" // high word of qscale*weight
+        "pmullw    %%xmm0, %%xmm2       \n\t"
+        "movdqa    %%xmm1, %%xmm4       \n\t"
+        "pmulhuw   %%xmm0, %%xmm4       \n\t"
+        "pmullw    %%xmm0, %%xmm1       \n\t"
+        "paddw     %%xmm4, %%xmm2       \n\t"
+        "pcmpeqw   %%xmm5, %%xmm0       \n\t" // level == 0
+        "movdqa    %%xmm1, %%xmm4       \n\t"
+        "punpcklwd %%xmm2, %%xmm1       \n\t"
+        "punpckhwd %%xmm2, %%xmm4       \n\t"
+        "paddd    (%5, %0, 2), %%xmm1   \n\t"
+        "paddd  16(%5, %0, 2), %%xmm4   \n\t"
+        "psrad     %%xmm6, %%xmm1       \n\t"
+        "psrad     %%xmm6, %%xmm4       \n\t"
+        "pslld     $16, %%xmm1          \n\t"
+        "pslld     $16, %%xmm4          \n\t"
+        "psrad     $16, %%xmm1          \n\t"
+        "psrad     $16, %%xmm4          \n\t"
+        "packssdw  %%xmm4, %%xmm1       \n\t"
+        "pxor      %%xmm3, %%xmm1       \n\t"
+        "psubw     %%xmm3, %%xmm1       \n\t"
+        "pandn     %%xmm1, %%xmm0       \n\t"
+        "movdqa    %%xmm0, (%1, %0)     \n\t"
+        "add       $16, %0              \n\t"
+        "js 1b                          \n\t"
+        : "+r" (i)
+        : "r" (block + 64), "r" (ctx->unquant_weight[c] + 64),
+          "r" (qscale), "r" (level_shift), "r" (ctx->unquant_bias[c] + 64)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                       "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+    );
+    block[0] = dc;
+}
+
+static av_always_inline int ctz32(uint32_t v)
+{
+    int i;
+    __asm__("bsf %1, %0" : "=r" (i) : "rm" (v));
+    return i;
+}
+
+/**
+ * Same as dnxhd_calc_ac_bits(), iterating over the nonzero coefficients
+ * only, from a bit mask of them in scan order.
+ */
+static int calc_ac_bits_sse2(DNXHDEncContext *ctx, DCTELEM *block, int last_index)
+{
+    const uint8_t *permutated = ctx->intra_scantable.permutated;
+    uint64_t (*scan_mask)[256] = ctx->scan_mask;
+    uint64_t mask;
+    uint32_t lo, hi, tmp;
+    int bits = 0, last_non_zero = 0;
+    int i, k;
+
+    __asm__ volatile(
+        "pxor      %%xmm4, %%xmm4       \n\t"
+        "movdqa    (%3), %%xmm0         \n\t"
+        "movdqa  16(%3), %%xmm1         \n\t"
+        "movdqa  32(%3), %%xmm2         \n\t"
+        "movdqa  48(%3), %%xmm3         \n\t"
+        "pcmpeqw   %%xmm4, %%xmm0       \n\t"
+        "pcmpeqw   %%xmm4, %%xmm1       \n\t"
+        "pcmpeqw   %%xmm4, %%xmm2       \n\t"
+        "pcmpeqw   %%xmm4, %%xmm3       \n\t"
+        "packsswb  %%xmm1, %%xmm0       \n\t"
+        "packsswb  %%xmm3, %%xmm2       \n\t"
+        "pmovmskb  %%xmm0, %0           \n\t"
+        "pmovmskb  %%xmm2, %2           \n\t"
+        "shl       $16, %2              \n\t"
+        "or        %2, %0               \n\t"
+        "movdqa  64(%3), %%xmm0         \n\t"
+        "movdqa  80(%3), %%xmm1         \n\t"
+        "movdqa  96(%3), %%xmm2         \n\t"
+        "movdqa 112(%3), %%xmm3         \n\t"
+        "pcmpeqw   %%xmm4, %%xmm0       \n\t"
+        "pcmpeqw   %%xmm4, %%xmm1       \n\t"
+        "pcmpeqw   %%xmm4, %%xmm2       \n\t"
+        "pcmpeqw   %%xmm4, %%xmm3       \n\t"
+        "packsswb  %%xmm1, %%xmm0       \n\t"
+        "packsswb  %%xmm3, %%xmm2       \n\t"
+        "pmovmskb  %%xmm0, %1           \n\t"
+        "pmovmskb  %%xmm2, %2           \n\t"
+        "shl       $16, %2              \n\t"
+        "or        %2, %1               \n\t"
+        : "=&r" (lo), "=&r" (hi), "=&r" (tmp)
+        : "r" (block)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4",) "memory"
+    );
+    lo = ~lo;
+    hi = ~hi;
+
+    mask = 0;
+    for (k = 0; k < 4; k++) {
+        mask |= scan_mask[k    ][lo >> 8*k & 0xff];
+        mask |= scan_mask[k + 4][hi >> 8*k & 0xff];
+    }
+    mask &= (2ULL << last_index) - 2; // dc and coefficients after last_index
+
+    for (k = 0; k < 64; k += 32) {
+        uint32_t m = mask >> k;
+        while (m) {
+            int run_level, level;
+            i = k + ctz32(m);
+            run_level = i - last_non_zero - 1;
+            level = block[permutated[i]];
+            bits += ctx->vlc_bits[(level<<1)|!!run_level]+ctx->run_bits[run_level];
+            last_non_zero = i;
+            m &= m - 1;
+        }
+    }
+    return bits;
+}
+
+/**
+ * Same as quantize_c() for 10 bits and no idct permutation, the 32 bits
+ * products of the coefficients by the matrix wrapping the same way.
+ */
+static int quantize_10_sse2(DNXHDEncContext *ctx, DCTELEM *block, int n, int qscale, int *overflow)
+{
+    LOCAL_ALIGNED_16(int32_t, consts, [12]);
+    const int bias = ctx->intra_quant_bias<<(QMAT_SHIFT - QUANT_BIAS_SHIFT);
+    const unsigned threshold1 = (1<<QMAT_SHIFT) - bias - 1;
+    const unsigned threshold2 = threshold1<<1;
+    int dc = block[0];
+    x86_reg i = -128;
+    int last, max, k;
+
+    for (k = 0; k < 4; k++) {
+        /* unsigned comparison done signed */
+        consts[k    ] = threshold1 + 0x80000000U;
+        consts[k + 4] = threshold2 ^ 0x80000000U;
+        consts[k + 8] = bias;
+    }
+    block[0] = 0;
+
+    __asm__ volatile(
+        "pxor      %%xmm6, %%xmm6       \n\t" // last
+        "pxor      %%xmm7, %%xmm7       \n\t" // max
+        "1:                             \n\t"
+        "movdqa   (%3, %0), %%xmm0      \n\t"
+        "pxor      %%xmm3, %%xmm3       \n\t"
+        "pcmpgtw   %%xmm0, %%xmm3       \n\t" // sign
+        "pxor      %%xmm3, %%xmm0       \n\t"
+        "psubw     %%xmm3, %%xmm0       \n\t" // |block|
+        "movdqa   (%4, %0, 2), %%xmm1   \n\t"
+        "movdqa 16(%4, %0, 2), %%xmm2   \n\t"
+        "movdqa    %%xmm1, %%xmm4       \n\t"
+        "movdqa    %%xmm2, %%xmm5       \n\t"
+        "pslld     $16, %%xmm4          \n\t"
+        "pslld     $16, %%xmm5          \n\t"
+        "psrad     $16, %%xmm4          \n\t"
+        "psrad     $16, %%xmm5          \n\t"
+        "packssdw  %%xmm5, %%xmm4       \n\t" // low words of qmat
+        "psrad     $16, %%xmm1          \n\t"
+        "psrad     $16, %%xmm2          \n\t"
+        "packssdw  %%xmm2, %%xmm1       \n\t" // high words of qmat
+        "pmullw    %%xmm0, %%xmm1       \n\t"
+        "movdqa    %%xmm4, %%xmm2       \n\t"
+        "pmulhuw   %%xmm0, %%xmm2       \n\t"
+        "pmullw    %%xmm0, %%xmm4       \n\t"
+        "paddw     %%xmm2, %%xmm1       \n\t"
+        "movdqa    %%xmm4, %%xmm0       \n\t"
+        "punpcklwd %%xmm1, %%xmm4       \n\t"
+        "punpckhwd %%xmm1, %%xmm0       \n\t"
+        "movdqa    %%xmm3, %%xmm1       \n\t"
+        "punpcklwd %%xmm3, %%xmm3       \n\t"
+        "punpckhwd %%xmm1, %%xmm1       \n\t"
+        "pxor      %%xmm3, %%xmm4       \n\t"
+        "pxor      %%xmm1, %%xmm0       \n\t"
+        "psubd     %%xmm3, %%xmm4       \n\t" // level of coefficients 0-3
+        "psubd     %%xmm1, %%xmm0       \n\t" // level of coefficients 4-7
+#define QUANTIZE_LEVEL(level, nz, sign) \
+        "movdqa    "level", "nz"        \n\t"\
+        "paddd     (%5), "nz"           \n\t"\
+        "pcmpgtd 16(%5), "nz"           \n\t"\
+        "pxor      "sign", "sign"       \n\t"\
+        "pcmpgtd   "level", "sign"      \n\t"\
+        "pxor      "sign", "level"      \n\t"\
+        "psubd     "sign", "level"      \n\t"\
+        "paddd   32(%5), "level"        \n\t"\
+        "psrad     $22, "level"         \n\t"\
+        "pand      "nz", "level"        \n\t"\
+        "por       "level", %%xmm7      \n\t"\
+        "pxor      "sign", "level"      \n\t"\
+        "psubd     "sign", "level"      \n\t"\
+        "pslld     $16, "level"         \n\t"\
+        "psrad     $16, "level"         \n\t"
+        QUANTIZE_LEVEL("%%xmm4", "%%xmm5", "%%xmm2")
+        QUANTIZE_LEVEL("%%xmm0", "%%xmm1", "%%xmm2")
+        "packssdw  %%xmm0, %%xmm4       \n\t"
+        "packssdw  %%xmm1, %%xmm5       \n\t"
+        "movdqa    %%xmm4, (%3, %0)     \n\t"
+        "pand     (%6, %0), %%xmm5      \n\t"
+        "pmaxsw    %%xmm5, %%xmm6       \n\t"
+        "add       $16, %0              \n\t"
+        "js 1b                          \n\t"
+        "pshufd    $0x0E, %%xmm7, %%xmm0\n\t"
+        "por       %%xmm0, %%xmm7       \n\t"
+        "pshufd    $0x01, %%xmm7, %%xmm0\n\t"
+        "por       %%xmm0, %%xmm7       \n\t"
+        "movd      %%xmm7, %2           \n\t"
+        "pshufd    $0x0E, %%xmm6, %%xmm0\n\t"
+        "pmaxsw    %%xmm0, %%xmm6       \n\t"
+        "pshuflw   $0x0E, %%xmm6, %%xmm0\n\t"
+        "pmaxsw    %%xmm0, %%xmm6       \n\t"
+        "pshuflw   $0x01, %%xmm6, %%xmm0\n\t"
+        "pmaxsw    %%xmm0, %%xmm6       \n\t"
+        "movd      %%xmm6, %1           \n\t"
+#undef QUANTIZE_LEVEL
+        : "+r" (i), "=r" (last), "=r" (max)
+        : "r" (block + 64), "r" (ctx->q_intra_matrix[qscale] + 64), "r" (consts),
+          "r" (inv_zigzag_direct16 + 64)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                       "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+    );
+    /* note: block[0] is assumed to be positive */
+    block[0] = (dc + 2) / 4;
+    *overflow = ctx->max_qcoeff < max;
+
+    last &= 0xffff;
+    return last ? last - 1 : 0;
+}
+
+static int dct_quantize_10_sse2(DNXHDEncContext *ctx, DCTELEM *block, int n, int qscale, int *overflow)
+{
+    ctx->dsp.fdct(block);
+    return quantize_10_sse2(ctx, block, n, qscale, overflow);
+}
+
 #if HAVE_SSSE3
 #define HAVE_SSSE3_BAK
 #endif
@@ -92,26 +379,82 @@ static void get_pixels_8x4_sym_sse2(DCTELEM *block, const uint8_t *pixels, int l
 #include "dnxhd_mmx_template.c"
 #endif
 
+static void init_unquantize_sse2(DNXHDEncContext *ctx)
+{
+    const int level_bias = ctx->cid_table->bit_depth == 10 ? 8 : 32;
+    int i;
+
+    for (i = 1; i < 64; i++) {
+        int j = ctx->intra_scantable.permutated[i];
+        ctx->unquant_weight[0][j] = ctx->cid_table->luma_weight[i];
+        ctx->unquant_weight[1][j] = ctx->cid_table->chroma_weight[i];
+        ctx->unquant_bias[0][j] = ctx->cid_table->luma_weight[i]   != level_bias ? level_bias : 0;
+        ctx->unquant_bias[1][j] = ctx->cid_table->chroma_weight[i] != level_bias ? level_bias : 0;
+    }
+    ctx->unquantize = unquantize_sse2;
+}
+
+static void init_calc_ac_bits_sse2(DNXHDEncContext *ctx)
+{
+    int i, v;
+
+    ctx->scan_mask = av_mallocz(8 * sizeof(*ctx->scan_mask));
+    if (!ctx->scan_mask)
+        return;
+    for (i = 0; i < 64; i++) {
+        int j = ctx->intra_scantable.permutated[i];
+        for (v = 0; v < 256; v++)
+            if (v & 1 << (j & 7))
+                ctx->scan_mask[j >> 3][v] |= 1ULL << i;
+    }
+    ctx->calc_ac_bits = calc_ac_bits_sse2;
+}
+
 void ff_dnxhd_init_mmx(DNXHDEncContext *ctx)
 {
     int mm_flags = av_get_cpu_flags();
     const int dct_algo = ctx->avctx->dct_algo;
 
+    if (mm_flags & AV_CPU_FLAG_SSE2) {
+        ctx->ssd_block = ssd_block_sse2;
+        init_unquantize_sse2(ctx);
+        init_calc_ac_bits_sse2(ctx);
+    }
+
+    if (ctx->cid_table->bit_depth == 10) {
+        if (mm_flags & AV_CPU_FLAG_SSE2 &&
+            ctx->dsp.idct_permutation_type == FF_NO_IDCT_PERM) {
+            ctx->dct_quantize = dct_quantize_10_sse2;
+            ctx->quantize     = quantize_10_sse2;
+        }
+        return;
+    }
+
     if (mm_flags & AV_CPU_FLAG_SSE2)
         ctx->get_pixels_8x4_sym = get_pixels_8x4_sym_sse2;
 
     if (dct_algo == FF_DCT_AUTO || dct_algo == FF_DCT_MMX) {
+        /* the rd search transforms once and quantizes each qscale,
+         * so fdct must match the one of dct_quantize */
 #if HAVE_SSSE3
         if (mm_flags & AV_CPU_FLAG_SSSE3) {
             ctx->dct_quantize = dct_quantize_SSSE3;
+            ctx->quantize     = quantize_SSSE3;
+            ctx->dsp.fdct     = ff_fdct_sse2;
         } else
 #endif
             if (mm_flags & AV_CPU_FLAG_SSE2) {
                 ctx->dct_quantize = dct_quantize_SSE2;
+                ctx->quantize     = quantize_SSE2;
+                ctx->dsp.fdct     = ff_fdct_sse2;
             } else if(mm_flags & AV_CPU_FLAG_MMX2){
                 ctx->dct_quantize = dct_quantize_MMX2;
+                ctx->quantize     = quantize_MMX2;
+                ctx->dsp.fdct     = ff_fdct_mmx2;
             } else {
                 ctx->dct_quantize = dct_quantize_MMX;
+                ctx->quantize     = quantize_MMX;
+                ctx->dsp.fdct     = ff_fdct_mmx;
             }
     }
 }
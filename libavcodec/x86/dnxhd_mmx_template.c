@@ -91,7 +91,7 @@
             "psubw "a", "b"             \n\t" // out=((ABS(block[i])*qmat[0] - bias[0]*qmat[0])>>16)*sign(block[i])
 #endif
 
-static int RENAME(dct_quantize)(DNXHDEncContext *s,
+static int RENAME(quantize)(DNXHDEncContext *s,
                             DCTELEM *block, int n,
                             int qscale, int *overflow)
 {
@@ -100,8 +100,6 @@ static int RENAME(dct_quantize)(DNXHDEncContext *s,
     const uint16_t *qmat, *bias;
     DECLARE_ALIGNED(16, int16_t, temp_block)[64];
 
-    RENAMEl(ff_fdct)(block); //cannot be anything else ...
-
     level = (block[0] + 4)>>3;
 
     block[0] = 0; //avoid fake overflow
@@ -295,3 +293,11 @@ static int RENAME(dct_quantize)(DNXHDEncContext *s,
 
     return last_non_zero_p1 - 1;
 }
+
+static int RENAME(dct_quantize)(DNXHDEncContext *s,
+                            DCTELEM *block, int n,
+                            int qscale, int *overflow)
+{
+    RENAMEl(ff_fdct)(block); //cannot be anything else ...
+    return RENAME(quantize)(s, block, n, qscale, overflow);
+}
@@ -0,0 +1,203 @@
+/*
+ * Audio channel interleaving, SSE2 versions
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "libavutil/x86_cpu.h"
+#include "libavcodec/interleavedsp.h"
+
+#if HAVE_SSE
+
+/*
+ * Stereo is a single unpack of the two planes. Other layouts with a
+ * multiple of 4 channels are transposed 4 channels at a time, each
+ * output sample receiving 4 channels per store. The remaining layouts
+ * and the last samples are interleaved in C.
+ */
+
+static void interleave_16_sse2(uint8_t *dst, const uint8_t *src, int plane_size,
+                               int len, int channels)
+{
+    x86_reg stride = channels * 2, plane = plane_size;
+    int c, n = len & ~7;
+
+    if (n && channels == 2) {
+        const uint8_t *end = src + n * 2;
+        uint8_t *d = dst;
+        const uint8_t *s = src;
+
+        __asm__ volatile(
+            "1: \n"
+            "movdqu         (%1), %%xmm0 \n"
+            "movdqu     (%1,%2), %%xmm1 \n"
+            "movdqa       %%xmm0, %%xmm2 \n"
+            "punpcklwd    %%xmm1, %%xmm0 \n"
+            "punpckhwd    %%xmm1, %%xmm2 \n"
+            "movdqu       %%xmm0,   (%0) \n"
+            "movdqu       %%xmm2, 16(%0) \n"
+            "add             $32, %0     \n"
+            "add             $16, %1     \n"
+            "cmp              %3, %1     \n"
+            "jb 1b \n"
+            : "+r"(d), "+r"(s)
+            : "r"(plane), "m"(end)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2",) "memory"
+        );
+    } else if (n && !(channels & 3)) {
+        for (c = 0; c < channels; c += 4) {
+            const uint8_t *s  = src + c * plane_size;
+            const uint8_t *s2 = s + 2 * plane_size;
+            const uint8_t *end = s + n * 2;
+            uint8_t *d = dst + c * 2;
+
+            __asm__ volatile(
+                "1: \n"
+                "movdqu         (%1), %%xmm0 \n"
+                "movdqu     (%1,%4), %%xmm1 \n"
+                "movdqu         (%2), %%xmm2 \n"
+                "movdqu     (%2,%4), %%xmm3 \n"
+                "movdqa       %%xmm0, %%xmm4 \n"
+                "punpcklwd    %%xmm1, %%xmm4 \n" // 01 of samples 0-3
+                "punpckhwd    %%xmm1, %%xmm0 \n" // 01 of samples 4-7
+                "movdqa       %%xmm2, %%xmm5 \n"
+                "punpcklwd    %%xmm3, %%xmm5 \n" // 23 of samples 0-3
+                "punpckhwd    %%xmm3, %%xmm2 \n" // 23 of samples 4-7
+                "movdqa       %%xmm4, %%xmm6 \n"
+                "punpckldq    %%xmm5, %%xmm6 \n" // samples 0-1
+                "punpckhdq    %%xmm5, %%xmm4 \n" // samples 2-3
+                "movdqa       %%xmm0, %%xmm7 \n"
+                "punpckldq    %%xmm2, %%xmm7 \n" // samples 4-5
+                "punpckhdq    %%xmm2, %%xmm0 \n" // samples 6-7
+                "movq         %%xmm6, (%0)    \n"
+                "movhps       %%xmm6, (%0,%3) \n"
+                "lea       (%0,%3,2), %0      \n"
+                "movq         %%xmm4, (%0)    \n"
+                "movhps       %%xmm4, (%0,%3) \n"
+                "lea       (%0,%3,2), %0      \n"
+                "movq         %%xmm7, (%0)    \n"
+                "movhps       %%xmm7, (%0,%3) \n"
+                "lea       (%0,%3,2), %0      \n"
+                "movq         %%xmm0, (%0)    \n"
+                "movhps       %%xmm0, (%0,%3) \n"
+                "lea       (%0,%3,2), %0      \n"
+                "add             $16, %1      \n"
+                "add             $16, %2      \n"
+                "cmp              %5, %1      \n"
+                "jb 1b \n"
+                : "+r"(d), "+r"(s), "+r"(s2)
+                : "r"(stride), "r"(plane), "m"(end)
+                : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                               "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+            );
+        }
+    } else
+        n = 0;
+
+    ff_interleave_16_c(dst + n * stride, src + n * 2, plane_size, len - n, channels);
+}
+
+static void interleave_32_sse2(uint8_t *dst, const uint8_t *src, int plane_size,
+                               int len, int channels)
+{
+    x86_reg stride = channels * 4, plane = plane_size;
+    int c, n = len & ~3;
+
+    if (n && channels == 2) {
+        const uint8_t *end = src + n * 4;
+        uint8_t *d = dst;
+        const uint8_t *s = src;
+
+        __asm__ volatile(
+            "1: \n"
+            "movdqu         (%1), %%xmm0 \n"
+            "movdqu     (%1,%2), %%xmm1 \n"
+            "movdqa       %%xmm0, %%xmm2 \n"
+            "punpckldq    %%xmm1, %%xmm0 \n"
+            "punpckhdq    %%xmm1, %%xmm2 \n"
+            "movdqu       %%xmm0,   (%0) \n"
+            "movdqu       %%xmm2, 16(%0) \n"
+            "add             $32, %0     \n"
+            "add             $16, %1     \n"
+            "cmp              %3, %1     \n"
+            "jb 1b \n"
+            : "+r"(d), "+r"(s)
+            : "r"(plane), "m"(end)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2",) "memory"
+        );
+    } else if (n && !(channels & 3)) {
+        for (c = 0; c < channels; c += 4) {
+            const uint8_t *s  = src + c * plane_size;
+            const uint8_t *s2 = s + 2 * plane_size;
+            const uint8_t *end = s + n * 4;
+            uint8_t *d = dst + c * 4;
+
+            __asm__ volatile(
+                "1: \n"
+                "movdqu         (%1), %%xmm0 \n"
+                "movdqu     (%1,%4), %%xmm1 \n"
+                "movdqu         (%2), %%xmm2 \n"
+                "movdqu     (%2,%4), %%xmm3 \n"
+                "movdqa       %%xmm0, %%xmm4 \n"
+                "punpckldq    %%xmm1, %%xmm4 \n" // 01 of samples 0-1
+                "punpckhdq    %%xmm1, %%xmm0 \n" // 01 of samples 2-3
+                "movdqa       %%xmm2, %%xmm5 \n"
+                "punpckldq    %%xmm3, %%xmm5 \n" // 23 of samples 0-1
+                "punpckhdq    %%xmm3, %%xmm2 \n" // 23 of samples 2-3
+                "movdqa       %%xmm4, %%xmm6 \n"
+                "punpcklqdq   %%xmm5, %%xmm6 \n" // sample 0
+                "punpckhqdq   %%xmm5, %%xmm4 \n" // sample 1
+                "movdqa       %%xmm0, %%xmm7 \n"
+                "punpcklqdq   %%xmm2, %%xmm7 \n" // sample 2
+                "punpckhqdq   %%xmm2, %%xmm0 \n" // sample 3
+                "movdqu       %%xmm6, (%0)    \n"
+                "movdqu       %%xmm4, (%0,%3) \n"
+                "lea       (%0,%3,2), %0      \n"
+                "movdqu       %%xmm7, (%0)    \n"
+                "movdqu       %%xmm0, (%0,%3) \n"
+                "lea       (%0,%3,2), %0      \n"
+                "add             $16, %1      \n"
+                "add             $16, %2      \n"
+                "cmp              %5, %1      \n"
+                "jb 1b \n"
+                : "+r"(d), "+r"(s), "+r"(s2)
+                : "r"(stride), "r"(plane), "m"(end)
+                : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                               "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+            );
+        }
+    } else
+        n = 0;
+
+    ff_interleave_32_c(dst + n * stride, src + n * 4, plane_size, len - n, channels);
+}
+
+#endif /* HAVE_SSE */
+
+av_cold void ff_interleavedsp_init_x86(InterleaveDSPContext *c)
+{
+    int mm_flags = av_get_cpu_flags();
+
+#if HAVE_SSE
+    if (mm_flags & AV_CPU_FLAG_SSE2) {
+        c->interleave[1] = interleave_16_sse2;
+        c->interleave[2] = interleave_32_sse2;
+    }
+#endif
+}
@@ -0,0 +1,164 @@
+/*
+ * Audio resampling filters
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "libavutil/x86_cpu.h"
+#include "libavcodec/resampledsp.h"
+
+#if HAVE_SSE
+
+/*
+ * The channels are filtered 8 or 4 at a time, one channel per lane, the
+ * tap being broadcast to all the lanes. The remaining channels are filtered
+ * in C, in the same order so that the results match.
+ */
+
+static void resample_filter_flt_sse(float *dst, const float *src, const float *filter,
+                                    int filter_length, int channels)
+{
+    x86_reg stride = channels * sizeof(*src);
+    int c, i;
+
+    for (c = 0; c + 8 <= channels; c += 8) {
+        x86_reg j = -filter_length;
+        const float *s = src + c;
+        __asm__ volatile(
+            "xorps     %%xmm0, %%xmm0       \n\t"
+            "xorps     %%xmm1, %%xmm1       \n\t"
+            "1:                             \n\t"
+            "movss    (%3, %0, 4), %%xmm2   \n\t"
+            "shufps    $0, %%xmm2, %%xmm2   \n\t"
+            "movups     (%1), %%xmm3        \n\t"
+            "movups   16(%1), %%xmm4        \n\t"
+            "mulps     %%xmm2, %%xmm3       \n\t"
+            "mulps     %%xmm2, %%xmm4       \n\t"
+            "addps     %%xmm3, %%xmm0       \n\t"
+            "addps     %%xmm4, %%xmm1       \n\t"
+            "add       %4, %1               \n\t"
+            "add       $1, %0               \n\t"
+            "js 1b                          \n\t"
+            "movups    %%xmm0,   (%2)       \n\t"
+            "movups    %%xmm1, 16(%2)       \n\t"
+            : "+r" (j), "+r" (s)
+            : "r" (dst + c), "r" (filter + filter_length), "r" (stride)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4",) "memory"
+        );
+    }
+    for (; c + 4 <= channels; c += 4) {
+        x86_reg j = -filter_length;
+        const float *s = src + c;
+        __asm__ volatile(
+            "xorps     %%xmm0, %%xmm0       \n\t"
+            "1:                             \n\t"
+            "movss    (%3, %0, 4), %%xmm2   \n\t"
+            "shufps    $0, %%xmm2, %%xmm2   \n\t"
+            "movups     (%1), %%xmm3        \n\t"
+            "mulps     %%xmm2, %%xmm3       \n\t"
+            "addps     %%xmm3, %%xmm0       \n\t"
+            "add       %4, %1               \n\t"
+            "add       $1, %0               \n\t"
+            "js 1b                          \n\t"
+            "movups    %%xmm0, (%2)         \n\t"
+            : "+r" (j), "+r" (s)
+            : "r" (dst + c), "r" (filter + filter_length), "r" (stride)
+            : XMM_CLOBBERS("%xmm0", "%xmm2", "%xmm3",) "memory"
+        );
+    }
+    for (; c < channels; c++) {
+        float sum = 0;
+        for (i = 0; i < filter_length; i++)
+            sum += src[i * channels + c] * filter[i];
+        dst[c] = sum;
+    }
+}
+
+static void resample_filter_s32_sse2(double *dst, const int32_t *src, const double *filter,
+                                     int filter_length, int channels)
+{
+    x86_reg stride = channels * sizeof(*src);
+    int c, i;
+
+    for (c = 0; c + 4 <= channels; c += 4) {
+        x86_reg j = -filter_length;
+        const int32_t *s = src + c;
+        __asm__ volatile(
+            "xorpd     %%xmm0, %%xmm0       \n\t"
+            "xorpd     %%xmm1, %%xmm1       \n\t"
+            "1:                             \n\t"
+            "movsd    (%3, %0, 8), %%xmm2   \n\t"
+            "unpcklpd  %%xmm2, %%xmm2       \n\t"
+            "cvtdq2pd  (%1), %%xmm3         \n\t"
+            "cvtdq2pd 8(%1), %%xmm4         \n\t"
+            "mulpd     %%xmm2, %%xmm3       \n\t"
+            "mulpd     %%xmm2, %%xmm4       \n\t"
+            "addpd     %%xmm3, %%xmm0       \n\t"
+            "addpd     %%xmm4, %%xmm1       \n\t"
+            "add       %4, %1               \n\t"
+            "add       $1, %0               \n\t"
+            "js 1b                          \n\t"
+            "movupd    %%xmm0,   (%2)       \n\t"
+            "movupd    %%xmm1, 16(%2)       \n\t"
+            : "+r" (j), "+r" (s)
+            : "r" (dst + c), "r" (filter + filter_length), "r" (stride)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4",) "memory"
+        );
+    }
+    for (; c + 2 <= channels; c += 2) {
+        x86_reg j = -filter_length;
+        const int32_t *s = src + c;
+        __asm__ volatile(
+            "xorpd     %%xmm0, %%xmm0       \n\t"
+            "1:                             \n\t"
+            "movsd    (%3, %0, 8), %%xmm2   \n\t"
+            "unpcklpd  %%xmm2, %%xmm2       \n\t"
+            "cvtdq2pd  (%1), %%xmm3         \n\t"
+            "mulpd     %%xmm2, %%xmm3       \n\t"
+            "addpd     %%xmm3, %%xmm0       \n\t"
+            "add       %4, %1               \n\t"
+            "add       $1, %0               \n\t"
+            "js 1b                          \n\t"
+            "movupd    %%xmm0, (%2)         \n\t"
+            : "+r" (j), "+r" (s)
+            : "r" (dst + c), "r" (filter + filter_length), "r" (stride)
+            : XMM_CLOBBERS("%xmm0", "%xmm2", "%xmm3",) "memory"
+        );
+    }
+    for (; c < channels; c++) {
+        double sum = 0;
+        for (i = 0; i < filter_length; i++)
+            sum += src[i * channels + c] * filter[i];
+        dst[c] = sum;
+    }
+}
+
+#endif /* HAVE_SSE */
+
+av_cold void ff_resampledsp_init_x86(ResampleDSPContext *c)
+{
+    int mm_flags = av_get_cpu_flags();
+
+#if HAVE_SSE
+    if (mm_flags & AV_CPU_FLAG_SSE)
+        c->filter_flt = resample_filter_flt_sse;
+    if (mm_flags & AV_CPU_FLAG_SSE2)
+        c->filter_s32 = resample_filter_s32_sse2;
+#endif
+}
@@ -0,0 +1,161 @@
+/*
+ * V210 line packing and unpacking, SSSE3 version
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/cpu.h"
+#include "libavutil/x86_cpu.h"
+#include "libavcodec/v210dsp.h"
+
+#if HAVE_SSSE3
+
+/*
+ * Each 16 bytes of v210 hold 6 pixels:
+ * u0 y0 v0 | y1 u1 y2 | v1 y3 u2 | y4 v2 y5
+ * The first and last sample of each word are extracted with a 16-bit
+ * multiply and shift, the middle one with a 32-bit shift, then pshufb
+ * puts the samples of each plane in order.
+ */
+DECLARE_ASM_CONST(16, uint16_t, v210_unpack_mult)[8]  = { 64, 4, 64, 4, 64, 4, 64, 4 };
+DECLARE_ASM_CONST(16, uint32_t, v210_unpack_mask)[4]  = { 0x3ff, 0x3ff, 0x3ff, 0x3ff };
+DECLARE_ASM_CONST(16, uint8_t,  v210_unpack_luma_shuf)[16] =
+    { 8, 9, 0, 1, 2, 3, 12, 13, 4, 5, 6, 7, -1, -1, -1, -1 };
+DECLARE_ASM_CONST(16, uint8_t,  v210_unpack_chroma_shuf)[16] =
+    { 0, 1, 8, 9, 6, 7, -1, -1, 2, 3, 4, 5, 12, 13, -1, -1 };
+
+/* clipping to 4..1019 with unsigned saturation, exact for any input */
+DECLARE_ASM_CONST(16, uint16_t, v210_pack_clip_max)[8] =
+    { 0xfc04, 0xfc04, 0xfc04, 0xfc04, 0xfc04, 0xfc04, 0xfc04, 0xfc04 };
+DECLARE_ASM_CONST(16, uint16_t, v210_pack_clip_min)[8] = { 4, 4, 4, 4, 4, 4, 4, 4 };
+DECLARE_ASM_CONST(16, uint16_t, v210_pack_luma_mult)[8]   = { 4, 1, 16, 4, 1, 16, 0, 0 };
+DECLARE_ASM_CONST(16, uint8_t,  v210_pack_luma_shuf)[16] =
+    { -1, 0, 1, -1, 2, 3, 4, 5, -1, 6, 7, -1, 8, 9, 10, 11 };
+DECLARE_ASM_CONST(16, uint16_t, v210_pack_chroma_mult)[8] = { 1, 4, 16, 0, 16, 1, 4, 0 };
+DECLARE_ASM_CONST(16, uint8_t,  v210_pack_chroma_shuf)[16] =
+    { 0, 1, 8, 9, -1, 2, 3, -1, 10, 11, 4, 5, -1, 12, 13, -1 };
+
+static void v210_unpack_line_ssse3(const uint8_t *src, uint16_t *y, uint16_t *u,
+                                   uint16_t *v, int width)
+{
+    x86_reg n = width / 6;
+
+    if (!n)
+        return;
+
+    __asm__ volatile(
+        "movdqa %5,             %%xmm3  \n\t"
+        "movdqa %6,             %%xmm4  \n\t"
+        "movdqa %7,             %%xmm5  \n\t"
+        "movdqa %8,             %%xmm6  \n\t"
+        "1:                             \n\t"
+        "movdqu (%0),           %%xmm0  \n\t"
+        "movdqa %%xmm0,         %%xmm1  \n\t"
+        "pmullw %%xmm3,         %%xmm1  \n\t"
+        "psrld  $10,            %%xmm0  \n\t"
+        "psrlw  $6,             %%xmm1  \n\t" /* u0 v0 y1 y2 v1 u2 y4 y5 */
+        "pand   %%xmm4,         %%xmm0  \n\t" /* y0 __ u1 __ y3 __ v2 __ */
+        "movaps %%xmm1,         %%xmm2  \n\t"
+        "shufps $0x8d, %%xmm0,  %%xmm2  \n\t" /* y1 y2 y4 y5 y0 __ y3 __ */
+        "pshufb %%xmm5,         %%xmm2  \n\t" /* y0 y1 y2 y3 y4 y5 __ __ */
+        "movdqu %%xmm2,         (%1)    \n\t"
+        "shufps $0xd8, %%xmm0,  %%xmm1  \n\t" /* u0 v0 v1 u2 u1 __ v2 __ */
+        "pshufb %%xmm6,         %%xmm1  \n\t" /* u0 u1 u2 __ v0 v1 v2 __ */
+        "movq   %%xmm1,         (%2)    \n\t"
+        "movhps %%xmm1,         (%3)    \n\t"
+        "add    $16,            %0      \n\t"
+        "add    $12,            %1      \n\t"
+        "add    $6,             %2      \n\t"
+        "add    $6,             %3      \n\t"
+        "dec    %4                      \n\t"
+        "jnz    1b                      \n\t"
+        : "+r"(src), "+r"(y), "+r"(u), "+r"(v), "+r"(n)
+        : "m"(v210_unpack_mult[0]), "m"(v210_unpack_mask[0]),
+          "m"(v210_unpack_luma_shuf[0]), "m"(v210_unpack_chroma_shuf[0])
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                       "%xmm4", "%xmm5", "%xmm6",) "memory"
+    );
+}
+
+static void v210_pack_line_ssse3(const uint16_t *y, const uint16_t *u,
+                                 const uint16_t *v, uint8_t *dst, int width)
+{
+    x86_reg n = width / 6;
+
+    if (!n)
+        return;
+
+    __asm__ volatile(
+        "movdqa %5,             %%xmm2  \n\t"
+        "movdqa %6,             %%xmm3  \n\t"
+        "movdqa %7,             %%xmm4  \n\t"
+        "movdqa %8,             %%xmm5  \n\t"
+        "movdqa %9,             %%xmm6  \n\t"
+        "movdqa %10,            %%xmm7  \n\t"
+        "1:                             \n\t"
+        "movdqu (%0),           %%xmm0  \n\t" /* y0 y1 y2 y3 y4 y5 __ __ */
+        "movq   (%1),           %%xmm1  \n\t"
+        "movhps (%2),           %%xmm1  \n\t" /* u0 u1 u2 __ v0 v1 v2 __ */
+        "paddusw %%xmm2,        %%xmm0  \n\t"
+        "paddusw %%xmm2,        %%xmm1  \n\t"
+        "psubusw %%xmm2,        %%xmm0  \n\t"
+        "psubusw %%xmm2,        %%xmm1  \n\t"
+        "psubusw %%xmm3,        %%xmm0  \n\t"
+        "psubusw %%xmm3,        %%xmm1  \n\t"
+        "paddusw %%xmm3,        %%xmm0  \n\t"
+        "paddusw %%xmm3,        %%xmm1  \n\t"
+        "pmullw %%xmm4,         %%xmm0  \n\t"
+        "pshufb %%xmm5,         %%xmm0  \n\t"
+        "pmullw %%xmm6,         %%xmm1  \n\t"
+        "pshufb %%xmm7,         %%xmm1  \n\t"
+        "por    %%xmm1,         %%xmm0  \n\t"
+        "movdqu %%xmm0,         (%3)    \n\t"
+        "add    $12,            %0      \n\t"
+        "add    $6,             %1      \n\t"
+        "add    $6,             %2      \n\t"
+        "add    $16,            %3      \n\t"
+        "dec    %4                      \n\t"
+        "jnz    1b                      \n\t"
+        : "+r"(y), "+r"(u), "+r"(v), "+r"(dst), "+r"(n)
+        : "m"(v210_pack_clip_max[0]), "m"(v210_pack_clip_min[0]),
+          "m"(v210_pack_luma_mult[0]), "m"(v210_pack_luma_shuf[0]),
+          "m"(v210_pack_chroma_mult[0]), "m"(v210_pack_chroma_shuf[0])
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                       "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+    );
+}
+
+#endif /* HAVE_SSSE3 */
+
+av_cold void ff_v210dsp_init_x86(V210DSPContext *c, AVCodecContext *avctx)
+{
+    int mm_flags = av_get_cpu_flags();
+
+    if (avctx->dsp_mask) {
+        if (avctx->dsp_mask & AV_CPU_FLAG_FORCE)
+            mm_flags |= (avctx->dsp_mask & 0xffff);
+        else
+            mm_flags &= ~(avctx->dsp_mask & 0xffff);
+    }
+
+#if HAVE_SSSE3
+    if (mm_flags & AV_CPU_FLAG_SSSE3) {
+        c->unpack_line = v210_unpack_line_ssse3;
+        c->pack_line   = v210_pack_line_ssse3;
+    }
+#endif
+}
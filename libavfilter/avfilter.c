@@ -583,6 +583,7 @@ int avfilter_open(AVFilterContext **filter_ctx, AVFilter *filter, const char *in
     ret->filter   = filter;
     ret->name     = inst_name ? av_strdup(inst_name) : NULL;
     ret->priv     = av_mallocz(filter->priv_size);
+    ret->execute  = avfilter_default_execute;
 
     ret->input_count  = pad_count(filter->inputs);
     if (ret->input_count) {
@@ -619,6 +620,7 @@ void avfilter_free(AVFilterContext *filter)
                 link->src->outputs[link->srcpad - link->src->output_pads] = NULL;
             avfilter_formats_unref(&link->in_formats);
             avfilter_formats_unref(&link->out_formats);
+            ff_avfilter_free_pool(link->pool);
         }
         av_freep(&link);
     }
@@ -628,6 +630,7 @@ void avfilter_free(AVFilterContext *filter)
                 link->dst->inputs[link->dstpad - link->dst->input_pads] = NULL;
             avfilter_formats_unref(&link->in_formats);
             avfilter_formats_unref(&link->out_formats);
+            ff_avfilter_free_pool(link->pool);
         }
         av_freep(&link);
     }
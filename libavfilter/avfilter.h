@@ -26,7 +26,7 @@
 #include "libavutil/samplefmt.h"
 
 #define LIBAVFILTER_VERSION_MAJOR  1
-#define LIBAVFILTER_VERSION_MINOR 76
+#define LIBAVFILTER_VERSION_MINOR 79
 #define LIBAVFILTER_VERSION_MICRO  0
 
 #define LIBAVFILTER_VERSION_INT AV_VERSION_INT(LIBAVFILTER_VERSION_MAJOR, \
@@ -59,6 +59,15 @@ typedef struct AVFilterContext AVFilterContext;
 typedef struct AVFilterLink    AVFilterLink;
 typedef struct AVFilterPad     AVFilterPad;
 
+/**
+ * A function executing one job of a filter, jobnr is the index of the job
+ * in [0, nb_jobs). The jobs of one call to AVFilterContext.execute() may
+ * be run concurrently, so they must not write to the same memory.
+ *
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+typedef int (avfilter_action_func)(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs);
+
 /**
  * A reference-counted buffer data type used by the filter system. Filters
  * should not store pointers to this structure directly, but instead use the
@@ -461,6 +470,10 @@ AVFilterBufferRef *avfilter_default_get_audio_buffer(AVFilterLink *link, int per
                                                      enum AVSampleFormat sample_fmt, int size,
                                                      int64_t channel_layout, int planar);
 
+/** default handler for execute(), runs the jobs one after the other */
+int avfilter_default_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                             void *arg, int *ret, int nb_jobs);
+
 /**
  * A helper for query_formats() which sets all links to the same list of
  * formats. If there are no links hooked to this filter, the list of formats is
@@ -553,6 +566,18 @@ struct AVFilterContext {
     AVFilterLink **outputs;         ///< array of pointers to output links
 
     void *priv;                     ///< private data for use by the filter
+
+    struct AVFilterGraph *graph;    ///< filter graph this filter belongs to, NULL if none
+
+    /**
+     * Run func nb_jobs times, with jobnr going from 0 to nb_jobs - 1, and
+     * return when all the jobs are done. The jobs are run in parallel by
+     * the threads of the filter graph if it has some, serially otherwise.
+     *
+     * @param ret array receiving the return value of each job, may be NULL
+     */
+    int (*execute)(AVFilterContext *ctx, avfilter_action_func *func, void *arg,
+                   int *ret, int nb_jobs);
 };
 
 /**
@@ -616,6 +641,12 @@ struct AVFilterLink {
      * input link is assumed to be an unchangeable property.
      */
     AVRational time_base;
+
+    /**
+     * Pool of video buffers allocated by the default get_video_buffer
+     * callback for this link. Internal, should not be accessed directly.
+     */
+    struct AVFilterPool *pool;
 };
 
 /**
@@ -638,6 +669,16 @@ int avfilter_link(AVFilterContext *src, unsigned srcpad,
  */
 int avfilter_config_links(AVFilterContext *filter);
 
+/**
+ * Get the statistics of the video buffer pool of a link.
+ *
+ * @param link   the link whose buffers are allocated by the default
+ *               get_video_buffer callback
+ * @param hits   set to the number of buffers reused from the pool
+ * @param misses set to the number of buffers that had to be allocated
+ */
+void avfilter_link_get_pool_stats(AVFilterLink *link, unsigned *hits, unsigned *misses);
+
 /**
  * Request a picture buffer with a specific set of permissions.
  *
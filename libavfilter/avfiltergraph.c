@@ -23,6 +23,7 @@
 #include <ctype.h>
 #include <string.h>
 
+#include "config.h"
 #include "avfilter.h"
 #include "avfiltergraph.h"
 #include "internal.h"
@@ -49,6 +50,8 @@ void avfilter_graph_free(AVFilterGraph **graph)
 {
     if (!*graph)
         return;
+    if (HAVE_PTHREADS)
+        ff_graph_thread_free(*graph);
     for (; (*graph)->filter_count > 0; (*graph)->filter_count--)
         avfilter_free((*graph)->filters[(*graph)->filter_count - 1]);
     av_freep(&(*graph)->scale_sws_opts);
@@ -65,6 +68,7 @@ int avfilter_graph_add_filter(AVFilterGraph *graph, AVFilterContext *filter)
 
     graph->filters = filters;
     graph->filters[graph->filter_count++] = filter;
+    filter->graph = graph;
 
     return 0;
 }
@@ -139,6 +143,13 @@ int ff_avfilter_graph_config_links(AVFilterGraph *graph)
     return 0;
 }
 
+int ff_filter_get_nb_threads(AVFilterContext *ctx)
+{
+    if (ctx->graph && ctx->graph->thread_opaque)
+        return ctx->graph->thread_count;
+    return 1;
+}
+
 AVFilterContext *avfilter_graph_get_filter(AVFilterGraph *graph, char *name)
 {
     int i;
@@ -256,6 +267,11 @@ int avfilter_graph_config(AVFilterGraph *graph)
         return ret;
     if ((ret = ff_avfilter_graph_config_formats(graph)))
         return ret;
+    /* started before the links are configured, so that the filters
+       know how many jobs to prepare for in their config_props() */
+    if (HAVE_PTHREADS && graph->thread_count > 1 &&
+        (ret = ff_graph_thread_init(graph)) < 0)
+        return ret;
     if ((ret = ff_avfilter_graph_config_links(graph)))
         return ret;
 
@@ -30,6 +30,15 @@ typedef struct AVFilterGraph {
     AVFilterContext **filters;
     int log_level_offset;
     char *scale_sws_opts; ///< sws options to use for the auto-inserted scale filters
+
+    /**
+     * Number of threads the filters of the graph may split their work
+     * between, set by the user before avfilter_graph_config().
+     * Values lower than 2 disable threading.
+     */
+    int thread_count;
+
+    void *thread_opaque;  ///< thread pool of the graph, used internally
 } AVFilterGraph;
 
 /**
@@ -25,21 +25,96 @@
 #include "avfilter.h"
 #include "internal.h"
 
-/* TODO: buffer pool.  see comment for avfilter_default_get_video_buffer() */
 void ff_avfilter_default_free_buffer(AVFilterBuffer *ptr)
 {
     av_free(ptr->data[0]);
     av_free(ptr);
 }
 
-/* TODO: set the buffer's priv member to a context structure for the whole
- * filter chain.  This will allow for a buffer pool instead of the constant
- * alloc & free cycle currently implemented. */
+static void free_pool_if_unused(AVFilterPool *pool)
+{
+    if (pool->draining && !pool->refcount) {
+        av_log(NULL, AV_LOG_DEBUG, "video buffer pool: %u hits, %u misses\n",
+               pool->hits, pool->misses);
+        av_free(pool);
+    }
+}
+
+/* put the buffer back into the pool of the link it was allocated for */
+static void pool_free_buffer(AVFilterBuffer *ptr)
+{
+    AVFilterPool *pool = ptr->priv;
+
+    if (!pool->draining && pool->count < POOL_SIZE) {
+        pool->buf[pool->count++] = ptr;
+    } else {
+        ff_avfilter_default_free_buffer(ptr);
+    }
+    pool->refcount--;
+    free_pool_if_unused(pool);
+}
+
+void ff_avfilter_free_pool(AVFilterPool *pool)
+{
+    int i;
+
+    if (!pool)
+        return;
+
+    for (i = 0; i < pool->count; i++)
+        ff_avfilter_default_free_buffer(pool->buf[i]);
+    pool->count = 0;
+    pool->draining = 1;
+    free_pool_if_unused(pool);
+}
+
+void avfilter_link_get_pool_stats(AVFilterLink *link, unsigned *hits, unsigned *misses)
+{
+    *hits   = link->pool ? link->pool->hits   : 0;
+    *misses = link->pool ? link->pool->misses : 0;
+}
+
+/* Buffers are recycled through a per-link pool since the link properties
+ * rarely change, which avoids the allocation and page faults of large
+ * frames for every picture. */
 AVFilterBufferRef *avfilter_default_get_video_buffer(AVFilterLink *link, int perms, int w, int h)
 {
     int linesize[4];
     uint8_t *data[4];
     AVFilterBufferRef *picref = NULL;
+    AVFilterPool *pool = link->pool;
+    int i;
+
+    if (!pool) {
+        pool = link->pool = av_mallocz(sizeof(AVFilterPool));
+        if (!pool)
+            return NULL;
+    }
+
+    for (i = 0; i < pool->count; i++) {
+        AVFilterBuffer *pic = pool->buf[i];
+        if (pic->w == w && pic->h == h && pic->format == link->format) {
+            if (!(picref = av_mallocz(sizeof(AVFilterBufferRef))) ||
+                !(picref->video = av_mallocz(sizeof(AVFilterBufferRefVideoProps)))) {
+                av_free(picref);
+                return NULL;
+            }
+            pool->buf[i] = pool->buf[--pool->count];
+            pool->hits++;
+            pool->refcount++;
+
+            pic->refcount = 1;
+            picref->buf = pic;
+            picref->type = AVMEDIA_TYPE_VIDEO;
+            picref->format = pic->format;
+            picref->video->w = w;
+            picref->video->h = h;
+            picref->perms = perms | AV_PERM_READ;
+            memcpy(picref->data,     pic->data,     sizeof(picref->data));
+            memcpy(picref->linesize, pic->linesize, sizeof(picref->linesize));
+            return picref;
+        }
+    }
 
     // +2 is needed for swscaler, +16 to be SIMD-friendly
     if (av_image_alloc(data, linesize, w, h, link->format, 16) < 0)
@@ -52,6 +127,11 @@ AVFilterBufferRef *avfilter_default_get_video_buffer(AVFilterLink *link, int per
         return NULL;
     }
 
+    picref->buf->priv = pool;
+    picref->buf->free = pool_free_buffer;
+    pool->misses++;
+    pool->refcount++;
+
     return picref;
 }
 
@@ -299,3 +379,16 @@ AVFilterBufferRef *avfilter_null_get_audio_buffer(AVFilterLink *link, int perms,
                                      size, channel_layout, packed);
 }
 
+
+int avfilter_default_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                             void *arg, int *ret, int nb_jobs)
+{
+    int i;
+
+    for (i = 0; i < nb_jobs; i++) {
+        int r = func(ctx, arg, i, nb_jobs);
+        if (ret)
+            ret[i] = r;
+    }
+    return 0;
+}
@@ -49,7 +49,47 @@ int ff_avfilter_graph_config_links(AVFilterGraph *graph);
  */
 int ff_avfilter_graph_config_formats(AVFilterGraph *graph);
 
+/**
+ * Start the thread pool of graph, if it has not been started yet, and
+ * make the filters of graph execute their jobs with it.
+ *
+ * @return 0 in case of success, a negative AVERROR code otherwise
+ */
+int ff_graph_thread_init(AVFilterGraph *graph);
+
+/**
+ * Stop and free the thread pool of graph.
+ */
+void ff_graph_thread_free(AVFilterGraph *graph);
+
+/**
+ * Return the number of threads which run the jobs of ctx->execute(),
+ * filters should cut their work in at most this number of jobs.
+ */
+int ff_filter_get_nb_threads(AVFilterContext *ctx);
+
 /** default handler for freeing audio/video buffer when there are no references left */
 void ff_avfilter_default_free_buffer(AVFilterBuffer *buf);
 
+#define POOL_SIZE 32
+
+/**
+ * Pool of video buffers of a link, kept for reuse once they are released.
+ * Only buffers of the current link dimensions and format are handed out.
+ */
+typedef struct AVFilterPool {
+    AVFilterBuffer *buf[POOL_SIZE]; ///< released buffers available for reuse
+    int count;                      ///< number of buffers in buf
+    int refcount;                   ///< number of pool buffers still referenced
+    int draining;                   ///< set when the link is gone, pool is freed with its last buffer
+    unsigned hits;                  ///< number of buffers served from the pool
+    unsigned misses;                ///< number of buffers that had to be allocated
+} AVFilterPool;
+
+/**
+ * Free the unused buffers of pool and mark it for deletion, the pool
+ * itself is freed when its last referenced buffer is released.
+ */
+void ff_avfilter_free_pool(AVFilterPool *pool);
+
 #endif  /* AVFILTER_INTERNAL_H */
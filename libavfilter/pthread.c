@@ -0,0 +1,182 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Slice threading of the filters of a graph.
+ *
+ * The graph owns a pool of thread_count - 1 worker threads, shared by all
+ * its filters since only one filter runs at a time. When a filter calls
+ * execute(), the workers and the calling thread take the jobs one after
+ * the other until none is left.
+ */
+
+#include <pthread.h>
+
+#include "libavutil/internal.h"
+#include "avfilter.h"
+#include "avfiltergraph.h"
+#include "internal.h"
+
+typedef struct ThreadContext {
+    pthread_t *workers;
+    int nb_workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  work_cond;  ///< Signalled when new jobs are to be run.
+    pthread_cond_t  done_cond;  ///< Signalled when the last worker is done.
+    unsigned batch;             ///< Number of execute() calls so far.
+    int pending;                ///< Number of workers not done with the current batch.
+    int die;                    ///< Set when the workers should exit.
+
+    AVFilterContext *ctx;
+    avfilter_action_func *func;
+    void *arg;
+    int *rets;
+    int nb_jobs;
+    int next_job;               ///< Index of the next job to be taken.
+} ThreadContext;
+
+/**
+ * Run the jobs of the current batch until none is left.
+ * Must be called with the lock held.
+ */
+static void run_jobs(ThreadContext *t)
+{
+    while (t->next_job < t->nb_jobs) {
+        int jobnr = t->next_job++;
+        int ret;
+
+        pthread_mutex_unlock(&t->lock);
+        ret = t->func(t->ctx, t->arg, jobnr, t->nb_jobs);
+        pthread_mutex_lock(&t->lock);
+        if (t->rets)
+            t->rets[jobnr] = ret;
+    }
+}
+
+static void* attribute_align_arg worker(void *arg)
+{
+    ThreadContext *t = arg;
+    unsigned batch = 0;
+
+    pthread_mutex_lock(&t->lock);
+    for (;;) {
+        while (t->batch == batch && !t->die)
+            pthread_cond_wait(&t->work_cond, &t->lock);
+        if (t->die)
+            break;
+        batch = t->batch;
+
+        run_jobs(t);
+
+        if (!--t->pending)
+            pthread_cond_signal(&t->done_cond);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                          void *arg, int *ret, int nb_jobs)
+{
+    ThreadContext *t = ctx->graph->thread_opaque;
+
+    if (nb_jobs < 2)
+        return avfilter_default_execute(ctx, func, arg, ret, nb_jobs);
+
+    pthread_mutex_lock(&t->lock);
+    t->ctx      = ctx;
+    t->func     = func;
+    t->arg      = arg;
+    t->rets     = ret;
+    t->nb_jobs  = nb_jobs;
+    t->next_job = 0;
+    t->pending  = t->nb_workers;
+    t->batch++;
+    pthread_cond_broadcast(&t->work_cond);
+
+    run_jobs(t);
+
+    while (t->pending)
+        pthread_cond_wait(&t->done_cond, &t->lock);
+    pthread_mutex_unlock(&t->lock);
+
+    return 0;
+}
+
+int ff_graph_thread_init(AVFilterGraph *graph)
+{
+    ThreadContext *t = graph->thread_opaque;
+    int i;
+
+    if (!t) {
+        if (!(t = av_mallocz(sizeof(ThreadContext))))
+            return AVERROR(ENOMEM);
+        if (!(t->workers = av_mallocz((graph->thread_count - 1) * sizeof(*t->workers)))) {
+            av_free(t);
+            return AVERROR(ENOMEM);
+        }
+        pthread_mutex_init(&t->lock, NULL);
+        pthread_cond_init(&t->work_cond, NULL);
+        pthread_cond_init(&t->done_cond, NULL);
+        graph->thread_opaque = t;
+
+        for (i = 0; i < graph->thread_count - 1; i++) {
+            if (pthread_create(&t->workers[i], NULL, worker, t)) {
+                av_log(graph, AV_LOG_ERROR, "Could not create filter thread %d\n", i);
+                ff_graph_thread_free(graph);
+                return AVERROR(ENOMEM);
+            }
+            t->nb_workers++;
+        }
+    }
+
+    for (i = 0; i < graph->filter_count; i++)
+        if (graph->filters[i])
+            graph->filters[i]->execute = thread_execute;
+
+    return 0;
+}
+
+void ff_graph_thread_free(AVFilterGraph *graph)
+{
+    ThreadContext *t = graph->thread_opaque;
+    int i;
+
+    if (!t)
+        return;
+
+    pthread_mutex_lock(&t->lock);
+    t->die = 1;
+    pthread_cond_broadcast(&t->work_cond);
+    pthread_mutex_unlock(&t->lock);
+
+    for (i = 0; i < t->nb_workers; i++)
+        pthread_join(t->workers[i], NULL);
+
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->work_cond);
+    pthread_cond_destroy(&t->done_cond);
+    av_freep(&t->workers);
+    av_freep(&graph->thread_opaque);
+
+    for (i = 0; i < graph->filter_count; i++)
+        if (graph->filters[i])
+            graph->filters[i]->execute = avfilter_default_execute;
+}
@@ -27,6 +27,7 @@
 #include <strings.h>
 #include <float.h>
 #include "avfilter.h"
+#include "internal.h"
 #include "libavutil/pixdesc.h"
 
 #define NS(n) n < 0 ? (int)(n*65536.0-0.5+DBL_EPSILON) : (int)(n*65536.0+0.5)
@@ -57,6 +58,11 @@ typedef struct {
     int hsub, vsub;
 } ColorMatrixContext;
 
+typedef struct ThreadData {
+    AVFilterBufferRef *dst;
+    AVFilterBufferRef *src;
+} ThreadData;
+
 #define ma m[0][0]
 #define mb m[0][1]
 #define mc m[0][2]
@@ -193,15 +199,20 @@ static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
     return 0;
 }
 
-static void process_frame_uyvy422(ColorMatrixContext *color,
-                                  AVFilterBufferRef *dst, AVFilterBufferRef *src)
+static int process_slice_uyvy422(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    const unsigned char *srcp = src->data[0];
-    const int src_pitch = src->linesize[0];
+    ColorMatrixContext *color = ctx->priv;
+    ThreadData *td = arg;
+    AVFilterBufferRef *src = td->src;
+    AVFilterBufferRef *dst = td->dst;
     const int height = src->video->h;
+    const int slice_start = height *  jobnr      / nb_jobs;
+    const int slice_end   = height * (jobnr + 1) / nb_jobs;
+    const int src_pitch = src->linesize[0];
     const int width = src->video->w*2;
-    unsigned char *dstp = dst->data[0];
     const int dst_pitch = dst->linesize[0];
+    const unsigned char *srcp = src->data[0] + slice_start * src_pitch;
+    unsigned char *dstp = dst->data[0] + slice_start * dst_pitch;
     const int c2 = color->yuv_convert[color->mode][0][1];
     const int c3 = color->yuv_convert[color->mode][0][2];
     const int c4 = color->yuv_convert[color->mode][1][1];
@@ -210,7 +221,7 @@ static void process_frame_uyvy422(ColorMatrixContext *color,
     const int c7 = color->yuv_convert[color->mode][2][2];
     int x, y;
 
-    for (y = 0; y < height; ++y) {
+    for (y = slice_start; y < slice_end; ++y) {
         for (x = 0; x < width; x += 4) {
             const int u = srcp[x + 0] - 128;
             const int v = srcp[x + 2] - 128;
@@ -223,23 +234,29 @@ static void process_frame_uyvy422(ColorMatrixContext *color,
         srcp += src_pitch;
         dstp += dst_pitch;
     }
+    return 0;
 }
 
-static void process_frame_yuv422p(ColorMatrixContext *color,
-                                  AVFilterBufferRef *dst, AVFilterBufferRef *src)
+static int process_slice_yuv422p(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    const unsigned char *srcpU = src->data[1];
-    const unsigned char *srcpV = src->data[2];
-    const unsigned char *srcpY = src->data[0];
+    ColorMatrixContext *color = ctx->priv;
+    ThreadData *td = arg;
+    AVFilterBufferRef *src = td->src;
+    AVFilterBufferRef *dst = td->dst;
+    const int height = src->video->h;
+    const int slice_start = height *  jobnr      / nb_jobs;
+    const int slice_end   = height * (jobnr + 1) / nb_jobs;
     const int src_pitchY  = src->linesize[0];
     const int src_pitchUV = src->linesize[1];
-    const int height = src->video->h;
     const int width = src->video->w;
-    unsigned char *dstpU = dst->data[1];
-    unsigned char *dstpV = dst->data[2];
-    unsigned char *dstpY = dst->data[0];
     const int dst_pitchY  = dst->linesize[0];
     const int dst_pitchUV = dst->linesize[1];
+    const unsigned char *srcpU = src->data[1] + slice_start * src_pitchUV;
+    const unsigned char *srcpV = src->data[2] + slice_start * src_pitchUV;
+    const unsigned char *srcpY = src->data[0] + slice_start * src_pitchY;
+    unsigned char *dstpU = dst->data[1] + slice_start * dst_pitchUV;
+    unsigned char *dstpV = dst->data[2] + slice_start * dst_pitchUV;
+    unsigned char *dstpY = dst->data[0] + slice_start * dst_pitchY;
     const int c2 = color->yuv_convert[color->mode][0][1];
     const int c3 = color->yuv_convert[color->mode][0][2];
     const int c4 = color->yuv_convert[color->mode][1][1];
@@ -248,7 +265,7 @@ static void process_frame_yuv422p(ColorMatrixContext *color,
     const int c7 = color->yuv_convert[color->mode][2][2];
     int x, y;
 
-    for (y = 0; y < height; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         for (x = 0; x < width; x += 2) {
             const int u = srcpU[x >> 1] - 128;
             const int v = srcpV[x >> 1] - 128;
@@ -265,25 +282,32 @@ static void process_frame_yuv422p(ColorMatrixContext *color,
         dstpU += dst_pitchUV;
         dstpV += dst_pitchUV;
     }
+    return 0;
 }
 
-static void process_frame_yuv420p(ColorMatrixContext *color,
-                                  AVFilterBufferRef *dst, AVFilterBufferRef *src)
+/* the lines are converted by pairs, sharing a line of chroma */
+static int process_slice_yuv420p(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    const unsigned char *srcpU = src->data[1];
-    const unsigned char *srcpV = src->data[2];
-    const unsigned char *srcpY = src->data[0];
-    const unsigned char *srcpN = src->data[0] + src->linesize[0];
+    ColorMatrixContext *color = ctx->priv;
+    ThreadData *td = arg;
+    AVFilterBufferRef *src = td->src;
+    AVFilterBufferRef *dst = td->dst;
+    const int pairs = (src->video->h + 1) >> 1;
+    const int slice_start = pairs *  jobnr      / nb_jobs;
+    const int slice_end   = pairs * (jobnr + 1) / nb_jobs;
     const int src_pitchY  = src->linesize[0];
     const int src_pitchUV = src->linesize[1];
-    const int height = src->video->h;
     const int width = src->video->w;
-    unsigned char *dstpU = dst->data[1];
-    unsigned char *dstpV = dst->data[2];
-    unsigned char *dstpY = dst->data[0];
-    unsigned char *dstpN = dst->data[0] + dst->linesize[0];
     const int dst_pitchY  = dst->linesize[0];
     const int dst_pitchUV = dst->linesize[1];
+    const unsigned char *srcpU = src->data[1] + slice_start * src_pitchUV;
+    const unsigned char *srcpV = src->data[2] + slice_start * src_pitchUV;
+    const unsigned char *srcpY = src->data[0] + 2 * slice_start * src_pitchY;
+    const unsigned char *srcpN = srcpY + src_pitchY;
+    unsigned char *dstpU = dst->data[1] + slice_start * dst_pitchUV;
+    unsigned char *dstpV = dst->data[2] + slice_start * dst_pitchUV;
+    unsigned char *dstpY = dst->data[0] + 2 * slice_start * dst_pitchY;
+    unsigned char *dstpN = dstpY + dst_pitchY;
     const int c2 = color->yuv_convert[color->mode][0][1];
     const int c3 = color->yuv_convert[color->mode][0][2];
     const int c4 = color->yuv_convert[color->mode][1][1];
@@ -292,7 +316,7 @@ static void process_frame_yuv420p(ColorMatrixContext *color,
     const int c7 = color->yuv_convert[color->mode][2][2];
     int x, y;
 
-    for (y = 0; y < height; y += 2) {
+    for (y = slice_start; y < slice_end; y++) {
         for (x = 0; x < width; x += 2) {
             const int u = srcpU[x >> 1] - 128;
             const int v = srcpV[x >> 1] - 128;
@@ -313,6 +337,7 @@ static void process_frame_yuv420p(ColorMatrixContext *color,
         dstpU += dst_pitchUV;
         dstpV += dst_pitchUV;
     }
+    return 0;
 }
 
 static int config_input(AVFilterLink *inlink)
@@ -362,15 +387,17 @@ static void start_frame(AVFilterLink *link, AVFilterBufferRef *picref)
 static void end_frame(AVFilterLink *link)
 {
     AVFilterContext *ctx = link->dst;
-    ColorMatrixContext *color = ctx->priv;
     AVFilterBufferRef *out = link->dst->outputs[0]->out_buf;
+    ThreadData td = { out, link->cur_buf };
+    int nb_jobs = FFMIN(link->h >> 1, ff_filter_get_nb_threads(ctx));
 
+    nb_jobs = FFMAX(nb_jobs, 1);
     if (link->cur_buf->format == PIX_FMT_YUV422P)
-        process_frame_yuv422p(color, out, link->cur_buf);
+        ctx->execute(ctx, process_slice_yuv422p, &td, NULL, nb_jobs);
     else if (link->cur_buf->format == PIX_FMT_YUV420P)
-        process_frame_yuv420p(color, out, link->cur_buf);
+        ctx->execute(ctx, process_slice_yuv420p, &td, NULL, nb_jobs);
     else
-        process_frame_uyvy422(color, out, link->cur_buf);
+        ctx->execute(ctx, process_slice_uyvy422, &td, NULL, nb_jobs);
 
     avfilter_draw_slice(ctx->outputs[0], 0, link->dst->outputs[0]->h, 1);
     avfilter_end_frame(ctx->outputs[0]);
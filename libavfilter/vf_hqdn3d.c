@@ -26,10 +26,11 @@
 
 #include "libavutil/pixdesc.h"
 #include "avfilter.h"
+#include "internal.h"
 
 typedef struct {
     int Coefs[4][512*16];
-    unsigned int *Line;
+    unsigned int *Line[3];  ///< one line buffer per plane, the planes are denoised in parallel
     unsigned short *Frame[3];
     int hsub, vsub;
 } HQDN3DContext;
@@ -255,7 +256,9 @@ static void uninit(AVFilterContext *ctx)
 {
     HQDN3DContext *hqdn3d = ctx->priv;
 
-    av_freep(&hqdn3d->Line);
+    av_freep(&hqdn3d->Line[0]);
+    av_freep(&hqdn3d->Line[1]);
+    av_freep(&hqdn3d->Line[2]);
     av_freep(&hqdn3d->Frame[0]);
     av_freep(&hqdn3d->Frame[1]);
     av_freep(&hqdn3d->Frame[2]);
@@ -275,46 +278,51 @@ static int query_formats(AVFilterContext *ctx)
 static int config_input(AVFilterLink *inlink)
 {
     HQDN3DContext *hqdn3d = inlink->dst->priv;
+    int i;
 
     hqdn3d->hsub = av_pix_fmt_descriptors[inlink->format].log2_chroma_w;
     hqdn3d->vsub = av_pix_fmt_descriptors[inlink->format].log2_chroma_h;
 
-    hqdn3d->Line = av_malloc(inlink->w * sizeof(*hqdn3d->Line));
-    if (!hqdn3d->Line)
-        return AVERROR(ENOMEM);
+    for (i = 0; i < 3; i++) {
+        hqdn3d->Line[i] = av_malloc(inlink->w * sizeof(*hqdn3d->Line[i]));
+        if (!hqdn3d->Line[i])
+            return AVERROR(ENOMEM);
+    }
 
     return 0;
 }
 
 static void null_draw_slice(AVFilterLink *link, int y, int h, int slice_dir) { }
 
+/**
+ * Denoise plane jobnr of the input picture. The vertical low-pass filter
+ * is recursive, so a plane cannot be cut in bands: the jobs are the planes.
+ */
+static int denoise_plane(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    HQDN3DContext *hqdn3d = ctx->priv;
+    AVFilterBufferRef *inpic  = ctx->inputs [0]->cur_buf;
+    AVFilterBufferRef *outpic = ctx->outputs[0]->out_buf;
+    int w = jobnr ? inpic->video->w >> hqdn3d->hsub : inpic->video->w;
+    int h = jobnr ? inpic->video->h >> hqdn3d->vsub : inpic->video->h;
+    int *spatial  = hqdn3d->Coefs[jobnr ? 2 : 0];
+    int *temporal = hqdn3d->Coefs[jobnr ? 3 : 1];
+
+    deNoise(inpic->data[jobnr], outpic->data[jobnr],
+            hqdn3d->Line[jobnr], &hqdn3d->Frame[jobnr], w, h,
+            inpic->linesize[jobnr], outpic->linesize[jobnr],
+            spatial, spatial, temporal);
+    return 0;
+}
+
 static void end_frame(AVFilterLink *inlink)
 {
-    HQDN3DContext *hqdn3d = inlink->dst->priv;
-    AVFilterLink *outlink = inlink->dst->outputs[0];
+    AVFilterContext *ctx = inlink->dst;
+    AVFilterLink *outlink = ctx->outputs[0];
     AVFilterBufferRef *inpic  = inlink ->cur_buf;
     AVFilterBufferRef *outpic = outlink->out_buf;
-    int cw = inpic->video->w >> hqdn3d->hsub;
-    int ch = inpic->video->h >> hqdn3d->vsub;
-
-    deNoise(inpic->data[0], outpic->data[0],
-            hqdn3d->Line, &hqdn3d->Frame[0], inpic->video->w, inpic->video->h,
-            inpic->linesize[0], outpic->linesize[0],
-            hqdn3d->Coefs[0],
-            hqdn3d->Coefs[0],
-            hqdn3d->Coefs[1]);
-    deNoise(inpic->data[1], outpic->data[1],
-            hqdn3d->Line, &hqdn3d->Frame[1], cw, ch,
-            inpic->linesize[1], outpic->linesize[1],
-            hqdn3d->Coefs[2],
-            hqdn3d->Coefs[2],
-            hqdn3d->Coefs[3]);
-    deNoise(inpic->data[2], outpic->data[2],
-            hqdn3d->Line, &hqdn3d->Frame[2], cw, ch,
-            inpic->linesize[2], outpic->linesize[2],
-            hqdn3d->Coefs[2],
-            hqdn3d->Coefs[2],
-            hqdn3d->Coefs[3]);
+
+    ctx->execute(ctx, denoise_plane, NULL, NULL, 3);
 
     avfilter_draw_slice(outlink, 0, inpic->video->h, 1);
     avfilter_end_frame(outlink);
@@ -239,12 +239,24 @@ static void start_frame_overlay(AVFilterLink *inlink, AVFilterBufferRef *inpicre
                                          ctx->outputs[0]->time_base);
 }
 
-static void blend_slice(AVFilterContext *ctx,
-                        AVFilterBufferRef *dst, AVFilterBufferRef *src,
-                        int x, int y, int w, int h,
-                        int slice_y, int slice_w, int slice_h)
+typedef struct ThreadData {
+    AVFilterBufferRef *dst, *src;
+    int x, y, w, h;
+    int slice_y, slice_w, slice_h;
+} ThreadData;
+
+/**
+ * Blend the part of the overlay covering the slice. Each job blends its
+ * own band of the lines of every plane, the lines are blended
+ * independently from each other.
+ */
+static int blend_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
     OverlayContext *over = ctx->priv;
+    ThreadData *td = arg;
+    AVFilterBufferRef *dst = td->dst, *src = td->src;
+    int x = td->x, y = td->y, w = td->w, h = td->h;
+    int slice_y = td->slice_y, slice_w = td->slice_w, slice_h = td->slice_h;
     int i, j, k;
     int width, height;
     int overlay_end_y = y+h;
@@ -257,13 +269,15 @@ static void blend_slice(AVFilterContext *ctx,
     height = end_y - start_y;
 
     if (dst->format == PIX_FMT_BGR24 || dst->format == PIX_FMT_RGB24) {
-        uint8_t *dp = dst->data[0] + x * 3 + start_y * dst->linesize[0];
-        uint8_t *sp = src->data[0];
+        int job_start = height *  jobnr      / nb_jobs;
+        int job_end   = height * (jobnr + 1) / nb_jobs;
+        uint8_t *dp = dst->data[0] + x * 3 + (start_y + job_start) * dst->linesize[0];
+        uint8_t *sp = src->data[0] + job_start * src->linesize[0];
         int b = dst->format == PIX_FMT_BGR24 ? 2 : 0;
         int r = dst->format == PIX_FMT_BGR24 ? 0 : 2;
         if (slice_y > y)
             sp += (slice_y - y) * src->linesize[0];
-        for (i = 0; i < height; i++) {
+        for (i = job_start; i < job_end; i++) {
             uint8_t *d = dp, *s = sp;
             for (j = 0; j < width; j++) {
                 d[r] = (d[r] * (0xff - s[3]) + s[0] * s[3] + 128) >> 8;
@@ -279,17 +293,19 @@ static void blend_slice(AVFilterContext *ctx,
         for (i = 0; i < 3; i++) {
             int hsub = i ? over->hsub : 0;
             int vsub = i ? over->vsub : 0;
-            uint8_t *dp = dst->data[i] + (x >> hsub) +
-                (start_y >> vsub) * dst->linesize[i];
-            uint8_t *sp = src->data[i];
-            uint8_t *ap = src->data[3];
             int wp = FFALIGN(width, 1<<hsub) >> hsub;
             int hp = FFALIGN(height, 1<<vsub) >> vsub;
+            int job_start = hp *  jobnr      / nb_jobs;
+            int job_end   = hp * (jobnr + 1) / nb_jobs;
+            uint8_t *dp = dst->data[i] + (x >> hsub) +
+                ((start_y >> vsub) + job_start) * dst->linesize[i];
+            uint8_t *sp = src->data[i] + job_start * src->linesize[i];
+            uint8_t *ap = src->data[3] + (job_start << vsub) * src->linesize[3];
             if (slice_y > y) {
                 sp += ((slice_y - y) >> vsub) * src->linesize[i];
                 ap += (slice_y - y) * src->linesize[3];
             }
-            for (j = 0; j < hp; j++) {
+            for (j = job_start; j < job_end; j++) {
                 uint8_t *d = dp, *s = sp, *a = ap;
                 for (k = 0; k < wp; k++) {
                     // average alpha for color components, improve quality
@@ -315,6 +331,7 @@ static void blend_slice(AVFilterContext *ctx,
             }
         }
     }
+    return 0;
 }
 
 static void draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir)
@@ -327,9 +344,12 @@ static void draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir)
     if (over->overpicref &&
         !(over->x >= outpicref->video->w || over->y >= outpicref->video->h ||
           y+h < over->y || y >= over->y + over->overpicref->video->h)) {
-        blend_slice(ctx, outpicref, over->overpicref, over->x, over->y,
-                    over->overpicref->video->w, over->overpicref->video->h,
-                    y, outpicref->video->w, h);
+        ThreadData td = { outpicref, over->overpicref, over->x, over->y,
+                          over->overpicref->video->w, over->overpicref->video->h,
+                          y, outpicref->video->w, h };
+        int nb_jobs = FFMIN(h >> over->vsub, ff_filter_get_nb_threads(ctx));
+
+        ctx->execute(ctx, blend_slice, &td, NULL, FFMAX(nb_jobs, 1));
     }
     avfilter_draw_slice(outlink, y, h, slice_dir);
 }
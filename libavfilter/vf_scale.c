@@ -60,6 +60,7 @@ typedef struct {
     char w_expr[255], h_expr[255];
     int interlaced;
     char *colorspace;
+    int threads;                ///< scaler threads, whole frames are scaled at end_frame if > 1
 } ScaleContext;
 
 static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
@@ -72,6 +73,8 @@ static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
         sscanf(args, "%255[^:]:%255[^:]:%d", scale->w_expr, scale->h_expr, &scale->interlaced);
         p= strstr(args,"flags=");
         if(p) scale->flags= strtoul(p+6, NULL, 0);
+        p = strstr(args, "threads=");
+        if (p) scale->threads = strtol(p+8, NULL, 0);
         p = strstr(args,"cs=");
         if (p) {
             const char *e = strchr(p+3, ':');
@@ -207,6 +210,8 @@ static int config_props(AVFilterLink *outlink)
     av_set_int(scale->sws, "dsth", outlink->h >> scale->interlaced);
     av_set_int(scale->sws, "dst_format", outlink->format);
     av_set_int(scale->sws, "sws_flags", scale->flags);
+    if (scale->threads > 1)
+        av_set_int(scale->sws, "sws_threads", scale->threads);
     if (scale->colorspace)
         av_set_string3(scale->sws, "colorspace", scale->colorspace, 0, NULL);
     if (sws_init_context(scale->sws, NULL, NULL) < 0)
@@ -225,6 +230,8 @@ static int config_props(AVFilterLink *outlink)
         av_set_int(scale->sws2, "dsth", outlink->h >> scale->interlaced);
         av_set_int(scale->sws2, "dst_format", outlink->format);
         av_set_int(scale->sws2, "sws_flags", scale->flags);
+        if (scale->threads > 1)
+            av_set_int(scale->sws2, "sws_threads", scale->threads);
         if (scale->colorspace)
             av_set_string3(scale->sws2, "colorspace", scale->colorspace, 0, NULL);
         if (sws_init_context(scale->sws2, NULL, NULL) < 0)
@@ -254,7 +261,7 @@ static void start_frame(AVFilterLink *link, AVFilterBufferRef *picref)
     avfilter_start_frame(outlink, avfilter_ref_buffer(outpicref, ~0));
 }
 
-static void draw_slice(AVFilterLink *link, int y, int h, int slice_dir)
+static void scale_slice(AVFilterLink *link, int y, int h, int slice_dir)
 {
     ScaleContext *scale = link->dst->priv;
     int out_h;
@@ -310,6 +317,24 @@ static void draw_slice(AVFilterLink *link, int y, int h, int slice_dir)
         scale->slice_y += out_h;
 }
 
+static void draw_slice(AVFilterLink *link, int y, int h, int slice_dir)
+{
+    ScaleContext *scale = link->dst->priv;
+
+    /* the scaler only threads whole frames, wait for the last slice */
+    if (scale->threads <= 1)
+        scale_slice(link, y, h, slice_dir);
+}
+
+static void end_frame(AVFilterLink *link)
+{
+    ScaleContext *scale = link->dst->priv;
+
+    if (scale->threads > 1)
+        scale_slice(link, 0, link->h, 1);
+    avfilter_default_end_frame(link);
+}
+
 AVFilter avfilter_vf_scale = {
     .name      = "scale",
     .description = NULL_IF_CONFIG_SMALL("Scale the input video to width:height size and/or convert the image format."),
@@ -325,6 +350,7 @@ AVFilter avfilter_vf_scale = {
                                     .type             = AVMEDIA_TYPE_VIDEO,
                                     .start_frame      = start_frame,
                                     .draw_slice       = draw_slice,
+                                    .end_frame        = end_frame,
                                     .min_perms        = AV_PERM_READ, },
                                   { .name = NULL}},
     .outputs   = (AVFilterPad[]) {{ .name             = "default",
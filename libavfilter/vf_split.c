@@ -0,0 +1,231 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * video splitter, feeds the input images to several outputs
+ *
+ * Each output gets its own read-only reference to the input buffer, so
+ * the image is never copied unless a downstream filter asks for write
+ * permissions. References are queued per output until the output
+ * requests them, which lets the branches be pulled independently.
+ */
+
+#include "avfilter.h"
+
+/** no input is read while an output has this many pictures queued */
+#define MAX_QUEUED_PICS 64
+
+typedef struct BufPic {
+    AVFilterBufferRef *picref;
+    struct BufPic     *next;
+} BufPic;
+
+typedef struct {
+    BufPic  root;
+    BufPic *last;   ///< last buffered picture
+    int     count;  ///< number of buffered pictures
+    int     error;  ///< error to return on the next request
+} SplitQueue;
+
+typedef struct {
+    SplitQueue *queues; ///< one queue per output
+    int nb_outputs;
+} SplitContext;
+
+static int request_frame(AVFilterLink *outlink);
+static int poll_frame(AVFilterLink *outlink, int flush);
+
+static BufPic *queue_pop(SplitQueue *q)
+{
+    BufPic *pic = q->root.next;
+
+    if (q->last == pic)
+        q->last = &q->root;
+    q->root.next = pic->next;
+    q->count--;
+
+    return pic;
+}
+
+static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
+{
+    SplitContext *split = ctx->priv;
+    int i;
+
+    split->nb_outputs = 2;
+    if (args && sscanf(args, "%d", &split->nb_outputs) != 1) {
+        av_log(ctx, AV_LOG_ERROR, "Invalid number of outputs '%s'\n", args);
+        return AVERROR(EINVAL);
+    }
+    if (split->nb_outputs < 1) {
+        av_log(ctx, AV_LOG_ERROR, "Invalid number of outputs %d\n", split->nb_outputs);
+        return AVERROR(EINVAL);
+    }
+
+    split->queues = av_mallocz(split->nb_outputs * sizeof(*split->queues));
+    if (!split->queues)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < split->nb_outputs; i++) {
+        AVFilterPad pad = { 0 };
+        char name[32];
+
+        snprintf(name, sizeof(name), "output%d", i);
+        pad.type          = AVMEDIA_TYPE_VIDEO;
+        pad.name          = av_strdup(name);
+        pad.request_frame = request_frame;
+        pad.poll_frame    = poll_frame;
+        if (!pad.name)
+            return AVERROR(ENOMEM);
+        avfilter_insert_outpad(ctx, i, &pad);
+
+        split->queues[i].last = &split->queues[i].root;
+    }
+
+    return 0;
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    SplitContext *split = ctx->priv;
+    BufPic *pic, *tmp;
+    int i;
+
+    for (i = 0; i < ctx->output_count; i++)
+        av_freep(&ctx->output_pads[i].name);
+
+    for (i = 0; i < split->nb_outputs && split->queues; i++) {
+        for (pic = split->queues[i].root.next; pic; pic = tmp) {
+            tmp = pic->next;
+            avfilter_unref_buffer(pic->picref);
+            av_free(pic);
+        }
+    }
+    av_freep(&split->queues);
+}
+
+static void start_frame(AVFilterLink *inlink, AVFilterBufferRef *picref)
+{
+    AVFilterContext *ctx = inlink->dst;
+    SplitContext *split = ctx->priv;
+    int i;
+
+    for (i = 0; i < ctx->output_count; i++) {
+        SplitQueue *q = &split->queues[i];
+        BufPic *pic;
+
+        if (!ctx->outputs[i])
+            continue;
+        if (!(pic = av_mallocz(sizeof(BufPic))) ||
+            !(pic->picref = avfilter_ref_buffer(picref, ~AV_PERM_WRITE))) {
+            av_log(ctx, AV_LOG_ERROR, "Could not queue the picture for output %d\n", i);
+            av_free(pic);
+            q->error = AVERROR(ENOMEM);
+            continue;
+        }
+        q->last->next = pic;
+        q->last = pic;
+        q->count++;
+    }
+}
+
+static void draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir) { }
+
+static void end_frame(AVFilterLink *inlink)
+{
+    avfilter_unref_buffer(inlink->cur_buf);
+    inlink->cur_buf = NULL;
+}
+
+static int request_frame(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    SplitContext *split = ctx->priv;
+    SplitQueue *q = &split->queues[outlink->srcpad - ctx->output_pads];
+    BufPic *pic;
+    int ret;
+
+    if (q->error) {
+        ret = q->error;
+        q->error = 0;
+        return ret;
+    }
+
+    if (!q->root.next) {
+        int i;
+
+        /* the pictures of an output that is not read would pile up */
+        for (i = 0; i < split->nb_outputs; i++) {
+            if (split->queues[i].count >= MAX_QUEUED_PICS) {
+                av_log(ctx, AV_LOG_ERROR, "Output %d is not read, %d pictures are queued\n",
+                       i, split->queues[i].count);
+                return AVERROR(EINVAL);
+            }
+        }
+        if ((ret = avfilter_request_frame(ctx->inputs[0])) < 0)
+            return ret;
+        if (!q->root.next) {
+            ret = q->error ? q->error : AVERROR(EAGAIN);
+            q->error = 0;
+            return ret;
+        }
+    }
+
+    pic = queue_pop(q);
+
+    /* the queued reference is handed over to the next filter */
+    avfilter_start_frame(outlink, pic->picref);
+    avfilter_draw_slice (outlink, 0, outlink->h, 1);
+    avfilter_end_frame  (outlink);
+    av_free(pic);
+
+    return 0;
+}
+
+static int poll_frame(AVFilterLink *outlink, int flush)
+{
+    AVFilterContext *ctx = outlink->src;
+    SplitContext *split = ctx->priv;
+    SplitQueue *q = &split->queues[outlink->srcpad - ctx->output_pads];
+    int ret = avfilter_poll_frame(ctx->inputs[0], flush);
+
+    if (ret < 0)
+        return q->count ? q->count : ret;
+    return q->count + ret;
+}
+
+AVFilter avfilter_vf_split = {
+    .name      = "split",
+    .description = NULL_IF_CONFIG_SMALL("Pass on the input video to N outputs."),
+
+    .init      = init,
+    .uninit    = uninit,
+
+    .priv_size = sizeof(SplitContext),
+
+    .inputs    = (AVFilterPad[]) {{ .name            = "default",
+                                    .type            = AVMEDIA_TYPE_VIDEO,
+                                    .start_frame     = start_frame,
+                                    .draw_slice      = draw_slice,
+                                    .end_frame       = end_frame,
+                                    .min_perms       = AV_PERM_READ,
+                                    .rej_perms       = AV_PERM_REUSE2, },
+                                  { .name = NULL}},
+    .outputs   = (AVFilterPad[]) {{ .name = NULL}},
+};
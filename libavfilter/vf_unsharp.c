@@ -37,6 +37,7 @@
  */
 
 #include "avfilter.h"
+#include "internal.h"
 #include "libavutil/common.h"
 #include "libavutil/mem.h"
 #include "libavutil/pixdesc.h"
@@ -55,38 +56,54 @@ typedef struct FilterParam {
     int steps_y;                             ///< vertical step count
     int scalebits;                           ///< bits to shift pixel
     int32_t halfscale;                       ///< amount to add to pixel
-    uint32_t *sc[(MAX_SIZE * MAX_SIZE) - 1]; ///< finite state machine storage
+    int sc_stride;                           ///< size of the state of one job in each sc line
+    uint32_t *sc[(MAX_SIZE * MAX_SIZE) - 1]; ///< finite state machine storage, one part per job
 } FilterParam;
 
 typedef struct {
     FilterParam luma;   ///< luma parameters (width, height, amount)
     FilterParam chroma; ///< chroma parameters (width, height, amount)
+    int nb_jobs;        ///< number of bands of lines filtered in parallel
 } UnsharpContext;
 
-static void unsharpen(uint8_t *dst, uint8_t *src, int dst_stride, int src_stride, int width, int height, FilterParam *fp)
+/**
+ * Filter the lines [slice_start, slice_end) of a plane. The vertical
+ * filter spans steps_y lines on both sides of the output line, so a band
+ * starts its state machine 2 * steps_y lines before its first output line,
+ * like the first band does at the top of the picture.
+ */
+static void unsharpen(uint8_t *dst, uint8_t *src, int dst_stride, int src_stride,
+                      int width, int slice_start, int slice_end, FilterParam *fp, int jobnr)
 {
-    uint32_t **sc = fp->sc;
+    uint32_t *sc[(MAX_SIZE * MAX_SIZE) - 1];
     uint32_t sr[(MAX_SIZE * MAX_SIZE) - 1], tmp1, tmp2;
 
     int32_t res;
     int x, y, z;
 
     if (!fp->amount) {
+        src += slice_start * src_stride;
+        dst += slice_start * dst_stride;
         if (dst_stride == src_stride)
-            memcpy(dst, src, src_stride * height);
+            memcpy(dst, src, src_stride * (slice_end - slice_start));
         else
-            for (y = 0; y < height; y++, dst += dst_stride, src += src_stride)
+            for (y = slice_start; y < slice_end; y++, dst += dst_stride, src += src_stride)
                 memcpy(dst, src, width);
         return;
     }
 
-    for (y = 0; y < 2 * fp->steps_y; y++)
+    for (y = 0; y < 2 * fp->steps_y; y++) {
+        sc[y] = fp->sc[y] + jobnr * fp->sc_stride;
         memset(sc[y], 0, sizeof(sc[y][0]) * (width + 2 * fp->steps_x));
+    }
+
+    for (y = slice_start - fp->steps_y; y < slice_end + fp->steps_y; y++) {
+        uint8_t *srl = src + FFMAX(y, 0) * src_stride;
+        uint8_t *dsl = dst + FFMAX(y, 0) * dst_stride;
 
-    for (y = -fp->steps_y; y < height + fp->steps_y; y++) {
         memset(sr, 0, sizeof(sr[0]) * (2 * fp->steps_x - 1));
         for (x = -fp->steps_x; x < width + fp->steps_x; x++) {
-            tmp1 = x <= 0 ? src[0] : x >= width ? src[width-1] : src[x];
+            tmp1 = x <= 0 ? srl[0] : x >= width ? srl[width-1] : srl[x];
             for (z = 0; z < fp->steps_x * 2; z += 2) {
                 tmp2 = sr[z + 0] + tmp1; sr[z + 0] = tmp1;
                 tmp1 = sr[z + 1] + tmp2; sr[z + 1] = tmp2;
@@ -95,18 +112,14 @@ static void unsharpen(uint8_t *dst, uint8_t *src, int dst_stride, int src_stride
                 tmp2 = sc[z + 0][x + fp->steps_x] + tmp1; sc[z + 0][x + fp->steps_x] = tmp1;
                 tmp1 = sc[z + 1][x + fp->steps_x] + tmp2; sc[z + 1][x + fp->steps_x] = tmp2;
             }
-            if (x >= fp->steps_x && y >= fp->steps_y) {
-                uint8_t* srx = src - fp->steps_y * src_stride + x - fp->steps_x;
-                uint8_t* dsx = dst - fp->steps_y * dst_stride + x - fp->steps_x;
+            if (x >= fp->steps_x && y >= slice_start + fp->steps_y) {
+                uint8_t* srx = srl - fp->steps_y * src_stride + x - fp->steps_x;
+                uint8_t* dsx = dsl - fp->steps_y * dst_stride + x - fp->steps_x;
 
                 res = (int32_t)*srx + ((((int32_t) * srx - (int32_t)((tmp1 + fp->halfscale) >> fp->scalebits)) * fp->amount) >> 16);
                 *dsx = av_clip_uint8(res);
             }
         }
-        if (y >= 0) {
-            dst += dst_stride;
-            src += src_stride;
-        }
     }
 }
 
@@ -160,7 +173,8 @@ static int query_formats(AVFilterContext *ctx)
     return 0;
 }
 
-static void init_filter_param(AVFilterContext *ctx, FilterParam *fp, const char *effect_type, int width)
+static int init_filter_param(AVFilterContext *ctx, FilterParam *fp, const char *effect_type,
+                             int width, int nb_jobs)
 {
     int z;
     const char *effect;
@@ -170,16 +184,25 @@ static void init_filter_param(AVFilterContext *ctx, FilterParam *fp, const char
     av_log(ctx, AV_LOG_INFO, "effect:%s type:%s msize_x:%d msize_y:%d amount:%0.2f\n",
            effect, effect_type, fp->msize_x, fp->msize_y, fp->amount / 65535.0);
 
-    for (z = 0; z < 2 * fp->steps_y; z++)
-        fp->sc[z] = av_malloc(sizeof(*(fp->sc[z])) * (width + 2 * fp->steps_x));
+    fp->sc_stride = width + 2 * fp->steps_x;
+    for (z = 0; z < 2 * fp->steps_y; z++) {
+        fp->sc[z] = av_malloc(sizeof(*(fp->sc[z])) * fp->sc_stride * nb_jobs);
+        if (!fp->sc[z])
+            return AVERROR(ENOMEM);
+    }
+    return 0;
 }
 
 static int config_props(AVFilterLink *link)
 {
     UnsharpContext *unsharp = link->dst->priv;
+    int ret;
+
+    unsharp->nb_jobs = FFMAX(1, FFMIN(ff_filter_get_nb_threads(link->dst), CHROMA_HEIGHT(link)));
 
-    init_filter_param(link->dst, &unsharp->luma,   "luma",   link->w);
-    init_filter_param(link->dst, &unsharp->chroma, "chroma", CHROMA_WIDTH(link));
+    if ((ret = init_filter_param(link->dst, &unsharp->luma,   "luma",   link->w,            unsharp->nb_jobs)) < 0 ||
+        (ret = init_filter_param(link->dst, &unsharp->chroma, "chroma", CHROMA_WIDTH(link), unsharp->nb_jobs)) < 0)
+        return ret;
 
     return 0;
 }
@@ -189,7 +212,7 @@ static void free_filter_param(FilterParam *fp)
     int z;
 
     for (z = 0; z < 2 * fp->steps_y; z++)
-        av_free(fp->sc[z]);
+        av_freep(&fp->sc[z]);
 }
 
 static av_cold void uninit(AVFilterContext *ctx)
@@ -200,19 +223,37 @@ static av_cold void uninit(AVFilterContext *ctx)
     free_filter_param(&unsharp->chroma);
 }
 
+static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    UnsharpContext *unsharp = ctx->priv;
+    AVFilterLink *link = ctx->inputs[0];
+    AVFilterBufferRef *in  = link->cur_buf;
+    AVFilterBufferRef *out = ctx->outputs[0]->out_buf;
+    int h  = link->h;
+    int ch = CHROMA_HEIGHT(link);
+    int cw = CHROMA_WIDTH(link);
+
+    unsharpen(out->data[0], in->data[0], out->linesize[0], in->linesize[0], link->w,
+              h  * jobnr / nb_jobs, h  * (jobnr + 1) / nb_jobs, &unsharp->luma,   jobnr);
+    unsharpen(out->data[1], in->data[1], out->linesize[1], in->linesize[1], cw,
+              ch * jobnr / nb_jobs, ch * (jobnr + 1) / nb_jobs, &unsharp->chroma, jobnr);
+    unsharpen(out->data[2], in->data[2], out->linesize[2], in->linesize[2], cw,
+              ch * jobnr / nb_jobs, ch * (jobnr + 1) / nb_jobs, &unsharp->chroma, jobnr);
+    return 0;
+}
+
 static void end_frame(AVFilterLink *link)
 {
-    UnsharpContext *unsharp = link->dst->priv;
+    AVFilterContext *ctx = link->dst;
+    UnsharpContext *unsharp = ctx->priv;
     AVFilterBufferRef *in  = link->cur_buf;
-    AVFilterBufferRef *out = link->dst->outputs[0]->out_buf;
+    AVFilterBufferRef *out = ctx->outputs[0]->out_buf;
 
-    unsharpen(out->data[0], in->data[0], out->linesize[0], in->linesize[0], link->w,            link->h,             &unsharp->luma);
-    unsharpen(out->data[1], in->data[1], out->linesize[1], in->linesize[1], CHROMA_WIDTH(link), CHROMA_HEIGHT(link), &unsharp->chroma);
-    unsharpen(out->data[2], in->data[2], out->linesize[2], in->linesize[2], CHROMA_WIDTH(link), CHROMA_HEIGHT(link), &unsharp->chroma);
+    ctx->execute(ctx, filter_slice, NULL, NULL, unsharp->nb_jobs);
 
     avfilter_unref_buffer(in);
-    avfilter_draw_slice(link->dst->outputs[0], 0, link->h, 1);
-    avfilter_end_frame(link->dst->outputs[0]);
+    avfilter_draw_slice(ctx->outputs[0], 0, link->h, 1);
+    avfilter_end_frame(ctx->outputs[0]);
     avfilter_unref_buffer(out);
 }
 
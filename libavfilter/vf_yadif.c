@@ -21,6 +21,7 @@
 #include "libavutil/common.h"
 #include "libavutil/pixdesc.h"
 #include "avfilter.h"
+#include "internal.h"
 #include "yadif.h"
 
 #undef NDEBUG
@@ -117,13 +118,25 @@ static void filter_line_c(uint8_t *dst,
     }
 }
 
-static void filter(AVFilterContext *ctx, AVFilterBufferRef *dstpic,
-                   int parity, int tff)
+typedef struct ThreadData {
+    AVFilterBufferRef *frame;
+    int parity;
+    int tff;
+} ThreadData;
+
+/**
+ * Deinterlace the band of lines jobnr of the three planes, the lines are
+ * filtered independently from each other so the bands need no overlap.
+ */
+static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
     YADIFContext *yadif = ctx->priv;
+    ThreadData *td = arg;
+    AVFilterBufferRef *dstpic = td->frame;
     AVFilterBufferRef *p = yadif->prev;
     AVFilterBufferRef *c = yadif->cur;
     AVFilterBufferRef *n = yadif->next;
+    int parity = td->parity;
     int y, i;
 
     if (!p)
@@ -135,15 +148,17 @@ static void filter(AVFilterContext *ctx, AVFilterBufferRef *dstpic,
         int w = i ? dstpic->video->w >> yadif->hsub : dstpic->video->w;
         int h = i ? dstpic->video->h >> yadif->vsub : dstpic->video->h;
         int refs = c->linesize[i];
+        int slice_start = h *  jobnr      / nb_jobs;
+        int slice_end   = h * (jobnr + 1) / nb_jobs;
 
-        for (y = 0; y < h; y++) {
+        for (y = slice_start; y < slice_end; y++) {
             if ((y ^ parity) & 1) {
                 uint8_t *prev = &p->data[i][y*refs];
                 uint8_t *cur  = &c->data[i][y*refs];
                 uint8_t *next = &n->data[i][y*refs];
                 uint8_t *dst  = &dstpic->data[i][y*dstpic->linesize[i]];
                 int     mode  = y==1 || y+2==h ? 2 : yadif->mode;
-                yadif->filter_line(dst, prev, cur, next, w, y+1<h ? refs : -refs, y ? -refs : refs, parity ^ tff, mode);
+                yadif->filter_line(dst, prev, cur, next, w, y+1<h ? refs : -refs, y ? -refs : refs, parity ^ td->tff, mode);
             } else {
                 memcpy(&dstpic->data[i][y*dstpic->linesize[i]],
                        &c->data[i][y*refs], w);
@@ -153,6 +168,18 @@ static void filter(AVFilterContext *ctx, AVFilterBufferRef *dstpic,
 #if HAVE_MMX
     __asm__ volatile("emms \n\t" : : : "memory");
 #endif
+    return 0;
+}
+
+static void filter(AVFilterContext *ctx, AVFilterBufferRef *dstpic,
+                   int parity, int tff)
+{
+    YADIFContext *yadif = ctx->priv;
+    ThreadData td = { dstpic, parity, tff };
+    int h = dstpic->video->h >> yadif->vsub;
+
+    ctx->execute(ctx, filter_slice, &td, NULL,
+                 FFMIN(h, ff_filter_get_nb_threads(ctx)));
 }
 
 static AVFilterBufferRef *get_video_buffer(AVFilterLink *link, int perms, int w, int h)
@@ -115,7 +115,8 @@ int ff_audio_rechunk_interleave(AVFormatContext *s, AVPacket *out, AVPacket *pkt
             // rewrite pts and dts to be decoded time line position
             pkt->pts = pkt->dts = aic->dts;
             aic->dts += pkt->duration;
-            ff_interleave_add_packet(s, pkt, compare_ts);
+            if (ff_interleave_add_packet(s, pkt, compare_ts) < 0)
+                return AVERROR(ENOMEM);
         }
         pkt = NULL;
     }
@@ -125,7 +126,10 @@ int ff_audio_rechunk_interleave(AVFormatContext *s, AVPacket *out, AVPacket *pkt
         if (st->codec->codec_type == AVMEDIA_TYPE_AUDIO) {
             AVPacket new_pkt;
             while (ff_interleave_new_audio_packet(s, &new_pkt, i, flush))
-                ff_interleave_add_packet(s, &new_pkt, compare_ts);
+                if (ff_interleave_add_packet(s, &new_pkt, compare_ts) < 0) {
+                    av_free_packet(&new_pkt);
+                    return AVERROR(ENOMEM);
+                }
         }
     }
 
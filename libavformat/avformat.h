@@ -328,6 +328,7 @@ typedef struct AVFormatParameters {
 #define AVFMT_VARIABLE_FPS  0x0400 /**< Format allows variable fps. */
 #define AVFMT_NODIMENSIONS  0x0800 /**< Format does not need width/height */
 #define AVFMT_NOSTREAMS     0x1000 /**< Format does not require any streams */
+#define AVFMT_CACHE_INDEX   0x2000 /**< Use generic index building code when an index cache is used. */
 
 typedef struct AVOutputFormat {
     const char *name;
@@ -662,7 +663,7 @@ typedef struct AVStream {
     int probe_packets;
 
     /**
-     * last packet in packet_buffer for this stream when muxing.
+     * last packet in the interleaving queue for this stream when muxing.
      * used internally, NOT PART OF PUBLIC API, dont read or write from outside of libav*
      */
     struct AVPacketList *last_in_packet_buffer;
@@ -783,6 +784,9 @@ typedef struct AVFormatContext {
      * seconds. Only set this value if you know none of the individual stream
      * durations and also dont set any of them. This is deduced from the
      * AVStream values if not set.
+     * Encoding: expected duration of the output if known, 0 otherwise,
+     * set by user before av_write_header(). Muxers may use it to
+     * preallocate space for their index.
      */
     int64_t duration;
 
@@ -927,6 +931,43 @@ typedef struct AVFormatContext {
      * duration are known as FFmpeg can compute it automatically.
      */
     int64_t bit_rate;
+
+    /**
+     * Size in bytes of the buffer the input is read ahead into by a
+     * separate thread, 0 to read synchronously.
+     * - encoding: unused
+     * - decoding: Set by user before av_open_input_file().
+     */
+    int readahead_size;
+
+    /**
+     * Size in bytes of the buffers waiting to be written by a separate
+     * thread, 0 to write synchronously.
+     * - encoding: Set by user before av_write_header().
+     * - decoding: unused
+     */
+    int writebehind_size;
+
+    /**
+     * Muxing: packets waiting to be interleaved, see ff_interleave_add_packet().
+     * NOT PART OF PUBLIC API
+     */
+    struct AVInterleaveQueue *interleave_queue;
+
+    /**
+     * Directory of the index cache, NULL to always build the index of
+     * the input. The index of local files is read from the cache if it
+     * is up to date and written back to it when the input is closed.
+     * - encoding: unused
+     * - decoding: Set by user before av_open_input_file().
+     */
+    char *index_cache;
+
+    /**
+     * Demuxing: the index cache entry of the input, see ff_index_cache_open().
+     * NOT PART OF PUBLIC API
+     */
+    struct IndexCache *index_cache_ctx;
 } AVFormatContext;
 
 typedef struct AVPacketList {
@@ -357,6 +357,8 @@ typedef struct {
     int (*read_pause)(void *opaque, int pause);
     int64_t (*read_seek)(void *opaque, int stream_index,
                          int64_t timestamp, int flags);
+    struct ReadAheadContext *readahead; ///< background reader, see url_setreadahead()
+    struct WriteBehindContext *writebehind; ///< background writer, see url_setwritebehind()
 } ByteIOContext;
 
 int init_put_byte(ByteIOContext *s,
@@ -519,6 +521,43 @@ int url_fdopen(ByteIOContext **s, URLContext *h);
 
 /** @warning must be called before any I/O */
 int url_setbufsize(ByteIOContext *s, int buf_size);
+
+/**
+ * Read the input ahead of the caller in a background thread, so that
+ * latency of the underlying resource overlaps with the processing of
+ * the data already read. Seeking is still supported.
+ * Not available for writing, for packetized inputs and for protocols
+ * that pause or seek by timestamp themselves.
+ *
+ * @param size size in bytes of the read-ahead buffer, 0 to go back to
+ *             synchronous reads
+ * @return 0 on success, AVERROR(ENOSYS) if read-ahead is not supported
+ *         for s, another negative AVERROR code on failure
+ */
+int url_setreadahead(ByteIOContext *s, int size);
+
+/**
+ * @return the number of bytes read ahead of s and not yet consumed,
+ *         0 if read-ahead is not enabled
+ */
+int64_t url_freadahead(ByteIOContext *s);
+
+/**
+ * Hand the output buffers to a background thread for writing, so that
+ * latency of the underlying resource overlaps with muxing. The buffer
+ * of s is enlarged, and put_flush_packet() no longer forces partially
+ * filled buffers out, they are written on the next seek, url_fsize()
+ * or url_fclose(). Seeking back is still supported, it waits for
+ * the pending writes to complete. Errors of the writer thread are
+ * reported by url_ferror() after a later flush and by url_fclose().
+ * Not available for reading and for packetized outputs.
+ *
+ * @param size total size in bytes of the buffers waiting to be written,
+ *             0 to go back to synchronous writes
+ * @return 0 on success, AVERROR(ENOSYS) if write-behind is not supported
+ *         for s, another negative AVERROR code on failure
+ */
+int url_setwritebehind(ByteIOContext *s, int size);
 #if FF_API_URL_RESETBUF
 /** Reset the buffer for reading or writing.
  * @note Will drop any data currently in the buffer without transmitting it.
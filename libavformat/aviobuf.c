@@ -35,6 +35,9 @@
  */
 #define SHORT_SEEK_THRESHOLD 4096
 
+/** maximum size of the buffers handed to the write-behind thread */
+#define WRITEBEHIND_MAX_BUFFER (1 << 20)
+
 static void fill_buffer(ByteIOContext *s);
 #if !FF_API_URL_RESETBUF
 static int url_resetbuf(ByteIOContext *s, int flags);
@@ -70,6 +73,8 @@ int init_put_byte(ByteIOContext *s,
     }
     s->read_pause = NULL;
     s->read_seek  = NULL;
+    s->readahead  = NULL;
+    s->writebehind = NULL;
     return 0;
 }
 
@@ -88,11 +93,42 @@ ByteIOContext *av_alloc_put_byte(
     return s;
 }
 
+static int io_read_packet(ByteIOContext *s, uint8_t *buf, int size)
+{
+    if (s->readahead)
+        return ff_readahead_read(s->readahead, buf, size);
+    if (s->read_packet)
+        return s->read_packet(s->opaque, buf, size);
+    return 0;
+}
+
+static int64_t io_seek(ByteIOContext *s, int64_t offset, int whence)
+{
+    if (s->readahead)
+        return ff_readahead_seek(s->readahead, offset, whence);
+    if (s->writebehind)
+        return ff_writebehind_seek(s->writebehind, offset, whence);
+    return s->seek(s->opaque, offset, whence);
+}
+
 static void flush_buffer(ByteIOContext *s)
 {
-    if (s->buf_ptr > s->buffer) {
+    /* data written before a seek back inside the buffer is not dropped,
+     * the resource is repositioned at the current position afterwards */
+    unsigned char *end = s->seek ? FFMAX(s->buf_ptr, s->max_buf_ptr) : s->buf_ptr;
+
+    if (end > s->buffer) {
+        int size = end - s->buffer;
+        int back = end - s->buf_ptr;
         if (s->write_packet && !s->error){
-            int ret= s->write_packet(s->opaque, s->buffer, s->buf_ptr - s->buffer);
+            int ret;
+            if (s->writebehind) {
+                /* the filled buffer is swapped for an empty one, it stays
+                 * valid for the checksum below until the next flush */
+                ret = ff_writebehind_write(s->writebehind, &s->buffer, size);
+                s->buf_end = s->buffer + s->buffer_size;
+            } else
+                ret = s->write_packet(s->opaque, s->buffer, size);
             if(ret < 0){
                 s->error = ret;
             }
@@ -101,7 +137,14 @@ static void flush_buffer(ByteIOContext *s)
             s->checksum= s->update_checksum(s->checksum, s->checksum_ptr, s->buf_ptr - s->checksum_ptr);
             s->checksum_ptr= s->buffer;
         }
-        s->pos += s->buf_ptr - s->buffer;
+        s->pos += size;
+        if (back && !s->error) {
+            int64_t pos = io_seek(s, s->pos - back, SEEK_SET);
+            if (pos < 0)
+                s->error = pos;
+            else
+                s->pos = pos;
+        }
     }
     s->buf_ptr = s->buffer;
     s->max_buf_ptr = s->buf_ptr;
@@ -146,7 +189,9 @@ void put_buffer(ByteIOContext *s, const unsigned char *buf, int size)
 
 void put_flush_packet(ByteIOContext *s)
 {
-    flush_buffer(s);
+    /* with write-behind, buffers are only handed out once full */
+    if (!s->writebehind)
+        flush_buffer(s);
 }
 
 int64_t url_fseek(ByteIOContext *s, int64_t offset, int whence)
@@ -200,7 +245,7 @@ int64_t url_fseek(ByteIOContext *s, int64_t offset, int whence)
 #endif /* CONFIG_MUXERS || CONFIG_NETWORK */
         if (!s->seek)
             return AVERROR(EPIPE);
-        if ((res = s->seek(s->opaque, offset, SEEK_SET)) < 0)
+        if ((res = io_seek(s, offset, SEEK_SET)) < 0)
             return res;
         if (!s->write_flag)
             s->buf_end = s->buffer;
@@ -231,12 +276,15 @@ int64_t url_fsize(ByteIOContext *s)
 
     if (!s->seek)
         return AVERROR(ENOSYS);
-    size = s->seek(s->opaque, 0, AVSEEK_SIZE);
+    /* data held back by put_flush_packet() has to reach the resource first */
+    if (s->writebehind)
+        flush_buffer(s);
+    size = io_seek(s, 0, AVSEEK_SIZE);
     if(size<0){
-        if ((size = s->seek(s->opaque, -1, SEEK_END)) < 0)
+        if ((size = io_seek(s, -1, SEEK_END)) < 0)
             return size;
         size++;
-        s->seek(s->opaque, s->pos, SEEK_SET);
+        io_seek(s, s->pos, SEEK_SET);
     }
     return size;
 }
@@ -393,10 +441,7 @@ static void fill_buffer(ByteIOContext *s)
         len = s->buffer_size;
     }
 
-    if(s->read_packet)
-        len = s->read_packet(s->opaque, dst, len);
-    else
-        len = 0;
+    len = io_read_packet(s, dst, len);
     if (len <= 0) {
         /* do not modify buffer if EOF reached so that a seek back can
            be done without rereading data */
@@ -464,8 +509,7 @@ int get_buffer(ByteIOContext *s, unsigned char *buf, int size)
             len = size;
         if (len == 0) {
             if(size > s->buffer_size && !s->update_checksum){
-                if(s->read_packet)
-                    len = s->read_packet(s->opaque, buf, size);
+                len = io_read_packet(s, buf, size);
                 if (len <= 0) {
                     /* do not modify buffer if EOF reached so that a seek back can
                     be done without rereading data */
@@ -702,6 +746,62 @@ int url_setbufsize(ByteIOContext *s, int buf_size)
     return 0;
 }
 
+int url_setreadahead(ByteIOContext *s, int size)
+{
+    if (s->readahead) {
+        int64_t ahead = ff_readahead_available(s->readahead);
+        ff_readahead_close(s->readahead);
+        s->readahead = NULL;
+        /* give the data read ahead back to the resource */
+        if (ahead && s->seek) {
+            int64_t ret = s->seek(s->opaque, s->pos, SEEK_SET);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    if (size <= 0)
+        return 0;
+    if (s->write_flag || s->max_packet_size || s->read_pause || s->read_seek)
+        return AVERROR(ENOSYS);
+    return ff_readahead_open(&s->readahead, s->opaque, s->read_packet, s->seek,
+                             s->pos, size);
+}
+
+int64_t url_freadahead(ByteIOContext *s)
+{
+    return s->readahead ? ff_readahead_available(s->readahead) : 0;
+}
+
+int url_setwritebehind(ByteIOContext *s, int size)
+{
+    int buffer_size, nb_buffers, ret;
+
+    if (s->writebehind) {
+        flush_buffer(s);
+        ret = ff_writebehind_close(s->writebehind);
+        s->writebehind = NULL;
+        if (ret < 0)
+            return ret;
+    }
+
+    if (size <= 0)
+        return 0;
+    if (!s->write_flag || s->max_packet_size)
+        return AVERROR(ENOSYS);
+
+    buffer_size = FFMAX(FFMIN(size / 4, WRITEBEHIND_MAX_BUFFER), IO_BUFFER_SIZE);
+    nb_buffers  = FFMAX(size / buffer_size, 1);
+
+    flush_buffer(s);
+    if (s->error)
+        return s->error;
+    if ((ret = url_setbufsize(s, buffer_size)) < 0)
+        return ret;
+    return ff_writebehind_open(&s->writebehind, s->opaque, s->write_packet,
+                               s->seek, nb_buffers, buffer_size);
+}
+
 #if FF_API_URL_RESETBUF
 int url_resetbuf(ByteIOContext *s, int flags)
 #else
@@ -782,10 +882,20 @@ int url_fopen(ByteIOContext **s, const char *filename, int flags)
 int url_fclose(ByteIOContext *s)
 {
     URLContext *h = s->opaque;
+    int ret = 0, err;
 
+    if (s->readahead)
+        ff_readahead_close(s->readahead);
+    if (s->writebehind) {
+        flush_buffer(s);
+        ret = ff_writebehind_close(s->writebehind);
+        if (!ret)
+            ret = s->error;
+    }
     av_free(s->buffer);
     av_free(s);
-    return url_close(h);
+    err = url_close(h);
+    return ret < 0 ? ret : err;
 }
 
 URLContext *url_fileno(ByteIOContext *s)
@@ -31,6 +31,78 @@ struct gxf_stream_info {
     int32_t fields_per_frame;
 };
 
+/** maximum number of fields in the position table */
+#define GXF_MAX_FIELDS (1 << 24)
+/** the position table is allocated in chunks of 1 << GXF_CHUNK_BITS fields */
+#define GXF_CHUNK_BITS 12
+#define GXF_CHUNK_SIZE (1 << GXF_CHUNK_BITS)
+
+struct gxf_context {
+    int64_t first_field;         ///< field number of the first table entry
+    int nb_fields;               ///< number of fields the table can hold, from the MAP if known
+    int64_t **field_pos;         ///< chunks of positions of the first media packet of each field,
+                                 ///< a chunk is NULL and an entry 0 if unknown
+    int max_field;               ///< one past the highest field index recorded
+    int64_t prev_field;          ///< highest field read before packet_end, AV_NOPTS_VALUE if unknown
+    int64_t packet_end;          ///< position following the last packet read
+};
+
+/**
+ * \brief records the position of the first media packet of a field
+ *
+ * Fields outside the range announced by the MAP are ignored.
+ */
+static void gxf_add_field(struct gxf_context *gxf, int64_t field, int64_t pos) {
+    int64_t idx;
+    int64_t *chunk;
+    if (gxf->first_field == AV_NOPTS_VALUE)
+        gxf->first_field = field;
+    idx = field - gxf->first_field;
+    if (idx < 0 || idx >= gxf->nb_fields)
+        return;
+    if (!gxf->field_pos) {
+        gxf->field_pos = av_mallocz(((gxf->nb_fields - 1 >> GXF_CHUNK_BITS) + 1) *
+                                    sizeof(*gxf->field_pos));
+        if (!gxf->field_pos)
+            return;
+    }
+    chunk = gxf->field_pos[idx >> GXF_CHUNK_BITS];
+    if (!chunk) {
+        chunk = av_mallocz(GXF_CHUNK_SIZE * sizeof(*chunk));
+        if (!chunk)
+            return;
+        gxf->field_pos[idx >> GXF_CHUNK_BITS] = chunk;
+    }
+    if (!chunk[idx & (GXF_CHUNK_SIZE - 1)])
+        chunk[idx & (GXF_CHUNK_SIZE - 1)] = pos;
+    gxf->max_field = FFMAX(gxf->max_field, idx + 1);
+}
+
+/**
+ * \brief finds the last field not after timestamp whose position is known
+ * \param pos set to the position of the field found
+ * \return index of the field in the table, -1 if none
+ */
+static int gxf_find_field(struct gxf_context *gxf, int64_t timestamp, int64_t *pos) {
+    int64_t i;
+    if (gxf->first_field == AV_NOPTS_VALUE || !gxf->field_pos)
+        return -1;
+    i = FFMIN(timestamp - gxf->first_field, gxf->max_field - 1);
+    while (i >= 0) {
+        int64_t *chunk = gxf->field_pos[i >> GXF_CHUNK_BITS];
+        if (!chunk) {
+            i = (i & ~(GXF_CHUNK_SIZE - 1)) - 1;
+            continue;
+        }
+        if (chunk[i & (GXF_CHUNK_SIZE - 1)]) {
+            *pos = chunk[i & (GXF_CHUNK_SIZE - 1)];
+            return i;
+        }
+        i--;
+    }
+    return -1;
+}
+
 /**
  * \brief parses a packet header, extracting type and length
  * \param pb ByteIOContext to read header from
@@ -259,6 +331,7 @@ static void gxf_read_index(AVFormatContext *s, int pkt_len) {
 }
 
 static int gxf_header(AVFormatContext *s, AVFormatParameters *ap) {
+    struct gxf_context *gxf = s->priv_data;
     ByteIOContext *pb = s->pb;
     GXFPktType pkt_type;
     int map_len;
@@ -284,6 +357,11 @@ static int gxf_header(AVFormatContext *s, AVFormatParameters *ap) {
     map_len -= len;
     gxf_material_tags(pb, &len, &si);
     url_fskip(pb, len);
+    gxf->first_field = si.first_field;
+    gxf->nb_fields = GXF_MAX_FIELDS;
+    if (si.first_field != AV_NOPTS_VALUE && si.last_field != AV_NOPTS_VALUE &&
+        si.last_field >= si.first_field && si.last_field - si.first_field < GXF_MAX_FIELDS)
+        gxf->nb_fields = si.last_field - si.first_field + 1;
     map_len -= 2;
     len = get_be16(pb); // length of track description
     if (len > map_len) {
@@ -322,6 +400,10 @@ static int gxf_header(AVFormatContext *s, AVFormatParameters *ap) {
         st->start_time = si.first_field;
         if (si.first_field != AV_NOPTS_VALUE && si.last_field != AV_NOPTS_VALUE)
             st->duration = si.last_field - si.first_field;
+        // no need to guess the frame rate from the packets
+        if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO &&
+            si.frames_per_second.num > 0 && si.frames_per_second.den > 0)
+            st->r_frame_rate = st->avg_frame_rate = si.frames_per_second;
     }
     if (len < 0)
         av_log(s, AV_LOG_ERROR, "invalid track description length specified\n");
@@ -363,6 +445,9 @@ static int gxf_header(AVFormatContext *s, AVFormatParameters *ap) {
         AVStream *st = s->streams[i];
         av_set_pts_info(st, 32, main_timebase.num, main_timebase.den);
     }
+    // the first media packet starts its field
+    gxf->prev_field = -1;
+    gxf->packet_end = url_ftell(pb);
     return 0;
 }
 
@@ -419,6 +504,7 @@ out:
 }
 
 static int gxf_packet(AVFormatContext *s, AVPacket *pkt) {
+    struct gxf_context *gxf = s->priv_data;
     ByteIOContext *pb = s->pb;
     GXFPktType pkt_type;
     int pkt_len;
@@ -427,6 +513,10 @@ static int gxf_packet(AVFormatContext *s, AVPacket *pkt) {
         int track_type, track_id, ret;
         int field_nr, field_info, skip = 0;
         int stream_index;
+        int64_t pos = url_ftell(pb);
+        // the stream was moved without us knowing the previous fields
+        if (pos != gxf->packet_end)
+            gxf->prev_field = AV_NOPTS_VALUE;
         if (!parse_packet_header(pb, &pkt_type, &pkt_len)) {
             if (!url_feof(pb))
                 av_log(s, AV_LOG_ERROR, "sync lost\n");
@@ -434,10 +524,12 @@ static int gxf_packet(AVFormatContext *s, AVPacket *pkt) {
         }
         if (pkt_type == PKT_FLT) {
             gxf_read_index(s, pkt_len);
+            gxf->packet_end = url_ftell(pb);
             continue;
         }
         if (pkt_type != PKT_MEDIA) {
             url_fskip(pb, pkt_len);
+            gxf->packet_end = url_ftell(pb);
             continue;
         }
         if (pkt_len < 16) {
@@ -471,6 +563,10 @@ static int gxf_packet(AVFormatContext *s, AVPacket *pkt) {
         ret = av_get_packet(pb, pkt, pkt_len);
         if (skip)
             url_fskip(pb, skip);
+        if (gxf->prev_field != AV_NOPTS_VALUE && (uint32_t)field_nr > gxf->prev_field)
+            gxf_add_field(gxf, (uint32_t)field_nr, pos);
+        gxf->prev_field = FFMAX(gxf->prev_field, (uint32_t)field_nr);
+        gxf->packet_end = url_ftell(pb);
         pkt->stream_index = stream_index;
         pkt->dts = field_nr;
         if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO)
@@ -480,28 +576,82 @@ static int gxf_packet(AVFormatContext *s, AVPacket *pkt) {
     return AVERROR(EIO);
 }
 
+/**
+ * \brief hops from packet to packet up to the first media packet of a field
+ *        not before timestamp, recording the fields found on the way
+ * \param pos position of a packet header
+ * \param end position at which to give up
+ * \param prev_field highest field of the media packets before pos, AV_NOPTS_VALUE if unknown
+ * \return field of the packet found, the stream being positioned on its header,
+ *         AV_NOPTS_VALUE if not found
+ */
+static int64_t gxf_seek_field(AVFormatContext *s, int64_t pos, int64_t end,
+                              int64_t prev_field, int64_t timestamp) {
+    struct gxf_context *gxf = s->priv_data;
+    ByteIOContext *pb = s->pb;
+    GXFPktType type;
+    int len;
+    while (pos < end && url_fseek(pb, pos, SEEK_SET) >= 0 &&
+           parse_packet_header(pb, &type, &len)) {
+        if (type == PKT_MEDIA && len >= 16) {
+            int64_t field;
+            get_byte(pb); // track type
+            get_byte(pb); // track id
+            field = get_be32(pb);
+            if (prev_field != AV_NOPTS_VALUE && field > prev_field)
+                gxf_add_field(gxf, field, pos);
+            if (field >= timestamp) {
+                if (url_fseek(pb, pos, SEEK_SET) < 0)
+                    break;
+                gxf->prev_field = prev_field;
+                gxf->packet_end = pos;
+                return field;
+            }
+            prev_field = FFMAX(prev_field, field);
+        }
+        pos += 16 + len;
+    }
+    return AV_NOPTS_VALUE;
+}
+
 static int gxf_seek(AVFormatContext *s, int stream_index, int64_t timestamp, int flags) {
+    struct gxf_context *gxf = s->priv_data;
     int res = 0;
     uint64_t pos;
     uint64_t maxlen = 100 * 1024 * 1024;
     AVStream *st = s->streams[0];
     int64_t start_time = s->streams[stream_index]->start_time;
-    int64_t found;
-    int idx;
+    int64_t found, prev_field, field_pos;
+    int idx, field_idx;
     if (timestamp < start_time) timestamp = start_time;
     idx = av_index_search_timestamp(st, timestamp - start_time,
                                     AVSEEK_FLAG_ANY | AVSEEK_FLAG_BACKWARD);
-    if (idx < 0)
-        return -1;
-    pos = st->index_entries[idx].pos;
-    if (idx < st->nb_index_entries - 2)
-        maxlen = st->index_entries[idx + 2].pos - pos;
+    field_idx = gxf_find_field(gxf, timestamp, &field_pos);
+    if (field_idx >= 0 &&
+        (idx < 0 || gxf->first_field + field_idx >= st->index_entries[idx].timestamp + start_time)) {
+        // start from the closest field already read
+        pos = field_pos;
+        prev_field = gxf->first_field + field_idx - 1;
+        if (idx >= 0 && idx < st->nb_index_entries - 2 && st->index_entries[idx + 2].pos > pos)
+            maxlen = st->index_entries[idx + 2].pos - pos;
+    } else {
+        if (idx < 0)
+            return -1;
+        pos = st->index_entries[idx].pos;
+        if (idx < st->nb_index_entries - 2)
+            maxlen = st->index_entries[idx + 2].pos - pos;
+        res = url_fseek(s->pb, pos, SEEK_SET);
+        if (res < 0)
+            return res;
+        // index positions are in 1024 bytes units, find the packet start
+        if (gxf_resync_media(s, FFMAX(maxlen, 200 * 1024), -1, -1) == AV_NOPTS_VALUE)
+            return -1;
+        pos = url_ftell(s->pb);
+        prev_field = AV_NOPTS_VALUE;
+    }
     maxlen = FFMAX(maxlen, 200 * 1024);
-    res = url_fseek(s->pb, pos, SEEK_SET);
-    if (res < 0)
-        return res;
-    found = gxf_resync_media(s, maxlen, -1, timestamp);
-    if (FFABS(found - timestamp) > 4)
+    found = gxf_seek_field(s, pos, pos + maxlen, prev_field, timestamp);
+    if (found == AV_NOPTS_VALUE || FFABS(found - timestamp) > 4)
         return -1;
     return 0;
 }
@@ -517,14 +667,24 @@ static int64_t gxf_read_timestamp(AVFormatContext *s, int stream_index,
     return res;
 }
 
+static int gxf_read_close(AVFormatContext *s) {
+    struct gxf_context *gxf = s->priv_data;
+    int i;
+    if (gxf->field_pos)
+        for (i = 0; i <= gxf->nb_fields - 1 >> GXF_CHUNK_BITS; i++)
+            av_freep(&gxf->field_pos[i]);
+    av_freep(&gxf->field_pos);
+    return 0;
+}
+
 AVInputFormat ff_gxf_demuxer = {
     "gxf",
     NULL_IF_CONFIG_SMALL("GXF format"),
-    0,
+    sizeof(struct gxf_context),
     gxf_probe,
     gxf_header,
     gxf_packet,
-    NULL,
+    gxf_read_close,
     gxf_seek,
     gxf_read_timestamp,
 };
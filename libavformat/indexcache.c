@@ -0,0 +1,377 @@
+/*
+ * Persistent index cache
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * On-disk cache of the stream indexes of local input files.
+ *
+ * The cache directory holds one file per input, named after the MD5 of
+ * the absolute path of the input, recording the path, device, inode, size
+ * and modification time of the input and the index entries of each of its
+ * streams, so that an input reached through another name or replaced by
+ * another file is never given the index of the first one. Entries are stored
+ * little-endian at fixed 8-byte aligned offsets so that the file can be
+ * mapped and each stream index restored with a single linear pass:
+ *
+ * @code
+ *  0 'FFIC'
+ *  4 le32 version
+ *  8 le64 size of the input file
+ * 16 le64 modification time of the input file
+ * 24 le64 device of the input file
+ * 32 le64 inode of the input file
+ * 40 le32 number of streams
+ * 44 le32 length of the file name
+ * 48 file name, zero padded to a multiple of 8 bytes
+ *    for each stream:
+ *    le32 stream id
+ *    le32 number of entries
+ *    for each entry:
+ *    le64 pos, le64 timestamp, le32 size | flags << 30, le32 min_distance
+ * @endcode
+ */
+
+/* needed for realpath() */
+#define _XOPEN_SOURCE 600
+
+#include <sys/stat.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "libavutil/avstring.h"
+#include "libavutil/file.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/md5.h"
+#include "libavutil/random_seed.h"
+#include "avformat.h"
+#include "internal.h"
+
+#define INDEX_CACHE_VERSION 2
+#define ENTRY_SIZE 24
+
+enum IndexCacheState {
+    STREAM_UNSEEN = 0,
+    STREAM_OWN_INDEX,     ///< indexed by the demuxer
+    STREAM_GENERIC_INDEX, ///< indexed from the packets read
+};
+
+typedef struct IndexCacheStream {
+    int id;
+    int nb_entries;
+    const uint8_t *entries; ///< packed entries in the mapped file
+} IndexCacheStream;
+
+struct IndexCache {
+    char *path;              ///< cache file
+    char *filename;          ///< absolute path of the input file
+    int64_t size, mtime;     ///< of the input file
+    int64_t dev, ino;        ///< of the input file
+    uint8_t *map;
+    size_t map_size;
+    IndexCacheStream *streams;
+    int nb_streams;
+    uint8_t *state;          ///< IndexCacheState of each AVStream
+    int nb_state;
+};
+
+static int parse_cache(IndexCache *ic)
+{
+    const uint8_t *p = ic->map, *end = ic->map + ic->map_size;
+    int i, len;
+
+    if (ic->map_size < 48 || AV_RL32(p) != MKTAG('F','F','I','C') ||
+        AV_RL32(p + 4) != INDEX_CACHE_VERSION ||
+        AV_RL64(p + 8) != ic->size || AV_RL64(p + 16) != ic->mtime ||
+        AV_RL64(p + 24) != ic->dev || AV_RL64(p + 32) != ic->ino)
+        return 0;
+    ic->nb_streams = AV_RL32(p + 40);
+    len = AV_RL32(p + 44);
+    if (ic->nb_streams < 0 || len != strlen(ic->filename) ||
+        len > end - p - 48 || memcmp(p + 48, ic->filename, len))
+        return 0;
+    p += 48 + FFALIGN(len, 8);
+    if (p > end || ic->nb_streams > (end - p) / 8)
+        return 0;
+
+    ic->streams = av_mallocz(ic->nb_streams * sizeof(*ic->streams));
+    if (!ic->streams)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < ic->nb_streams; i++) {
+        IndexCacheStream *cst = &ic->streams[i];
+        if (end - p < 8)
+            return 0;
+        cst->id         = AV_RL32(p);
+        cst->nb_entries = AV_RL32(p + 4);
+        p += 8;
+        if (cst->nb_entries < 0 || cst->nb_entries > (end - p) / ENTRY_SIZE)
+            return 0;
+        cst->entries = p;
+        p += cst->nb_entries * ENTRY_SIZE;
+    }
+    return 1;
+}
+
+/**
+ * @return absolute path of filename without links, or a copy of filename
+ *         where it cannot be resolved, to be freed with av_free()
+ */
+static char *absolute_path(const char *filename)
+{
+#if HAVE_REALPATH
+    char path[PATH_MAX];
+    if (realpath(filename, path))
+        return av_strdup(path);
+#endif
+    return av_strdup(filename);
+}
+
+int ff_index_cache_open(AVFormatContext *s, URLContext *h, const char *filename)
+{
+    IndexCache *ic;
+    struct stat st;
+    uint8_t md5[16];
+    char name[33];
+    int i, len, ret;
+
+    if (strcmp(h->prot->name, "file"))
+        return 0;
+    av_strstart(filename, "file:", &filename);
+    if (stat(filename, &st) < 0)
+        return 0;
+
+    ic = av_mallocz(sizeof(*ic));
+    if (!ic)
+        return AVERROR(ENOMEM);
+    s->index_cache_ctx = ic;
+    ic->size     = st.st_size;
+    ic->mtime    = st.st_mtime;
+    ic->dev      = st.st_dev;
+    ic->ino      = st.st_ino;
+    ic->filename = absolute_path(filename);
+    if (!ic->filename)
+        return AVERROR(ENOMEM);
+
+    av_md5_sum(md5, ic->filename, strlen(ic->filename));
+    for (i = 0; i < 16; i++)
+        snprintf(name + 2*i, 3, "%02x", md5[i]);
+    len = strlen(s->index_cache) + sizeof(name) + 5;
+    ic->path = av_malloc(len);
+    if (!ic->path)
+        return AVERROR(ENOMEM);
+    snprintf(ic->path, len, "%s/%s.idx", s->index_cache, name);
+
+    /* av_file_map() complains about missing files, which is the common case */
+    if (stat(ic->path, &st) < 0 ||
+        av_file_map(ic->path, &ic->map, &ic->map_size, 0, s) < 0)
+        return 0;
+    if ((ret = parse_cache(ic)) <= 0) {
+        av_log(s, AV_LOG_DEBUG, "index cache %s is stale\n", ic->path);
+        ic->nb_streams = 0;
+    }
+    return ret;
+}
+
+static IndexCacheStream *find_stream(IndexCache *ic, AVStream *st)
+{
+    if (st->index < ic->nb_streams && ic->streams[st->index].id == st->id)
+        return &ic->streams[st->index];
+    return NULL;
+}
+
+int ff_index_cache_entries(AVFormatContext *s, AVStream *st)
+{
+    IndexCacheStream *cst;
+
+    if (!s->index_cache_ctx || !(cst = find_stream(s->index_cache_ctx, st)))
+        return 0;
+    return cst->nb_entries;
+}
+
+static int set_state(IndexCache *ic, AVStream *st, int state)
+{
+    if (st->index >= ic->nb_state) {
+        uint8_t *tmp = av_realloc(ic->state, st->index + 1);
+        if (!tmp)
+            return AVERROR(ENOMEM);
+        memset(tmp + ic->nb_state, STREAM_UNSEEN, st->index + 1 - ic->nb_state);
+        ic->state    = tmp;
+        ic->nb_state = st->index + 1;
+    }
+    ic->state[st->index] = state;
+    return 0;
+}
+
+static int restore_index(IndexCache *ic, AVStream *st)
+{
+    IndexCacheStream *cst = find_stream(ic, st);
+    const uint8_t *p;
+    int i;
+
+    if (!cst || !cst->nb_entries)
+        return 0;
+    if (cst->nb_entries >= UINT_MAX / sizeof(*st->index_entries))
+        return AVERROR(ENOMEM);
+    av_freep(&st->index_entries);
+    st->nb_index_entries = 0;
+    st->index_entries_allocated_size = 0;
+    st->index_entries = av_malloc(cst->nb_entries * sizeof(*st->index_entries));
+    if (!st->index_entries)
+        return AVERROR(ENOMEM);
+    st->index_entries_allocated_size = cst->nb_entries * sizeof(*st->index_entries);
+
+    for (i = 0, p = cst->entries; i < cst->nb_entries; i++, p += ENTRY_SIZE) {
+        AVIndexEntry *e = &st->index_entries[i];
+        unsigned size_flags = AV_RL32(p + 16);
+        e->pos          = AV_RL64(p);
+        e->timestamp    = AV_RL64(p + 8);
+        e->size         = size_flags & 0x3fffffff;
+        e->flags        = size_flags >> 30;
+        e->min_distance = AV_RL32(p + 20);
+    }
+    st->nb_index_entries = cst->nb_entries;
+    return 0;
+}
+
+int ff_index_cache_restore(AVFormatContext *s, AVStream *st)
+{
+    IndexCache *ic = s->index_cache_ctx;
+    int ret;
+
+    if (!ic)
+        return 0;
+    if ((ret = set_state(ic, st, STREAM_OWN_INDEX)) < 0)
+        return ret;
+    return restore_index(ic, st);
+}
+
+/**
+ * Decide how st is indexed the first time it is seen, restoring the
+ * cached index if it is built from the packets read.
+ */
+static int init_stream(AVFormatContext *s, AVStream *st)
+{
+    IndexCache *ic = s->index_cache_ctx;
+    int ret;
+
+    if (st->index < ic->nb_state && ic->state[st->index] != STREAM_UNSEEN)
+        return ic->state[st->index];
+    if (st->nb_index_entries ||
+        !(s->iformat->flags & (AVFMT_GENERIC_INDEX|AVFMT_CACHE_INDEX)))
+        return set_state(ic, st, STREAM_OWN_INDEX);
+    if ((ret = set_state(ic, st, STREAM_GENERIC_INDEX)) < 0)
+        return ret;
+    if ((ret = restore_index(ic, st)) < 0)
+        return ret;
+    return STREAM_GENERIC_INDEX;
+}
+
+void ff_index_cache_restore_streams(AVFormatContext *s)
+{
+    int i;
+
+    if (!s->index_cache_ctx)
+        return;
+    for (i = 0; i < s->nb_streams; i++)
+        init_stream(s, s->streams[i]);
+}
+
+int ff_index_cache_generic(AVFormatContext *s, AVStream *st)
+{
+    return s->index_cache_ctx && init_stream(s, st) == STREAM_GENERIC_INDEX;
+}
+
+static int index_changed(IndexCache *ic, AVFormatContext *s)
+{
+    int i, indexed = 0;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        if (st->nb_index_entries != ff_index_cache_entries(s, st))
+            return 1;
+        indexed |= st->nb_index_entries;
+    }
+    return indexed && ic->nb_streams != s->nb_streams;
+}
+
+static int write_cache(IndexCache *ic, AVFormatContext *s, const char *path)
+{
+    ByteIOContext *pb;
+    int i, j, ret, len = strlen(ic->filename);
+
+    if ((ret = url_fopen(&pb, path, URL_WRONLY)) < 0)
+        return ret;
+    put_tag(pb, "FFIC");
+    put_le32(pb, INDEX_CACHE_VERSION);
+    put_le64(pb, ic->size);
+    put_le64(pb, ic->mtime);
+    put_le64(pb, ic->dev);
+    put_le64(pb, ic->ino);
+    put_le32(pb, s->nb_streams);
+    put_le32(pb, len);
+    put_buffer(pb, ic->filename, len);
+    for (i = len; i & 7; i++)
+        put_byte(pb, 0);
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        put_le32(pb, st->id);
+        put_le32(pb, st->nb_index_entries);
+        for (j = 0; j < st->nb_index_entries; j++) {
+            AVIndexEntry *e = &st->index_entries[j];
+            put_le64(pb, e->pos);
+            put_le64(pb, e->timestamp);
+            put_le32(pb, (unsigned)e->size | (e->flags & 3U) << 30);
+            put_le32(pb, e->min_distance);
+        }
+    }
+    put_flush_packet(pb);
+    ret = url_ferror(pb);
+    url_fclose(pb);
+    return ret;
+}
+
+void ff_index_cache_close(AVFormatContext *s, int save)
+{
+    IndexCache *ic = s->index_cache_ctx;
+
+    if (!ic)
+        return;
+    if (save && ic->path && index_changed(ic, s)) {
+        /* write aside and rename, readers never see a partial cache */
+        int len = strlen(ic->path) + 10;
+        char *tmp = av_malloc(len);
+        if (tmp) {
+            snprintf(tmp, len, "%s.%08x", ic->path, av_get_random_seed());
+            if (write_cache(ic, s, tmp) < 0 || rename(tmp, ic->path) < 0) {
+                av_log(s, AV_LOG_WARNING, "Could not write index cache %s\n", ic->path);
+                remove(tmp);
+            }
+            av_free(tmp);
+        }
+    }
+    if (ic->map)
+        av_file_unmap(ic->map, ic->map_size);
+    av_free(ic->streams);
+    av_free(ic->state);
+    av_free(ic->filename);
+    av_free(ic->path);
+    av_freep(&s->index_cache_ctx);
+}
@@ -67,15 +67,149 @@ int ff_hex_to_data(uint8_t *data, const char *p);
 
 void ff_program_add_stream_index(AVFormatContext *ac, int progid, unsigned int idx);
 
+typedef struct AVInterleaveQueue AVInterleaveQueue;
+
 /**
- * Add packet to AVFormatContext->packet_buffer list, determining its
+ * Add packet to the AVFormatContext interleaving queue, determining its
  * interleaved position using compare() function argument.
+ * compare(s, next, pkt) must return nonzero if pkt is to be muxed before
+ * next; packets comparing equal keep the order they were added in.
+ * Packets of a single stream are always muxed in the order they were added.
+ * @return 0 on success, a negative AVERROR on failure
+ */
+int ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
+                             int (*compare)(AVFormatContext *, AVPacket *, AVPacket *));
+
+/**
+ * Remove the first packet in interleaving order from the queue.
+ * @param out the packet, owned by the caller afterwards
+ * @return 1 if a packet was returned, 0 if the queue is empty
+ */
+int ff_interleave_get_packet(AVFormatContext *s, AVPacket *out);
+
+/**
+ * Free the interleaving queue and the packets still queued in it.
  */
-void ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
-                              int (*compare)(AVFormatContext *, AVPacket *, AVPacket *));
+void ff_interleave_free_queue(AVFormatContext *s);
 
 void ff_read_frame_flush(AVFormatContext *s);
 
+typedef struct ReadAheadContext ReadAheadContext;
+
+/**
+ * Start a thread reading ahead of the caller through read_packet.
+ * @param pos  current position of the resource
+ * @param size size of the read-ahead buffer
+ * @return 0 on success, a negative AVERROR on failure
+ */
+int ff_readahead_open(ReadAheadContext **ra, void *opaque,
+                      int (*read_packet)(void *opaque, uint8_t *buf, int buf_size),
+                      int64_t (*seek)(void *opaque, int64_t offset, int whence),
+                      int64_t pos, int size);
+
+/**
+ * Stop the read-ahead thread and free the context.
+ * The resource is left positioned after the data read ahead.
+ */
+void ff_readahead_close(ReadAheadContext *ra);
+
+/**
+ * Read up to size bytes of the data read ahead, waiting for the reader
+ * thread if none is available yet.
+ * @return number of bytes read, 0 at end of file or a negative AVERROR
+ */
+int ff_readahead_read(ReadAheadContext *ra, uint8_t *buf, int size);
+
+/**
+ * Seek with the semantics of ByteIOContext.seek. Forward seeks within the
+ * data read ahead do not touch the resource, other seeks discard it.
+ */
+int64_t ff_readahead_seek(ReadAheadContext *ra, int64_t offset, int whence);
+
+/**
+ * @return number of bytes read ahead and not yet consumed
+ */
+int64_t ff_readahead_available(ReadAheadContext *ra);
+
+typedef struct WriteBehindContext WriteBehindContext;
+
+/**
+ * Start a thread writing the buffers queued by ff_writebehind_write()
+ * through write_packet.
+ * @param nb_buffers  number of buffers the caller may fill ahead of the
+ *                    writer thread
+ * @param buffer_size size of each buffer
+ * @return 0 on success, a negative AVERROR on failure
+ */
+int ff_writebehind_open(WriteBehindContext **wb, void *opaque,
+                        int (*write_packet)(void *opaque, uint8_t *buf, int buf_size),
+                        int64_t (*seek)(void *opaque, int64_t offset, int whence),
+                        int nb_buffers, int buffer_size);
+
+/**
+ * Write out all queued buffers, stop the writer thread and free the context.
+ * @return 0 or the first error returned by write_packet
+ */
+int ff_writebehind_close(WriteBehindContext *wb);
+
+/**
+ * Queue size bytes of *buf for writing and replace *buf with an empty
+ * buffer, waiting for the writer thread if none is free.
+ * The buffer passed must be buffer_size bytes large.
+ * @return 0 on success, or the error of a previous write, in which case
+ *         *buf is left untouched
+ */
+int ff_writebehind_write(WriteBehindContext *wb, uint8_t **buf, int size);
+
+/**
+ * Seek with the semantics of ByteIOContext.seek, once all queued buffers
+ * have been written.
+ */
+int64_t ff_writebehind_seek(WriteBehindContext *wb, int64_t offset, int whence);
+
+typedef struct IndexCache IndexCache;
+
+/**
+ * Look the input up in the s->index_cache directory and map its cached
+ * index if the size and modification time of the file still match.
+ * Does nothing for other than local files.
+ * @param h        the input opened from filename
+ * @return 1 if a matching cached index was found, 0 if not,
+ *         a negative AVERROR on failure
+ */
+int ff_index_cache_open(AVFormatContext *s, URLContext *h, const char *filename);
+
+/**
+ * @return the number of cached index entries of st, 0 if none
+ */
+int ff_index_cache_entries(AVFormatContext *s, AVStream *st);
+
+/**
+ * Replace the index of st by the cached one. Demuxers building their own
+ * index call this from read_header() in place of building it when
+ * ff_index_cache_entries() is nonzero.
+ * @return 0 on success, a negative AVERROR on failure
+ */
+int ff_index_cache_restore(AVFormatContext *s, AVStream *st);
+
+/**
+ * Restore the cached index of the streams the demuxer does not index,
+ * for formats indexed by the generic code.
+ */
+void ff_index_cache_restore_streams(AVFormatContext *s);
+
+/**
+ * @return 1 if the key frames read from st are to be added to its index
+ *         for the cache, see AVFMT_CACHE_INDEX
+ */
+int ff_index_cache_generic(AVFormatContext *s, AVStream *st);
+
+/**
+ * Free the index cache entry of the input.
+ * @param save write the index of all streams to the cache if it changed
+ */
+void ff_index_cache_close(AVFormatContext *s, int save);
+
 #define NTP_OFFSET 2208988800ULL
 #define NTP_OFFSET_US (NTP_OFFSET * 1000000ULL)
 
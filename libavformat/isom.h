@@ -59,6 +59,14 @@ typedef struct {
     unsigned id;
 } MOVStsc;
 
+/**
+ * Start of a stsc or stts run in a compact index.
+ */
+typedef struct {
+    int64_t first; ///< first sample of the run
+    int64_t start; ///< first index entry (stsc) or dts (stts) of the run
+} MOVIndexRun;
+
 typedef struct {
     uint32_t type;
     char *path;
@@ -133,6 +141,12 @@ typedef struct MOVStreamContext {
     AVRational pixel_aspect; ///< information in 'pasp' atom
     MOVElst *elst_data;   ///< edit list
     unsigned elst_count;
+    int compact_index;    ///< index_entries only hold the samples around the current one
+    unsigned index_count; ///< number of index entries of the compact index
+    unsigned index_first; ///< index entry of index_entries[0] in a compact index
+    unsigned index_step;  ///< samples per index entry in a compact index
+    MOVIndexRun *stsc_runs;
+    MOVIndexRun *stts_runs;
 } MOVStreamContext;
 
 typedef struct MOVContext {
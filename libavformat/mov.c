@@ -28,6 +28,7 @@
 #include "libavutil/intreadwrite.h"
 #include "libavutil/avstring.h"
 #include "avformat.h"
+#include "internal.h"
 #include "riff.h"
 #include "isom.h"
 #include "id3v1.h"
@@ -990,6 +991,16 @@ static int mov_read_strf(MOVContext *c, ByteIOContext *pb, MOVAtom atom)
     return 0;
 }
 
+/**
+ * The sample tables are not read when the index is restored from the
+ * cache, see mov_restore_index().
+ */
+static int mov_index_cached(MOVContext *c, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    return sc->drefs_count == 1 && ff_index_cache_entries(c->fc, st) > 0;
+}
+
 static int mov_read_stco(MOVContext *c, ByteIOContext *pb, MOVAtom atom)
 {
     AVStream *st;
@@ -1001,6 +1012,9 @@ static int mov_read_stco(MOVContext *c, ByteIOContext *pb, MOVAtom atom)
     st = c->fc->streams[c->fc->nb_streams-1];
     sc = st->priv_data;
 
+    if (mov_index_cached(c, st))
+        return 0;
+
     get_byte(pb); /* version */
     get_be24(pb); /* flags */
 
@@ -1489,6 +1503,9 @@ static int mov_read_stps(MOVContext *c, ByteIOContext *pb, MOVAtom atom)
     st = c->fc->streams[c->fc->nb_streams-1];
     sc = st->priv_data;
 
+    if (mov_index_cached(c, st))
+        return 0;
+
     get_be32(pb); // version + flags
 
     entries = get_be32(pb);
@@ -1518,6 +1535,9 @@ static int mov_read_stss(MOVContext *c, ByteIOContext *pb, MOVAtom atom)
     st = c->fc->streams[c->fc->nb_streams-1];
     sc = st->priv_data;
 
+    if (mov_index_cached(c, st))
+        return 0;
+
     get_byte(pb); /* version */
     get_be24(pb); /* flags */
 
@@ -1552,6 +1572,9 @@ static int mov_read_stsz(MOVContext *c, ByteIOContext *pb, MOVAtom atom)
     st = c->fc->streams[c->fc->nb_streams-1];
     sc = st->priv_data;
 
+    if (mov_index_cached(c, st))
+        return 0;
+
     get_byte(pb); /* version */
     get_be24(pb); /* flags */
 
@@ -1755,6 +1778,273 @@ static void mov_compute_stream_time_offset(MOVContext *mov, AVStream *st)
            "a/v desync might occur, patch welcome\n");
 }
 
+#define MOV_INDEX_WINDOW 4096 ///< entries of a compact index expanded at once
+
+/* only use old uncompressed audio chunk demuxing when stts specifies it */
+static int mov_chunk_audio(AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    return st->codec->codec_type == AVMEDIA_TYPE_AUDIO &&
+           sc->stts_count == 1 && sc->stts_data[0].duration == 1;
+}
+
+/**
+ * @return the last of the runs starting at or before value
+ */
+static int mov_find_run(const MOVIndexRun *runs, int nb_runs, int64_t value, int by_start)
+{
+    int lo = 0, hi = nb_runs - 1;
+
+    while (lo < hi) {
+        int mid = (lo + hi + 1) >> 1;
+        if ((by_start ? runs[mid].start : runs[mid].first) <= value)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+static unsigned mov_entry_size(MOVStreamContext *sc, unsigned samples)
+{
+    if (sc->index_step == 1)
+        return sc->sample_size;
+    if (sc->samples_per_frame >= 160) // gsm
+        return sc->bytes_per_frame;
+    if (sc->samples_per_frame > 1)
+        return samples / sc->samples_per_frame * sc->bytes_per_frame;
+    return samples * sc->sample_size;
+}
+
+/**
+ * Expand the entries of a compact index from the whole chunks holding
+ * entries first to first+count-1 into st->index_entries.
+ */
+static int mov_fill_index(AVStream *st, unsigned first, unsigned count)
+{
+    MOVStreamContext *sc = st->priv_data;
+    unsigned end = FFMIN((uint64_t)first + count, sc->index_count);
+    unsigned chunk, per_chunk, nb = 0;
+    int r, t, ret = 0;
+    int64_t sample;
+
+    r = mov_find_run(sc->stsc_runs, sc->stsc_count, first, 1);
+    per_chunk = (sc->stsc_data[r].count + sc->index_step - 1) / sc->index_step;
+    chunk  = (first - sc->stsc_runs[r].start) / per_chunk;
+    sample = sc->stsc_runs[r].first + (int64_t)chunk * sc->stsc_data[r].count;
+    first  = sc->stsc_runs[r].start + chunk * per_chunk;
+    chunk += sc->stsc_data[r].first - 1;
+    t = mov_find_run(sc->stts_runs, sc->stts_count, sample, 0);
+
+    while (chunk < sc->chunk_count && first + nb < end) {
+        unsigned chunk_samples;
+        int64_t pos;
+
+        if (r + 1 < sc->stsc_count && chunk + 1 == sc->stsc_data[r + 1].first)
+            r++;
+        chunk_samples = sc->stsc_data[r].count;
+        pos = sc->chunk_offsets[chunk++];
+        while (chunk_samples > 0) {
+            unsigned samples = FFMIN(sc->index_step, chunk_samples);
+            AVIndexEntry *e;
+
+            if ((nb + 1) * sizeof(*e) > st->index_entries_allocated_size) {
+                e = av_fast_realloc(st->index_entries, &st->index_entries_allocated_size,
+                                    FFMAX(nb + 1, FFMIN(end - first, 2 * MOV_INDEX_WINDOW)) *
+                                    sizeof(*e));
+                if (!e) {
+                    ret = AVERROR(ENOMEM);
+                    goto end;
+                }
+                st->index_entries = e;
+            }
+            while (t + 1 < sc->stts_count && sample >= sc->stts_runs[t + 1].first)
+                t++;
+            e = &st->index_entries[nb++];
+            e->pos          = pos;
+            e->timestamp    = sc->stts_runs[t].start +
+                              (sample - sc->stts_runs[t].first) * sc->stts_data[t].duration;
+            e->size         = mov_entry_size(sc, samples);
+            e->min_distance = 0;
+            e->flags        = AVINDEX_KEYFRAME;
+
+            pos           += e->size;
+            sample        += samples;
+            chunk_samples -= samples;
+        }
+    }
+ end:
+    st->nb_index_entries = nb;
+    sc->index_first = first;
+    return ret;
+}
+
+/**
+ * Expand the entries of a compact index around entry.
+ */
+static int mov_expand_index(AVStream *st, unsigned entry)
+{
+    return mov_fill_index(st, entry > MOV_INDEX_WINDOW/4 ? entry - MOV_INDEX_WINDOW/4 : 0,
+                          MOV_INDEX_WINDOW);
+}
+
+/**
+ * @return the index entry of sample, expanding a compact index around it
+ *         if needed, NULL past the last sample
+ */
+static AVIndexEntry *mov_get_sample(AVStream *st, int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    if (!sc->compact_index)
+        return sample < st->nb_index_entries ? &st->index_entries[sample] : NULL;
+    if ((unsigned)sample >= sc->index_count)
+        return NULL;
+    if ((unsigned)sample - sc->index_first >= st->nb_index_entries &&
+        mov_expand_index(st, sample) < 0)
+        return NULL;
+    return &st->index_entries[sample - sc->index_first];
+}
+
+static ByteIOContext *mov_sample_pb(MOVStreamContext *sc, int sample)
+{
+    return sc->compact_index ? sc->drefs[0].pb : sc->sample_dref[sample];
+}
+
+/**
+ * @return the index entry of a compact index holding timestamp
+ */
+static unsigned mov_timestamp_entry(AVStream *st, int64_t timestamp)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int64_t sample = 0, offset;
+    unsigned per_chunk;
+    int r, t;
+
+    t = mov_find_run(sc->stts_runs, sc->stts_count, timestamp, 1);
+    if (timestamp > sc->stts_runs[t].start && sc->stts_data[t].duration > 0)
+        sample = sc->stts_runs[t].first +
+                 (timestamp - sc->stts_runs[t].start) / sc->stts_data[t].duration;
+    else
+        sample = sc->stts_runs[t].first;
+
+    r = mov_find_run(sc->stsc_runs, sc->stsc_count, sample, 0);
+    per_chunk = (sc->stsc_data[r].count + sc->index_step - 1) / sc->index_step;
+    offset = sample - sc->stsc_runs[r].first;
+    return FFMIN(sc->stsc_runs[r].start + offset / sc->stsc_data[r].count * per_chunk +
+                 offset % sc->stsc_data[r].count / sc->index_step,
+                 sc->index_count - 1);
+}
+
+/**
+ * Index constant size samples from the stco, stsc and stts runs instead
+ * of one entry per sample, only expanding the entries around the current
+ * sample, see mov_get_sample().
+ * @return 1 if st got a compact index
+ */
+static int mov_build_compact_index(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int chunk_audio = mov_chunk_audio(st);
+    int64_t samples = 0, entries = 0, dts;
+    unsigned i;
+
+    /* the index cache stores whole indexes */
+    if (mov->fc->index_cache_ctx || sc->drefs_count != 1 ||
+        (st->codec->codec_type != AVMEDIA_TYPE_AUDIO &&
+         st->codec->codec_type != AVMEDIA_TYPE_VIDEO) ||
+        !sc->chunk_count || !sc->stsc_count || !sc->stts_count ||
+        sc->stsc_data[0].first != 1)
+        return 0;
+    if (chunk_audio) {
+        if (sc->samples_per_frame >= 160)
+            sc->index_step = sc->samples_per_frame;
+        else if (sc->samples_per_frame > 1)
+            sc->index_step = (1920 / sc->samples_per_frame) * sc->samples_per_frame;
+        else
+            sc->index_step = 1920;
+    } else {
+        if (!sc->sample_size || sc->keyframe_count || sc->stps_count)
+            return 0;
+        sc->index_step = 1;
+    }
+
+    for (i = 0; i < sc->stsc_count; i++) {
+        MOVStsc *stsc = &sc->stsc_data[i];
+        int next = i + 1 < sc->stsc_count ? stsc[1].first : sc->chunk_count + 1;
+        if (next <= stsc->first || stsc->count <= 0 ||
+            stsc->id - 1 >= sc->dref_ids_count || sc->dref_ids[stsc->id - 1] != 1 ||
+            (sc->samples_per_frame && chunk_audio && stsc->count % sc->samples_per_frame))
+            return 0;
+        samples += (int64_t)(next - stsc->first) * stsc->count;
+        entries += (int64_t)(next - stsc->first) *
+                   ((stsc->count + sc->index_step - 1) / sc->index_step);
+    }
+    for (i = 0; i < sc->stts_count; i++)
+        if (sc->stts_data[i].count <= 0 || sc->stts_data[i].duration < 0)
+            return 0;
+    if ((!chunk_audio && samples != sc->sample_count) ||
+        entries < 4 * MOV_INDEX_WINDOW || entries >= INT_MAX)
+        return 0;
+
+    sc->stsc_runs = av_malloc(sc->stsc_count * sizeof(*sc->stsc_runs));
+    sc->stts_runs = av_malloc(sc->stts_count * sizeof(*sc->stts_runs));
+    if (!sc->stsc_runs || !sc->stts_runs) {
+        av_freep(&sc->stsc_runs);
+        av_freep(&sc->stts_runs);
+        return 0;
+    }
+    for (i = 0, samples = entries = 0; i < sc->stsc_count; i++) {
+        MOVStsc *stsc = &sc->stsc_data[i];
+        int next = i + 1 < sc->stsc_count ? stsc[1].first : sc->chunk_count + 1;
+        sc->stsc_runs[i].first = samples;
+        sc->stsc_runs[i].start = entries;
+        samples += (int64_t)(next - stsc->first) * stsc->count;
+        entries += (int64_t)(next - stsc->first) *
+                   ((stsc->count + sc->index_step - 1) / sc->index_step);
+    }
+    dts = -sc->time_offset - (chunk_audio ? 0 : sc->dts_shift);
+    for (i = 0, samples = 0; i < sc->stts_count; i++) {
+        sc->stts_runs[i].first = samples;
+        sc->stts_runs[i].start = dts;
+        samples += sc->stts_data[i].count;
+        dts     += (int64_t)sc->stts_data[i].count * sc->stts_data[i].duration;
+    }
+    sc->index_count   = entries;
+    sc->compact_index = 1;
+    av_dlog(mov->fc, "stream %d, compact index of %d entries\n", st->index, sc->index_count);
+
+    if (!chunk_audio && st->duration > 0)
+        st->codec->bit_rate = (int64_t)sc->sample_count*sc->sample_size*8*sc->time_scale/st->duration;
+
+    mov_expand_index(st, 0);
+    return 1;
+}
+
+/**
+ * Expand a compact index entirely, for fragments to be added to it.
+ */
+static int mov_uncompact_index(AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int i, ret;
+
+    if ((ret = mov_fill_index(st, 0, sc->index_count)) < 0)
+        return ret;
+    sc->sample_dref = av_malloc(st->nb_index_entries * sizeof(*sc->sample_dref));
+    if (!sc->sample_dref)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < st->nb_index_entries; i++)
+        sc->sample_dref[i] = sc->drefs[0].pb;
+    sc->compact_index = 0;
+    av_freep(&sc->chunk_offsets);
+    av_freep(&sc->stsc_data);
+    av_freep(&sc->stts_data);
+    av_freep(&sc->stsc_runs);
+    av_freep(&sc->stts_runs);
+    return 0;
+}
+
 static void mov_build_index(MOVContext *mov, AVStream *st)
 {
     MOVStreamContext *sc = st->priv_data;
@@ -1770,9 +2060,10 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     mov_compute_stream_time_offset(mov, st);
     current_dts = -sc->time_offset;
 
-    /* only use old uncompressed audio chunk demuxing when stts specifies it */
-    if (!(st->codec->codec_type == AVMEDIA_TYPE_AUDIO &&
-          sc->stts_count == 1 && sc->stts_data[0].duration == 1)) {
+    if (mov_build_compact_index(mov, st))
+        return;
+
+    if (!mov_chunk_audio(st)) {
         unsigned int current_sample = 0;
         unsigned int stts_sample = 0;
         unsigned int sample_size;
@@ -1942,6 +2233,28 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     }
 }
 
+static void mov_restore_index(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    uint64_t stream_size = 0;
+    int i;
+
+    mov_compute_stream_time_offset(mov, st);
+
+    if (ff_index_cache_restore(mov->fc, st) < 0)
+        return;
+    sc->sample_dref = av_malloc(st->nb_index_entries*sizeof(*sc->sample_dref));
+    if (!sc->sample_dref)
+        return;
+    for (i = 0; i < st->nb_index_entries; i++) {
+        sc->sample_dref[i] = sc->drefs[0].pb;
+        stream_size += st->index_entries[i].size;
+    }
+
+    if (!mov_chunk_audio(st) && st->duration > 0)
+        st->codec->bit_rate = stream_size*8*sc->time_scale/st->duration;
+}
+
 static int mov_open_dref(MOVContext *mov, MOVDref *dref, char *src)
 {
     /* try relative path, we do not try the absolute because it can leak information about our
@@ -2051,7 +2364,10 @@ static int mov_read_trak(MOVContext *c, ByteIOContext *pb, MOVAtom atom)
         }
     }
 
-    mov_build_index(c, st);
+    if (mov_index_cached(c, st))
+        mov_restore_index(c, st);
+    else
+        mov_build_index(c, st);
 
     if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
         av_reduce(&st->avg_frame_rate.num, &st->avg_frame_rate.den,
@@ -2075,12 +2391,14 @@ static int mov_read_trak(MOVContext *c, ByteIOContext *pb, MOVAtom atom)
         }
     }
 
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->stsc_data);
+    /* Do not need those anymore, unless indexing from them. */
+    if (!sc->compact_index) {
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->stsc_data);
+        av_freep(&sc->stts_data);
+    }
     av_freep(&sc->sample_sizes);
     av_freep(&sc->keyframes);
-    av_freep(&sc->stts_data);
     av_freep(&sc->stps_data);
     av_freep(&sc->elst_data);
 
@@ -2288,6 +2606,8 @@ static int mov_read_trun(MOVContext *c, ByteIOContext *pb, MOVAtom atom)
 
     if (frag->stsd_id - 1 >= sc->dref_ids_count || !sc->dref_ids[frag->stsd_id-1])
         return 0;
+    if (sc->compact_index && mov_uncompact_index(st) < 0)
+        return AVERROR(ENOMEM);
     get_byte(pb); /* version */
     flags = get_be24(pb);
     entries = get_be32(pb);
@@ -2693,10 +3013,10 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
         MOVStreamContext *msc = avst->priv_data;
-        if (msc->current_sample < avst->nb_index_entries) {
-            AVIndexEntry *current_sample = &avst->index_entries[msc->current_sample];
+        AVIndexEntry *current_sample = mov_get_sample(avst, msc->current_sample);
+        if (current_sample) {
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
-            ByteIOContext *pb = msc->sample_dref[msc->current_sample];
+            ByteIOContext *pb = mov_sample_pb(msc, msc->current_sample);
             av_dlog(s, "stream %d, sample %d, dts %"PRId64"\n", i, msc->current_sample, dts);
             if (!sample || (url_is_streamed(s->pb) && current_sample->pos < sample->pos) ||
                 (!url_is_streamed(s->pb) &&
@@ -2716,12 +3036,12 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
 {
     MOVContext *mov = s->priv_data;
     MOVStreamContext *sc;
-    AVIndexEntry *sample;
+    AVIndexEntry *entry, sample;
     AVStream *st = NULL;
     int ret;
  retry:
-    sample = mov_find_next_sample(s, &st);
-    if (!sample) {
+    entry = mov_find_next_sample(s, &st);
+    if (!entry) {
         mov->found_mdat = 0;
         if (!url_is_streamed(s->pb) ||
             mov_read_default(mov, s->pb, (MOVAtom){ AV_RL32("root"), INT64_MAX }) < 0 ||
@@ -2730,18 +3050,20 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
         av_dlog(s, "read fragments, offset 0x%llx\n", url_ftell(s->pb));
         goto retry;
     }
+    /* a compact index may be expanded again for the next sample */
+    sample = *entry;
     sc = st->priv_data;
     /* must be done just before reading, to avoid infinite loop on sample */
     sc->current_sample++;
 
     if (st->discard != AVDISCARD_ALL) {
-        ByteIOContext *pb = sc->sample_dref[sc->current_sample - 1];
-        if (url_fseek(pb, sample->pos, SEEK_SET) != sample->pos) {
+        ByteIOContext *pb = mov_sample_pb(sc, sc->current_sample - 1);
+        if (url_fseek(pb, sample.pos, SEEK_SET) != sample.pos) {
             av_log(mov->fc, AV_LOG_ERROR, "stream %d, offset 0x%"PRIx64": partial file\n",
-                   sc->ffindex, sample->pos);
+                   sc->ffindex, sample.pos);
             return -1;
         }
-        ret = av_get_packet(pb, pkt, sample->size);
+        ret = av_get_packet(pb, pkt, sample.size);
         if (ret < 0)
             return ret;
 #if CONFIG_DV_DEMUXER
@@ -2757,7 +3079,7 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
     }
 
     pkt->stream_index = sc->ffindex;
-    pkt->dts = sample->timestamp;
+    pkt->dts = sample.timestamp;
     if (sc->ctts_data) {
         pkt->pts = pkt->dts + sc->dts_shift + sc->ctts_data[sc->ctts_index].duration;
         /* update ctts context */
@@ -2768,15 +3090,15 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
             sc->ctts_sample = 0;
         }
     } else {
-        int64_t next_dts = (sc->current_sample < st->nb_index_entries) ?
-            st->index_entries[sc->current_sample].timestamp : st->duration;
+        AVIndexEntry *next = mov_get_sample(st, sc->current_sample);
+        int64_t next_dts = next ? next->timestamp : st->duration;
         pkt->duration = next_dts - pkt->dts;
         pkt->pts = pkt->dts;
     }
     if (st->discard == AVDISCARD_ALL)
         goto retry;
-    pkt->flags |= sample->flags & AVINDEX_KEYFRAME ? AV_PKT_FLAG_KEY : 0;
-    pkt->pos = sample->pos;
+    pkt->flags |= sample.flags & AVINDEX_KEYFRAME ? AV_PKT_FLAG_KEY : 0;
+    pkt->pos = sample.pos;
     //av_dlog(s, "stream %d, pts %"PRId64", dts %"PRId64", pos 0x%"PRIx64", duration %d\n",
     //        pkt->stream_index, pkt->pts, pkt->dts, pkt->pos, pkt->duration);
     return 0;
@@ -2788,7 +3110,14 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
     int sample, time_sample;
     int i;
 
-    sample = av_index_search_timestamp(st, timestamp, flags);
+    if (sc->compact_index) {
+        if (mov_expand_index(st, mov_timestamp_entry(st, timestamp)) < 0)
+            return -1;
+        sample = av_index_search_timestamp(st, timestamp, flags);
+        if (sample >= 0)
+            sample += sc->index_first;
+    } else
+        sample = av_index_search_timestamp(st, timestamp, flags);
     av_dlog(s, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
     if (sample < 0 && st->nb_index_entries && timestamp < st->index_entries[0].timestamp)
         sample = 0;
@@ -2830,7 +3159,7 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
         return -1;
 
     /* adjust seek timestamp to found sample timestamp */
-    seek_timestamp = st->index_entries[sample].timestamp;
+    seek_timestamp = mov_get_sample(st, sample)->timestamp;
 
     for (i = 0; i < s->nb_streams; i++) {
         st = s->streams[i];
@@ -2853,6 +3182,11 @@ static int mov_read_close(AVFormatContext *s)
         MOVStreamContext *sc = st->priv_data;
 
         av_freep(&sc->ctts_data);
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->stsc_data);
+        av_freep(&sc->stts_data);
+        av_freep(&sc->stsc_runs);
+        av_freep(&sc->stts_runs);
         for (j = 0; j < sc->drefs_count; j++) {
             if (sc->drefs[j].pb && sc->drefs[j].pb != s->pb)
                 url_fclose(sc->drefs[j].pb);
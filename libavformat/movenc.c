@@ -2488,6 +2488,57 @@ static void mov_create_chapter_track(AVFormatContext *s, int tracknum)
     }
 }
 
+/**
+ * Estimate an upper bound of the moov atom size for a file of the given
+ * duration, so it can be reserved before the mdat and written in place.
+ * Sample tables are counted as one 64 bit chunk offset, one sample size
+ * and one sync sample per packet, plus composition offsets if needed.
+ */
+static int mov_estimate_moov_size(AVFormatContext *s, int64_t duration)
+{
+    MOVMuxContext *mov = s->priv_data;
+    int64_t size = 4096, video_packets = 0; // mvhd, udta, metadata
+    int i;
+
+    for (i = 0; i < mov->nb_streams; i++) {
+        AVCodecContext *enc = mov->tracks[i].enc;
+        if (enc->codec_type == AVMEDIA_TYPE_VIDEO && enc->time_base.num)
+            video_packets = FFMAX(video_packets,
+                                  av_rescale(duration, enc->time_base.den,
+                                             (int64_t)enc->time_base.num *
+                                             enc->ticks_per_frame * AV_TIME_BASE));
+    }
+
+    for (i = 0; i < mov->nb_streams; i++) {
+        MOVTrack *track = &mov->tracks[i];
+        AVCodecContext *enc = track->enc;
+        int64_t packets = 0;
+        int entry_size = 8 + 4 + 4;
+
+        size += 1024 + enc->extradata_size; // trak, stsd, edts
+
+        if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
+            packets = video_packets;
+            if (enc->has_b_frames || enc->max_b_frames)
+                entry_size += 8;
+        } else if (enc->codec_type == AVMEDIA_TYPE_AUDIO) {
+            // uncompressed audio packets usually follow video frames
+            if (enc->frame_size > 1)
+                packets = av_rescale(duration, enc->sample_rate,
+                                     (int64_t)enc->frame_size * AV_TIME_BASE);
+            else
+                packets = FFMAX(video_packets,
+                                av_rescale(duration, enc->sample_rate, 1024 * AV_TIME_BASE));
+        } else if (enc->codec_type == AVMEDIA_TYPE_SUBTITLE) {
+            packets = duration / AV_TIME_BASE;
+        }
+        size += (packets + 1) * entry_size;
+    }
+
+    size += size / 10; // margin for timestamps jitter
+    return FFMIN(size, INT_MAX);
+}
+
 static int mov_write_header(AVFormatContext *s)
 {
     ByteIOContext *pb = s->pb;
@@ -2631,12 +2682,19 @@ static int mov_write_header(AVFormatContext *s)
             mov->overwrite = 1;
         else if (!strcmp(mov->faststart, "no"))
             mov->overwrite = -1;
-        else
+        else if (!strcmp(mov->faststart, "reserve")) {
+            mov->overwrite = 1;
+            if (s->duration > 0 && !url_is_streamed(pb))
+                mov->free_size = mov_estimate_moov_size(s, s->duration);
+            else
+                av_log(s, AV_LOG_WARNING, "duration is unknown, cannot reserve "
+                       "space for the header, file will be rewritten\n");
+        } else
             mov->overwrite = atoi(mov->faststart);
-        if (mov->overwrite > 1) {
-            av_log(s, AV_LOG_INFO, "writing free atom of %d bytes\n", mov->overwrite);
+        if (mov->overwrite > 1)
             mov->free_size = mov->overwrite;
-        }
+        if (mov->free_size > 0)
+            av_log(s, AV_LOG_INFO, "writing free atom of %d bytes\n", mov->free_size);
     }
 
     mov->free_pos = url_ftell(pb);
@@ -2776,6 +2834,7 @@ static int mov_write_trailer(AVFormatContext *s)
     MOVMuxContext *mov = s->priv_data;
     ByteIOContext *pb = s->pb;
     int res = 0;
+    int moov_size = 0;
     int i;
 
     int64_t moov_pos = url_ftell(pb);
@@ -2796,17 +2855,20 @@ static int mov_write_trailer(AVFormatContext *s)
 
     put_flush_packet(pb);
 
-    if (mov->free_size > 8) {
-        int moov_size = mov_compute_moov_size(s);
-        if (moov_size > mov->free_size) {
-            av_log(s, AV_LOG_ERROR, "moov size is bigger than available space\n");
-            goto write_end;
-        }
+    if (mov->free_size > 8)
+        moov_size = mov_compute_moov_size(s);
+
+    if (moov_size && (moov_size == mov->free_size ||
+                      moov_size <= mov->free_size - 8)) {
         url_fseek(pb, mov->free_pos, SEEK_SET);
         mov_write_moov_tag(pb, mov, s);
-        mov_write_free_tag(pb, mov, mov->free_size - moov_size);
+        if (moov_size < mov->free_size)
+            mov_write_free_tag(pb, mov, mov->free_size - moov_size);
     } else if (mov->overwrite > 0 ||
                (mov->overwrite != -1 && moov_pos < 20000000)) {
+        if (moov_size)
+            av_log(s, AV_LOG_WARNING, "moov size %d is bigger than reserved "
+                   "space %d, rewriting file\n", moov_size, mov->free_size);
         if (mov_overwrite_file(s) < 0)
             goto write_end;
     } else {
@@ -2838,7 +2900,9 @@ static int mov_write_trailer(AVFormatContext *s)
 }
 
 #define FAST_START_OPTION \
-    { "faststart", "Pre-allocate space for the header in front of the file: <size or 'auto' or 'no'>\n" \
+    { "faststart", "Pre-allocate space for the header in front of the file: <size or 'auto' or 'reserve' or 'no'>\n" \
+      "'reserve' estimates the header size from the expected duration and\n" \
+      "only rewrites the file if the estimate is exceeded.\n" \
       "Files are automatically rewritten if size is < 20MB unless 'no' is specified.\n", \
       offsetof(MOVMuxContext, faststart), FF_OPT_TYPE_STRING, 0, 0, 0, AV_OPT_FLAG_ENCODING_PARAM} \
 
@@ -1846,7 +1846,7 @@ AVInputFormat ff_mpegts_demuxer = {
     mpegts_read_close,
     read_seek,
     mpegts_get_pcr,
-    .flags = AVFMT_SHOW_IDS|AVFMT_TS_DISCONT,
+    .flags = AVFMT_SHOW_IDS|AVFMT_TS_DISCONT|AVFMT_CACHE_INDEX,
 #ifdef USE_SYNCPOINT_SEARCH
     .read_seek2 = read_seek2,
 #endif
@@ -19,6 +19,9 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "config.h"
+#include "libavutil/cpu.h"
+#include "libavutil/intreadwrite.h"
 #include "mxf.h"
 
 /**
@@ -95,3 +98,189 @@ int ff_mxf_decode_pixel_layout(const char pixel_layout[16], enum PixelFormat *pi
 
     return -1;
 }
+
+/* SMPTE 331M 5.3: sample in bits 4-27, channel number in bits 0-2 */
+void ff_mxf_pack_d10_aes3_c(uint8_t *dst, const uint8_t *src, int nb_samples,
+                            int channels, int bits)
+{
+    int i, ch;
+
+    if (bits == 24) {
+        for (i = 0; i < nb_samples; i++) {
+            for (ch = 0; ch < channels; ch++, src += 3, dst += 4)
+                AV_WL32(dst, AV_RL24(src) << 4 | ch);
+            for (; ch < 8; ch++, dst += 4)
+                AV_WL32(dst, ch);
+        }
+    } else {
+        for (i = 0; i < nb_samples; i++) {
+            for (ch = 0; ch < channels; ch++, src += 2, dst += 4)
+                AV_WL32(dst, AV_RL16(src) << 12 | ch);
+            for (; ch < 8; ch++, dst += 4)
+                AV_WL32(dst, ch);
+        }
+    }
+}
+
+void ff_mxf_unpack_d10_aes3_c(uint8_t *dst, const uint8_t *src, int nb_samples,
+                              int channels, int bits)
+{
+    int i, ch;
+
+    if (bits == 24) {
+        for (i = 0; i < nb_samples; i++, src += 32)
+            for (ch = 0; ch < channels; ch++, dst += 3)
+                AV_WL24(dst, AV_RL32(src + 4*ch) >> 4);
+    } else {
+        for (i = 0; i < nb_samples; i++, src += 32)
+            for (ch = 0; ch < channels; ch++, dst += 2)
+                AV_WL16(dst, AV_RL32(src + 4*ch) >> 12);
+    }
+}
+
+void ff_mxf_dsp_init(MXFDSPContext *c)
+{
+    av_unused int cpu_flags = av_get_cpu_flags();
+
+    c->pack_d10_aes3   = ff_mxf_pack_d10_aes3_c;
+    c->unpack_d10_aes3 = ff_mxf_unpack_d10_aes3_c;
+    if (HAVE_SSE && cpu_flags & AV_CPU_FLAG_SSE2) {
+        c->pack_d10_aes3   = ff_mxf_pack_d10_aes3_sse2;
+        c->unpack_d10_aes3 = ff_mxf_unpack_d10_aes3_sse2;
+    }
+    if (HAVE_SSSE3 && cpu_flags & AV_CPU_FLAG_SSSE3) {
+        c->pack_d10_aes3   = ff_mxf_pack_d10_aes3_ssse3;
+        c->unpack_d10_aes3 = ff_mxf_unpack_d10_aes3_ssse3;
+    }
+}
+
+#ifdef TEST
+#include <sys/time.h>
+#include "libavutil/lfg.h"
+#include "avio.h"
+
+#undef printf
+
+#define NB_SAMPLES 1920
+#define NB_ITS 1000
+
+static int64_t gettime(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* per sample writes, as the d-10 muxer used to do */
+static void put_d10_aes3(ByteIOContext *pb, const uint8_t *src, int nb_samples,
+                         int channels, int bits)
+{
+    int i, ch;
+
+    for (i = 0; i < nb_samples; i++) {
+        for (ch = 0; ch < channels; ch++) {
+            if (bits == 24) {
+                put_le32(pb, AV_RL24(src) << 4 | ch);
+                src += 3;
+            } else {
+                put_le32(pb, AV_RL16(src) << 12 | ch);
+                src += 2;
+            }
+        }
+        for (; ch < 8; ch++)
+            put_le32(pb, ch);
+    }
+}
+
+int main(void)
+{
+    static const int nb_samples[] = { 1, 2, 3, 1601, NB_SAMPLES };
+    static uint8_t pcm[NB_SAMPLES * 8 * 3], unpacked[NB_SAMPLES * 8 * 3];
+    static uint8_t aes3[NB_SAMPLES * 8 * 4], element[4 + NB_SAMPLES * 8 * 4];
+    MXFDSPContext dsp;
+    AVLFG prng;
+    int i, it, bits, channels, errors = 0;
+
+    ff_mxf_dsp_init(&dsp);
+    av_lfg_init(&prng, 1);
+    for (i = 0; i < sizeof(pcm); i++)
+        pcm[i] = av_lfg_get(&prng);
+
+    for (bits = 16; bits <= 24; bits += 8) {
+        for (channels = 1; channels <= 8; channels++) {
+            for (i = 0; i < FF_ARRAY_ELEMS(nb_samples); i++) {
+                int size = nb_samples[i] * channels * (bits >> 3);
+                ByteIOContext *pb;
+                uint8_t *ref;
+
+                url_open_dyn_buf(&pb);
+                put_d10_aes3(pb, pcm, nb_samples[i], channels, bits);
+                url_close_dyn_buf(pb, &ref);
+                memset(aes3, 0, sizeof(aes3));
+                dsp.pack_d10_aes3(aes3, pcm, nb_samples[i], channels, bits);
+                if (memcmp(ref, aes3, nb_samples[i] * 32)) {
+                    printf("error: %d bit %d channels %d samples packing differs\n",
+                           bits, channels, nb_samples[i]);
+                    errors++;
+                }
+                av_free(ref);
+
+                memset(unpacked, 0, sizeof(unpacked));
+                dsp.unpack_d10_aes3(unpacked, aes3, nb_samples[i], channels, bits);
+                /* in place, as the demuxer does */
+                memcpy(element + 4, aes3, nb_samples[i] * 32);
+                dsp.unpack_d10_aes3(element, element + 4, nb_samples[i], channels, bits);
+                if (memcmp(unpacked, pcm, size) || memcmp(element, pcm, size)) {
+                    printf("error: %d bit %d channels %d samples unpacking differs\n",
+                           bits, channels, nb_samples[i]);
+                    errors++;
+                }
+            }
+        }
+    }
+
+    for (bits = 16; bits <= 24; bits += 8) {
+        for (channels = 2; channels <= 8; channels += 2) {
+            ByteIOContext *pb;
+            uint8_t *ref;
+            int64_t t[5];
+
+            url_open_dyn_buf(&pb);
+            t[0] = gettime();
+            for (it = 0; it < NB_ITS; it++)
+                put_d10_aes3(pb, pcm, NB_SAMPLES, channels, bits);
+            t[0] = gettime() - t[0];
+            t[1] = gettime();
+            for (it = 0; it < NB_ITS; it++) {
+                ff_mxf_pack_d10_aes3_c(aes3, pcm, NB_SAMPLES, channels, bits);
+                put_buffer(pb, aes3, sizeof(aes3));
+            }
+            t[1] = gettime() - t[1];
+            t[2] = gettime();
+            for (it = 0; it < NB_ITS; it++) {
+                dsp.pack_d10_aes3(aes3, pcm, NB_SAMPLES, channels, bits);
+                put_buffer(pb, aes3, sizeof(aes3));
+            }
+            t[2] = gettime() - t[2];
+            url_close_dyn_buf(pb, &ref);
+            av_free(ref);
+
+            t[3] = gettime();
+            for (it = 0; it < NB_ITS; it++)
+                ff_mxf_unpack_d10_aes3_c(unpacked, aes3, NB_SAMPLES, channels, bits);
+            t[3] = gettime() - t[3];
+            t[4] = gettime();
+            for (it = 0; it < NB_ITS; it++)
+                dsp.unpack_d10_aes3(unpacked, aes3, NB_SAMPLES, channels, bits);
+            t[4] = gettime() - t[4];
+
+            printf("%d bit %d channels, us per frame: put_le32 %.1f, "
+                   "pack+put_buffer C %.1f, %.1f, unpack C %.1f, %.1f\n",
+                   bits, channels, (double)t[0] / NB_ITS, (double)t[1] / NB_ITS,
+                   (double)t[2] / NB_ITS, (double)t[3] / NB_ITS, (double)t[4] / NB_ITS);
+        }
+    }
+
+    return !!errors;
+}
+#endif
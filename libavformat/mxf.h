@@ -63,6 +63,41 @@ extern const MXFCodecUL ff_mxf_codec_uls[];
 
 int ff_mxf_decode_pixel_layout(const char pixel_layout[16], enum PixelFormat *pix_fmt);
 
+typedef struct MXFDSPContext {
+    /**
+     * Pack little-endian PCM into the 8 channel, 32-bit words of a
+     * SMPTE 331M AES3 element, the missing channels only hold their number.
+     * @param dst  nb_samples*32 bytes
+     * @param bits 16 or 24
+     */
+    void (*pack_d10_aes3)(uint8_t *dst, const uint8_t *src, int nb_samples,
+                          int channels, int bits);
+
+    /**
+     * Unpack the first channels of the samples of a SMPTE 331M AES3 element
+     * into little-endian PCM, reverse of pack_d10_aes3().
+     * dst may point to the start of the element header, before src.
+     */
+    void (*unpack_d10_aes3)(uint8_t *dst, const uint8_t *src, int nb_samples,
+                            int channels, int bits);
+} MXFDSPContext;
+
+void ff_mxf_dsp_init(MXFDSPContext *c);
+
+void ff_mxf_pack_d10_aes3_c(uint8_t *dst, const uint8_t *src, int nb_samples,
+                            int channels, int bits);
+void ff_mxf_unpack_d10_aes3_c(uint8_t *dst, const uint8_t *src, int nb_samples,
+                              int channels, int bits);
+
+void ff_mxf_pack_d10_aes3_sse2(uint8_t *dst, const uint8_t *src, int nb_samples,
+                               int channels, int bits);
+void ff_mxf_unpack_d10_aes3_sse2(uint8_t *dst, const uint8_t *src, int nb_samples,
+                                 int channels, int bits);
+void ff_mxf_pack_d10_aes3_ssse3(uint8_t *dst, const uint8_t *src, int nb_samples,
+                                int channels, int bits);
+void ff_mxf_unpack_d10_aes3_ssse3(uint8_t *dst, const uint8_t *src, int nb_samples,
+                                  int channels, int bits);
+
 #define PRINT_KEY(pc, s, x) av_dlog(pc, "%s %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X\n", s, \
                              (x)[0], (x)[1], (x)[2], (x)[3], (x)[4], (x)[5], (x)[6], (x)[7], (x)[8], (x)[9], (x)[10], (x)[11], (x)[12], (x)[13], (x)[14], (x)[15])
 
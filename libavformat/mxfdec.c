@@ -49,6 +49,7 @@
 #include "libavcodec/bytestream.h"
 #include "libavcodec/timecode.h"
 #include "avformat.h"
+#include "internal.h"
 #include "mxf.h"
 
 typedef struct {
@@ -113,11 +114,42 @@ typedef struct {
     enum PixelFormat pix_fmt;
 } MXFDescriptor;
 
+typedef struct {
+    int8_t pos_table_index;
+    uint8_t slice;
+    uint32_t element_delta;
+} MXFDeltaEntry;
+
 typedef struct {
     UID uid;
     enum MXFMetadataSetType type;
+    int edit_unit_byte_count;
+    int index_sid;
+    int body_sid;
+    int slice_count;
+    int pos_table_count;
+    AVRational index_edit_rate;
+    int64_t index_start_position;
+    int64_t index_duration;
+    int nb_delta_entries;
+    MXFDeltaEntry *delta_entries;
+    int nb_index_entries;
+    int8_t *temporal_offset_entries;
+    int8_t *key_frame_offset_entries;
+    uint8_t *flag_entries;
+    uint64_t *stream_offset_entries;
 } MXFIndexTableSegment;
 
+typedef struct {
+    uint64_t this_partition;
+    uint64_t previous_partition;
+    uint64_t footer_partition;
+    int index_sid;
+    int body_sid;
+    int64_t body_offset;
+    int64_t essence_offset; ///< absolute file offset of the first essence byte, -1 if none
+} MXFPartition;
+
 typedef struct {
     UID uid;
     enum MXFMetadataSetType type;
@@ -142,6 +174,17 @@ typedef struct {
     struct AVAES *aesc;
     uint8_t *local_tags;
     int local_tags_count;
+    MXFPartition *partitions;
+    int partitions_count;
+    MXFPartition **body_partitions; ///< partitions with essence of body_sid, sorted by body offset
+    int body_partitions_count;
+    MXFIndexTableSegment **index_segments; ///< index table segments of body_sid, sorted by start position
+    int index_segments_count;
+    int64_t run_in;              ///< size of the run-in preceding the header partition
+    int body_sid;                ///< essence container the index refers to
+    int edit_unit_byte_count;    ///< constant edit unit size, 0 if indexed per entry
+    AVRational index_edit_rate;
+    MXFDSPContext dsp;
 } MXFContext;
 
 enum MXFWrappingScheme {
@@ -162,13 +205,18 @@ typedef struct {
 static const uint8_t mxf_header_partition_pack_key[]       = { 0x06,0x0e,0x2b,0x34,0x02,0x05,0x01,0x01,0x0d,0x01,0x02,0x01,0x01,0x02 };
 static const uint8_t mxf_essence_element_key[]             = { 0x06,0x0e,0x2b,0x34,0x01,0x02,0x01,0x01,0x0d,0x01,0x03,0x01 };
 static const uint8_t mxf_klv_key[]                         = { 0x06,0x0e,0x2b,0x34 };
+static const uint8_t mxf_partition_pack_key[]              = { 0x06,0x0e,0x2b,0x34,0x02,0x05,0x01,0x01,0x0d,0x01,0x02,0x01,0x01 };
 /* complete keys to match */
 static const uint8_t mxf_crypto_source_container_ul[]      = { 0x06,0x0e,0x2b,0x34,0x01,0x01,0x01,0x09,0x06,0x01,0x01,0x02,0x02,0x00,0x00,0x00 };
 static const uint8_t mxf_encrypted_triplet_key[]           = { 0x06,0x0e,0x2b,0x34,0x02,0x04,0x01,0x07,0x0d,0x01,0x03,0x01,0x02,0x7e,0x01,0x00 };
 static const uint8_t mxf_encrypted_essence_container[]     = { 0x06,0x0e,0x2b,0x34,0x04,0x01,0x01,0x07,0x0d,0x01,0x03,0x01,0x02,0x0b,0x01,0x00 };
 static const uint8_t mxf_sony_mpeg4_extradata[]            = { 0x06,0x0e,0x2b,0x34,0x04,0x01,0x01,0x01,0x0e,0x06,0x06,0x02,0x02,0x01,0x00,0x00 };
+static const uint8_t mxf_index_table_segment_key[]         = { 0x06,0x0e,0x2b,0x34,0x02,0x53,0x01,0x01,0x0d,0x01,0x02,0x01,0x01,0x10,0x01,0x00 };
+static const uint8_t mxf_random_index_pack_key[]           = { 0x06,0x0e,0x2b,0x34,0x02,0x05,0x01,0x01,0x0d,0x01,0x02,0x01,0x01,0x11,0x01,0x00 };
 
 #define IS_KLV_KEY(x, y) (!memcmp(x, y, sizeof(y)))
+/* header, body and footer partition packs, SMPTE 377M 6.1 */
+#define IS_PARTITION_PACK_KEY(x) (IS_KLV_KEY(x, mxf_partition_pack_key) && (x)[13] >= 0x02 && (x)[13] <= 0x04)
 
 static int64_t klv_decode_ber_length(ByteIOContext *pb)
 {
@@ -224,30 +272,23 @@ static int mxf_get_stream_index(AVFormatContext *s, KLVPacket *klv)
 }
 
 /* XXX: use AVBitStreamFilter */
-static int mxf_get_d10_aes3_packet(ByteIOContext *pb, AVStream *st, AVPacket *pkt, int64_t length)
+static int mxf_get_d10_aes3_packet(MXFContext *mxf, ByteIOContext *pb, AVStream *st,
+                                   AVPacket *pkt, int64_t length)
 {
-    const uint8_t *buf_ptr, *end_ptr;
-    uint8_t *data_ptr;
-    int i;
+    int bits = st->codec->bits_per_coded_sample == 24 ? 24 : 16;
+    int nb_samples;
 
-    if (length > 61444) /* worst case PAL 1920 samples 8 channels */
+    /* worst case PAL 1920 samples 8 channels */
+    if (length < 4 || length > 61444 || st->codec->channels > 8)
         return -1;
-    av_new_packet(pkt, length);
+    if (av_new_packet(pkt, length) < 0)
+        return AVERROR(ENOMEM);
     get_buffer(pb, pkt->data, length);
-    data_ptr = pkt->data;
-    end_ptr = pkt->data + length;
-    buf_ptr = pkt->data + 4; /* skip SMPTE 331M header */
-    for (; buf_ptr < end_ptr; ) {
-        for (i = 0; i < st->codec->channels; i++) {
-            uint32_t sample = bytestream_get_le32(&buf_ptr);
-            if (st->codec->bits_per_coded_sample == 24)
-                bytestream_put_le24(&data_ptr, (sample >> 4) & 0xffffff);
-            else
-                bytestream_put_le16(&data_ptr, (sample >> 12) & 0xffff);
-        }
-        buf_ptr += 32 - st->codec->channels*4; // always 8 channels stored SMPTE 331M
-    }
-    pkt->size = data_ptr - pkt->data;
+    /* skip SMPTE 331M header, always 8 channels stored */
+    nb_samples = (length - 4) / 32;
+    mxf->dsp.unpack_d10_aes3(pkt->data, pkt->data + 4, nb_samples,
+                             st->codec->channels, bits);
+    pkt->size = nb_samples * st->codec->channels * (bits >> 3);
     return 0;
 }
 
@@ -312,6 +353,7 @@ static int mxf_decrypt_triplet(AVFormatContext *s, AVPacket *pkt, KLVPacket *klv
 
 static int mxf_read_packet(AVFormatContext *s, AVPacket *pkt)
 {
+    MXFContext *mxf = s->priv_data;
     KLVPacket klv;
 
     while (!url_feof(s->pb)) {
@@ -337,7 +379,7 @@ static int mxf_read_packet(AVFormatContext *s, AVPacket *pkt)
                 goto skip;
             /* check for 8 channels AES3 element */
             if (klv.key[12] == 0x06 && klv.key[13] == 0x01 && klv.key[14] == 0x10) {
-                if (mxf_get_d10_aes3_packet(s->pb, s->streams[index], pkt, klv.length) < 0) {
+                if (mxf_get_d10_aes3_packet(mxf, s->pb, s->streams[index], pkt, klv.length) < 0) {
                     av_log(s, AV_LOG_ERROR, "error reading D-10 aes3 frame\n");
                     return -1;
                 }
@@ -541,15 +583,100 @@ static int mxf_read_source_package(void *arg, ByteIOContext *pb, int tag, int si
     return 0;
 }
 
+static int mxf_read_delta_entry_array(ByteIOContext *pb, MXFIndexTableSegment *segment)
+{
+    int i, length;
+
+    segment->nb_delta_entries = get_be32(pb);
+    length = get_be32(pb);
+    if (segment->nb_delta_entries < 0 || length < 6 ||
+        segment->nb_delta_entries >= UINT_MAX / sizeof(*segment->delta_entries))
+        return -1;
+    segment->delta_entries = av_malloc(segment->nb_delta_entries * sizeof(*segment->delta_entries));
+    if (!segment->delta_entries && segment->nb_delta_entries)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < segment->nb_delta_entries; i++) {
+        segment->delta_entries[i].pos_table_index = get_byte(pb);
+        segment->delta_entries[i].slice = get_byte(pb);
+        segment->delta_entries[i].element_delta = get_be32(pb);
+        url_fskip(pb, length - 6);
+    }
+    return 0;
+}
+
+static int mxf_read_index_entry_array(ByteIOContext *pb, MXFIndexTableSegment *segment)
+{
+    int i, length;
+
+    segment->nb_index_entries = get_be32(pb);
+    length = get_be32(pb);
+    /* SMPTE 377M 10.3.3, 11 bytes plus slice offsets and pos table */
+    if (segment->nb_index_entries < 0 || length < 11 ||
+        segment->nb_index_entries >= UINT_MAX / sizeof(*segment->stream_offset_entries))
+        return -1;
+    segment->temporal_offset_entries  = av_malloc(segment->nb_index_entries);
+    segment->key_frame_offset_entries = av_malloc(segment->nb_index_entries);
+    segment->flag_entries             = av_malloc(segment->nb_index_entries);
+    segment->stream_offset_entries    = av_malloc(segment->nb_index_entries *
+                                                  sizeof(*segment->stream_offset_entries));
+    if (segment->nb_index_entries &&
+        (!segment->temporal_offset_entries || !segment->key_frame_offset_entries ||
+         !segment->flag_entries || !segment->stream_offset_entries))
+        return AVERROR(ENOMEM);
+    for (i = 0; i < segment->nb_index_entries; i++) {
+        segment->temporal_offset_entries[i] = get_byte(pb);
+        segment->key_frame_offset_entries[i] = get_byte(pb);
+        segment->flag_entries[i] = get_byte(pb);
+        segment->stream_offset_entries[i] = get_be64(pb);
+        url_fskip(pb, length - 11); /* slice offsets and pos table */
+    }
+    return 0;
+}
+
 static int mxf_read_index_table_segment(void *arg, ByteIOContext *pb, int tag, int size, UID uid)
 {
+    MXFIndexTableSegment *segment = arg;
     switch(tag) {
-    case 0x3F05: av_dlog(NULL, "EditUnitByteCount %d\n", get_be32(pb)); break;
-    case 0x3F06: av_dlog(NULL, "IndexSID %d\n", get_be32(pb)); break;
-    case 0x3F07: av_dlog(NULL, "BodySID %d\n", get_be32(pb)); break;
-    case 0x3F0B: av_dlog(NULL, "IndexEditRate %d/%d\n", get_be32(pb), get_be32(pb)); break;
-    case 0x3F0C: av_dlog(NULL, "IndexStartPosition %lld\n", get_be64(pb)); break;
-    case 0x3F0D: av_dlog(NULL, "IndexDuration %lld\n", get_be64(pb)); break;
+    case 0x3F05:
+        segment->edit_unit_byte_count = get_be32(pb);
+        av_dlog(NULL, "EditUnitByteCount %d\n", segment->edit_unit_byte_count);
+        break;
+    case 0x3F06:
+        segment->index_sid = get_be32(pb);
+        av_dlog(NULL, "IndexSID %d\n", segment->index_sid);
+        break;
+    case 0x3F07:
+        segment->body_sid = get_be32(pb);
+        av_dlog(NULL, "BodySID %d\n", segment->body_sid);
+        break;
+    case 0x3F08:
+        segment->slice_count = get_byte(pb);
+        av_dlog(NULL, "SliceCount %d\n", segment->slice_count);
+        break;
+    case 0x3F09:
+        av_dlog(NULL, "DeltaEntryArray found\n");
+        return mxf_read_delta_entry_array(pb, segment);
+    case 0x3F0A:
+        av_dlog(NULL, "IndexEntryArray found\n");
+        return mxf_read_index_entry_array(pb, segment);
+    case 0x3F0B:
+        segment->index_edit_rate.den = get_be32(pb);
+        segment->index_edit_rate.num = get_be32(pb);
+        av_dlog(NULL, "IndexEditRate %d/%d\n", segment->index_edit_rate.den,
+                segment->index_edit_rate.num);
+        break;
+    case 0x3F0C:
+        segment->index_start_position = get_be64(pb);
+        av_dlog(NULL, "IndexStartPosition %"PRId64"\n", segment->index_start_position);
+        break;
+    case 0x3F0D:
+        segment->index_duration = get_be64(pb);
+        av_dlog(NULL, "IndexDuration %"PRId64"\n", segment->index_duration);
+        break;
+    case 0x3F0E:
+        segment->pos_table_count = get_byte(pb);
+        av_dlog(NULL, "PosTableCount %d\n", segment->pos_table_count);
+        break;
     }
     return 0;
 }
@@ -897,7 +1024,6 @@ static const MXFMetadataReadTableEntry mxf_metadata_read_table[] = {
     { { 0x06,0x0E,0x2B,0x34,0x02,0x53,0x01,0x01,0x0d,0x01,0x01,0x01,0x01,0x01,0x3A,0x00 }, mxf_read_track, sizeof(MXFTrack), Track }, /* Static Track */
     { { 0x06,0x0E,0x2B,0x34,0x02,0x53,0x01,0x01,0x0d,0x01,0x01,0x01,0x01,0x01,0x3B,0x00 }, mxf_read_track, sizeof(MXFTrack), Track }, /* Generic Track */
     { { 0x06,0x0E,0x2B,0x34,0x02,0x53,0x01,0x01,0x0d,0x01,0x04,0x01,0x02,0x02,0x00,0x00 }, mxf_read_cryptographic_context, sizeof(MXFCryptoContext), CryptoContext },
-    { { 0x06,0x0E,0x2B,0x34,0x02,0x53,0x01,0x01,0x0d,0x01,0x02,0x01,0x01,0x10,0x01,0x00 }, mxf_read_index_table_segment, sizeof(MXFIndexTableSegment), IndexTableSegment },
     { { 0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00 }, NULL, 0, AnyType },
 };
 
@@ -942,6 +1068,311 @@ static int mxf_read_local_tags(MXFContext *mxf, KLVPacket *klv, MXFMetadataReadF
     return ctx_size ? mxf_add_metadata_set(mxf, ctx) : 0;
 }
 
+/*
+ * Read the partition pack at the current position and locate the first
+ * essence element following it, index table segments found on the way
+ * are added to the metadata sets.
+ * Returns: index of the partition in mxf->partitions, < 0 on error
+ */
+static int mxf_read_partition_pack(MXFContext *mxf, int64_t offset)
+{
+    ByteIOContext *pb = mxf->fc->pb;
+    MXFPartition *partition;
+    KLVPacket klv;
+    int64_t klv_end;
+    int i, res;
+
+    url_fseek(pb, mxf->run_in + offset, SEEK_SET);
+    if (klv_read_packet(&klv, pb) < 0 || klv.offset != mxf->run_in + offset ||
+        !IS_PARTITION_PACK_KEY(klv.key)) {
+        av_log(mxf->fc, AV_LOG_ERROR, "no partition pack at offset %"PRId64"\n", offset);
+        return -1;
+    }
+    klv_end = url_ftell(pb) + klv.length;
+
+    for (i = 0; i < mxf->partitions_count; i++)
+        if (mxf->partitions[i].this_partition == offset)
+            return i;
+
+    if (mxf->partitions_count+1 >= UINT_MAX / sizeof(*mxf->partitions))
+        return AVERROR(ENOMEM);
+    mxf->partitions = av_realloc(mxf->partitions, (mxf->partitions_count + 1) * sizeof(*mxf->partitions));
+    if (!mxf->partitions)
+        return AVERROR(ENOMEM);
+    partition = &mxf->partitions[mxf->partitions_count];
+
+    url_fskip(pb, 8); /* major and minor versions, KAG size */
+    partition->this_partition = get_be64(pb);
+    partition->previous_partition = get_be64(pb);
+    partition->footer_partition = get_be64(pb);
+    url_fskip(pb, 16); /* header and index byte counts */
+    partition->index_sid = get_be32(pb);
+    partition->body_offset = get_be64(pb);
+    partition->body_sid = get_be32(pb);
+    partition->essence_offset = -1;
+    av_dlog(mxf->fc, "partition %"PRId64" body sid %d body offset %"PRId64"\n",
+            partition->this_partition, partition->body_sid, partition->body_offset);
+
+    /* header and index byte counts do not include the fill item following
+     * the partition pack in all muxers, walk the KLVs instead */
+    url_fseek(pb, klv_end, SEEK_SET);
+    while (!url_feof(pb)) {
+        if (klv_read_packet(&klv, pb) < 0)
+            break;
+        klv_end = url_ftell(pb) + klv.length;
+        if (IS_KLV_KEY(klv.key, mxf_essence_element_key) ||
+            IS_KLV_KEY(klv.key, mxf_encrypted_triplet_key)) {
+            partition->essence_offset = klv.offset;
+            break;
+        }
+        if (IS_PARTITION_PACK_KEY(klv.key) ||
+            IS_KLV_KEY(klv.key, mxf_random_index_pack_key))
+            break;
+        if (IS_KLV_KEY(klv.key, mxf_index_table_segment_key)) {
+            res = mxf_read_local_tags(mxf, &klv, mxf_read_index_table_segment,
+                                      sizeof(MXFIndexTableSegment), IndexTableSegment);
+            if (res < 0)
+                return res;
+        }
+        url_fseek(pb, klv_end, SEEK_SET);
+    }
+    return mxf->partitions_count++;
+}
+
+/*
+ * Read all partitions using the random index pack, or follow the
+ * previous partition chain backwards from the footer if there is none.
+ */
+static int mxf_read_partitions(MXFContext *mxf)
+{
+    ByteIOContext *pb = mxf->fc->pb;
+    int64_t file_size = url_fsize(pb);
+    int64_t offset;
+    int64_t length;
+    KLVPacket klv;
+    int i, n, res;
+
+    if (file_size <= mxf->run_in + 4)
+        return -1;
+    url_fseek(pb, file_size - 4, SEEK_SET);
+    length = get_be32(pb);
+    if (length > 20 && length < file_size - mxf->run_in) {
+        url_fseek(pb, file_size - length, SEEK_SET);
+        if (klv_read_packet(&klv, pb) == 0 && klv.offset == file_size - length &&
+            IS_KLV_KEY(klv.key, mxf_random_index_pack_key)) {
+            int64_t pos = url_ftell(pb);
+            n = (klv.length - 4) / 12;
+            for (i = 0; i < n; i++) {
+                url_fseek(pb, pos + i*12 + 4, SEEK_SET);
+                offset = get_be64(pb); /* BodySID is read from the partition pack */
+                if ((res = mxf_read_partition_pack(mxf, offset)) < 0)
+                    return res;
+            }
+            return 0;
+        }
+    }
+
+    av_log(mxf->fc, AV_LOG_VERBOSE, "no random index pack, following partitions chain\n");
+    if ((res = mxf_read_partition_pack(mxf, 0)) < 0)
+        return res;
+    offset = mxf->partitions[res].footer_partition;
+    while (offset > 0) {
+        for (i = 0; i < mxf->partitions_count; i++)
+            if (mxf->partitions[i].this_partition == offset)
+                return 0;
+        if ((res = mxf_read_partition_pack(mxf, offset)) < 0)
+            return res;
+        offset = mxf->partitions[res].previous_partition;
+    }
+    return 0;
+}
+
+static int mxf_compare_partitions(const void *a, const void *b)
+{
+    const MXFPartition *p1 = *(MXFPartition * const *)a;
+    const MXFPartition *p2 = *(MXFPartition * const *)b;
+    if (p1->body_offset != p2->body_offset)
+        return p1->body_offset < p2->body_offset ? -1 : 1;
+    /* a later partition continuing at the same body offset wins */
+    if (p1->this_partition != p2->this_partition)
+        return p1->this_partition < p2->this_partition ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Convert an essence container stream offset of body_sid into a file offset.
+ */
+static int64_t mxf_absolute_offset(MXFContext *mxf, int64_t offset)
+{
+    MXFPartition *partition;
+    int lo = 0, hi = mxf->body_partitions_count;
+
+    /* find the last partition starting at or before offset */
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        if (mxf->body_partitions[mid]->body_offset <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (!lo)
+        return -1;
+    partition = mxf->body_partitions[lo - 1];
+    return partition->essence_offset + offset - partition->body_offset;
+}
+
+static int mxf_compare_segments(const void *a, const void *b)
+{
+    const MXFIndexTableSegment *s1 = *(MXFIndexTableSegment * const *)a;
+    const MXFIndexTableSegment *s2 = *(MXFIndexTableSegment * const *)b;
+    if (s1->index_start_position != s2->index_start_position)
+        return s1->index_start_position < s2->index_start_position ? -1 : 1;
+    /* prefer the most complete segment, repeated segments are dropped */
+    return s2->nb_index_entries - s1->nb_index_entries;
+}
+
+/*
+ * Find the index entry of edit_unit.
+ * Returns: index of the entry in *segment, < 0 if not indexed
+ */
+static int mxf_find_index_entry(MXFContext *mxf, int64_t edit_unit, MXFIndexTableSegment **segment)
+{
+    int lo = 0, hi = mxf->index_segments_count;
+
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        if (mxf->index_segments[mid]->index_start_position <= edit_unit)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (!lo)
+        return -1;
+    *segment = mxf->index_segments[lo - 1];
+    if (edit_unit - (*segment)->index_start_position >= (*segment)->nb_index_entries)
+        return -1;
+    return edit_unit - (*segment)->index_start_position;
+}
+
+/*
+ * Find the stored edit unit decoding has to start from to present
+ * sample_time, SMPTE 377M 10.3.3: the temporal offset of a picture gives
+ * its position in stored order, the key frame offset at that position
+ * the key frame it depends on.
+ * Returns: timestamp of the stored edit unit, < 0 if not indexed
+ */
+static int64_t mxf_key_sample_time(MXFContext *mxf, AVStream *st, int64_t sample_time,
+                                   int flags, int64_t *pos)
+{
+    AVRational edit_rate = mxf->index_segments[0]->index_edit_rate;
+    MXFIndexTableSegment *segment;
+    int64_t edit_unit = sample_time;
+    int j;
+
+    if (edit_rate.num && edit_rate.den)
+        edit_unit = av_rescale_q(sample_time, st->time_base, edit_rate);
+    /* timestamps of reordered pictures are delayed, see compute_pkt_fields() */
+    edit_unit = FFMAX(edit_unit - st->codec->has_b_frames, 0);
+    if ((j = mxf_find_index_entry(mxf, edit_unit, &segment)) < 0)
+        return -1;
+    edit_unit += segment->temporal_offset_entries[j];
+    if (!(flags & AVSEEK_FLAG_ANY)) {
+        if ((j = mxf_find_index_entry(mxf, edit_unit, &segment)) < 0)
+            return -1;
+        edit_unit += segment->key_frame_offset_entries[j];
+    }
+    if ((j = mxf_find_index_entry(mxf, edit_unit, &segment)) < 0)
+        return -1;
+    *pos = mxf_absolute_offset(mxf, segment->stream_offset_entries[j]);
+    if (*pos < 0)
+        return -1;
+    if (edit_rate.num && edit_rate.den)
+        return av_rescale_q(edit_unit, edit_rate, st->time_base);
+    return edit_unit;
+}
+
+/*
+ * Build the stream index entries from the index table segments.
+ * Constant edit unit size essence only records the edit unit byte count.
+ */
+static int mxf_build_index(AVFormatContext *s)
+{
+    MXFContext *mxf = s->priv_data;
+    MXFIndexTableSegment **segments;
+    int64_t last_position = -1;
+    int i, j, k, segments_count = 0;
+
+    for (i = 0; i < mxf->partitions_count; i++) {
+        if (mxf->partitions[i].essence_offset >= 0) {
+            mxf->body_sid = mxf->partitions[i].body_sid;
+            break;
+        }
+    }
+    if (!mxf->body_sid)
+        return 0;
+
+    mxf->body_partitions = av_malloc(mxf->partitions_count * sizeof(*mxf->body_partitions));
+    if (!mxf->body_partitions)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < mxf->partitions_count; i++) {
+        MXFPartition *partition = &mxf->partitions[i];
+        if (partition->body_sid == mxf->body_sid && partition->essence_offset >= 0)
+            mxf->body_partitions[mxf->body_partitions_count++] = partition;
+    }
+    qsort(mxf->body_partitions, mxf->body_partitions_count,
+          sizeof(*mxf->body_partitions), mxf_compare_partitions);
+
+    if (mxf->metadata_sets_count >= UINT_MAX / sizeof(*segments))
+        return AVERROR(ENOMEM);
+    segments = av_malloc(mxf->metadata_sets_count * sizeof(*segments));
+    if (!segments)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < mxf->metadata_sets_count; i++) {
+        MXFIndexTableSegment *segment = (MXFIndexTableSegment *)mxf->metadata_sets[i];
+        if (segment->type == IndexTableSegment && segment->body_sid == mxf->body_sid)
+            segments[segments_count++] = segment;
+    }
+    qsort(segments, segments_count, sizeof(*segments), mxf_compare_segments);
+    mxf->index_segments = segments;
+
+    for (i = 0; i < segments_count; i++) {
+        MXFIndexTableSegment *segment = segments[i];
+
+        if (segment->index_start_position == last_position)
+            continue;
+        last_position = segment->index_start_position;
+
+        if (segment->edit_unit_byte_count && !segment->nb_index_entries) {
+            mxf->edit_unit_byte_count = segment->edit_unit_byte_count;
+            mxf->index_edit_rate = segment->index_edit_rate;
+            av_dlog(s, "constant edit unit byte count %d\n", mxf->edit_unit_byte_count);
+            continue;
+        }
+        mxf->index_segments[mxf->index_segments_count++] = segment;
+
+        for (j = 0; j < segment->nb_index_entries; j++) {
+            int64_t pos = mxf_absolute_offset(mxf, segment->stream_offset_entries[j]);
+            int64_t edit_unit = segment->index_start_position + j;
+            if (pos < 0)
+                continue;
+            for (k = 0; k < s->nb_streams; k++) {
+                AVStream *st = s->streams[k];
+                int64_t timestamp = edit_unit;
+                /* its own key frame, and random access or no forward/backward
+                 * prediction, SMPTE 377M 10.3.3 */
+                int flags = st->codec->codec_type != AVMEDIA_TYPE_VIDEO ||
+                    (!segment->key_frame_offset_entries[j] &&
+                     (segment->flag_entries[j] & 0x80 ||
+                      !(segment->flag_entries[j] & 0x30))) ? AVINDEX_KEYFRAME : 0;
+                if (segment->index_edit_rate.num && segment->index_edit_rate.den)
+                    timestamp = av_rescale_q(edit_unit, segment->index_edit_rate, st->time_base);
+                av_add_index_entry(st, pos, timestamp, 0, 0, flags);
+            }
+        }
+    }
+    return 0;
+}
+
 static int mxf_read_header(AVFormatContext *s, AVFormatParameters *ap)
 {
     MXFContext *mxf = s->priv_data;
@@ -953,6 +1384,8 @@ static int mxf_read_header(AVFormatContext *s, AVFormatParameters *ap)
     }
     url_fseek(s->pb, -14, SEEK_CUR);
     mxf->fc = s;
+    mxf->run_in = url_ftell(s->pb);
+    ff_mxf_dsp_init(&mxf->dsp);
     while (!url_feof(s->pb)) {
         const MXFMetadataReadTableEntry *metadata;
 
@@ -986,7 +1419,15 @@ static int mxf_read_header(AVFormatContext *s, AVFormatParameters *ap)
     }
     if (url_feof(s->pb))
         av_log(s, AV_LOG_ERROR, "error, essence data could not be found\n");
-    return mxf_parse_structural_metadata(mxf);
+    if (mxf_parse_structural_metadata(mxf) < 0)
+        return -1;
+    if (!url_is_streamed(s->pb)) {
+        int64_t essence_offset = url_ftell(s->pb);
+        if (mxf_read_partitions(mxf) < 0 || mxf_build_index(s) < 0)
+            av_log(s, AV_LOG_WARNING, "could not read index, seeking will be approximate\n");
+        url_fseek(s->pb, essence_offset, SEEK_SET);
+    }
+    return 0;
 }
 
 static int mxf_read_close(AVFormatContext *s)
@@ -1011,6 +1452,15 @@ static int mxf_read_close(AVFormatContext *s)
         case MaterialPackage:
             av_freep(&((MXFPackage *)mxf->metadata_sets[i])->tracks_refs);
             break;
+        case IndexTableSegment: {
+            MXFIndexTableSegment *segment = (MXFIndexTableSegment *)mxf->metadata_sets[i];
+            av_freep(&segment->delta_entries);
+            av_freep(&segment->temporal_offset_entries);
+            av_freep(&segment->key_frame_offset_entries);
+            av_freep(&segment->flag_entries);
+            av_freep(&segment->stream_offset_entries);
+            break;
+        }
         default:
             break;
         }
@@ -1019,6 +1469,9 @@ static int mxf_read_close(AVFormatContext *s)
     av_freep(&mxf->metadata_sets);
     av_freep(&mxf->aesc);
     av_freep(&mxf->local_tags);
+    av_freep(&mxf->partitions);
+    av_freep(&mxf->body_partitions);
+    av_freep(&mxf->index_segments);
     return 0;
 }
 
@@ -1038,19 +1491,46 @@ static int mxf_probe(AVProbeData *p) {
     return 0;
 }
 
-/* rudimentary byte seek */
-/* XXX: use MXF Index */
 static int mxf_read_seek(AVFormatContext *s, int stream_index, int64_t sample_time, int flags)
 {
+    MXFContext *mxf = s->priv_data;
     AVStream *st = s->streams[stream_index];
-    int64_t seconds;
+    int64_t seconds, pos, key_time;
+    int index;
 
-    if (!s->bit_rate)
-        return -1;
     if (sample_time < 0)
         sample_time = 0;
-    seconds = av_rescale(sample_time, st->time_base.num, st->time_base.den);
-    url_fseek(s->pb, (s->bit_rate * seconds) >> 3, SEEK_SET);
+
+    if (mxf->edit_unit_byte_count) {
+        int64_t edit_unit = sample_time;
+        if (mxf->index_edit_rate.num && mxf->index_edit_rate.den)
+            edit_unit = av_rescale_q(sample_time, st->time_base, mxf->index_edit_rate);
+        pos = mxf_absolute_offset(mxf, edit_unit * mxf->edit_unit_byte_count);
+        if (pos < 0)
+            return -1;
+        if (mxf->index_edit_rate.num && mxf->index_edit_rate.den)
+            sample_time = av_rescale_q(edit_unit, mxf->index_edit_rate, st->time_base);
+    } else if (mxf->index_segments_count && flags & AVSEEK_FLAG_BACKWARD &&
+               st->codec->codec_type == AVMEDIA_TYPE_VIDEO &&
+               (key_time = mxf_key_sample_time(mxf, st, sample_time, flags, &pos)) >= 0) {
+        sample_time = key_time;
+    } else if (st->nb_index_entries &&
+               (!ff_index_cache_generic(s, st) || !s->bit_rate ||
+                sample_time <= st->index_entries[st->nb_index_entries-1].timestamp)) {
+        /* an index built from the packets read may not cover sample_time */
+        index = av_index_search_timestamp(st, sample_time, flags);
+        if (index < 0)
+            return -1;
+        pos = st->index_entries[index].pos;
+        sample_time = st->index_entries[index].timestamp;
+    } else {
+        /* rudimentary byte seek */
+        if (!s->bit_rate)
+            return -1;
+        seconds = av_rescale(sample_time, st->time_base.num, st->time_base.den);
+        pos = (s->bit_rate * seconds) >> 3;
+    }
+    url_fseek(s->pb, pos, SEEK_SET);
     av_update_cur_dts(s, st, sample_time);
     return 0;
 }
@@ -1064,4 +1544,5 @@ AVInputFormat ff_mxf_demuxer = {
     mxf_read_packet,
     mxf_read_close,
     mxf_read_seek,
+    .flags = AVFMT_CACHE_INDEX,
 };
@@ -41,6 +41,7 @@
 #include "libavcodec/timecode.h"
 #include "audiointerleave.h"
 #include "avformat.h"
+#include "internal.h"
 #include "mxf.h"
 
 static const int samples_per_frame_tab[][6] = {
@@ -202,6 +203,9 @@ typedef struct MXFContext {
     uint64_t body_offset;
     uint32_t instance_number;
     uint8_t umid[16];        ///< unique material identifier
+    uint8_t *aes3_buf;       ///< d-10 audio element being built
+    unsigned aes3_buf_size;
+    MXFDSPContext dsp;
 } MXFContext;
 
 static const uint8_t uuid_base[]            = { 0xAD,0xAB,0x44,0x24,0x2f,0x25,0x4d,0xc7,0x92,0xff,0x29,0xbd };
@@ -1407,6 +1411,8 @@ static int mxf_write_header(AVFormatContext *s)
     if (!s->nb_streams)
         return -1;
 
+    ff_mxf_dsp_init(&mxf->dsp);
+
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *st = s->streams[i];
         MXFStreamContext *sc = av_mallocz(sizeof(*sc));
@@ -1658,37 +1664,30 @@ static void mxf_write_d10_video_packet(AVFormatContext *s, AVStream *st, AVPacke
     }
 }
 
-static void mxf_write_d10_audio_packet(AVFormatContext *s, AVStream *st, AVPacket *pkt)
+/**
+ * Build the SMPTE 331M element of a d-10 audio packet in mxf->aes3_buf,
+ * before anything of the packet is written.
+ * @return size of the element
+ */
+static int mxf_pack_d10_audio_packet(AVFormatContext *s, AVStream *st, AVPacket *pkt)
 {
     MXFContext *mxf = s->priv_data;
     MXFStreamContext *sc = st->priv_data;
-    ByteIOContext *pb = s->pb;
     int frame_size = pkt->size / st->codec->block_align;
-    uint8_t *samples = pkt->data;
-    uint8_t *end = pkt->data + pkt->size;
-    int i;
+    int size = 4 + frame_size*4*8;
+    uint8_t *p;
 
-    klv_encode_ber4_length(pb, 4 + frame_size*4*8);
-
-    put_byte(pb, (frame_size == 1920 ? 0 : (mxf->edit_units_count-1) % 5 + 1));
-    put_le16(pb, frame_size);
-    put_byte(pb, (1<<sc->audio_channels)-1);
-
-    while (samples < end) {
-        for (i = 0; i < st->codec->channels; i++) {
-            uint32_t sample;
-            if (st->codec->codec_id == CODEC_ID_PCM_S24LE) {
-                sample = AV_RL24(samples)<< 4;
-                samples += 3;
-            } else {
-                sample = AV_RL16(samples)<<12;
-                samples += 2;
-            }
-            put_le32(pb, sample | i);
-        }
-        for (; i < 8; i++)
-            put_le32(pb, i);
-    }
+    av_fast_malloc(&mxf->aes3_buf, &mxf->aes3_buf_size, size);
+    if (!mxf->aes3_buf)
+        return AVERROR(ENOMEM);
+    p = mxf->aes3_buf;
+
+    *p++ = frame_size == 1920 ? 0 : (mxf->edit_units_count-1) % 5 + 1;
+    bytestream_put_le16(&p, frame_size);
+    *p++ = (1<<sc->audio_channels)-1;
+    mxf->dsp.pack_d10_aes3(p, pkt->data, frame_size, st->codec->channels,
+                           st->codec->codec_id == CODEC_ID_PCM_S24LE ? 24 : 16);
+    return size;
 }
 
 static int mxf_write_packet(AVFormatContext *s, AVPacket *pkt)
@@ -1698,6 +1697,11 @@ static int mxf_write_packet(AVFormatContext *s, AVPacket *pkt)
     AVStream *st = s->streams[pkt->stream_index];
     MXFStreamContext *sc = st->priv_data;
     MXFIndexEntry ie = {0};
+    int aes3_size = 0;
+
+    if (s->oformat == &ff_mxf_d10_muxer && st->codec->codec_type == AVMEDIA_TYPE_AUDIO &&
+        (aes3_size = mxf_pack_d10_audio_packet(s, st, pkt)) < 0)
+        return aes3_size;
 
     if (!mxf->edit_unit_byte_count && !(mxf->edit_units_count % EDIT_UNITS_PER_BODY)) {
         mxf->index_entries = av_realloc(mxf->index_entries,
@@ -1755,10 +1759,12 @@ static int mxf_write_packet(AVFormatContext *s, AVPacket *pkt)
     mxf_write_klv_fill(s);
     put_buffer(pb, sc->track_essence_element_key, 16); // write key
     if (s->oformat == &ff_mxf_d10_muxer) {
-        if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO)
+        if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
             mxf_write_d10_video_packet(s, st, pkt);
-        else
-            mxf_write_d10_audio_packet(s, st, pkt);
+        } else {
+            klv_encode_ber4_length(pb, aes3_size);
+            put_buffer(pb, mxf->aes3_buf, aes3_size);
+        }
     } else {
         klv_encode_ber4_length(pb, pkt->size); // write length
         put_buffer(pb, pkt->data, pkt->size);
@@ -1835,6 +1841,7 @@ static int mxf_write_footer(AVFormatContext *s)
 
     av_freep(&mxf->index_entries);
     av_freep(&mxf->body_partition_offset);
+    av_freep(&mxf->aes3_buf);
     av_freep(&mxf->timecode_track->priv_data);
     av_freep(&mxf->timecode_track);
 
@@ -1843,6 +1850,15 @@ static int mxf_write_footer(AVFormatContext *s)
     return 0;
 }
 
+static int mxf_compare_timestamps(AVFormatContext *s, AVPacket *next, AVPacket *pkt)
+{
+    MXFStreamContext *sc  = s->streams[pkt ->stream_index]->priv_data;
+    MXFStreamContext *sc2 = s->streams[next->stream_index]->priv_data;
+
+    return next->dts > pkt->dts ||
+        (next->dts == pkt->dts && sc->order < sc2->order);
+}
+
 static int mxf_interleave_get_packet(AVFormatContext *s, AVPacket *out, AVPacket *pkt, int flush)
 {
     int i, stream_count = 0;
@@ -1851,46 +1867,33 @@ static int mxf_interleave_get_packet(AVFormatContext *s, AVPacket *out, AVPacket
         stream_count += !!s->streams[i]->last_in_packet_buffer;
 
     if (stream_count && (s->nb_streams == stream_count || flush)) {
-        AVPacketList *pktl = s->packet_buffer;
         if (s->nb_streams != stream_count) {
-            AVPacketList *last = NULL;
+            AVPacket *keep = av_malloc(stream_count * sizeof(*keep));
+            int nb_keep = 0;
+
+            if (!keep)
+                return AVERROR(ENOMEM);
             // find last packet in edit unit
-            while (pktl) {
-                if (!stream_count || pktl->pkt.stream_index == 0)
+            while (nb_keep < stream_count && ff_interleave_get_packet(s, &keep[nb_keep])) {
+                if (keep[nb_keep].stream_index == 0) {
+                    av_free_packet(&keep[nb_keep]);
                     break;
-                last = pktl;
-                pktl = pktl->next;
-                stream_count--;
+                }
+                nb_keep++;
             }
             // purge packet queue
-            while (pktl) {
-                AVPacketList *next = pktl->next;
-
-                if(s->streams[pktl->pkt.stream_index]->last_in_packet_buffer == pktl)
-                    s->streams[pktl->pkt.stream_index]->last_in_packet_buffer= NULL;
-                av_free_packet(&pktl->pkt);
-                av_freep(&pktl);
-                pktl = next;
-            }
-            if (last)
-                last->next = NULL;
-            else {
-                s->packet_buffer = NULL;
-                s->packet_buffer_end= NULL;
+            while (ff_interleave_get_packet(s, out))
+                av_free_packet(out);
+            for (i = 0; i < nb_keep; i++)
+                if (ff_interleave_add_packet(s, &keep[i], mxf_compare_timestamps) < 0)
+                    av_free_packet(&keep[i]);
+            av_free(keep);
+            if (!nb_keep)
                 goto out;
-            }
-            pktl = s->packet_buffer;
         }
 
-        *out = pktl->pkt;
         //av_log(s, AV_LOG_DEBUG, "out st:%d dts:%lld\n", (*out).stream_index, (*out).dts);
-        s->packet_buffer = pktl->next;
-        if(s->streams[pktl->pkt.stream_index]->last_in_packet_buffer == pktl)
-            s->streams[pktl->pkt.stream_index]->last_in_packet_buffer= NULL;
-        if(!s->packet_buffer)
-            s->packet_buffer_end= NULL;
-        av_freep(&pktl);
-        return 1;
+        return ff_interleave_get_packet(s, out);
     } else {
     out:
         av_init_packet(out);
@@ -1898,15 +1901,6 @@ static int mxf_interleave_get_packet(AVFormatContext *s, AVPacket *out, AVPacket
     }
 }
 
-static int mxf_compare_timestamps(AVFormatContext *s, AVPacket *next, AVPacket *pkt)
-{
-    MXFStreamContext *sc  = s->streams[pkt ->stream_index]->priv_data;
-    MXFStreamContext *sc2 = s->streams[next->stream_index]->priv_data;
-
-    return next->dts > pkt->dts ||
-        (next->dts == pkt->dts && sc->order < sc2->order);
-}
-
 static int mxf_interleave(AVFormatContext *s, AVPacket *out, AVPacket *pkt, int flush)
 {
     return ff_audio_rechunk_interleave(s, out, pkt, flush,
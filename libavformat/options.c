@@ -61,6 +61,9 @@ static const AVOption options[]={
 {"fdebug", "print specific debug info", OFFSET(debug), FF_OPT_TYPE_FLAGS, DEFAULT, 0, INT_MAX, E|D, "fdebug"},
 {"ts", NULL, 0, FF_OPT_TYPE_CONST, FF_FDEBUG_TS, INT_MIN, INT_MAX, E|D, "fdebug"},
 {"max_delay", "maximum muxing or demuxing delay in microseconds", OFFSET(max_delay), FF_OPT_TYPE_INT, DEFAULT, 0, INT_MAX, E|D},
+{"readahead", "size of the buffer the input is read ahead into by a separate thread", OFFSET(readahead_size), FF_OPT_TYPE_INT, DEFAULT, 0, INT_MAX, D},
+{"index_cache", "directory the index of input files is cached in", OFFSET(index_cache), FF_OPT_TYPE_STRING, 0, 0, 0, D},
+{"writebehind", "size of the buffers the output is written from by a separate thread", OFFSET(writebehind_size), FF_OPT_TYPE_INT, DEFAULT, 0, INT_MAX, E},
 {NULL},
 };
 
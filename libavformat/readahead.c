@@ -0,0 +1,279 @@
+/*
+ * Threaded read-ahead for ByteIOContext
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Read-ahead of a ByteIOContext input in a background thread.
+ *
+ * A reader thread calls the read_packet callback to fill a ring buffer
+ * ahead of the demuxer, so that storage latency overlaps with decoding.
+ * All calls to the read_packet and seek callbacks are serialized, the
+ * demuxer thread only seeks the underlying resource once the reader
+ * thread is idle.
+ */
+
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "avformat.h"
+#include "internal.h"
+
+/** maximum size of a single read issued by the reader thread */
+#define READAHEAD_MAX_CHUNK (1 << 20)
+
+#if HAVE_PTHREADS
+
+struct ReadAheadContext {
+    void *opaque;
+    int (*read_packet)(void *opaque, uint8_t *buf, int buf_size);
+    int64_t (*seek)(void *opaque, int64_t offset, int whence);
+
+    uint8_t *buffer;
+    int size;               ///< size of the ring buffer
+    int chunk_size;         ///< size of the reads issued by the reader thread
+    int rpos;               ///< read position in the ring buffer
+    int fill;               ///< number of bytes read ahead
+    int64_t pos;            ///< position in the resource of the data at rpos
+
+    int eof;
+    int error;
+    int reading;            ///< the reader thread is inside read_packet
+    int seek_pending;       ///< the caller waits to seek the resource
+    int abort;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+static void *readahead_thread(void *arg)
+{
+    ReadAheadContext *ra = arg;
+
+    pthread_mutex_lock(&ra->mutex);
+    for (;;) {
+        int wpos, len;
+
+        while (!ra->abort && (ra->seek_pending || ra->eof || ra->error ||
+                              ra->size - ra->fill < ra->chunk_size))
+            pthread_cond_wait(&ra->cond, &ra->mutex);
+        if (ra->abort)
+            break;
+
+        wpos = ra->rpos + ra->fill;
+        if (wpos >= ra->size)
+            wpos -= ra->size;
+        len = FFMIN(ra->chunk_size, ra->size - wpos);
+
+        ra->reading = 1;
+        pthread_mutex_unlock(&ra->mutex);
+        len = ra->read_packet(ra->opaque, ra->buffer + wpos, len);
+        pthread_mutex_lock(&ra->mutex);
+        ra->reading = 0;
+
+        if (len > 0) {
+            ra->fill += len;
+        } else if (!len) {
+            ra->eof = 1;
+        } else
+            ra->error = len;
+        pthread_cond_broadcast(&ra->cond);
+    }
+    pthread_mutex_unlock(&ra->mutex);
+
+    return NULL;
+}
+
+int ff_readahead_open(ReadAheadContext **rap, void *opaque,
+                      int (*read_packet)(void *opaque, uint8_t *buf, int buf_size),
+                      int64_t (*seek)(void *opaque, int64_t offset, int whence),
+                      int64_t pos, int size)
+{
+    ReadAheadContext *ra;
+
+    if (!read_packet || size <= 0)
+        return AVERROR(EINVAL);
+
+    ra = av_mallocz(sizeof(*ra));
+    if (!ra)
+        return AVERROR(ENOMEM);
+    ra->buffer = av_malloc(size);
+    if (!ra->buffer) {
+        av_free(ra);
+        return AVERROR(ENOMEM);
+    }
+    ra->opaque      = opaque;
+    ra->read_packet = read_packet;
+    ra->seek        = seek;
+    ra->size        = size;
+    ra->chunk_size  = FFMAX(FFMIN(size / 4, READAHEAD_MAX_CHUNK), 1);
+    ra->pos         = pos;
+
+    pthread_mutex_init(&ra->mutex, NULL);
+    pthread_cond_init(&ra->cond, NULL);
+    if (pthread_create(&ra->thread, NULL, readahead_thread, ra)) {
+        pthread_cond_destroy(&ra->cond);
+        pthread_mutex_destroy(&ra->mutex);
+        av_free(ra->buffer);
+        av_free(ra);
+        return AVERROR(ENOMEM);
+    }
+
+    *rap = ra;
+    return 0;
+}
+
+void ff_readahead_close(ReadAheadContext *ra)
+{
+    pthread_mutex_lock(&ra->mutex);
+    ra->abort = 1;
+    pthread_cond_broadcast(&ra->cond);
+    pthread_mutex_unlock(&ra->mutex);
+
+    pthread_join(ra->thread, NULL);
+
+    pthread_cond_destroy(&ra->cond);
+    pthread_mutex_destroy(&ra->mutex);
+    av_free(ra->buffer);
+    av_free(ra);
+}
+
+int ff_readahead_read(ReadAheadContext *ra, uint8_t *buf, int size)
+{
+    int len = 0;
+
+    pthread_mutex_lock(&ra->mutex);
+    while (!ra->fill && !ra->eof && !ra->error)
+        pthread_cond_wait(&ra->cond, &ra->mutex);
+
+    if (!ra->fill) {
+        len = ra->error;
+    } else {
+        size = FFMIN(size, ra->fill);
+        while (len < size) {
+            int chunk = FFMIN(size - len, ra->size - ra->rpos);
+            memcpy(buf + len, ra->buffer + ra->rpos, chunk);
+            len      += chunk;
+            ra->rpos += chunk;
+            if (ra->rpos == ra->size)
+                ra->rpos = 0;
+        }
+        ra->fill -= len;
+        ra->pos  += len;
+        pthread_cond_broadcast(&ra->cond);
+    }
+    pthread_mutex_unlock(&ra->mutex);
+
+    return len;
+}
+
+int64_t ff_readahead_seek(ReadAheadContext *ra, int64_t offset, int whence)
+{
+    int64_t ret;
+
+    pthread_mutex_lock(&ra->mutex);
+
+    if (whence == SEEK_CUR) {
+        offset += ra->pos;
+        whence  = SEEK_SET;
+    }
+
+    if (whence == SEEK_SET && offset >= ra->pos && offset - ra->pos <= ra->fill) {
+        /* forward seek within the data already read ahead */
+        int skip = offset - ra->pos;
+        ra->rpos += skip;
+        if (ra->rpos >= ra->size)
+            ra->rpos -= ra->size;
+        ra->fill -= skip;
+        ra->pos   = offset;
+        pthread_cond_broadcast(&ra->cond);
+        pthread_mutex_unlock(&ra->mutex);
+        return offset;
+    }
+
+    if (!ra->seek) {
+        pthread_mutex_unlock(&ra->mutex);
+        return AVERROR(EPIPE);
+    }
+
+    ra->seek_pending = 1;
+    while (ra->reading)
+        pthread_cond_wait(&ra->cond, &ra->mutex);
+
+    ret = ra->seek(ra->opaque, offset, whence);
+    if (ret >= 0 && whence != AVSEEK_SIZE) {
+        ra->rpos  = 0;
+        ra->fill  = 0;
+        ra->pos   = ret;
+        ra->eof   = 0;
+        ra->error = 0;
+    }
+
+    ra->seek_pending = 0;
+    pthread_cond_broadcast(&ra->cond);
+    pthread_mutex_unlock(&ra->mutex);
+
+    return ret;
+}
+
+int64_t ff_readahead_available(ReadAheadContext *ra)
+{
+    int64_t fill;
+
+    pthread_mutex_lock(&ra->mutex);
+    fill = ra->fill;
+    pthread_mutex_unlock(&ra->mutex);
+
+    return fill;
+}
+
+#else
+
+int ff_readahead_open(ReadAheadContext **rap, void *opaque,
+                      int (*read_packet)(void *opaque, uint8_t *buf, int buf_size),
+                      int64_t (*seek)(void *opaque, int64_t offset, int whence),
+                      int64_t pos, int size)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_readahead_close(ReadAheadContext *ra)
+{
+}
+
+int ff_readahead_read(ReadAheadContext *ra, uint8_t *buf, int size)
+{
+    return AVERROR(ENOSYS);
+}
+
+int64_t ff_readahead_seek(ReadAheadContext *ra, int64_t offset, int whence)
+{
+    return AVERROR(ENOSYS);
+}
+
+int64_t ff_readahead_available(ReadAheadContext *ra)
+{
+    return 0;
+}
+
+#endif /* HAVE_PTHREADS */
@@ -503,6 +503,7 @@ int av_open_input_stream(AVFormatContext **ic_ptr,
  fail:
     if (ic) {
         int i;
+        ff_index_cache_close(ic, 0);
         av_freep(&ic->priv_data);
         for(i=0;i<ic->nb_streams;i++) {
             AVStream *st = ic->streams[i];
@@ -622,6 +623,9 @@ int av_open_input_file(AVFormatContext **ic_ptr, const char *filename,
         if (buf_size > 0) {
             url_setbufsize(pb, buf_size);
         }
+        if (logctx && (*ic_ptr)->readahead_size > 0 &&
+            (err = url_setreadahead(pb, (*ic_ptr)->readahead_size)) < 0)
+            av_log(logctx, AV_LOG_WARNING, "Could not enable read-ahead for '%s', reading synchronously\n", filename);
         if (!fmt && (err = av_probe_input_buffer(pb, &fmt, filename, logctx, 0, logctx ? (*ic_ptr)->probesize : 0)) < 0) {
             goto fail;
         }
@@ -640,9 +644,13 @@ int av_open_input_file(AVFormatContext **ic_ptr, const char *filename,
             goto fail;
         }
     }
+    if (logctx && pb && (*ic_ptr)->index_cache &&
+        (err = ff_index_cache_open(*ic_ptr, url_fileno(pb), filename)) < 0)
+        goto fail;
     err = av_open_input_stream(ic_ptr, pb, filename, fmt, ap);
     if (err)
         goto fail;
+    ff_index_cache_restore_streams(*ic_ptr);
     return 0;
  fail:
     av_freep(&pd->buf);
@@ -1007,6 +1015,15 @@ static void compute_pkt_fields(AVFormatContext *s, AVStream *st,
 }
 
 
+/**
+ * @return 1 if the key frames read from st are to be added to its index
+ */
+static int generic_index(AVFormatContext *s, AVStream *st)
+{
+    return ff_index_cache_generic(s, st) ||
+           s->iformat->flags & AVFMT_GENERIC_INDEX;
+}
+
 static int av_read_frame_internal(AVFormatContext *s, AVPacket *pkt)
 {
     AVStream *st;
@@ -1024,7 +1041,7 @@ static int av_read_frame_internal(AVFormatContext *s, AVPacket *pkt)
                 *pkt = st->cur_pkt; st->cur_pkt.data= NULL;
                 compute_pkt_fields(s, st, NULL, pkt);
                 s->cur_st = NULL;
-                if ((s->iformat->flags & AVFMT_GENERIC_INDEX) &&
+                if (generic_index(s, st) &&
                     (pkt->flags & AV_PKT_FLAG_KEY) && pkt->dts != AV_NOPTS_VALUE) {
                     ff_reduce_index(s, st->index);
                     av_add_index_entry(st, pkt->pos, pkt->dts, 0, 0, AVINDEX_KEYFRAME);
@@ -1064,7 +1081,7 @@ static int av_read_frame_internal(AVFormatContext *s, AVPacket *pkt)
                         pkt->duration = st->cur_pkt.duration;
                     compute_pkt_fields(s, st, st->parser, pkt);
 
-                    if((s->iformat->flags & AVFMT_GENERIC_INDEX) && pkt->flags & AV_PKT_FLAG_KEY){
+                    if(generic_index(s, st) && pkt->flags & AV_PKT_FLAG_KEY){
                         ff_reduce_index(s, st->index);
                         av_add_index_entry(st, st->parser->frame_offset, pkt->dts,
                                            0, 0, AVINDEX_KEYFRAME);
@@ -2438,6 +2455,8 @@ int av_find_stream_info(AVFormatContext *ic)
     }
 #endif
 
+    ff_index_cache_restore_streams(ic);
+
  find_stream_info_err:
     for (i=0; i < ic->nb_streams; i++)
         av_freep(&ic->streams[i]->info);
@@ -2529,6 +2548,7 @@ int av_read_pause(AVFormatContext *s)
 
 void av_close_input_stream(AVFormatContext *s)
 {
+    ff_index_cache_close(s, 1);
     flush_packet_queue(s);
     if (s->iformat->read_close)
         s->iformat->read_close(s);
@@ -2540,6 +2560,8 @@ void avformat_free_context(AVFormatContext *s)
     int i;
     AVStream *st;
 
+    /* muxing aborted without av_write_trailer() */
+    ff_interleave_free_queue(s);
     for(i=0;i<s->nb_streams;i++) {
         /* free all data in a stream component */
         st = s->streams[i];
@@ -2580,6 +2602,7 @@ void avformat_free_context(AVFormatContext *s)
     av_freep(&s->chapters);
     av_metadata_free(&s->metadata);
     av_freep(&s->key);
+    ff_index_cache_close(s, 0);
     av_free(s);
 }
 
@@ -2840,6 +2863,11 @@ int av_write_header(AVFormatContext *s)
             s->timestamp = parse_date("now", 0) / 1000000;
     }
 
+    if (s->writebehind_size > 0 && s->pb && !s->pb->writebehind &&
+        !(s->oformat->flags & AVFMT_NOFILE) &&
+        (ret = url_setwritebehind(s->pb, s->writebehind_size)) < 0)
+        av_log(s, AV_LOG_WARNING, "Could not enable write-behind, writing synchronously\n");
+
     if(s->oformat->write_header){
         ret = s->oformat->write_header(s);
         if (ret < 0)
@@ -2964,40 +2992,165 @@ int av_write_frame(AVFormatContext *s, AVPacket *pkt)
     return ret;
 }
 
-void ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
-                              int (*compare)(AVFormatContext *, AVPacket *, AVPacket *))
+/**
+ * Packet queued for interleaving. Packets of one stream are linked
+ * through list.next in the order they were added.
+ */
+typedef struct PacketNode {
+    AVPacketList list;  ///< must be first, AVStream.last_in_packet_buffer points here
+    uint64_t seq;       ///< insertion order, breaks ties between streams
+} PacketNode;
+
+struct AVInterleaveQueue {
+    PacketNode **head;  ///< first queued packet of each stream
+    int *heap;          ///< min-heap of the streams with queued packets, keyed on their first packet
+    int nb_heap;
+    int nb_streams;     ///< allocated size of head and heap
+    PacketNode *free_nodes; ///< recycled nodes, linked through list.next
+    uint64_t seq;
+    int (*compare)(AVFormatContext *, AVPacket *, AVPacket *);
+};
+
+/**
+ * @return 1 if the first packet of stream a must be muxed before
+ *         the first packet of stream b
+ */
+static int interleave_before(AVFormatContext *s, int a, int b)
+{
+    AVInterleaveQueue *q = s->interleave_queue;
+    PacketNode *na = q->head[a], *nb = q->head[b];
+
+    if (q->compare(s, &nb->list.pkt, &na->list.pkt))
+        return 1;
+    if (q->compare(s, &na->list.pkt, &nb->list.pkt))
+        return 0;
+    return na->seq < nb->seq;
+}
+
+static void interleave_heap_up(AVFormatContext *s, int i)
 {
-    AVPacketList **next_point, *this_pktl;
+    AVInterleaveQueue *q = s->interleave_queue;
+
+    while (i > 0) {
+        int parent = (i - 1) >> 1;
+        if (!interleave_before(s, q->heap[i], q->heap[parent]))
+            break;
+        FFSWAP(int, q->heap[i], q->heap[parent]);
+        i = parent;
+    }
+}
+
+static void interleave_heap_down(AVFormatContext *s, int i)
+{
+    AVInterleaveQueue *q = s->interleave_queue;
+
+    for (;;) {
+        int child = 2*i + 1;
+        if (child >= q->nb_heap)
+            break;
+        if (child + 1 < q->nb_heap &&
+            interleave_before(s, q->heap[child + 1], q->heap[child]))
+            child++;
+        if (!interleave_before(s, q->heap[child], q->heap[i]))
+            break;
+        FFSWAP(int, q->heap[i], q->heap[child]);
+        i = child;
+    }
+}
+
+int ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
+                             int (*compare)(AVFormatContext *, AVPacket *, AVPacket *))
+{
+    AVInterleaveQueue *q = s->interleave_queue;
+    AVStream *st = s->streams[pkt->stream_index];
+    PacketNode *node;
+
+    if (!q) {
+        q = s->interleave_queue = av_mallocz(sizeof(*q));
+        if (!q)
+            return AVERROR(ENOMEM);
+    }
+    if (q->nb_streams < s->nb_streams) {
+        void *head = av_realloc(q->head, s->nb_streams * sizeof(*q->head));
+        if (!head)
+            return AVERROR(ENOMEM);
+        q->head = head;
+        memset(q->head + q->nb_streams, 0,
+               (s->nb_streams - q->nb_streams) * sizeof(*q->head));
+        if (!(head = av_realloc(q->heap, s->nb_streams * sizeof(*q->heap))))
+            return AVERROR(ENOMEM);
+        q->heap = head;
+        q->nb_streams = s->nb_streams;
+    }
+
+    if (q->free_nodes) {
+        node = q->free_nodes;
+        q->free_nodes = (PacketNode *)node->list.next;
+    } else if (!(node = av_malloc(sizeof(*node))))
+        return AVERROR(ENOMEM);
 
-    this_pktl = av_mallocz(sizeof(AVPacketList));
-    this_pktl->pkt= *pkt;
+    node->list.pkt  = *pkt;
+    node->list.next = NULL;
+    node->seq       = q->seq++;
     pkt->destruct= NULL;             // do not free original but only the copy
-    av_dup_packet(&this_pktl->pkt);  // duplicate the packet if it uses non-alloced memory
+    av_dup_packet(&node->list.pkt);  // duplicate the packet if it uses non-alloced memory
 
-    if(s->streams[pkt->stream_index]->last_in_packet_buffer){
-        next_point = &(s->streams[pkt->stream_index]->last_in_packet_buffer->next);
-    }else
-        next_point = &s->packet_buffer;
+    q->compare = compare;
 
-    if(*next_point){
-        if(compare(s, &s->packet_buffer_end->pkt, pkt)){
-            while(!compare(s, &(*next_point)->pkt, pkt)){
-                next_point= &(*next_point)->next;
-            }
-            goto next_non_null;
-        }else{
-            next_point = &(s->packet_buffer_end->next);
-        }
+    if (st->last_in_packet_buffer) {
+        st->last_in_packet_buffer->next = &node->list;
+    } else {
+        q->head[pkt->stream_index] = node;
+        q->heap[q->nb_heap] = pkt->stream_index;
+        interleave_heap_up(s, q->nb_heap++);
+    }
+    st->last_in_packet_buffer = &node->list;
+
+    return 0;
+}
+
+int ff_interleave_get_packet(AVFormatContext *s, AVPacket *out)
+{
+    AVInterleaveQueue *q = s->interleave_queue;
+    PacketNode *node;
+    int stream_index;
+
+    if (!q || !q->nb_heap)
+        return 0;
+
+    stream_index = q->heap[0];
+    node         = q->head[stream_index];
+    *out         = node->list.pkt;
+
+    q->head[stream_index] = (PacketNode *)node->list.next;
+    if (!q->head[stream_index]) {
+        s->streams[stream_index]->last_in_packet_buffer = NULL;
+        q->heap[0] = q->heap[--q->nb_heap];
     }
-    assert(!*next_point);
+    interleave_heap_down(s, 0);
 
-    s->packet_buffer_end= this_pktl;
-next_non_null:
+    node->list.next = (AVPacketList *)q->free_nodes;
+    q->free_nodes   = node;
+    return 1;
+}
 
-    this_pktl->next= *next_point;
+void ff_interleave_free_queue(AVFormatContext *s)
+{
+    AVInterleaveQueue *q = s->interleave_queue;
+    AVPacket pkt;
 
-    s->streams[pkt->stream_index]->last_in_packet_buffer=
-    *next_point= this_pktl;
+    if (!q)
+        return;
+    while (ff_interleave_get_packet(s, &pkt))
+        av_free_packet(&pkt);
+    while (q->free_nodes) {
+        PacketNode *next = (PacketNode *)q->free_nodes->list.next;
+        av_free(q->free_nodes);
+        q->free_nodes = next;
+    }
+    av_freep(&q->head);
+    av_freep(&q->heap);
+    av_freep(&s->interleave_queue);
 }
 
 static int ff_interleave_compare_dts(AVFormatContext *s, AVPacket *next, AVPacket *pkt)
@@ -3010,29 +3163,20 @@ static int ff_interleave_compare_dts(AVFormatContext *s, AVPacket *next, AVPacke
 }
 
 int av_interleave_packet_per_dts(AVFormatContext *s, AVPacket *out, AVPacket *pkt, int flush){
-    AVPacketList *pktl;
     int stream_count=0;
     int i;
 
     if(pkt){
-        ff_interleave_add_packet(s, pkt, ff_interleave_compare_dts);
+        int ret = ff_interleave_add_packet(s, pkt, ff_interleave_compare_dts);
+        if (ret < 0)
+            return ret;
     }
 
     for(i=0; i < s->nb_streams; i++)
         stream_count+= !!s->streams[i]->last_in_packet_buffer;
 
     if(stream_count && (s->nb_streams == stream_count || flush)){
-        pktl= s->packet_buffer;
-        *out= pktl->pkt;
-
-        s->packet_buffer= pktl->next;
-        if(!s->packet_buffer)
-            s->packet_buffer_end= NULL;
-
-        if(s->streams[out->stream_index]->last_in_packet_buffer == pktl)
-            s->streams[out->stream_index]->last_in_packet_buffer= NULL;
-        av_freep(&pktl);
-        return 1;
+        return ff_interleave_get_packet(s, out);
     }else{
         av_init_packet(out);
         return 0;
@@ -3114,6 +3258,7 @@ int av_write_trailer(AVFormatContext *s)
 fail:
     if(ret == 0)
        ret=url_ferror(s->pb);
+    ff_interleave_free_queue(s);
     for(i=0;i<s->nb_streams;i++) {
         av_freep(&s->streams[i]->priv_data);
         av_freep(&s->streams[i]->index_entries);
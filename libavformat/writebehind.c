@@ -0,0 +1,240 @@
+/*
+ * Threaded write-behind for ByteIOContext
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Write-behind of a ByteIOContext output in a background thread.
+ *
+ * Filled buffers are queued to a writer thread which passes them to the
+ * write_packet callback, and the caller goes on with an empty buffer from
+ * a fixed pool, blocking only when all of them are waiting to be written.
+ * The caller only seeks the underlying resource once the queue is drained,
+ * so muxers can still go back and patch data already written.
+ */
+
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "avformat.h"
+#include "internal.h"
+
+#if HAVE_PTHREADS
+
+typedef struct WriteBehindBuffer {
+    uint8_t *data;
+    int size;
+} WriteBehindBuffer;
+
+struct WriteBehindContext {
+    void *opaque;
+    int (*write_packet)(void *opaque, uint8_t *buf, int buf_size);
+    int64_t (*seek)(void *opaque, int64_t offset, int whence);
+
+    int queue_size;             ///< the pool buffers and the one of the caller
+    WriteBehindBuffer *queue;   ///< filled buffers, in write order
+    int head;                   ///< index of the oldest entry of queue
+    int count;                  ///< number of buffers queued or being written
+    uint8_t **free_buffers;     ///< empty buffers ready to be handed out
+    int nb_free;
+
+    int error;
+    int abort;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+static void *writebehind_thread(void *arg)
+{
+    WriteBehindContext *wb = arg;
+
+    pthread_mutex_lock(&wb->mutex);
+    for (;;) {
+        WriteBehindBuffer buf;
+        int ret = 0;
+
+        while (!wb->abort && !wb->count)
+            pthread_cond_wait(&wb->cond, &wb->mutex);
+        /* everything queued is written before the thread exits */
+        if (!wb->count)
+            break;
+
+        buf = wb->queue[wb->head];
+        if (!wb->error) {
+            pthread_mutex_unlock(&wb->mutex);
+            ret = wb->write_packet(wb->opaque, buf.data, buf.size);
+            pthread_mutex_lock(&wb->mutex);
+        }
+
+        if (ret < 0)
+            wb->error = ret;
+        if (++wb->head == wb->queue_size)
+            wb->head = 0;
+        wb->count--;
+        wb->free_buffers[wb->nb_free++] = buf.data;
+        pthread_cond_broadcast(&wb->cond);
+    }
+    pthread_mutex_unlock(&wb->mutex);
+
+    return NULL;
+}
+
+static void free_buffers(WriteBehindContext *wb)
+{
+    while (wb->nb_free)
+        av_free(wb->free_buffers[--wb->nb_free]);
+    av_free(wb->free_buffers);
+    av_free(wb->queue);
+    av_free(wb);
+}
+
+int ff_writebehind_open(WriteBehindContext **wbp, void *opaque,
+                        int (*write_packet)(void *opaque, uint8_t *buf, int buf_size),
+                        int64_t (*seek)(void *opaque, int64_t offset, int whence),
+                        int nb_buffers, int buffer_size)
+{
+    WriteBehindContext *wb;
+
+    if (!write_packet || nb_buffers <= 0 || buffer_size <= 0)
+        return AVERROR(EINVAL);
+
+    wb = av_mallocz(sizeof(*wb));
+    if (!wb)
+        return AVERROR(ENOMEM);
+    wb->queue_size   = nb_buffers + 1;
+    wb->queue        = av_malloc(wb->queue_size * sizeof(*wb->queue));
+    wb->free_buffers = av_malloc(wb->queue_size * sizeof(*wb->free_buffers));
+    if (!wb->queue || !wb->free_buffers) {
+        free_buffers(wb);
+        return AVERROR(ENOMEM);
+    }
+    for (; wb->nb_free < nb_buffers; wb->nb_free++) {
+        if (!(wb->free_buffers[wb->nb_free] = av_malloc(buffer_size))) {
+            free_buffers(wb);
+            return AVERROR(ENOMEM);
+        }
+    }
+    wb->opaque       = opaque;
+    wb->write_packet = write_packet;
+    wb->seek         = seek;
+
+    pthread_mutex_init(&wb->mutex, NULL);
+    pthread_cond_init(&wb->cond, NULL);
+    if (pthread_create(&wb->thread, NULL, writebehind_thread, wb)) {
+        pthread_cond_destroy(&wb->cond);
+        pthread_mutex_destroy(&wb->mutex);
+        free_buffers(wb);
+        return AVERROR(ENOMEM);
+    }
+
+    *wbp = wb;
+    return 0;
+}
+
+int ff_writebehind_close(WriteBehindContext *wb)
+{
+    int ret;
+
+    pthread_mutex_lock(&wb->mutex);
+    wb->abort = 1;
+    pthread_cond_broadcast(&wb->cond);
+    pthread_mutex_unlock(&wb->mutex);
+
+    pthread_join(wb->thread, NULL);
+
+    ret = wb->error;
+    pthread_cond_destroy(&wb->cond);
+    pthread_mutex_destroy(&wb->mutex);
+    free_buffers(wb);
+
+    return ret;
+}
+
+int ff_writebehind_write(WriteBehindContext *wb, uint8_t **buf, int size)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&wb->mutex);
+    if (wb->error) {
+        ret = wb->error;
+    } else {
+        int tail = wb->head + wb->count;
+        if (tail >= wb->queue_size)
+            tail -= wb->queue_size;
+        wb->queue[tail].data = *buf;
+        wb->queue[tail].size = size;
+        wb->count++;
+        pthread_cond_broadcast(&wb->cond);
+
+        while (!wb->nb_free)
+            pthread_cond_wait(&wb->cond, &wb->mutex);
+        *buf = wb->free_buffers[--wb->nb_free];
+    }
+    pthread_mutex_unlock(&wb->mutex);
+
+    return ret;
+}
+
+int64_t ff_writebehind_seek(WriteBehindContext *wb, int64_t offset, int whence)
+{
+    int64_t ret;
+
+    if (!wb->seek)
+        return AVERROR(EPIPE);
+
+    pthread_mutex_lock(&wb->mutex);
+    while (wb->count)
+        pthread_cond_wait(&wb->cond, &wb->mutex);
+    ret = wb->seek(wb->opaque, offset, whence);
+    pthread_mutex_unlock(&wb->mutex);
+
+    return ret;
+}
+
+#else
+
+int ff_writebehind_open(WriteBehindContext **wbp, void *opaque,
+                        int (*write_packet)(void *opaque, uint8_t *buf, int buf_size),
+                        int64_t (*seek)(void *opaque, int64_t offset, int whence),
+                        int nb_buffers, int buffer_size)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_writebehind_close(WriteBehindContext *wb)
+{
+    return 0;
+}
+
+int ff_writebehind_write(WriteBehindContext *wb, uint8_t **buf, int size)
+{
+    return AVERROR(ENOSYS);
+}
+
+int64_t ff_writebehind_seek(WriteBehindContext *wb, int64_t offset, int whence)
+{
+    return AVERROR(ENOSYS);
+}
+
+#endif /* HAVE_PTHREADS */
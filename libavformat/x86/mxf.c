@@ -0,0 +1,234 @@
+/*
+ * MXF D-10 AES3 element packing and unpacking, SSE2 and SSSE3 versions
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/cpu.h"
+#include "libavutil/x86_cpu.h"
+#include "libavformat/mxf.h"
+
+/*
+ * Each sample is converted with two 16 byte loads, whatever the number of
+ * channels, and the words of the missing channels are masked out. The
+ * vector loops stop before the loads or stores would cross the end of the
+ * buffers, the C versions finish the element.
+ */
+DECLARE_ASM_CONST(16, uint32_t, aes3_channel_nb)[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+/* mask for n channels is at aes3_channel_mask + 8 - n */
+DECLARE_ASM_CONST(16, uint32_t, aes3_channel_mask)[16] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0
+};
+DECLARE_ASM_CONST(16, uint8_t, aes3_pack_24_shuf)[16] =
+    { 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 };
+DECLARE_ASM_CONST(16, uint8_t, aes3_unpack_24_shuf)[16] =
+    { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1 };
+
+/**
+ * Number of samples whose sample_size bytes at the start of the
+ * (nb_samples * sample_size) byte buffer leave room for an access of
+ * size bytes.
+ */
+static int vector_samples(int nb_samples, int sample_size, int size)
+{
+    return FFMAX(nb_samples - (size + sample_size - 1) / sample_size + 1, 0);
+}
+
+void ff_mxf_pack_d10_aes3_sse2(uint8_t *dst, const uint8_t *src, int nb_samples,
+                               int channels, int bits)
+{
+#if HAVE_SSE
+    x86_reg stride = channels * 2;
+    x86_reg n;
+
+    if (bits == 24) {
+        ff_mxf_pack_d10_aes3_c(dst, src, nb_samples, channels, bits);
+        return;
+    }
+
+    n = vector_samples(nb_samples, stride, 16);
+    nb_samples -= n;
+    if (n) {
+        const uint32_t *mask = aes3_channel_mask + 8 - channels;
+
+        __asm__ volatile(
+            "movdqu           %4, %%xmm4 \n"
+            "movdqu           %5, %%xmm5 \n"
+            "movdqa           %6, %%xmm6 \n"
+            "movdqa           %7, %%xmm7 \n"
+            "pxor         %%xmm3, %%xmm3 \n"
+            "1: \n"
+            "movdqu         (%1), %%xmm0 \n"
+            "movdqa       %%xmm0, %%xmm1 \n"
+            "punpcklwd    %%xmm3, %%xmm0 \n"
+            "punpckhwd    %%xmm3, %%xmm1 \n"
+            "pslld           $12, %%xmm0 \n"
+            "pslld           $12, %%xmm1 \n"
+            "pand         %%xmm4, %%xmm0 \n"
+            "pand         %%xmm5, %%xmm1 \n"
+            "por          %%xmm6, %%xmm0 \n"
+            "por          %%xmm7, %%xmm1 \n"
+            "movdqu       %%xmm0,   (%0) \n"
+            "movdqu       %%xmm1, 16(%0) \n"
+            "add              %3, %1     \n"
+            "add             $32, %0     \n"
+            "dec              %2         \n"
+            "jg 1b \n"
+            : "+r"(dst), "+r"(src), "+r"(n)
+            : "r"(stride),
+              "m"(mask[0]), "m"(mask[4]),
+              "m"(aes3_channel_nb[0]), "m"(aes3_channel_nb[4])
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm3", "%xmm4",
+                           "%xmm5", "%xmm6", "%xmm7",) "memory"
+        );
+    }
+#endif
+    ff_mxf_pack_d10_aes3_c(dst, src, nb_samples, channels, bits);
+}
+
+void ff_mxf_unpack_d10_aes3_sse2(uint8_t *dst, const uint8_t *src, int nb_samples,
+                                 int channels, int bits)
+{
+#if HAVE_SSE
+    x86_reg stride = channels * 2;
+    x86_reg n;
+
+    if (bits == 24) {
+        ff_mxf_unpack_d10_aes3_c(dst, src, nb_samples, channels, bits);
+        return;
+    }
+
+    /* bits 12-27 of each word, the sign extension makes packssdw exact */
+    n = vector_samples(nb_samples, stride, 16);
+    nb_samples -= n;
+    if (n) {
+        __asm__ volatile(
+            "1: \n"
+            "movdqu         (%1), %%xmm0 \n"
+            "movdqu       16(%1), %%xmm1 \n"
+            "pslld            $4, %%xmm0 \n"
+            "pslld            $4, %%xmm1 \n"
+            "psrad           $16, %%xmm0 \n"
+            "psrad           $16, %%xmm1 \n"
+            "packssdw     %%xmm1, %%xmm0 \n"
+            "movdqu       %%xmm0,   (%0) \n"
+            "add              %3, %0     \n"
+            "add             $32, %1     \n"
+            "dec              %2         \n"
+            "jg 1b \n"
+            : "+r"(dst), "+r"(src), "+r"(n)
+            : "r"(stride)
+            : XMM_CLOBBERS("%xmm0", "%xmm1",) "memory"
+        );
+    }
+#endif
+    ff_mxf_unpack_d10_aes3_c(dst, src, nb_samples, channels, bits);
+}
+
+void ff_mxf_pack_d10_aes3_ssse3(uint8_t *dst, const uint8_t *src, int nb_samples,
+                                int channels, int bits)
+{
+#if HAVE_SSSE3
+    x86_reg stride = channels * 3;
+    x86_reg n;
+
+    if (bits != 24) {
+        ff_mxf_pack_d10_aes3_sse2(dst, src, nb_samples, channels, bits);
+        return;
+    }
+
+    /* channels 0-3 from src, channels 4-7 from src + 12 */
+    n = vector_samples(nb_samples, stride, 28);
+    nb_samples -= n;
+    if (n) {
+        const uint32_t *mask = aes3_channel_mask + 8 - channels;
+
+        __asm__ volatile(
+            "movdqu           %4, %%xmm4 \n"
+            "movdqu           %5, %%xmm5 \n"
+            "movdqa           %6, %%xmm6 \n"
+            "movdqa           %7, %%xmm7 \n"
+            "movdqa           %8, %%xmm2 \n"
+            "1: \n"
+            "movdqu         (%1), %%xmm0 \n"
+            "movdqu       12(%1), %%xmm1 \n"
+            "pshufb       %%xmm2, %%xmm0 \n"
+            "pshufb       %%xmm2, %%xmm1 \n"
+            "pslld            $4, %%xmm0 \n"
+            "pslld            $4, %%xmm1 \n"
+            "pand         %%xmm4, %%xmm0 \n"
+            "pand         %%xmm5, %%xmm1 \n"
+            "por          %%xmm6, %%xmm0 \n"
+            "por          %%xmm7, %%xmm1 \n"
+            "movdqu       %%xmm0,   (%0) \n"
+            "movdqu       %%xmm1, 16(%0) \n"
+            "add              %3, %1     \n"
+            "add             $32, %0     \n"
+            "dec              %2         \n"
+            "jg 1b \n"
+            : "+r"(dst), "+r"(src), "+r"(n)
+            : "r"(stride),
+              "m"(mask[0]), "m"(mask[4]),
+              "m"(aes3_channel_nb[0]), "m"(aes3_channel_nb[4]),
+              "m"(aes3_pack_24_shuf[0])
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm4",
+                           "%xmm5", "%xmm6", "%xmm7",) "memory"
+        );
+    }
+#endif
+    ff_mxf_pack_d10_aes3_c(dst, src, nb_samples, channels, bits);
+}
+
+void ff_mxf_unpack_d10_aes3_ssse3(uint8_t *dst, const uint8_t *src, int nb_samples,
+                                  int channels, int bits)
+{
+#if HAVE_SSSE3
+    x86_reg stride = channels * 3;
+    x86_reg n;
+
+    if (bits != 24) {
+        ff_mxf_unpack_d10_aes3_sse2(dst, src, nb_samples, channels, bits);
+        return;
+    }
+
+    /* the second store overwrites the 4 zero bytes of the first one */
+    n = vector_samples(nb_samples, stride, 28);
+    nb_samples -= n;
+    if (n) {
+        __asm__ volatile(
+            "movdqa           %4, %%xmm2 \n"
+            "1: \n"
+            "movdqu         (%1), %%xmm0 \n"
+            "movdqu       16(%1), %%xmm1 \n"
+            "psrld            $4, %%xmm0 \n"
+            "psrld            $4, %%xmm1 \n"
+            "pshufb       %%xmm2, %%xmm0 \n"
+            "pshufb       %%xmm2, %%xmm1 \n"
+            "movdqu       %%xmm0,   (%0) \n"
+            "movdqu       %%xmm1, 12(%0) \n"
+            "add              %3, %0     \n"
+            "add             $32, %1     \n"
+            "dec              %2         \n"
+            "jg 1b \n"
+            : "+r"(dst), "+r"(src), "+r"(n)
+            : "r"(stride), "m"(aes3_unpack_24_shuf[0])
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2",) "memory"
+        );
+    }
+#endif
+    ff_mxf_unpack_d10_aes3_c(dst, src, nb_samples, channels, bits);
+}
@@ -65,6 +65,7 @@ static const AVOption options[] = {
     { "dst_range" , "destination range" , OFFSET(dstRange) , FF_OPT_TYPE_INT, DEFAULT, 0, 1, VE },
     { "param0" , "scaler param 0" , OFFSET(param[0]) , FF_OPT_TYPE_DOUBLE, SWS_PARAM_DEFAULT, INT_MIN, INT_MAX, VE },
     { "param1" , "scaler param 1" , OFFSET(param[1]) , FF_OPT_TYPE_DOUBLE, SWS_PARAM_DEFAULT, INT_MIN, INT_MAX, VE },
+    { "sws_threads", "number of threads scaling whole frames (experimental)", OFFSET(thread_count), FF_OPT_TYPE_INT, 1, 1, 64, VE },
 
     { NULL }
 };
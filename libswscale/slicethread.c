@@ -0,0 +1,231 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation;
+ * version 2 of the License.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Slice threading of the scaler.
+ *
+ * When a whole frame is passed to sws_scale(), the destination is cut in
+ * horizontal bands of lines scaled in parallel. Each band is scaled by its
+ * own SwsContext, so each thread owns its horizontal scaler line buffers,
+ * and starts at the first source line the vertical filter needs for its
+ * first output line: the source lines around band edges are scaled
+ * horizontally by both neighbouring bands.
+ */
+
+#include <pthread.h>
+
+#include "config.h"
+#include "swscale.h"
+#include "swscale_internal.h"
+#include "libavutil/avutil.h"
+#include "libavutil/internal.h"
+#include "libavutil/pixdesc.h"
+
+/** Minimum number of lines in a band. */
+#define MIN_BAND_HEIGHT 16
+
+typedef struct SliceWorker {
+    struct SwsSliceThreads *t;
+    pthread_t thread;
+    int band;
+} SliceWorker;
+
+typedef struct SwsSliceThreads {
+    SliceWorker *workers;
+    int nb_workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  work_cond;  ///< Signalled when a new frame is to be scaled.
+    pthread_cond_t  done_cond;  ///< Signalled when the last band of the frame is done.
+    unsigned frame;             ///< Number of frames submitted so far.
+    int pending;                ///< Number of bands of the current frame not done yet.
+    int die;                    ///< Set when the workers should exit.
+
+    SwsContext *c;
+    const uint8_t *src[4];
+    int srcStride[4];
+    uint8_t *dst[4];
+    int dstStride[4];
+} SwsSliceThreads;
+
+static void scale_band(SwsSliceThreads *t, int band)
+{
+    SwsContext *c = t->c->slice_ctx[band];
+    const uint8_t *src[4] = { t->src[0], t->src[1], t->src[2], t->src[3] };
+    uint8_t       *dst[4] = { t->dst[0], t->dst[1], t->dst[2], t->dst[3] };
+    int srcStride[4], dstStride[4];
+
+    /* swScale() modifies the strides */
+    memcpy(srcStride, t->srcStride, sizeof(srcStride));
+    memcpy(dstStride, t->dstStride, sizeof(dstStride));
+    c->swScale(c, src, srcStride, 0, c->srcH, dst, dstStride);
+}
+
+static void* attribute_align_arg worker(void *arg)
+{
+    SliceWorker *w = arg;
+    SwsSliceThreads *t = w->t;
+    unsigned frame = 0;
+
+    pthread_mutex_lock(&t->lock);
+    for (;;) {
+        while (t->frame == frame && !t->die)
+            pthread_cond_wait(&t->work_cond, &t->lock);
+        if (t->die)
+            break;
+        frame = t->frame;
+        pthread_mutex_unlock(&t->lock);
+
+        scale_band(t, w->band);
+
+        pthread_mutex_lock(&t->lock);
+        if (!--t->pending)
+            pthread_cond_signal(&t->done_cond);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+int ff_sws_scale_threads(SwsContext *c, const uint8_t *src[], int srcStride[],
+                         uint8_t *dst[], int dstStride[])
+{
+    SwsSliceThreads *t = c->slice_threads;
+    int i;
+
+    if (usePal(c->srcFormat)) {
+        for (i = 0; i < c->nb_slice_ctx; i++) {
+            memcpy(c->slice_ctx[i]->pal_yuv, c->pal_yuv, sizeof(c->pal_yuv));
+            memcpy(c->slice_ctx[i]->pal_rgb, c->pal_rgb, sizeof(c->pal_rgb));
+        }
+    }
+
+    pthread_mutex_lock(&t->lock);
+    t->c = c;
+    memcpy(t->src,       src,       sizeof(t->src));
+    memcpy(t->srcStride, srcStride, sizeof(t->srcStride));
+    memcpy(t->dst,       dst,       sizeof(t->dst));
+    memcpy(t->dstStride, dstStride, sizeof(t->dstStride));
+    t->pending = t->nb_workers;
+    t->frame++;
+    pthread_cond_broadcast(&t->work_cond);
+    pthread_mutex_unlock(&t->lock);
+
+    /* the calling thread scales the first band */
+    scale_band(t, 0);
+
+    pthread_mutex_lock(&t->lock);
+    while (t->pending)
+        pthread_cond_wait(&t->done_cond, &t->lock);
+    pthread_mutex_unlock(&t->lock);
+
+    return c->dstH;
+}
+
+int ff_sws_init_threads(SwsContext *c, SwsFilter *srcFilter, SwsFilter *dstFilter,
+                        enum PixelFormat srcFormat, enum PixelFormat dstFormat)
+{
+    SwsSliceThreads *t;
+    int align = 1 << c->chrDstVSubSample;
+    int i, ret, nb_bands = FFMIN(c->thread_count, c->dstH / FFMAX(MIN_BAND_HEIGHT, align));
+
+    if (nb_bands < 2)
+        return 0;
+
+    if (!(c->slice_ctx = av_mallocz(nb_bands * sizeof(*c->slice_ctx))))
+        return AVERROR(ENOMEM);
+    c->nb_slice_ctx = nb_bands;
+
+    for (i = 0; i < nb_bands; i++) {
+        SwsContext *s = sws_alloc_context();
+        if (!s)
+            return AVERROR(ENOMEM);
+        c->slice_ctx[i] = s;
+        s->srcW            = c->srcW;
+        s->srcH            = c->srcH;
+        s->dstW            = c->dstW;
+        s->dstH            = c->dstH;
+        s->srcFormat       = srcFormat;
+        s->dstFormat       = dstFormat;
+        s->flags           = c->flags;
+        s->param[0]        = c->param[0];
+        s->param[1]        = c->param[1];
+        s->color_primaries = c->color_primaries;
+        s->thread_count    = 1;
+        if ((ret = sws_init_context(s, srcFilter, dstFilter)) < 0)
+            return ret;
+        sws_setColorspaceDetails(s, c->srcColorspaceTable, c->srcRange,
+                                 c->dstColorspaceTable, c->dstRange,
+                                 c->brightness, c->contrast, c->saturation);
+
+        s->band_start = c->dstH *  i      / nb_bands & ~(align - 1);
+        s->band_end   = c->dstH * (i + 1) / nb_bands & ~(align - 1);
+        if (i == nb_bands - 1)
+            s->band_end = c->dstH;
+    }
+
+    if (!(t = c->slice_threads = av_mallocz(sizeof(SwsSliceThreads))))
+        return AVERROR(ENOMEM);
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->work_cond, NULL);
+    pthread_cond_init(&t->done_cond, NULL);
+
+    if (!(t->workers = av_mallocz((nb_bands - 1) * sizeof(*t->workers))))
+        return AVERROR(ENOMEM);
+    for (i = 0; i < nb_bands - 1; i++) {
+        SliceWorker *w = &t->workers[i];
+        w->t    = t;
+        w->band = i + 1;
+        if (pthread_create(&w->thread, NULL, worker, w)) {
+            av_log(c, AV_LOG_ERROR, "Could not create scaler thread %d\n", i);
+            return AVERROR(ENOMEM);
+        }
+        t->nb_workers++;
+    }
+
+    if (c->flags & SWS_PRINT_INFO)
+        av_log(c, AV_LOG_INFO, "using %d slice threads\n", nb_bands);
+    return 0;
+}
+
+void ff_sws_free_threads(SwsContext *c)
+{
+    SwsSliceThreads *t = c->slice_threads;
+    int i;
+
+    if (t) {
+        pthread_mutex_lock(&t->lock);
+        t->die = 1;
+        pthread_cond_broadcast(&t->work_cond);
+        pthread_mutex_unlock(&t->lock);
+
+        for (i = 0; i < t->nb_workers; i++)
+            pthread_join(t->workers[i].thread, NULL);
+
+        pthread_mutex_destroy(&t->lock);
+        pthread_cond_destroy(&t->work_cond);
+        pthread_cond_destroy(&t->done_cond);
+        av_freep(&t->workers);
+        av_freep(&c->slice_threads);
+    }
+
+    for (i = 0; i < c->nb_slice_ctx; i++)
+        sws_freeContext(c->slice_ctx[i]);
+    av_freep(&c->slice_ctx);
+    c->nb_slice_ctx = 0;
+}
@@ -2062,6 +2062,7 @@ static int swScale(SwsContext *c, const uint8_t* src[],
     uint8_t *formatConvBuffer= c->formatConvBuffer;
     const int chrSrcSliceY= srcSliceY >> c->chrSrcVSubSample;
     const int chrSrcSliceH= -((-srcSliceH) >> c->chrSrcVSubSample);
+    const int dstYEnd= c->band_end ? c->band_end : dstH;
     int lastDstY;
     uint32_t *pal=c->pal_yuv;
     int should_dither= isNBPS(c->srcFormat) || is16BPS(c->srcFormat);
@@ -2114,14 +2115,14 @@ static int swScale(SwsContext *c, const uint8_t* src[],
     if (srcSliceY ==0) {
         lumBufIndex=-1;
         chrBufIndex=-1;
-        dstY=0;
+        dstY= c->band_start;
         lastInLumBuf= -1;
         lastInChrBuf= -1;
     }
 
     lastDstY= dstY;
 
-    for (;dstY < dstH; dstY++) {
+    for (;dstY < dstYEnd; dstY++) {
         unsigned char *dest =dst[0]+dstStride[0]*dstY;
         const int chrDstY= dstY>>c->chrDstVSubSample;
         unsigned char *uDest=dst[1]+dstStride[1]*chrDstY;
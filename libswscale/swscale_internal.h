@@ -329,6 +329,18 @@ struct SwsContext {
 
     int needs_hcscale; ///< Set if there are chroma planes to be converted.
 
+    /**
+     * @name Slice threading, see slicethread.c.
+     */
+    //@{
+    int thread_count;             ///< Number of threads whole frames may be scaled with.
+    int band_start;               ///< First destination line output by this context, if scaling a band.
+    int band_end;                 ///< Line after the last one output by this context, if scaling a band.
+    struct SwsContext **slice_ctx;///< Context scaling each band of the frame.
+    int nb_slice_ctx;
+    struct SwsSliceThreads *slice_threads;
+    //@}
+
 };
 //FIXME check init (where 0)
 
@@ -535,5 +547,23 @@ SwsFunc ff_getSwsFunc(SwsContext *c);
 
 void ff_sws_init_swScale_altivec(SwsContext *c);
 void ff_sws_init_swScale_mmx(SwsContext *c);
+void ff_sws_init_swScale_sse2(SwsContext *c);
+
+/**
+ * Create the contexts and threads scaling whole frames in bands of lines,
+ * if c->thread_count asks for it.
+ * srcFormat and dstFormat are the formats set by the user.
+ */
+int ff_sws_init_threads(SwsContext *c, SwsFilter *srcFilter, SwsFilter *dstFilter,
+                        enum PixelFormat srcFormat, enum PixelFormat dstFormat);
+
+/**
+ * Scale a whole frame using the slice threads.
+ * @return the height of the output
+ */
+int ff_sws_scale_threads(SwsContext *c, const uint8_t *src[], int srcStride[],
+                         uint8_t *dst[], int dstStride[]);
+
+void ff_sws_free_threads(SwsContext *c);
 
 #endif /* SWSCALE_SWSCALE_INTERNAL_H */
@@ -682,6 +682,15 @@ static int check_image_pointers(uint8_t *data[4], enum PixelFormat pix_fmt,
     return 1;
 }
 
+static int scale_slice(SwsContext *c, const uint8_t* src[], int srcStride[], int srcSliceY,
+                       int srcSliceH, uint8_t* dst[], int dstStride[])
+{
+    /* only whole frames can be cut in bands */
+    if (HAVE_PTHREADS && c->slice_threads && srcSliceY == 0 && srcSliceH == c->srcH)
+        return ff_sws_scale_threads(c, src, srcStride, dst, dstStride);
+    return c->swScale(c, src, srcStride, srcSliceY, srcSliceH, dst, dstStride);
+}
+
 /**
  * swscale wrapper, so we don't need to export the SwsContext.
  * Assumes planar YUV to be in YUV order instead of YVU.
@@ -790,7 +799,7 @@ int sws_scale(SwsContext *c, const uint8_t* const src[], const int srcStride[],
         if (srcSliceY + srcSliceH == c->srcH)
             c->sliceDir = 0;
 
-        return c->swScale(c, src2, srcStride2, srcSliceY, srcSliceH, dst2, dstStride2);
+        return scale_slice(c, src2, srcStride2, srcSliceY, srcSliceH, dst2, dstStride2);
     } else {
         // slices go from bottom to top => we flip the image internally
         int srcStride2[4]= {-srcStride[0], -srcStride[1], -srcStride[2], -srcStride[3]};
@@ -813,7 +822,7 @@ int sws_scale(SwsContext *c, const uint8_t* const src[], const int srcStride[],
         if (!srcSliceY)
             c->sliceDir = 0;
 
-        return c->swScale(c, src2, srcStride2, c->srcH-srcSliceY-srcSliceH, srcSliceH, dst2, dstStride2);
+        return scale_slice(c, src2, srcStride2, c->srcH-srcSliceY-srcSliceH, srcSliceH, dst2, dstStride2);
     }
 }
 
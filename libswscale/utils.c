@@ -714,6 +714,12 @@ static void getSubSampleFactors(int *h, int *v, enum PixelFormat format)
 
 int sws_setColorspaceDetails(SwsContext *c, const int inv_table[4], int srcRange, const int table[4], int dstRange, int brightness, int contrast, int saturation)
 {
+    int i;
+
+    for (i = 0; i < c->nb_slice_ctx; i++)
+        sws_setColorspaceDetails(c->slice_ctx[i], inv_table, srcRange, table, dstRange,
+                                 brightness, contrast, saturation);
+
     memcpy(c->srcColorspaceTable, inv_table, sizeof(int)*4);
     memcpy(c->dstColorspaceTable,     table, sizeof(int)*4);
 
@@ -784,6 +790,7 @@ int sws_init_context(SwsContext *c, SwsFilter *srcFilter, SwsFilter *dstFilter)
     int dst_stride = FFALIGN(dstW * sizeof(int16_t)+66, 16), dst_stride_px = dst_stride >> 1;
     int flags, cpu_flags;
     enum PixelFormat srcFormat, dstFormat;
+    enum PixelFormat userSrcFormat= c->srcFormat, userDstFormat= c->dstFormat;
 
     c->srcRange = handle_jpeg(&c->srcFormat);
     c->dstRange = handle_jpeg(&c->dstFormat);
@@ -1174,6 +1181,9 @@ int sws_init_context(SwsContext *c, SwsFilter *srcFilter, SwsFilter *dstFilter)
     }
 
     c->swScale= ff_getSwsFunc(c);
+
+    if (HAVE_PTHREADS && c->thread_count > 1)
+        return ff_sws_init_threads(c, srcFilter, dstFilter, userSrcFormat, userDstFormat);
     return 0;
 fail: //FIXME replace things by appropriate error codes
     return -1;
@@ -1516,6 +1526,9 @@ void sws_freeContext(SwsContext *c)
     int i;
     if (!c) return;
 
+    if (HAVE_PTHREADS)
+        ff_sws_free_threads(c);
+
     if (c->lumPixBuf) {
         for (i=0; i<c->vLumBufSize; i++)
             av_freep(&c->lumPixBuf[i]);
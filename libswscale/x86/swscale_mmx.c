@@ -184,4 +184,6 @@ void ff_sws_init_swScale_mmx(SwsContext *c)
         sws_init_swScale_MMX(c);
     if (cpu_flags & AV_CPU_FLAG_MMX2)
         sws_init_swScale_MMX2(c);
+    if (HAVE_SSE && cpu_flags & AV_CPU_FLAG_SSE2)
+        ff_sws_init_swScale_sse2(c);
 }
@@ -0,0 +1,463 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * SSE2 scaler functions for high bit depth planar YUV.
+ *
+ * Unlike the MMX ones, these compute exactly what the C functions do, so
+ * they are also used with SWS_BITEXACT:
+ * - horizontal scaling of 9, 10 and 16 bit input, in either endianness,
+ * - vertical scaling to 9, 10 and 16 bit output, in either endianness,
+ * - vertical scaling to 8 bit output with the dithering used when the
+ *   input has more than 8 bits.
+ */
+
+#include <inttypes.h>
+#include "config.h"
+#include "libswscale/swscale.h"
+#include "libswscale/swscale_internal.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/x86_cpu.h"
+#include "libavutil/pixdesc.h"
+
+/**
+ * Two taps of a vertical filter, laid out for the asm below: the
+ * coefficient pair repeated for 4 pixels, then the matching source lines.
+ * The pointers are padded to 64 bits so the offsets do not depend on the
+ * architecture.
+ */
+typedef struct VScaleTap {
+    int32_t coeff[4];
+    union { const int16_t *p; uint64_t pad; } src[2];
+} VScaleTap;
+
+typedef struct VScaleFilter {
+    DECLARE_ALIGNED(16, int32_t,  rnd)[8];   ///< initial value of the 8 sums
+    DECLARE_ALIGNED(16, uint16_t, clip)[8];  ///< maximum value, or bias of 16 bit output
+    DECLARE_ALIGNED(16, uint64_t, shift)[2];
+    DECLARE_ALIGNED(16, VScaleTap, taps)[MAX_FILTER_SIZE/2 + 1]; ///< NULL terminated
+} VScaleFilter;
+
+#define VF_CLIP  "32"
+#define VF_SHIFT "48"
+#define VF_TAPS  "64"
+#define VT_SRC0  "16"
+#define VT_SRC1  "24"
+#define VT_SIZE  "32"
+
+static void init_vscale_taps(VScaleFilter *vf, const int16_t *filter,
+                             int filterSize, const int16_t **src)
+{
+    int i, j;
+
+    for (i = j = 0; j < filterSize; i++, j += 2) {
+        VScaleTap *t = &vf->taps[i];
+        int last = j + 1 == filterSize;
+        t->src[0].p = src[j];
+        t->src[1].p = src[j + !last];
+        t->coeff[0] =
+        t->coeff[1] =
+        t->coeff[2] =
+        t->coeff[3] = (uint16_t)filter[j] + (last ? 0 : filter[j + 1] << 16);
+    }
+    vf->taps[i].src[0].p = NULL;
+}
+
+/**
+ * Filter 8 pixels at a time from pos to end (a multiple of 8 larger than
+ * pos): the 32 bit sums start from rnd, are shifted and packed with
+ * signed saturation in xmm4, then written by store.
+ */
+#define YSCALEYUV2PLANEX_SSE2(vf, dest, end, pos, store) \
+    __asm__ volatile(\
+        "movdqa                          (%1), %%xmm4       \n\t"\
+        "movdqa                        16(%1), %%xmm5       \n\t"\
+        "lea                    "VF_TAPS"(%1), %%"REG_d"    \n\t"\
+        "mov             "VT_SRC0"(%%"REG_d"), %%"REG_S"    \n\t"\
+        ".p2align                           4               \n\t"\
+        "1:                                                 \n\t"\
+        "movdqu            (%%"REG_S", %0, 2), %%xmm0       \n\t"\
+        "mov             "VT_SRC1"(%%"REG_d"), %%"REG_S"    \n\t"\
+        "movdqu            (%%"REG_S", %0, 2), %%xmm1       \n\t"\
+        "movdqa                  (%%"REG_d"), %%xmm3        \n\t" /* filterCoeff */\
+        "add                     $"VT_SIZE", %%"REG_d"      \n\t"\
+        "mov             "VT_SRC0"(%%"REG_d"), %%"REG_S"    \n\t"\
+        "movdqa                        %%xmm0, %%xmm2       \n\t"\
+        "punpcklwd                     %%xmm1, %%xmm0       \n\t"\
+        "punpckhwd                     %%xmm1, %%xmm2       \n\t"\
+        "pmaddwd                       %%xmm3, %%xmm0       \n\t"\
+        "pmaddwd                       %%xmm3, %%xmm2       \n\t"\
+        "paddd                         %%xmm0, %%xmm4       \n\t"\
+        "paddd                         %%xmm2, %%xmm5       \n\t"\
+        "test                        %%"REG_S", %%"REG_S"   \n\t"\
+        " jnz                               1b              \n\t"\
+        "movq                  "VF_SHIFT"(%1), %%xmm0       \n\t"\
+        "psrad                         %%xmm0, %%xmm4       \n\t"\
+        "psrad                         %%xmm0, %%xmm5       \n\t"\
+        "packssdw                      %%xmm5, %%xmm4       \n\t"\
+        store\
+        "add                                $8, %0          \n\t"\
+        "cmp                                %3, %0          \n\t"\
+        "movdqa                          (%1), %%xmm4       \n\t"\
+        "movdqa                        16(%1), %%xmm5       \n\t"\
+        "lea                    "VF_TAPS"(%1), %%"REG_d"    \n\t"\
+        "mov             "VT_SRC0"(%%"REG_d"), %%"REG_S"    \n\t"\
+        " jb                                1b              \n\t"\
+        : "+r" (pos)\
+        : "r" (vf), "r" (dest), "g" ((x86_reg)(end))\
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5",)\
+          "%"REG_d, "%"REG_S, "memory"\
+    );
+
+#define STORE_8BIT \
+        "packuswb                      %%xmm4, %%xmm4       \n\t"\
+        "movq                          %%xmm4, (%2, %0)     \n\t"
+
+#define BSWAP16_XMM4 \
+        "movdqa                        %%xmm4, %%xmm0       \n\t"\
+        "psllw                             $8, %%xmm4       \n\t"\
+        "psrlw                             $8, %%xmm0       \n\t"\
+        "por                           %%xmm0, %%xmm4       \n\t"
+
+#define CLIP_NBIT \
+        "pxor                          %%xmm0, %%xmm0       \n\t"\
+        "pmaxsw                        %%xmm0, %%xmm4       \n\t"\
+        "pminsw                 "VF_CLIP"(%1), %%xmm4       \n\t"
+
+/* the sums are biased by -0x8000 << shift, so that the signed saturation
+ * of packssdw clips to the unsigned 16 bit range once the bias is undone */
+#define CLIP_16BIT \
+        "pxor                   "VF_CLIP"(%1), %%xmm4       \n\t"
+
+#define STORE_16BIT \
+        "movdqu                        %%xmm4, (%2, %0, 2)  \n\t"
+
+static av_always_inline void
+yuv2planeX_sse2(VScaleFilter *vf, const int16_t *filter, int filterSize,
+                const int16_t **src, uint8_t *dest, int width,
+                const uint8_t *dither, int dither_offset,
+                int big_endian, int output_bits)
+{
+    x86_reg pos = 0;
+    int i, j, end = width & ~7;
+    int shift = output_bits == 8 ? 19 : 11 + 16 - output_bits;
+
+    for (i = 0; i < 8; i++) {
+        if (output_bits == 8) {
+            vf->rnd[i] = dither[(i + dither_offset) & 7] << 12;
+        } else if (output_bits == 16) {
+            vf->rnd[i] = (1 << (26 - output_bits)) - (0x8000 << shift);
+            vf->clip[i] = 0x8000;
+        } else {
+            vf->rnd[i] = 1 << (26 - output_bits);
+            vf->clip[i] = (1 << output_bits) - 1;
+        }
+    }
+    vf->shift[0] = shift;
+    init_vscale_taps(vf, filter, filterSize, src);
+
+    if (end) {
+        if (output_bits == 8) {
+            YSCALEYUV2PLANEX_SSE2(vf, dest, end, pos, STORE_8BIT)
+        } else if (output_bits == 16) {
+            if (big_endian) {
+                YSCALEYUV2PLANEX_SSE2(vf, dest, end, pos, CLIP_16BIT BSWAP16_XMM4 STORE_16BIT)
+            } else {
+                YSCALEYUV2PLANEX_SSE2(vf, dest, end, pos, CLIP_16BIT STORE_16BIT)
+            }
+        } else {
+            if (big_endian) {
+                YSCALEYUV2PLANEX_SSE2(vf, dest, end, pos, CLIP_NBIT BSWAP16_XMM4 STORE_16BIT)
+            } else {
+                YSCALEYUV2PLANEX_SSE2(vf, dest, end, pos, CLIP_NBIT STORE_16BIT)
+            }
+        }
+    }
+
+    for (i = end; i < width; i++) {
+        int val = output_bits == 8 ? dither[(i + dither_offset) & 7] << 12 :
+                                     1 << (26 - output_bits);
+        for (j = 0; j < filterSize; j++)
+            val += src[j][i] * filter[j];
+        val >>= shift;
+        if (output_bits == 8) {
+            dest[i] = av_clip_uint8(val);
+        } else {
+            val = output_bits == 16 ? av_clip_uint16(val) : av_clip_uintp2(val, output_bits);
+            if (big_endian) AV_WB16(dest + 2*i, val);
+            else            AV_WL16(dest + 2*i, val);
+        }
+    }
+}
+
+static void yuv2yuvX_sse2(SwsContext *c, const int16_t *lumFilter,
+                          const int16_t **lumSrc, int lumFilterSize,
+                          const int16_t *chrFilter, const int16_t **chrUSrc,
+                          const int16_t **chrVSrc,
+                          int chrFilterSize, const int16_t **alpSrc,
+                          uint8_t *dest, uint8_t *uDest, uint8_t *vDest,
+                          uint8_t *aDest, int dstW, int chrDstW,
+                          const uint8_t *lumDither, const uint8_t *chrDither)
+{
+    VScaleFilter vf;
+
+    yuv2planeX_sse2(&vf, lumFilter, lumFilterSize, lumSrc, dest, dstW,
+                    lumDither, 0, 0, 8);
+    if (uDest) {
+        yuv2planeX_sse2(&vf, chrFilter, chrFilterSize, chrUSrc, uDest, chrDstW,
+                        chrDither, 0, 0, 8);
+        yuv2planeX_sse2(&vf, chrFilter, chrFilterSize, chrVSrc, vDest, chrDstW,
+                        chrDither, 3, 0, 8);
+    }
+    if (CONFIG_SWSCALE_ALPHA && aDest)
+        yuv2planeX_sse2(&vf, lumFilter, lumFilterSize, alpSrc, aDest, dstW,
+                        lumDither, 0, 0, 8);
+}
+
+#define yuv2NBPS_sse2(bits, BE_LE, is_be) \
+static void yuv2yuvX ## bits ## BE_LE ## _sse2(SwsContext *c, const int16_t *lumFilter, \
+                              const int16_t **lumSrc, int lumFilterSize, \
+                              const int16_t *chrFilter, const int16_t **chrUSrc, \
+                              const int16_t **chrVSrc, \
+                              int chrFilterSize, const int16_t **alpSrc, \
+                              uint8_t *dest, uint8_t *uDest, uint8_t *vDest, \
+                              uint8_t *aDest, int dstW, int chrDstW, \
+                              const uint8_t *lumDither, const uint8_t *chrDither) \
+{ \
+    VScaleFilter vf; \
+    yuv2planeX_sse2(&vf, lumFilter, lumFilterSize, lumSrc, dest, dstW, \
+                    NULL, 0, is_be, bits); \
+    if (uDest) { \
+        yuv2planeX_sse2(&vf, chrFilter, chrFilterSize, chrUSrc, uDest, chrDstW, \
+                        NULL, 0, is_be, bits); \
+        yuv2planeX_sse2(&vf, chrFilter, chrFilterSize, chrVSrc, vDest, chrDstW, \
+                        NULL, 0, is_be, bits); \
+    } \
+    if (CONFIG_SWSCALE_ALPHA && aDest) \
+        yuv2planeX_sse2(&vf, lumFilter, lumFilterSize, alpSrc, aDest, dstW, \
+                        NULL, 0, is_be, bits); \
+}
+yuv2NBPS_sse2( 9, BE, 1);
+yuv2NBPS_sse2( 9, LE, 0);
+yuv2NBPS_sse2(10, BE, 1);
+yuv2NBPS_sse2(10, LE, 0);
+yuv2NBPS_sse2(16, BE, 1);
+yuv2NBPS_sse2(16, LE, 0);
+
+static void yuv2plane1_sse2(const int16_t *src, uint8_t *dest, int width,
+                            const uint8_t *dither, int dither_offset)
+{
+    DECLARE_ALIGNED(16, int16_t, dither16)[8];
+    x86_reg end = width & ~7;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        dither16[i] = dither[(i + dither_offset) & 7];
+
+    /* (src + dither) >> 7 only saturates where the result is clipped anyway */
+    if (end) {
+        __asm__ volatile(
+            "movdqa                 %3, %%xmm2      \n\t"
+            "mov                    %2, %%"REG_a"   \n\t"
+            ".p2align                4              \n\t"
+            "1:                                     \n\t"
+            "movdqu (%0, %%"REG_a", 2), %%xmm0      \n\t"
+            "paddsw             %%xmm2, %%xmm0      \n\t"
+            "psraw                  $7, %%xmm0      \n\t"
+            "packuswb           %%xmm0, %%xmm0      \n\t"
+            "movq               %%xmm0, (%1, %%"REG_a") \n\t"
+            "add                    $8, %%"REG_a"   \n\t"
+            " jnc                   1b              \n\t"
+            :: "r" (src + end), "r" (dest + end), "g" (-end), "m" (*dither16)
+            : XMM_CLOBBERS("%xmm0", "%xmm2",) "%"REG_a, "memory"
+        );
+    }
+    for (i = end; i < width; i++)
+        dest[i] = av_clip_uint8((src[i] + dither[(i + dither_offset) & 7]) >> 7);
+}
+
+static void yuv2yuv1_sse2(SwsContext *c, const int16_t *lumSrc,
+                          const int16_t *chrUSrc, const int16_t *chrVSrc,
+                          const int16_t *alpSrc,
+                          uint8_t *dest, uint8_t *uDest, uint8_t *vDest,
+                          uint8_t *aDest, int dstW, int chrDstW,
+                          const uint8_t *lumDither, const uint8_t *chrDither)
+{
+    yuv2plane1_sse2(lumSrc, dest, dstW, lumDither, 0);
+    if (uDest) {
+        yuv2plane1_sse2(chrUSrc, uDest, chrDstW, chrDither, 0);
+        yuv2plane1_sse2(chrVSrc, vDest, chrDstW, chrDither, 3);
+    }
+    if (CONFIG_SWSCALE_ALPHA && aDest)
+        yuv2plane1_sse2(alpSrc, aDest, dstW, lumDither, 0);
+}
+
+/**
+ * Filter two pixels: the 4-tap chunks of the first pixel are in the low
+ * half of xmm0, those of the second one in the high half. pmaddwd works on
+ * signed words, so 16 bit input is biased by -0x8000 and the bias times
+ * the coefficients is subtracted back from the sums.
+ */
+#define HSCALE16_PAIR_SSE2(load, bias, unbias) \
+    __asm__ volatile(\
+        "pxor                    %%xmm4, %%xmm4     \n\t"\
+        "pxor                    %%xmm5, %%xmm5     \n\t"\
+        ".p2align                     4             \n\t"\
+        "1:                                         \n\t"\
+        "movq                 (%1, %0), %%xmm0      \n\t"\
+        "movhps               (%2, %0), %%xmm0      \n\t"\
+        "movq                 (%3, %0), %%xmm1      \n\t"\
+        "movhps               (%4, %0), %%xmm1      \n\t"\
+        load\
+        bias\
+        "pmaddwd                 %%xmm1, %%xmm0     \n\t"\
+        "paddd                   %%xmm0, %%xmm4     \n\t"\
+        "add                         $8, %0         \n\t"\
+        " jnc                        1b             \n\t"\
+        unbias\
+        "pshufd             $0xB1, %%xmm4, %%xmm0   \n\t"\
+        "paddd                   %%xmm0, %%xmm4     \n\t"\
+        "pshufd             $0x08, %%xmm4, %%xmm4   \n\t"\
+        "movd                        %7, %%xmm0     \n\t"\
+        "psrad                   %%xmm0, %%xmm4     \n\t"\
+        "packssdw                %%xmm4, %%xmm4     \n\t"\
+        "movd                    %%xmm4, %5         \n\t"\
+        : "+r" (j), "+r" (srcA), "+r" (srcB), "+r" (filterA), "+r" (filterB),\
+          "=m" (res)\
+        : "m" (*bias16), "m" (shift)\
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5",) "memory"\
+    );
+
+#define HSCALE16_BSWAP \
+        "movdqa                  %%xmm0, %%xmm2     \n\t"\
+        "psllw                       $8, %%xmm0     \n\t"\
+        "psrlw                       $8, %%xmm2     \n\t"\
+        "por                     %%xmm2, %%xmm0     \n\t"
+
+#define HSCALE16_BIAS \
+        "pxor                        %6, %%xmm0     \n\t"\
+        "movdqa                      %6, %%xmm3     \n\t"\
+        "pmaddwd                 %%xmm1, %%xmm3     \n\t"\
+        "paddd                   %%xmm3, %%xmm5     \n\t"
+
+#define HSCALE16_UNBIAS \
+        "psubd                   %%xmm5, %%xmm4     \n\t"
+
+static av_always_inline void
+hScale16_sse2_template(int16_t *dst, int dstW, const uint16_t *src,
+                       const int16_t *filter, const int16_t *filterPos,
+                       long filterSize, int shift, int swap)
+{
+    DECLARE_ALIGNED(16, uint16_t, bias16)[8];
+    int i, k;
+
+    for (i = 0; i < 8; i++)
+        bias16[i] = 0x8000;
+
+    for (i = 0; i + 1 < dstW; i += 2) {
+        const int16_t *filterA = filter + filterSize * (i + 1);
+        const int16_t *filterB = filterA + filterSize;
+        const uint16_t *srcA = src + filterPos[i]     + filterSize;
+        const uint16_t *srcB = src + filterPos[i + 1] + filterSize;
+        x86_reg j = -2 * filterSize;
+        uint32_t res;
+
+        if (shift == 15) {
+            if (swap) HSCALE16_PAIR_SSE2(HSCALE16_BSWAP, HSCALE16_BIAS, HSCALE16_UNBIAS)
+            else      HSCALE16_PAIR_SSE2("",             HSCALE16_BIAS, HSCALE16_UNBIAS)
+        } else {
+            if (swap) HSCALE16_PAIR_SSE2(HSCALE16_BSWAP, "", "")
+            else      HSCALE16_PAIR_SSE2("",             "", "")
+        }
+        AV_WN32(dst + i, res);
+    }
+
+    for (; i < dstW; i++) {
+        int val = 0;
+        for (k = 0; k < filterSize; k++) {
+            int s = swap ? av_bswap16(src[filterPos[i] + k]) : src[filterPos[i] + k];
+            val += s * filter[filterSize * i + k];
+        }
+        dst[i] = FFMIN(val >> shift, (1 << 15) - 1);
+    }
+}
+
+static void hScale16_sse2(int16_t *dst, int dstW, const uint16_t *src, int srcW, int xInc,
+                          const int16_t *filter, const int16_t *filterPos,
+                          long filterSize, int shift)
+{
+    hScale16_sse2_template(dst, dstW, src, filter, filterPos, filterSize, shift, 0);
+}
+
+static void hScale16X_sse2(int16_t *dst, int dstW, const uint16_t *src, int srcW, int xInc,
+                           const int16_t *filter, const int16_t *filterPos,
+                           long filterSize, int shift)
+{
+    hScale16_sse2_template(dst, dstW, src, filter, filterPos, filterSize, shift, 1);
+}
+
+av_cold void ff_sws_init_swScale_sse2(SwsContext *c)
+{
+    enum PixelFormat srcFormat = c->srcFormat,
+                     dstFormat = c->dstFormat;
+    int depth = av_pix_fmt_descriptors[dstFormat].comp[0].depth_minus1 + 1;
+
+    if (is16BPS(dstFormat)) {
+        c->yuv2yuvX = isBE(dstFormat) ? yuv2yuvX16BE_sse2 : yuv2yuvX16LE_sse2;
+    } else if (is9_OR_10BPS(dstFormat)) {
+        if (depth == 9)
+            c->yuv2yuvX = isBE(dstFormat) ? yuv2yuvX9BE_sse2  : yuv2yuvX9LE_sse2;
+        else
+            c->yuv2yuvX = isBE(dstFormat) ? yuv2yuvX10BE_sse2 : yuv2yuvX10LE_sse2;
+    } else if ((isNBPS(srcFormat) || is16BPS(srcFormat)) &&
+               dstFormat != PIX_FMT_NV12 && dstFormat != PIX_FMT_NV21) {
+        /* dithered output of high bit depth input */
+        c->yuv2yuv1 = yuv2yuv1_sse2;
+        c->yuv2yuvX = yuv2yuvX_sse2;
+    }
+
+    /* the horizontal filters are padded to multiples of 4 taps for MMX */
+    if (c->hLumFilterSize & 3 || c->hChrFilterSize & 3)
+        return;
+
+    switch (srcFormat) {
+    case PIX_FMT_YUV420P9LE:
+    case PIX_FMT_YUV444P9LE:
+    case PIX_FMT_YUV420P10LE:
+    case PIX_FMT_YUV422P10LE:
+    case PIX_FMT_YUV444P10LE:
+        /* the unrolled 4-tap MMX filter is faster for unscaled widths */
+        if (c->hLumFilterSize == 4 && c->hChrFilterSize == 4)
+            break;
+    case PIX_FMT_GRAY16LE:
+    case PIX_FMT_YUV420P16LE:
+    case PIX_FMT_YUV422P16LE:
+    case PIX_FMT_YUV444P16LE: c->hScale16 = hScale16_sse2;  break;
+    case PIX_FMT_GRAY16BE:
+    case PIX_FMT_YUV420P9BE:
+    case PIX_FMT_YUV444P9BE:
+    case PIX_FMT_YUV420P10BE:
+    case PIX_FMT_YUV422P10BE:
+    case PIX_FMT_YUV444P10BE:
+    case PIX_FMT_YUV420P16BE:
+    case PIX_FMT_YUV422P16BE:
+    case PIX_FMT_YUV444P16BE: c->hScale16 = hScale16X_sse2; break;
+    default: break;
+    }
+}
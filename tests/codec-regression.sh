@@ -60,6 +60,16 @@ do_video_encoding mpeg2threadivlc.mpg "-qscale 10" "-vcodec mpeg2video -f mpeg1v
 do_video_decoding
 fi
 
+if [ -n "$do_mpeg2gopthread" ] ; then
+# mpeg2 encoding one closed gop per thread
+do_video_encoding mpeg2gopthread.mpg "-qscale 10" "-vcodec mpeg2video -f mpeg1video -bf 2 -flags +cgop -flags2 +sgop -sc_threshold 1000000000 -thread_type gop -threads 2"
+do_video_decoding
+
+# mpeg2 encoding cbr, the vbv buffer disables gop threading
+do_video_encoding mpeg2gopthreadcbr.mpg "-b 4000k -minrate 4000k -maxrate 4000k -bufsize 1835k" "-vcodec mpeg2video -f mpeg1video -bf 2 -flags +cgop -flags2 +sgop -sc_threshold 1000000000 -thread_type gop -threads 2"
+do_video_decoding
+fi
+
 if [ -n "$do_msmpeg4v2" ] ; then
 do_video_encoding msmpeg4v2.avi "-qscale 10" "-an -vcodec msmpeg4v2"
 do_video_decoding
@@ -149,6 +159,12 @@ do_video_encoding mjpeg.avi "-qscale 9" "-an -vcodec mjpeg -pix_fmt yuvj420p"
 do_video_decoding "" "-pix_fmt yuv420p"
 fi
 
+if [ -n "$do_mjpegthread" ] ; then
+# must be identical to the single-threaded output
+do_video_encoding mjpegthread.avi "-qscale 9" "-an -vcodec mjpeg -pix_fmt yuvj420p -threads 2 -thread_type frame"
+do_video_decoding "" "-pix_fmt yuv420p"
+fi
+
 if [ -n "$do_ljpeg" ] ; then
 do_video_encoding ljpeg.avi "" "-an -vcodec ljpeg -strict -1"
 do_video_decoding
@@ -217,6 +233,16 @@ do_video_encoding dnxhd-1080i.dnxhd "" "-flags +ildct -vf scale=1920:1080 -b 120
 do_video_decoding "-r 25" "-vf scale=352:288 -pix_fmt yuv420p"
 fi
 
+if [ -n "$do_dnxhd_1080i_10bit" ] ; then
+do_video_encoding dnxhd-1080i-10bit.dnxhd "" "-flags +ildct -vf scale=1920:1080 -b 185M -pix_fmt yuv422p10 -vframes 5 -an"
+do_video_decoding "-r 25" "-vf scale=352:288 -pix_fmt yuv420p"
+fi
+
+if [ -n "$do_dnxhd_1080i_10bit_rd" ] ; then
+do_video_encoding dnxhd-1080i-10bit-rd.dnxhd "" "-flags +ildct -mbd rd -vf scale=1920:1080 -b 185M -pix_fmt yuv422p10 -vframes 5 -an"
+do_video_decoding "-r 25" "-vf scale=352:288 -pix_fmt yuv420p"
+fi
+
 if [ -n "$do_dnxhd_720p" ] ; then
 do_video_encoding dnxhd-720p.dnxhd "" "-vf scale=1280:720 -b 90M -pix_fmt yuv422p -vframes 5 -an"
 do_video_decoding "-r 25" "-vf scale=352:288 -pix_fmt yuv420p"
@@ -356,3 +382,11 @@ do_audio_enc_dec au  dbl pcm_f64be
 do_audio_enc_dec wav dbl pcm_f64le
 do_audio_enc_dec wav s16 pcm_zork
 fi
+
+if [ -n "$do_resample" ] ; then
+# 44.1 to 48 kHz and back
+do_audio_encoding resample_s24le.wav "" "-ar 48000 -sample_fmt s32 -acodec pcm_s24le"
+do_ffmpeg $pcm_dst -i $target_path/$file -ar 44100 -sample_fmt s16 -f wav
+do_audio_encoding resample_f32le.wav "" "-ar 48000 -sample_fmt flt -acodec pcm_f32le"
+do_ffmpeg $pcm_dst -i $target_path/$file -ar 44100 -sample_fmt s16 -f wav
+fi
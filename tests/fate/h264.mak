@@ -169,6 +169,20 @@ FATE_H264  := $(FATE_H264:%=fate-h264-conformance-%)                    \
               fate-h264-lossless                                        \
               fate-h264-extreme-plane-pred                              \
 
+# frame threaded decoding must match the single threaded references
+FATE_H264_FRAME_THREADS = fate-h264-frame-threads-ba3_sva_c             \
+                          fate-h264-frame-threads-caba3_toshiba_e       \
+                          fate-h264-frame-threads-cabac_mot_fld0_full   \
+                          fate-h264-frame-threads-cabac_mot_mbaff0_full \
+                          fate-h264-frame-threads-cabac_mot_picaff0_full \
+                          fate-h264-frame-threads-cama3_vtc_b           \
+                          fate-h264-frame-threads-frext-frext_mmco4_sony_b \
+                          fate-h264-frame-threads-frext-hpcafl_bcrm_c   \
+                          fate-h264-frame-threads-mr9_bt_b              \
+                          fate-h264-frame-threads-sharp_mp_paff_1r2     \
+
+FATE_H264 += $(FATE_H264_FRAME_THREADS)
+
 FATE_TESTS += $(FATE_H264)
 fate-h264: $(FATE_H264)
 
@@ -341,3 +355,24 @@ fate-h264-conformance-sva_nl2_e: CMD = framecrc  -i $(SAMPLES)/h264-conformance/
 fate-h264-interlace-crop: CMD = framecrc  -vframes 3 -i $(SAMPLES)/h264/interlaced_crop.mp4
 fate-h264-lossless: CMD = framecrc -i $(SAMPLES)/h264/lossless.h264
 fate-h264-extreme-plane-pred: CMD = framemd5 -strict 1 -vsync 0 -i $(SAMPLES)/h264/extreme-plane-pred.h264
+
+fate-h264-frame-threads-ba3_sva_c: CMD = framecrc  -vsync 0 -strict 1 -threads 2 -thread_type frame -i $(SAMPLES)/h264-conformance/BA3_SVA_C.264
+fate-h264-frame-threads-ba3_sva_c: REF = $(SRC_PATH_BARE)/tests/ref/fate/h264-conformance-ba3_sva_c
+fate-h264-frame-threads-caba3_toshiba_e: CMD = framecrc  -threads 2 -thread_type frame -i $(SAMPLES)/h264-conformance/CABA3_TOSHIBA_E.264
+fate-h264-frame-threads-caba3_toshiba_e: REF = $(SRC_PATH_BARE)/tests/ref/fate/h264-conformance-caba3_toshiba_e
+fate-h264-frame-threads-cabac_mot_fld0_full: CMD = framecrc  -vsync 0 -strict 1 -threads 2 -thread_type frame -i $(SAMPLES)/h264-conformance/camp_mot_fld0_full.26l
+fate-h264-frame-threads-cabac_mot_fld0_full: REF = $(SRC_PATH_BARE)/tests/ref/fate/h264-conformance-cabac_mot_fld0_full
+fate-h264-frame-threads-cabac_mot_mbaff0_full: CMD = framecrc  -vsync 0 -strict 1 -threads 2 -thread_type frame -i $(SAMPLES)/h264-conformance/camp_mot_mbaff0_full.26l
+fate-h264-frame-threads-cabac_mot_mbaff0_full: REF = $(SRC_PATH_BARE)/tests/ref/fate/h264-conformance-cabac_mot_mbaff0_full
+fate-h264-frame-threads-cabac_mot_picaff0_full: CMD = framecrc  -vsync 0 -strict 1 -threads 2 -thread_type frame -i $(SAMPLES)/h264-conformance/camp_mot_picaff0_full.26l
+fate-h264-frame-threads-cabac_mot_picaff0_full: REF = $(SRC_PATH_BARE)/tests/ref/fate/h264-conformance-cabac_mot_picaff0_full
+fate-h264-frame-threads-cama3_vtc_b: CMD = framecrc  -vsync 0 -strict 1 -threads 2 -thread_type frame -i $(SAMPLES)/h264-conformance/cama3_vtc_b.avc
+fate-h264-frame-threads-cama3_vtc_b: REF = $(SRC_PATH_BARE)/tests/ref/fate/h264-conformance-cama3_vtc_b
+fate-h264-frame-threads-frext-frext_mmco4_sony_b: CMD = framecrc  -vsync 0 -threads 2 -thread_type frame -i $(SAMPLES)/h264-conformance/FRext/FRExt_MMCO4_Sony_B.264
+fate-h264-frame-threads-frext-frext_mmco4_sony_b: REF = $(SRC_PATH_BARE)/tests/ref/fate/h264-conformance-frext-frext_mmco4_sony_b
+fate-h264-frame-threads-frext-hpcafl_bcrm_c: CMD = framecrc  -threads 2 -thread_type frame -i $(SAMPLES)/h264-conformance/FRext/HPCAFL_BRCM_C.264 -vsync 0
+fate-h264-frame-threads-frext-hpcafl_bcrm_c: REF = $(SRC_PATH_BARE)/tests/ref/fate/h264-conformance-frext-hpcafl_bcrm_c
+fate-h264-frame-threads-mr9_bt_b: CMD = framecrc  -vsync 0 -strict 1 -threads 2 -thread_type frame -i $(SAMPLES)/h264-conformance/MR9_BT_B.h264
+fate-h264-frame-threads-mr9_bt_b: REF = $(SRC_PATH_BARE)/tests/ref/fate/h264-conformance-mr9_bt_b
+fate-h264-frame-threads-sharp_mp_paff_1r2: CMD = framecrc  -vsync 0 -strict 1 -threads 2 -thread_type frame -i $(SAMPLES)/h264-conformance/Sharp_MP_PAFF_1r2.jvt
+fate-h264-frame-threads-sharp_mp_paff_1r2: REF = $(SRC_PATH_BARE)/tests/ref/fate/h264-conformance-sharp_mp_paff_1r2